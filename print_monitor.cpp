@@ -11,21 +11,38 @@
  * - Interactive command interface
  * - RFC-4180 compliant CSV export
  * - Comprehensive error logging
+ * - Optional binary structured log with an offline decoder
  * 
  * Compilation:
  * To compile this application, use g++ with the following command:
- * g++ -o print_monitor.exe print_monitor.cpp -lwinmm -lwinspool -std=c++17
+ * g++ -o print_monitor.exe print_monitor.cpp -lwinmm -lwinspool -lcabinet -lws2_32 -std=c++20
  * 
  * Usage:
  * - Run the executable to start the monitoring system
  * - Use the command interface to control monitoring and export data
  * - Check print_monitor.log for detailed logs
+ * - Decode a binary log with: print_monitor.exe --decode-log print_monitor.blog
+ * - Rotated logs are compressed; read one with: print_monitor.exe --decompress-log <archive>
+ * - Check the codecs and data structures, without a spooler: print_monitor.exe --self-test
+ * - Time a log call, with its level disabled and as a binary event: print_monitor.exe --bench log [events]
+ * - Time the statistics kernels with: print_monitor.exe --bench columns [rows]
+ * - Time the time-series codec with: print_monitor.exe --bench series [samples]
+ * - Time the UTF-16 to UTF-8 converter with: print_monitor.exe --bench utf8 [strings]
+ * - Compare asynchronous file writes with std::ofstream: print_monitor.exe --bench io [MB]
+ * - Time the memory-mapped CSV export writer with: print_monitor.exe --bench export [rows]
+ * - Time the analyze command on synthetic exports with: print_monitor.exe --bench analyze [MB]
+ * - Check and time the SIMD CSV parser with: print_monitor.exe --bench csv [MB]
+ * - Time the job history's Bloom filter with: print_monitor.exe --bench history [keys]
+ * - Run unattended with --headless (or --service under the Service Control Manager)
+ *   and send it commands with: print_monitor.exe --send <command>
  * - CSV files are saved in the same directory as the executable
  */
 
+#include <winsock2.h>
 #include <windows.h>
 #include <lmcons.h>
 #include <winspool.h>
+#include <compressapi.h>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -37,16 +54,53 @@
 #include <iomanip>
 #include <ctime>
 #include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <queue>
+#include <filesystem>
+#include <atomic>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+#include <cstring>
 #include <algorithm>
+#include <functional>
+#include <memory>
+#include <coroutine>
+#include <charconv>
+#include <type_traits>
 #include <cctype>
 #include <locale>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <bit>
 #include <io.h>
 #include <fcntl.h>
 
+// SIMD aggregation kernels (see "Columnar job table") and CSV kernels (see
+// "RFC-4180 CSV parsing"); the AVX2 ones are compiled for AVX2 individually
+// and only called when the CPU supports it
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PRINT_MONITOR_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+#if defined(__GNUC__) || defined(__clang__)
+#define PRINT_MONITOR_TARGET_AVX2 __attribute__((target("avx2")))
+#define PRINT_MONITOR_TARGET_AVX2_PCLMUL __attribute__((target("avx2,pclmul")))
+#else
+#define PRINT_MONITOR_TARGET_AVX2
+#define PRINT_MONITOR_TARGET_AVX2_PCLMUL
+#endif
+
 // Function declarations
 std::string getCurrentTimestamp();
-std::string wideStringToUtf8(const wchar_t* wideStr);
-std::string ansiStringToUtf8(const char* ansiStr);
+std::string wideStringToUtf8(const WCHAR* wideStr);
+void autoSave();
+bool selfTestCommandPipe();
 
 // Print job data structure to store collected metadata
 struct PrintJob {
@@ -60,44 +114,223 @@ struct PrintJob {
     std::string paperSize;       // Paper size used
     std::string userAccount;     // User who initiated the job
     std::string jobId;           // System-assigned job identifier
+    uint64_t submitted = 0;      // Submission time (UTC) as YYYYMMDDhhmmssmmm; not exported
 };
 
 // Global variables for monitoring
-bool monitoringActive = false;
+std::atomic<bool> monitoringActive{false};
 std::vector<PrintJob> printJobs;
+std::unordered_map<std::string, uint64_t> recordedJobKeys;  // Dedupe index: printer + job ID -> job sequence
+uint64_t firstJobSequence = 0;  // Sequence number of printJobs[0]; a job's row is its sequence minus this
 std::mutex jobsMutex;
+std::atomic<uint64_t> storeLockAcquisitions{0};     // Poller acquisitions of jobsMutex, total
+std::atomic<uint64_t> lastCycleLockAcquisitions{0}; // ... during the last poll cycle (one poll interval)
 std::thread monitorThread;
-std::mutex logMutex; // For logging synchronization
+std::mutex logMutex; // Serializes direct writes while the log sink threads are not running
 
-// Log message to file
-void logMessage(const std::string& level, const std::string& message) {
-    std::lock_guard<std::mutex> lock(logMutex);
-    
-    std::string timestamp = getCurrentTimestamp();
-    std::string logEntry = "[" + timestamp + "] [" + level + "] " + message + "\n";
-    
-    // Write to log file
-    std::ofstream logFile("print_monitor.log", std::ios::app);
-    if (logFile.is_open()) {
-        logFile << logEntry;
-        logFile.close();
+const char* logFileName = "print_monitor.log";
+
+// Log file rotation settings (see the `config` command)
+std::atomic<long long> logMaxBytes{10 * 1024 * 1024};
+std::atomic<long long> logMaxAgeHours{24};
+std::atomic<long long> logRetentionCount{10};
+
+// Log levels, lowest to highest severity
+enum class LogLevel : int {
+    Debug = 0,
+    Info,
+    Warn,
+    Error
+};
+
+// Levels below this are compiled out entirely, e.g. -DPRINT_MONITOR_MIN_LOG_LEVEL=2 keeps WARN and ERROR
+#ifndef PRINT_MONITOR_MIN_LOG_LEVEL
+#define PRINT_MONITOR_MIN_LOG_LEVEL 1
+#endif
+
+// Runtime threshold on top of the compile-time one (see the `config` command)
+std::atomic<long long> logLevelThreshold{static_cast<long long>(LogLevel::Info)};
+
+constexpr bool logLevelCompiledIn(LogLevel level) {
+    return static_cast<int>(level) >= PRINT_MONITOR_MIN_LOG_LEVEL;
+}
+
+// A finished log line on its way to a sink
+struct LogLine {
+    LogLevel level;
+    std::string text;            // Including the trailing newline
+};
+
+// Log sinks. Each has its own level threshold, a bounded queue and a flush
+// interval (see "Log sinks" below); a line is copied into the queue of every
+// sink whose level it meets, and a sink whose queue is full drops the line
+// and counts it rather than making the caller wait.
+enum LogSinkId {
+    LOG_SINK_FILE,
+    LOG_SINK_CONSOLE,
+    LOG_SINK_SYSLOG,
+    LOG_SINK_MEMORY,
+    LOG_SINK_COUNT
+};
+
+const long long logSinkOff = 4;  // Sink level that delivers nothing
+
+struct LogSink {
+    const char* name;
+    std::atomic<long long> level;        // Lowest level delivered, logSinkOff to disable
+    std::atomic<long long> bufferLines;  // Queue capacity; for the memory sink, lines kept
+    std::atomic<long long> flushMs;      // 0 = write and flush as soon as lines arrive
+    std::deque<LogLine> queue;           // Waiting lines; for the memory sink, the ring itself
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool running = false;                // A writer thread owns the sink (not used by the memory sink)
+    bool stopRequested = false;
+    std::thread thread;
+    std::chrono::steady_clock::time_point lastFlush;  // Only touched by the writer thread
+    std::atomic<uint64_t> delivered{0};
+    std::atomic<uint64_t> dropped{0};
+
+    LogSink(const char* sinkName, long long sinkLevel, long long sinkBufferLines, long long sinkFlushMs)
+        : name(sinkName), level(sinkLevel), bufferLines(sinkBufferLines), flushMs(sinkFlushMs) {}
+};
+
+LogSink logSinks[LOG_SINK_COUNT] = {
+    { "file",    0,          100000, 0 },
+    { "console", 0,          10000,  0 },
+    { "syslog",  logSinkOff, 10000,  0 },
+    { "memory",  0,          1000,   0 },
+};
+
+// Function to get the lowest level any sink accepts
+inline long long lowestSinkLevel() {
+    long long lowest = logSinkOff;
+    for (const auto& sink : logSinks) {
+        lowest = std::min(lowest, sink.level.load(std::memory_order_relaxed));
     }
-    
-    // Also output to console
-    if (level == "ERROR") {
-        std::cerr << logEntry;
-    } else {
-        std::cout << logEntry;
+    return lowest;
+}
+
+inline bool logLevelEnabled(LogLevel level) {
+    return static_cast<long long>(level) >= logLevelThreshold.load(std::memory_order_relaxed) &&
+           static_cast<long long>(level) >= lowestSinkLevel();
+}
+
+constexpr const char* logLevelName(LogLevel level) {
+    return level == LogLevel::Debug ? "DEBUG"
+         : level == LogLevel::Info  ? "INFO"
+         : level == LogLevel::Warn  ? "WARN"
+         : "ERROR";
+}
+
+// Function to queue a line for a sink's writer thread; returns false if the thread is not running
+bool enqueueLogLine(LogSink& sink, LogLevel level, const std::string& text) {
+    std::lock_guard<std::mutex> lock(sink.mutex);
+    if (!sink.running) return false;
+    if (sink.queue.size() >= static_cast<size_t>(std::max(1LL, sink.bufferLines.load()))) {
+        ++sink.dropped;
+        return true;
     }
+    sink.queue.push_back({ level, text });
+    sink.condition.notify_one();
+    return true;
 }
 
-// Function to get current timestamp in ISO 8601 format
-std::string getCurrentTimestamp() {
-    auto now = std::chrono::system_clock::now();
+// Function to keep a line in the memory sink's ring
+void appendToLogRing(LogLevel level, const std::string& text) {
+    LogSink& sink = logSinks[LOG_SINK_MEMORY];
+    std::lock_guard<std::mutex> lock(sink.mutex);
+    sink.queue.push_back({ level, text });
+    size_t capacity = static_cast<size_t>(std::max(1LL, sink.bufferLines.load()));
+    while (sink.queue.size() > capacity) sink.queue.pop_front();
+    ++sink.delivered;
+}
+
+// Hand a finished log line to every sink whose level it meets
+void writeLogEntry(LogLevel level, std::string&& logEntry) {
+    long long severity = static_cast<long long>(level);
+    if (severity >= logSinks[LOG_SINK_MEMORY].level.load(std::memory_order_relaxed)) {
+        appendToLogRing(level, logEntry);
+    }
+    if (severity >= logSinks[LOG_SINK_SYSLOG].level.load(std::memory_order_relaxed)) {
+        enqueueLogLine(logSinks[LOG_SINK_SYSLOG], level, logEntry);
+    }
+
+    // Before the sink threads start and after they stop, write the file and console directly
+    if (severity >= logSinks[LOG_SINK_CONSOLE].level.load(std::memory_order_relaxed) &&
+        !enqueueLogLine(logSinks[LOG_SINK_CONSOLE], level, logEntry)) {
+        std::lock_guard<std::mutex> lock(logMutex);
+        (level == LogLevel::Error ? std::cerr : std::cout) << logEntry;
+    }
+    if (severity >= logSinks[LOG_SINK_FILE].level.load(std::memory_order_relaxed) &&
+        !enqueueLogLine(logSinks[LOG_SINK_FILE], level, logEntry)) {
+        std::lock_guard<std::mutex> lock(logMutex);
+        std::ofstream logFile(logFileName, std::ios::app);
+        if (logFile.is_open()) {
+            logFile << logEntry;
+            logFile.close();
+        }
+    }
+}
+
+// Append one message fragment to a log line
+inline void appendLogArg(std::string& out, const std::string& value) { out += value; }
+inline void appendLogArg(std::string& out, const char* value) { out += value; }
+inline void appendLogArg(std::string& out, char value) { out += value; }
+
+inline void appendLogArg(std::string& out, double value) {
+    char buffer[32];
+    int length = snprintf(buffer, sizeof(buffer), "%g", value);
+    out.append(buffer, static_cast<size_t>(std::max(0, length)));
+}
+
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value>::type appendLogArg(std::string& out, T value) {
+    char buffer[24];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, result.ptr);
+}
+
+// Format the fragments straight into the line; only reached for enabled levels
+template <typename... Args>
+void logFormatted(LogLevel level, const Args&... args) {
+    std::string logEntry;
+    logEntry.reserve(128);
+    logEntry += '[';
+    logEntry += getCurrentTimestamp();
+    logEntry += "] [";
+    logEntry += logLevelName(level);
+    logEntry += "] ";
+    (appendLogArg(logEntry, args), ...);
+    logEntry += '\n';
+    writeLogEntry(level, std::move(logEntry));
+}
+
+// Log message to file. Arguments are only evaluated when the level is enabled;
+// levels below PRINT_MONITOR_MIN_LOG_LEVEL generate no code at all.
+#define PM_LOG(level, ...)                                  \
+    do {                                                    \
+        if constexpr (logLevelCompiledIn(level)) {          \
+            if (logLevelEnabled(level)) {                   \
+                logFormatted(level, __VA_ARGS__);           \
+            }                                               \
+        }                                                   \
+    } while (0)
+
+#define LOG_DEBUG(...) PM_LOG(LogLevel::Debug, __VA_ARGS__)
+#define LOG_INFO(...)  PM_LOG(LogLevel::Info, __VA_ARGS__)
+#define LOG_WARN(...)  PM_LOG(LogLevel::Warn, __VA_ARGS__)
+#define LOG_ERROR(...) PM_LOG(LogLevel::Error, __VA_ARGS__)
+
+// Function to format a point in time in ISO 8601 format
+std::string formatTimestamp(std::chrono::system_clock::time_point now) {
     auto time_t = std::chrono::system_clock::to_time_t(now);
     
+    // localtime_s: timestamps are formatted concurrently on many threads
+    std::tm localTime = {};
+    localtime_s(&localTime, &time_t);
+
     std::stringstream ss;
-    ss << std::put_time(std::localtime(&time_t), "%Y-%m-%dT%H:%M:%S");
+    ss << std::put_time(&localTime, "%Y-%m-%dT%H:%M:%S");
     
     // Add milliseconds
     auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
@@ -110,536 +343,9660 @@ std::string getCurrentTimestamp() {
     return ss.str();
 }
 
-// Function to convert ANSI string to UTF-8 string
-std::string ansiStringToUtf8(const char* ansiStr) {
-    if (!ansiStr) return "";
-    return std::string(ansiStr);
+// Function to get current timestamp in ISO 8601 format
+std::string getCurrentTimestamp() {
+    return formatTimestamp(std::chrono::system_clock::now());
 }
 
-// Function to convert wide string to UTF-8 string
-std::string wideStringToUtf8(const wchar_t* wideStr) {
-    if (!wideStr) return "";
+// ---------------------------------------------------------------------------
+// Asynchronous file I/O
+//
+// Partition files, the binary log and the log file writer append
+// through AsyncFile rather than std::ofstream, so the writing thread hands
+// full buffers to the OS and goes on formatting instead of sitting in
+// WriteFile. Each file gets io.queue_depth buffers of io.buffer_kb when it is
+// opened and reuses them until it is closed: nothing is allocated per write,
+// and a buffer is not touched again while a write from it is outstanding.
+// Filled buffers are given their file offset, collected, and submitted
+// together once half of them are ready (or on submit/flush), so up to
+// io.queue_depth writes are in flight; a writer only waits when every buffer
+// is full or in flight.
+//
+// io.backend 0 opens files with FILE_FLAG_OVERLAPPED and issues overlapped
+// WriteFile calls with an event per buffer. io.backend 1, or a file that
+// cannot be opened for overlapped I/O, uses an ordinary handle and runs each
+// write on the ioWritePool threads (inline when the pool is not running).
+// Settings apply to files opened afterwards. `print_monitor.exe --bench io
+// [MB]` compares both backends with std::ofstream.
+// Both backends are Win32; there is no io_uring or pwrite backend.
+//
+// A write that fails outright is retried once after the file's other writes
+// have finished (overlapped writes mostly fail for lack of resources while
+// many are outstanding). A write that still fails fails the file: nothing
+// more is written, and closing it cuts it back to the end of the last good
+// data so no zero-filled gap is left where the lost bytes belonged.
+// ---------------------------------------------------------------------------
 
-    int size_needed = WideCharToMultiByte(CP_UTF8, 0, wideStr, -1, NULL, 0, NULL, NULL);
-    if (size_needed == 0) return "";
+// Pool of detached threads draining a queue of work items. A thread stuck in
+// an abandoned spooler call is released from the pool and replaced, so the
+// pool keeps its capacity; the stuck thread exits once the call returns.
+struct WorkerPool {
+    std::deque<std::function<void()>> queue;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::condition_variable threadExited;
+    size_t liveThreads = 0;
+    bool stopRequested = false;
+};
 
-    std::string result(size_needed - 1, 0);
-    WideCharToMultiByte(CP_UTF8, 0, wideStr, -1, &result[0], size_needed, NULL, NULL);
+// Set by a work item whose thread was released from its pool; the thread exits without touching the pool
+thread_local bool retireCurrentWorker = false;
 
-    return result;
-}
+// Pool the current thread works for; null on threads outside the pools
+thread_local const WorkerPool* currentWorkerPool = nullptr;
 
-// Function to get color mode from device mode
-std::string getColorMode(DEVMODE* pDevMode) {
-    if (!pDevMode) return "Unknown";
-    
-    if (pDevMode->dmFields & DM_COLOR) {
-        return (pDevMode->dmColor == DMCOLOR_COLOR) ? "Color" : "Monochrome";
+// Function to queue work on a pool
+void postToPool(WorkerPool& pool, std::function<void()> work) {
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.queue.push_back(std::move(work));
     }
-    return "Unknown";
+    pool.condition.notify_one();
 }
 
-// Function to get duplex setting from device mode
-std::string getDuplexSetting(DEVMODE* pDevMode) {
-    if (!pDevMode) return "Unknown";
-    
-    if (pDevMode->dmFields & DM_DUPLEX) {
-        switch(pDevMode->dmDuplex) {
-            case DMDUP_SIMPLEX: return "Simplex";
-            case DMDUP_VERTICAL: return "Duplex Vertical";
-            case DMDUP_HORIZONTAL: return "Duplex Horizontal";
-            default: return "Unknown";
-        }
+void runPoolWorker(WorkerPool& pool) {
+    currentWorkerPool = &pool;
+    std::unique_lock<std::mutex> lock(pool.mutex);
+    while (true) {
+        pool.condition.wait(lock, [&pool] { return pool.stopRequested || !pool.queue.empty(); });
+        if (pool.queue.empty()) break;
+        std::function<void()> work = std::move(pool.queue.front());
+        pool.queue.pop_front();
+        lock.unlock();
+        work();
+        if (retireCurrentWorker) return;
+        lock.lock();
     }
-    return "Unknown";
+    --pool.liveThreads;
+    pool.threadExited.notify_all();
 }
 
-// Function to get paper size from device mode
-std::string getPaperSize(DEVMODE* pDevMode) {
-    if (!pDevMode) return "Unknown";
-    
-    if (pDevMode->dmFields & DM_PAPERSIZE) {
-        switch(pDevMode->dmPaperSize) {
-            case DMPAPER_LETTER: return "Letter";
-            case DMPAPER_LEGAL: return "Legal";
-            case DMPAPER_A4: return "A4";
-            case DMPAPER_A3: return "A3";
-            case DMPAPER_A5: return "A5";
-            default: return "Custom";
-        }
-    }
-    return "Unknown";
+// Function to add one thread to a pool; caller holds pool.mutex
+void addPoolWorker(WorkerPool& pool) {
+    ++pool.liveThreads;
+    std::thread(runPoolWorker, std::ref(pool)).detach();
 }
 
-// Function to get current user
-std::string getCurrentUser() {
-    char username[UNLEN + 1];
-    DWORD username_len = UNLEN + 1;
-    if (GetUserNameA(username, &username_len)) {
-        return std::string(username);
+void startWorkerPool(WorkerPool& pool, size_t threadCount) {
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    pool.stopRequested = false;
+    for (size_t i = 0; i < threadCount; ++i) {
+        addPoolWorker(pool);
     }
-    return "Unknown";
 }
 
-// Helper function to get extended print job information
-bool getExtendedJobInfo(HANDLE hPrinter, DWORD jobId, PrintJob& job) {
-    // Request detailed job information
-    DWORD bytesNeeded = 0;
-    DWORD numJobs = 0;
-    
-    // Enumerate the specific job to get more details
-    if (!EnumJobs(hPrinter, jobId, 1, 2, NULL, 0, &bytesNeeded, &numJobs)) {
-        // If job 2 fails, the printer might not support detailed info
-        return false;
-    }
-    
-    if (bytesNeeded == 0) {
-        return false;
+// Stop a pool once its queue has drained. Threads stuck in an abandoned
+// spooler call were already released and are not waited for.
+void stopWorkerPool(WorkerPool& pool) {
+    std::unique_lock<std::mutex> lock(pool.mutex);
+    pool.stopRequested = true;
+    pool.condition.notify_all();
+    pool.threadExited.wait(lock, [&pool] { return pool.liveThreads == 0; });
+}
+
+// Function to queue work on a pool; false, leaving the work to the caller, if the pool has no threads
+bool tryPostToPool(WorkerPool& pool, std::function<void()>& work) {
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    if (pool.liveThreads == 0 || pool.stopRequested) return false;
+    pool.queue.push_back(std::move(work));
+    pool.condition.notify_one();
+    return true;
+}
+
+// Function to queue work on a pool, or run it here when the pool has no threads
+void postToPoolOrRun(WorkerPool& pool, std::function<void()> work) {
+    if (!tryPostToPool(pool, work)) work();
+}
+
+std::atomic<long long> ioBackend{0};      // 0 = overlapped, 1 = thread pool
+std::atomic<long long> ioQueueDepth{4};
+std::atomic<long long> ioBufferKb{64};
+
+const size_t ioWriteThreads = 2;
+WorkerPool ioWritePool;
+
+std::atomic<uint64_t> ioWritesSubmitted{0};
+std::atomic<uint64_t> ioBatchesSubmitted{0};
+std::atomic<uint64_t> ioBytesWritten{0};
+std::atomic<uint64_t> ioBufferWaits{0};    // Writers that found every buffer busy
+std::atomic<uint64_t> ioWriteErrors{0};
+
+struct AsyncWriteBuffer {
+    enum State { Filling, Ready, InFlight };
+    std::unique_ptr<char[]> data;
+    size_t used = 0;
+    uint64_t offset = 0;          // File offset, fixed when the buffer is marked ready
+    State state = Filling;
+    OVERLAPPED overlapped = {};   // Overlapped backend
+    bool done = false;            // Thread-pool backend, guarded by AsyncFile::completionMutex
+    bool ok = false;
+};
+
+struct AsyncFile {
+    HANDLE handle = INVALID_HANDLE_VALUE;
+    bool overlappedIo = false;
+    bool failed = false;                // A write failed; the file is incomplete
+    DWORD error = 0;
+    uint64_t failedOffset = ~0ULL;      // Start of the first lost write; the file is cut back to it
+    uint64_t offset = 0;                // Where the next ready buffer goes
+    size_t capacity = 0;                // Bytes per buffer
+    std::vector<AsyncWriteBuffer> buffers;
+    size_t current = 0;                 // Buffer being filled
+    size_t ready = 0;                   // Buffers marked ready and not yet submitted
+    std::mutex completionMutex;
+    std::condition_variable completion;
+
+    AsyncFile() = default;
+    AsyncFile(const AsyncFile&) = delete;
+    AsyncFile& operator=(const AsyncFile&) = delete;
+    ~AsyncFile() { close(); }
+
+    bool isOpen() const { return handle != INVALID_HANDLE_VALUE; }
+
+    // Function to open a file for writing, truncated or appended to; bufferBytes 0 uses io.buffer_kb
+    bool open(const std::string& path, bool append, size_t bufferBytes = 0) {
+        close();
+        failed = false;
+        error = 0;
+        failedOffset = ~0ULL;
+        DWORD disposition = append ? OPEN_ALWAYS : CREATE_ALWAYS;
+        overlappedIo = ioBackend == 0;
+        handle = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, disposition,
+                             FILE_ATTRIBUTE_NORMAL | (overlappedIo ? FILE_FLAG_OVERLAPPED : 0), NULL);
+        if (handle == INVALID_HANDLE_VALUE && overlappedIo) {
+            overlappedIo = false;
+            handle = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, disposition,
+                                 FILE_ATTRIBUTE_NORMAL, NULL);
+        }
+        if (handle == INVALID_HANDLE_VALUE) {
+            error = GetLastError();
+            return false;
+        }
+        offset = 0;
+        LARGE_INTEGER size;
+        if (append && GetFileSizeEx(handle, &size)) offset = static_cast<uint64_t>(size.QuadPart);
+
+        capacity = bufferBytes > 0 ? bufferBytes : static_cast<size_t>(std::max(4LL, ioBufferKb.load())) * 1024;
+        buffers = std::vector<AsyncWriteBuffer>(static_cast<size_t>(std::clamp(ioQueueDepth.load(), 1LL, 64LL)));
+        for (auto& buffer : buffers) {
+            buffer.data.reset(new char[capacity]);
+            if (overlappedIo) buffer.overlapped.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+        }
+        current = 0;
+        ready = 0;
+        return true;
     }
-    
-    std::vector<BYTE> jobBuffer(bytesNeeded);
-    JOB_INFO_2* pJobInfo2 = reinterpret_cast<JOB_INFO_2*>(jobBuffer.data());
-
-    if (EnumJobs(hPrinter, jobId, 1, 2, reinterpret_cast<LPBYTE>(pJobInfo2), bytesNeeded, &bytesNeeded, &numJobs)) {
-        if (numJobs > 0) {
-            // Try to get device mode information for color/duplex/paper settings
-            if (pJobInfo2->pDevMode) {
-                DEVMODE* pDevMode = pJobInfo2->pDevMode;
-                job.colorMode = getColorMode(pDevMode);
-                job.duplexSetting = getDuplexSetting(pDevMode);
-                job.paperSize = getPaperSize(pDevMode);
+
+    // Function to append bytes, submitting buffers as they fill
+    void write(const char* data, size_t size) {
+        while (size > 0 && isOpen() && !failed) {
+            AsyncWriteBuffer& buffer = buffers[current];
+            if (buffer.state != AsyncWriteBuffer::Filling) {
+                if (buffer.state == AsyncWriteBuffer::Ready || !completed(buffer)) ++ioBufferWaits;
+                wait(buffer);
+            }
+            size_t chunk = std::min(size, capacity - buffer.used);
+            std::memcpy(buffer.data.get() + buffer.used, data, chunk);
+            buffer.used += chunk;
+            data += chunk;
+            size -= chunk;
+            if (buffer.used == capacity) {
+                markReady(buffer);
+                if (ready * 2 >= buffers.size()) submitReady();
             }
-            return true;
         }
     }
-    
-    return false;
-}
 
-// Main monitoring function that uses Windows Print Spooler APIs
-void monitorPrintJobs() {
-    while (monitoringActive) {
-        DWORD flags = PRINTER_ENUM_LOCAL | PRINTER_ENUM_CONNECTIONS;
-        DWORD bytesNeeded = 0;
-        DWORD numPrinters = 0;
+    void write(const std::string& text) { write(text.data(), text.size()); }
+
+    // Function to submit everything written so far without waiting for it
+    void submit() {
+        if (!isOpen()) return;
+        AsyncWriteBuffer& buffer = buffers[current];
+        if (buffer.state == AsyncWriteBuffer::Filling && buffer.used > 0) markReady(buffer);
+        submitReady();
+    }
 
-        // First call to get required buffer size
-        EnumPrinters(flags, NULL, 2, NULL, 0, &bytesNeeded, &numPrinters);
+    // Function to submit everything written so far and wait until it is on disk; false if any write failed
+    bool flush() {
+        submit();
+        for (auto& buffer : buffers) wait(buffer);
+        return !failed;
+    }
 
-        if (bytesNeeded == 0) {
-            logMessage("WARN", "No printers found during monitoring cycle");
-            std::this_thread::sleep_for(std::chrono::seconds(5)); // Wait before retrying
-            continue;
+    // Function to flush and close the file; false if any write failed
+    bool close() {
+        if (!isOpen()) return !failed;
+        flush();
+        if (failed && failedOffset != ~0ULL) {
+            // Drop whatever landed after the lost bytes
+            LARGE_INTEGER end;
+            end.QuadPart = static_cast<LONGLONG>(failedOffset);
+            if (SetFilePointerEx(handle, end, NULL, FILE_BEGIN)) SetEndOfFile(handle);
+        }
+        for (auto& buffer : buffers) {
+            if (buffer.overlapped.hEvent) CloseHandle(buffer.overlapped.hEvent);
         }
+        buffers.clear();
+        CloseHandle(handle);
+        handle = INVALID_HANDLE_VALUE;
+        return !failed;
+    }
 
-        // Allocate buffer for printer info
-        std::vector<BYTE> buffer(bytesNeeded);
-        PRINTER_INFO_2A* pPrinterInfo2 = reinterpret_cast<PRINTER_INFO_2A*>(buffer.data());
+    void markReady(AsyncWriteBuffer& buffer) {
+        buffer.offset = offset;
+        offset += buffer.used;
+        buffer.state = AsyncWriteBuffer::Ready;
+        ++ready;
+        current = (current + 1) % buffers.size();
+    }
 
-        // Get printer information
-        if (!EnumPrinters(flags, NULL, 2, reinterpret_cast<LPBYTE>(pPrinterInfo2), bytesNeeded, &bytesNeeded, &numPrinters)) {
-            logMessage("ERROR", "Failed to enumerate printers. Error: " + std::to_string(GetLastError()));
-            std::this_thread::sleep_for(std::chrono::seconds(5)); // Wait before retrying
-            continue;
+    // Function to issue every ready buffer, oldest first, as one batch
+    void submitReady() {
+        if (ready == 0) return;
+        ++ioBatchesSubmitted;
+        size_t first = (current + buffers.size() - ready) % buffers.size();
+        size_t count = ready;
+        ready = 0;
+        for (size_t n = 0; n < count; ++n) {
+            AsyncWriteBuffer& buffer = buffers[(first + n) % buffers.size()];
+            if (failed) {
+                // Past a lost write; the file is cut back on close
+                buffer.used = 0;
+                buffer.state = AsyncWriteBuffer::Filling;
+            } else {
+                issue(buffer);
+            }
         }
+    }
 
-        // Monitor print jobs for each printer
-        for (DWORD i = 0; i < numPrinters && monitoringActive; ++i) {
-            // Open the printer
-            HANDLE hPrinter = NULL;
-            const char* printerNameAnsi = pPrinterInfo2[i].pPrinterName;
-
-            PRINTER_DEFAULTS pd = { NULL, NULL, PRINTER_ACCESS_USE };
-            if (OpenPrinterA(const_cast<LPSTR>(printerNameAnsi), &hPrinter, &pd)) {
-                // Enumerate jobs on this printer
-                DWORD jobBytesNeeded = 0;
-                DWORD numJobs = 0;
-                
-                // First call to get required buffer size
-                EnumJobs(hPrinter, 0, 1000, 2, NULL, 0, &jobBytesNeeded, &numJobs);
-
-                if (jobBytesNeeded > 0) {
-                    std::vector<BYTE> jobBuffer(jobBytesNeeded);
-                    JOB_INFO_2A* pJobInfo = reinterpret_cast<JOB_INFO_2A*>(jobBuffer.data());
-
-                    if (EnumJobs(hPrinter, 0, 1000, 2, reinterpret_cast<LPBYTE>(pJobInfo), jobBytesNeeded, &jobBytesNeeded, &numJobs)) {
-                        for (DWORD j = 0; j < numJobs && monitoringActive; ++j) {
-                            PrintJob job;
-                            job.printerName = ansiStringToUtf8(pPrinterInfo2[i].pPrinterName);
-                            job.timestamp = getCurrentTimestamp();
-
-                            // Map job status
-                            if (pJobInfo[j].Status & JOB_STATUS_PAUSED)
-                                job.status = "Paused";
-                            else if (pJobInfo[j].Status & JOB_STATUS_ERROR)
-                                job.status = "Error";
-                            else if (pJobInfo[j].Status & JOB_STATUS_DELETING)
-                                job.status = "Deleting";
-                            else if (pJobInfo[j].Status & JOB_STATUS_SPOOLING)
-                                job.status = "Spooling";
-                            else if (pJobInfo[j].Status & JOB_STATUS_PRINTING)
-                                job.status = "Printing";
-                            else if (pJobInfo[j].Status & JOB_STATUS_OFFLINE)
-                                job.status = "Offline";
-                            else if (pJobInfo[j].Status & JOB_STATUS_PAPEROUT)
-                                job.status = "Paper Out";
-                            else if (pJobInfo[j].Status & JOB_STATUS_DELETED)
-                                job.status = "Deleted";
-                            else if (pJobInfo[j].Status & JOB_STATUS_BLOCKED_DEVQ)
-                                job.status = "Blocked";
-                            else if (pJobInfo[j].Status & JOB_STATUS_USER_INTERVENTION)
-                                job.status = "User Intervention Required";
-                            else
-                                job.status = "Queued";
-
-                            job.pages = pJobInfo[j].TotalPages > 0 ? pJobInfo[j].TotalPages : pJobInfo[j].PagesPrinted;
-                            job.documentSize = static_cast<int>(pJobInfo[j].Size);
-                            job.userAccount = ansiStringToUtf8(pJobInfo[j].pUserName);
-                            job.jobId = std::to_string(pJobInfo[j].JobId);
-
-                            // Try to get extended information from the printer
-                            // The getExtendedJobInfo function might need adjustment since we're already using level 2
-                            if (pJobInfo[j].pDevMode) {
-                                DEVMODEA* pDevMode = pJobInfo[j].pDevMode;
-                                job.colorMode = getColorMode(reinterpret_cast<DEVMODE*>(pDevMode));
-                                job.duplexSetting = getDuplexSetting(reinterpret_cast<DEVMODE*>(pDevMode));
-                                job.paperSize = getPaperSize(reinterpret_cast<DEVMODE*>(pDevMode));
-                            }
-                            
-                            {
-                                std::lock_guard<std::mutex> lock(jobsMutex);
-                                
-                                // Check if this job is already recorded to avoid duplicates
-                                bool exists = false;
-                                for (const auto& existingJob : printJobs) {
-                                    if (existingJob.jobId == job.jobId && existingJob.printerName == job.printerName) {
-                                        exists = true;
-                                        break;
-                                    }
-                                }
-                                
-                                if (!exists) {
-                                    printJobs.push_back(job);
-                                    
-                                    // Keep only the last 1000 jobs to prevent memory issues
-                                    if (printJobs.size() > 1000) {
-                                        printJobs.erase(printJobs.begin(), printJobs.begin() + 100); // Remove oldest 100
-                                    }
-                                }
-                            }
-                            
-                            if (monitoringActive) {
-                                logMessage("INFO", "Detected print job: " + job.jobId 
-                                          + " on " + job.printerName 
-                                          + " - Status: " + job.status);
-                            }
-                        }
-                    } else {
-                        logMessage("ERROR", "Failed to enumerate jobs. Error: " + std::to_string(GetLastError()));
-                    }
-                }
-                
-                ClosePrinter(hPrinter);
-            } else {
-                logMessage("ERROR", "Could not open printer: " + ansiStringToUtf8(pPrinterInfo2[i].pPrinterName)
-                          + ". Error: " + std::to_string(GetLastError()));
+    void issue(AsyncWriteBuffer& buffer) {
+        buffer.state = AsyncWriteBuffer::InFlight;
+        ++ioWritesSubmitted;
+        if (overlappedIo) {
+            if (startOverlappedWrite(buffer)) return;
+            // Let the other writes finish, then try once more before giving up on the file
+            for (auto& other : buffers) {
+                if (&other != &buffer && other.state == AsyncWriteBuffer::InFlight) wait(other);
+            }
+            if (!startOverlappedWrite(buffer)) {
+                recordFailure(buffer, GetLastError());
+                buffer.used = 0;
+                buffer.state = AsyncWriteBuffer::Filling;
             }
+            return;
         }
-        
-        // Wait before checking again to reduce CPU usage, but check if monitoring is still active
-        for (int i = 0; i < 10 && monitoringActive; ++i) {
-            std::this_thread::sleep_for(std::chrono::seconds(1));
+        {
+            std::lock_guard<std::mutex> lock(completionMutex);
+            buffer.done = false;
         }
+        AsyncWriteBuffer* target = &buffer;
+        postToPoolOrRun(ioWritePool, [this, target] {
+            OVERLAPPED position = {};
+            position.Offset = static_cast<DWORD>(target->offset & 0xffffffffULL);
+            position.OffsetHigh = static_cast<DWORD>(target->offset >> 32);
+            DWORD written = 0;
+            BOOL ok = WriteFile(handle, target->data.get(), static_cast<DWORD>(target->used), &written, &position) &&
+                      written == target->used;
+            DWORD writeError = ok ? 0 : GetLastError();
+            std::lock_guard<std::mutex> lock(completionMutex);
+            target->ok = ok;
+            if (!ok) error = writeError;
+            target->done = true;
+            completion.notify_all();
+        });
     }
-}
 
-// Start monitoring print jobs
-void startMonitoring() {
-    if (monitoringActive) {
-        logMessage("INFO", "Monitoring is already active.");
-        return;
-    }
-    
-    try {
-        monitoringActive = true;
-        monitorThread = std::thread(monitorPrintJobs);
-        logMessage("INFO", "Print job monitoring started.");
-    } catch (const std::exception& e) {
-        logMessage("ERROR", std::string("Failed to start monitoring thread: ") + e.what());
+    // Function to start an overlapped write of a buffer at its offset; false if it failed outright
+    bool startOverlappedWrite(AsyncWriteBuffer& buffer) {
+        HANDLE event = buffer.overlapped.hEvent;
+        buffer.overlapped = {};
+        buffer.overlapped.hEvent = event;
+        buffer.overlapped.Offset = static_cast<DWORD>(buffer.offset & 0xffffffffULL);
+        buffer.overlapped.OffsetHigh = static_cast<DWORD>(buffer.offset >> 32);
+        return WriteFile(handle, buffer.data.get(), static_cast<DWORD>(buffer.used), NULL, &buffer.overlapped) ||
+               GetLastError() == ERROR_IO_PENDING;
     }
-}
 
-// Stop monitoring print jobs
-void stopMonitoring() {
-    if (!monitoringActive) {
-        logMessage("INFO", "Monitoring is not active.");
-        return;
+    // Function to check, without waiting, whether a buffer's write has finished
+    bool completed(AsyncWriteBuffer& buffer) {
+        if (overlappedIo) return HasOverlappedIoCompleted(&buffer.overlapped);
+        std::lock_guard<std::mutex> lock(completionMutex);
+        return buffer.done;
     }
-    
-    try {
-        monitoringActive = false;
-        if (monitorThread.joinable()) {
-            monitorThread.join();
+
+    // Function to wait for a buffer's write, if it has one outstanding, and free the buffer
+    void wait(AsyncWriteBuffer& buffer) {
+        if (buffer.state == AsyncWriteBuffer::Ready) submitReady();
+        if (buffer.state != AsyncWriteBuffer::InFlight) return;
+        bool ok;
+        if (overlappedIo) {
+            DWORD written = 0;
+            ok = GetOverlappedResult(handle, &buffer.overlapped, &written, TRUE) && written == buffer.used;
+            if (!ok) recordFailure(buffer, GetLastError());
+        } else {
+            std::unique_lock<std::mutex> lock(completionMutex);
+            completion.wait(lock, [&buffer] { return buffer.done; });
+            ok = buffer.ok;
+            if (!ok) recordFailure(buffer, error);
         }
-        logMessage("INFO", "Print job monitoring stopped.");
-    } catch (const std::exception& e) {
-        logMessage("ERROR", std::string("Failed to stop monitoring thread: ") + e.what());
+        if (ok) ioBytesWritten += buffer.used;
+        buffer.used = 0;
+        buffer.state = AsyncWriteBuffer::Filling;
     }
+
+    void recordFailure(const AsyncWriteBuffer& buffer, DWORD code) {
+        failed = true;
+        error = code;
+        failedOffset = std::min(failedOffset, buffer.offset);
+        ++ioWriteErrors;
+    }
+};
+
+// Function to show the file I/O settings and counters
+void showIoStatistics(std::ostream& out) {
+    out << "File I/O: " << (ioBackend == 0 ? "overlapped" : "thread pool") << ", queue depth "
+              << ioQueueDepth << ", " << ioWritesSubmitted << " writes in " << ioBatchesSubmitted << " batches, "
+              << ioBytesWritten / 1024 << " KB, " << ioBufferWaits << " waits for a free buffer, "
+              << ioWriteErrors << " errors" << std::endl;
 }
 
-// Export print jobs to CSV file
-bool exportToCSV(const std::string& filename) {
-    try {
-        std::lock_guard<std::mutex> lock(jobsMutex);
-        
-        std::ofstream file(filename);
-        if (!file.is_open()) {
-            logMessage("ERROR", "Could not open file for writing: " + filename);
-            return false;
-        }
-        
-        // Write CSV header following RFC-4180
-        file << "\"Printer Name\",\"Timestamp\",\"Status\",\"Pages\",\"Document Size\",\"Color Mode\",\"Duplex Setting\",\"Paper Size\",\"User Account\",\"Job ID\"\n";
-        
-        // Write each print job as a CSV row, properly escaping values per RFC-4180
-        for (const auto& job : printJobs) {
-            // Properly escape and quote each field per RFC-4180
-            std::string printerName = job.printerName;
-            std::string status = job.status;
-            std::string colorMode = job.colorMode;
-            std::string duplexSetting = job.duplexSetting;
-            std::string paperSize = job.paperSize;
-            std::string userAccount = job.userAccount;
-            std::string jobId = job.jobId;
-            
-            // Replace double quotes with two double quotes (RFC-4180 section 2.4)
-            size_t pos;
-            pos = 0;
-            while ((pos = printerName.find('"', pos)) != std::string::npos) {
-                printerName.replace(pos, 1, "\"\"");
-                pos += 2;
-            }
-            
-            pos = 0;
-            while ((pos = status.find('"', pos)) != std::string::npos) {
-                status.replace(pos, 1, "\"\"");
-                pos += 2;
-            }
-            
-            pos = 0;
-            while ((pos = colorMode.find('"', pos)) != std::string::npos) {
-                colorMode.replace(pos, 1, "\"\"");
-                pos += 2;
-            }
-            
-            pos = 0;
-            while ((pos = duplexSetting.find('"', pos)) != std::string::npos) {
-                duplexSetting.replace(pos, 1, "\"\"");
-                pos += 2;
-            }
-            
-            pos = 0;
-            while ((pos = paperSize.find('"', pos)) != std::string::npos) {
-                paperSize.replace(pos, 1, "\"\"");
-                pos += 2;
-            }
-            
-            pos = 0;
-            while ((pos = userAccount.find('"', pos)) != std::string::npos) {
-                userAccount.replace(pos, 1, "\"\"");
-                pos += 2;
-            }
-            
-            pos = 0;
-            while ((pos = jobId.find('"', pos)) != std::string::npos) {
-                jobId.replace(pos, 1, "\"\"");
-                pos += 2;
-            }
-            
-            file << "\"" << printerName << "\","
-                 << "\"" << job.timestamp << "\","
-                 << "\"" << status << "\","
-                 << job.pages << ","
-                 << job.documentSize << ","
-                 << "\"" << colorMode << "\","
-                 << "\"" << duplexSetting << "\","
-                 << "\"" << paperSize << "\","
-                 << "\"" << userAccount << "\","
-                 << "\"" << jobId << "\"\n";
-        }
-        
+// Function to time std::ofstream and both AsyncFile backends writing CSV-sized lines
+int runIoBenchmark(size_t megabytes) {
+    const std::string path = "print_monitor_io_bench.tmp";
+    std::string line = "\"Office_HP_LaserJet_4250\",\"2026-10-17T09:30:00.000+00:00\",\"Printing\",3,24576,"
+                       "\"Color\",\"Duplex Vertical\",\"A4\",\"jsmith\",\"1234\"\n";
+    size_t lines = megabytes * 1024 * 1024 / line.size();
+    uint64_t expected = static_cast<uint64_t>(lines) * line.size();
+    std::cout << "Writing " << lines << " lines (" << megabytes << " MB) per backend, queue depth "
+              << ioQueueDepth << ", " << ioBufferKb << " KB buffers..." << std::endl;
+    startWorkerPool(ioWritePool, ioWriteThreads);
+
+    bool allOk = true;
+    auto report = [&](const char* label, std::chrono::steady_clock::time_point started, bool ok) {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        std::error_code ec;
+        ok = ok && std::filesystem::file_size(path, ec) == expected;
+        allOk = allOk && ok;
+        char text[128];
+        std::snprintf(text, sizeof(text), "%-14s%10.1f MB/s%10.1f ms%s", label,
+                      static_cast<double>(expected) / 1e6 / std::max(seconds, 1e-9), seconds * 1000,
+                      ok ? "" : "  FAILED");
+        std::cout << text << std::endl;
+    };
+
+    {
+        auto started = std::chrono::steady_clock::now();
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        for (size_t i = 0; i < lines; ++i) file << line;
         file.close();
-        logMessage("INFO", "Data exported to: " + filename + " (" + std::to_string(printJobs.size()) + " records)");
-        return true;
-    } catch (const std::exception& e) {
-        logMessage("ERROR", std::string("Exception during CSV export: ") + e.what());
-        return false;
+        report("std::ofstream", started, static_cast<bool>(file));
     }
+    long long savedBackend = ioBackend;
+    for (long long backend = 0; backend <= 1; ++backend) {
+        ioBackend = backend;
+        auto started = std::chrono::steady_clock::now();
+        AsyncFile file;
+        bool ok = file.open(path, false);
+        for (size_t i = 0; ok && i < lines; ++i) file.write(line);
+        ok = file.close() && ok;
+        report(backend == 0 ? "overlapped" : "thread pool", started, ok);
+    }
+    ioBackend = savedBackend;
+
+    stopWorkerPool(ioWritePool);
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+    return allOk ? 0 : 1;
 }
 
-// Function to perform periodic saves
-void periodicSave() {
-    while (monitoringActive) {
-        // Sleep for 30 minutes (1800 seconds)
-        for (int i = 0; i < 1800 && monitoringActive; ++i) {
-            std::this_thread::sleep_for(std::chrono::seconds(1));
-        }
-        
-        if (monitoringActive) {
-            std::string filename = "print_jobs_auto_save_" + getCurrentTimestamp().substr(0, 19) + ".csv";
-            // Replace colons in timestamp with hyphens for valid filename
-            std::replace(filename.begin(), filename.end(), ':', '-');
-            exportToCSV(filename);
-        }
-    }
+// ---------------------------------------------------------------------------
+// Memory-mapped export writer
+//
+// Full and filtered exports go through MappedFileWriter. The file is sized
+// once from the rows' field lengths, mapped, and formatCsvRow formats each
+// row straight into the mapping: there is no intermediate buffer to copy and
+// no WriteFile per chunk, and fields without quotes are a single memcpy. A
+// row is only given room for its worst case (every quote doubled), so if a
+// file full of quotes runs past the estimate the mapping is extended by half
+// and remapped. close() unmaps the view and truncates the file to the bytes
+// actually written. Partition files receive a few rows at a time over their
+// whole period, so they keep their AsyncFile, filled by the same formatter
+// through appendCsvRow. `print_monitor.exe --bench export [rows]` compares
+// the writer with the buffered paths and with a memcpy of the same bytes.
+// The mapping is Win32 only; there is no mmap/ftruncate backend.
+// ---------------------------------------------------------------------------
+
+// Rows end in CRLF (RFC-4180 section 2.1)
+const std::string csvHeader =
+    "\"Printer Name\",\"Timestamp\",\"Status\",\"Pages\",\"Document Size\",\"Color Mode\",\"Duplex Setting\",\"Paper Size\",\"User Account\",\"Job ID\"\r\n";
+
+// Quotes around the eight text fields, two integers, nine commas and CRLF
+const size_t csvRowOverhead = 8 * 2 + 2 * 11 + 9 + 2;
+const uint64_t mappedWriterMinimum = 64 * 1024;  // Smallest mapping; an empty file cannot be mapped
+
+// Function to total the text field lengths of a job's CSV row
+size_t csvTextLength(const PrintJob& job) {
+    return job.printerName.size() + job.timestamp.size() + job.status.size() + job.colorMode.size() +
+           job.duplexSetting.size() + job.paperSize.size() + job.userAccount.size() + job.jobId.size();
 }
 
-// Force save data to default file
-void forceSave() {
-    std::string filename = "print_jobs_" + getCurrentTimestamp().substr(0, 19) + ".csv";
-    // Replace colons in timestamp with hyphens for valid filename
-    std::replace(filename.begin(), filename.end(), ':', '-');
-    exportToCSV(filename);
+// Function to bound the length of a job's CSV row, as if every character were a quote
+size_t csvRowBound(const PrintJob& job) {
+    return 2 * csvTextLength(job) + csvRowOverhead;
 }
 
-// Show current statistics
-void showStatistics() {
-    std::lock_guard<std::mutex> lock(jobsMutex);
-    
-    std::cout << "\n=== Print Job Statistics ===" << std::endl;
-    std::cout << "Total print jobs recorded: " << printJobs.size() << std::endl;
-    
-    if (!printJobs.empty()) {
-        // Count jobs by status
-        std::map<std::string, int> statusCount;
-        int totalPages = 0;
-        int totalSize = 0;
-        
-        for (const auto& job : printJobs) {
-            statusCount[job.status]++;
-            totalPages += job.pages;
-            totalSize += job.documentSize;
-        }
-        
-        std::cout << "Jobs by status:" << std::endl;
-        for (const auto& pair : statusCount) {
-            std::cout << "  " << pair.first << ": " << pair.second << std::endl;
-        }
-        
-        std::cout << "Total pages printed: " << totalPages << std::endl;
-        std::cout << "Total document size: " << totalSize << " bytes" << std::endl;
-        std::cout << "Average pages per job: " << (double)totalPages / printJobs.size() << std::endl;
+// Function to write a quoted CSV field, doubling embedded quotes (RFC-4180 section 2.7); returns the end
+char* formatCsvField(char* out, const std::string& value) {
+    *out++ = '"';
+    const char* p = value.data();
+    const char* end = p + value.size();
+    while (const char* quote = static_cast<const char*>(std::memchr(p, '"', end - p))) {
+        std::memcpy(out, p, quote + 1 - p);
+        out += quote + 1 - p;
+        *out++ = '"';
+        p = quote + 1;
     }
-    
-    std::cout << "Monitoring status: " << (monitoringActive ? "ACTIVE" : "STOPPED") << std::endl;
-    std::cout << "============================\n" << std::endl;
+    std::memcpy(out, p, end - p);
+    out += end - p;
+    *out++ = '"';
+    return out;
 }
 
-// Show help information
-void showHelp() {
-    std::cout << "\n=== Print Job Monitor Help ===" << std::endl;
-    std::cout << "Commands:" << std::endl;
-    std::cout << "  start         - Start monitoring print jobs" << std::endl;
-    std::cout << "  stop          - Stop monitoring print jobs" << std::endl;
-    std::cout << "  save          - Force save current data to CSV" << std::endl;
-    std::cout << "  export [file] - Export to specified CSV file" << std::endl;
-    std::cout << "  stats         - Show current statistics" << std::endl;
-    std::cout << "  help          - Show this help message" << std::endl;
-    std::cout << "  quit/exit     - Quit the application" << std::endl;
-    std::cout << "==============================\n" << std::endl;
+// Function to write a job as one CSV row in the export column order; out needs csvRowBound bytes
+char* formatCsvRow(char* out, const PrintJob& job) {
+    out = formatCsvField(out, job.printerName);
+    *out++ = ',';
+    out = formatCsvField(out, job.timestamp);
+    *out++ = ',';
+    out = formatCsvField(out, job.status);
+    *out++ = ',';
+    out = std::to_chars(out, out + 11, job.pages).ptr;
+    *out++ = ',';
+    out = std::to_chars(out, out + 11, job.documentSize).ptr;
+    *out++ = ',';
+    out = formatCsvField(out, job.colorMode);
+    *out++ = ',';
+    out = formatCsvField(out, job.duplexSetting);
+    *out++ = ',';
+    out = formatCsvField(out, job.paperSize);
+    *out++ = ',';
+    out = formatCsvField(out, job.userAccount);
+    *out++ = ',';
+    out = formatCsvField(out, job.jobId);
+    *out++ = '\r';
+    *out++ = '\n';
+    return out;
 }
 
-// Main command loop
-void commandLoop() {
-    std::cout << "Windows Print Job Monitoring System" << std::endl;
-    std::cout << "Type 'help' for available commands or 'quit' to exit.\n" << std::endl;
-    
-    std::string input;
-    while (true) {
-        std::cout << "> ";
-        std::getline(std::cin, input);
-        
-        // Convert to lowercase for easier command matching
-        std::transform(input.begin(), input.end(), input.begin(), ::tolower);
-        
-        if (input == "start") {
-            startMonitoring();
-        }
-        else if (input == "stop") {
-            stopMonitoring();
-        }
-        else if (input == "save") {
-            forceSave();
+// Function to append a job as one CSV row to a string
+void appendCsvRow(std::string& out, const PrintJob& job) {
+    size_t used = out.size();
+    out.resize(used + csvRowBound(job));
+    out.resize(formatCsvRow(out.data() + used, job) - out.data());
+}
+
+// Output file written through a shared mapping of its first `capacity` bytes
+struct MappedFileWriter {
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+    char* view = nullptr;
+    uint64_t capacity = 0;  // Size of the file while it is mapped
+    uint64_t used = 0;      // Bytes written from the start of the file
+    bool failed = false;
+    DWORD error = 0;
+
+    ~MappedFileWriter() {
+        if (file != INVALID_HANDLE_VALUE) close();
+    }
+
+    // Function to create or truncate a file and map `expected` bytes of it
+    bool open(const std::string& path, uint64_t expected) {
+        file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS,
+                           FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            error = GetLastError();
+            return false;
         }
-        else if (input.substr(0, 6) == "export") {
-            std::string filename = "print_jobs_export.csv";
-            size_t pos = input.find(' ', 6);
-            if (pos != std::string::npos) {
-                filename = input.substr(pos + 1);
-            }
-            
-            if (filename.length() > 0) {
-                exportToCSV(filename);
-            } else {
-                std::cout << "Please specify a filename for export." << std::endl;
-            }
+        used = 0;
+        failed = false;
+        if (map(std::max(expected, mappedWriterMinimum))) return true;
+        CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+        return false;
+    }
+
+    // Function to get room for `bytes` at the write position, extending the mapping if needed
+    char* reserve(size_t bytes) {
+        if (failed) return nullptr;
+        if (used + bytes > capacity && !map(std::max(capacity + capacity / 2, used + bytes))) return nullptr;
+        return view + used;
+    }
+
+    // Function to mark everything up to `end` in the view as written
+    void commit(const char* end) {
+        used = static_cast<uint64_t>(end - view);
+    }
+
+    bool write(const char* data, size_t size) {
+        char* out = reserve(size);
+        if (!out) return false;
+        std::memcpy(out, data, size);
+        commit(out + size);
+        return true;
+    }
+
+    bool write(const std::string& text) {
+        return write(text.data(), text.size());
+    }
+
+    // Function to unmap the file and truncate it to the bytes written
+    bool close() {
+        if (file == INVALID_HANDLE_VALUE) return false;
+        unmap();
+        LARGE_INTEGER size;
+        size.QuadPart = static_cast<LONGLONG>(used);
+        if (!SetFilePointerEx(file, size, NULL, FILE_BEGIN) || !SetEndOfFile(file)) {
+            failed = true;
+            error = GetLastError();
+        }
+        CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+        return !failed;
+    }
+
+    // Function to (re)map the file at a new size; CreateFileMapping extends the file to it
+    bool map(uint64_t size) {
+        unmap();
+        mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, static_cast<DWORD>(size >> 32),
+                                     static_cast<DWORD>(size & 0xffffffffULL), NULL);
+        view = mapping ? static_cast<char*>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0)) : nullptr;
+        if (!view) {
+            failed = true;
+            error = GetLastError();
+            unmap();
+            return false;
+        }
+        capacity = size;
+        return true;
+    }
+
+    void unmap() {
+        if (view) UnmapViewOfFile(view);
+        if (mapping) CloseHandle(mapping);
+        view = nullptr;
+        mapping = NULL;
+    }
+};
+
+// Function to time writing the same jobs as CSV through each export path, against a memcpy of the output
+int runExportBenchmark(size_t count) {
+    static const char* const printers[] = {"Office_HP_LaserJet_4250", "\\\\printsrv01\\Floor3-Color",
+                                           "Brother HL-L2350DW series", "Canon iR-ADV C5535"};
+    static const char* const users[] = {"jsmith", "Jürgen Müller", "akowalski", "mlopez"};
+    static const char* const statuses[] = {"Printing", "Spooling", "Paused", "Completed"};
+    std::cout << "Generating " << count << " jobs..." << std::endl;
+    std::vector<PrintJob> jobs(count);
+    for (size_t i = 0; i < count; ++i) {
+        PrintJob& job = jobs[i];
+        job.printerName = printers[i % std::size(printers)];
+        job.timestamp = "2026-10-17T09:" + std::to_string(10 + i % 50) + ":00.000+00:00";
+        job.status = statuses[i % std::size(statuses)];
+        job.pages = static_cast<int>(1 + i % 40);
+        job.documentSize = static_cast<int>(4096 + i * 37 % 2000000);
+        job.colorMode = i % 3 ? "Monochrome" : "Color";
+        job.duplexSetting = i % 2 ? "Simplex" : "Duplex Vertical";
+        job.paperSize = i % 5 ? "A4" : "Letter";
+        job.userAccount = i % 97 ? users[i % std::size(users)] : "o\"brien";  // A few quotes to escape
+        job.jobId = std::to_string(1000 + i);
+    }
+
+    std::string expected = csvHeader;
+    for (const auto& job : jobs) appendCsvRow(expected, job);
+    const std::string path = "print_monitor_export_bench.tmp";
+    std::cout << "Writing " << expected.size() / (1024 * 1024) << " MB per path..." << std::endl;
+    startWorkerPool(ioWritePool, ioWriteThreads);
+
+    bool allOk = true;
+    auto report = [&](const char* label, std::chrono::steady_clock::time_point started, bool ok, bool checkFile) {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        if (checkFile) {
+            std::ifstream written(path, std::ios::binary);
+            std::string content((std::istreambuf_iterator<char>(written)), std::istreambuf_iterator<char>());
+            ok = ok && content == expected;
+        }
+        allOk = allOk && ok;
+        char text[128];
+        std::snprintf(text, sizeof(text), "%-22s%10.1f MB/s%10.1f ms%s", label,
+                      static_cast<double>(expected.size()) / 1e6 / std::max(seconds, 1e-9), seconds * 1000,
+                      ok ? "" : "  FAILED");
+        std::cout << text << std::endl;
+    };
+
+    {
+        // Baseline: the finished bytes copied into memory that has already been touched
+        std::vector<char> target(expected.size());
+        std::memcpy(target.data(), expected.data(), expected.size());
+        auto started = std::chrono::steady_clock::now();
+        std::memcpy(target.data(), expected.data(), expected.size());
+        report("memcpy", started, target.back() == expected.back(), false);
+
+        // The formatter on its own, into the same memory
+        started = std::chrono::steady_clock::now();
+        char* out = target.data();
+        out = std::copy(csvHeader.begin(), csvHeader.end(), out);
+        for (const auto& job : jobs) out = formatCsvRow(out, job);
+        report("format into memory", started, std::memcmp(target.data(), expected.data(), expected.size()) == 0, false);
+    }
+    {
+        auto started = std::chrono::steady_clock::now();
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file << csvHeader;
+        for (const auto& job : jobs) {
+            auto field = [&file](const std::string& value) {
+                file << '"';
+                for (char c : value) {
+                    if (c == '"') file << '"';
+                    file << c;
+                }
+                file << '"';
+            };
+            field(job.printerName);
+            file << ',';
+            field(job.timestamp);
+            file << ',';
+            field(job.status);
+            file << ',' << job.pages << ',' << job.documentSize << ',';
+            field(job.colorMode);
+            file << ',';
+            field(job.duplexSetting);
+            file << ',';
+            field(job.paperSize);
+            file << ',';
+            field(job.userAccount);
+            file << ',';
+            field(job.jobId);
+            file << "\r\n";
+        }
+        file.close();
+        report("std::ofstream <<", started, static_cast<bool>(file), true);
+    }
+    {
+        auto started = std::chrono::steady_clock::now();
+        AsyncFile file;
+        bool ok = file.open(path, false);
+        file.write(csvHeader);
+        std::string text;
+        for (const auto& job : jobs) {
+            appendCsvRow(text, job);
+            if (text.size() >= 16 * 1024) {
+                file.write(text);
+                text.clear();
+            }
+        }
+        file.write(text);
+        ok = file.close() && ok;
+        report("AsyncFile", started, ok, true);
+    }
+    for (int pass = 0; pass < 2; ++pass) {
+        // Second pass starts from half the estimate, so the mapping has to grow
+        auto started = std::chrono::steady_clock::now();
+        uint64_t estimate = csvHeader.size();
+        for (const auto& job : jobs) estimate += csvTextLength(job) + csvRowOverhead;
+        MappedFileWriter file;
+        bool ok = file.open(path, pass == 0 ? estimate : estimate / 2) && file.write(csvHeader);
+        for (size_t i = 0; ok && i < jobs.size(); ++i) {
+            char* out = file.reserve(csvRowBound(jobs[i]));
+            if (!out) break;
+            file.commit(formatCsvRow(out, jobs[i]));
+        }
+        ok = file.close() && ok;
+        report(pass == 0 ? "mapped" : "mapped, growing", started, ok, true);
+    }
+
+    stopWorkerPool(ioWritePool);
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+    return allOk ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------------
+// Binary structured logging
+//
+// Hot-path callers record a static format ID plus raw arguments instead of
+// building a text line. Strings are interned only while binary logging is
+// on, and referenced by ID; each thread caches the IDs it has seen, so only
+// its first use of a string takes the intern lock. Records are appended to an in-memory buffer that is flushed to
+// print_monitor.blog in large writes; `print_monitor --decode-log <file>`
+// renders them as text offline.
+//
+// Record layout (little-endian):
+//   u16 format ID, u8 argument count, u8 reserved, u64 timestamp (ns since
+//   epoch), then per argument u8 type followed by u64 value.
+// Format ID 0 defines an interned string: u32 string ID, u32 length, bytes.
+// Each session starts with the 8-byte magic "PMBLOG01", which also resets
+// the decoder's string table.
+// ---------------------------------------------------------------------------
+
+enum LogFormatId : uint16_t {
+    LOGFMT_STRING_DEFINITION = 0,
+    LOGFMT_JOB_DETECTED,
+    LOGFMT_NO_PRINTERS,
+    LOGFMT_ENUM_PRINTERS_FAILED,
+    LOGFMT_ENUM_JOBS_FAILED,
+    LOGFMT_OPEN_PRINTER_FAILED,
+    LOGFMT_SPOOLER_CALL_TIMED_OUT,
+    LOGFMT_COUNT
+};
+
+enum LogArgType : uint8_t {
+    LOGARG_INT = 1,
+    LOGARG_UINT,
+    LOGARG_ERROR_CODE,
+    LOGARG_STRING_ID
+};
+
+// Static format table; each '%' is replaced by the next argument
+struct LogFormat {
+    LogLevel level;
+    const char* text;
+};
+
+constexpr LogFormat logFormats[LOGFMT_COUNT] = {
+    { LogLevel::Info,  "" },
+    { LogLevel::Info,  "Detected print job: % on % - Status: %" },
+    { LogLevel::Warn,  "No printers found during monitoring cycle" },
+    { LogLevel::Error, "Failed to enumerate printers. Error: %" },
+    { LogLevel::Error, "Failed to enumerate jobs on %. Error: %" },
+    { LogLevel::Error, "Could not open printer: %. Error: %" },
+    { LogLevel::Error, "Spooler call timed out on printer: %. Error: %" }
+};
+
+// A string argument carries its text until the event is logged; the binary
+// path interns it into value, the text path renders it directly
+struct LogArg {
+    uint8_t type;
+    uint64_t value;
+    const std::string* text = nullptr;
+};
+
+const char binaryLogMagic[8] = { 'P', 'M', 'B', 'L', 'O', 'G', '0', '1' };
+const char* binaryLogFileName = "print_monitor.blog";
+const size_t binaryLogFlushThreshold = 64 * 1024;
+
+std::atomic<bool> binaryLogEnabled{false};
+std::vector<char> binaryLogBuffer;
+std::mutex binaryLogBufferMutex;
+std::mutex binaryLogFileMutex;       // Serializes writes to the .blog file
+AsyncFile binaryLogFile;             // Open while there is binary logging to write; guarded by binaryLogFileMutex
+std::unordered_map<std::string, uint32_t> internedStringIds;
+std::vector<std::string> internedStrings;
+std::mutex internMutex;              // Always taken before binaryLogBufferMutex; IDs are never reused
+
+inline LogArg logInt(long long value) { return { LOGARG_INT, static_cast<uint64_t>(value) }; }
+inline LogArg logUint(unsigned long long value) { return { LOGARG_UINT, value }; }
+inline LogArg logErrorCode(DWORD code) { return { LOGARG_ERROR_CODE, code }; }
+
+// Append raw bytes to a binary log buffer
+inline void appendBytes(std::vector<char>& buffer, const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+// Append a string definition record; caller holds internMutex and binaryLogBufferMutex
+void appendStringDefinition(uint32_t id, const std::string& value) {
+    uint16_t formatId = LOGFMT_STRING_DEFINITION;
+    uint8_t argCount = 0, reserved = 0;
+    uint64_t nanos = 0;
+    uint32_t length = static_cast<uint32_t>(value.size());
+    appendBytes(binaryLogBuffer, &formatId, sizeof(formatId));
+    appendBytes(binaryLogBuffer, &argCount, sizeof(argCount));
+    appendBytes(binaryLogBuffer, &reserved, sizeof(reserved));
+    appendBytes(binaryLogBuffer, &nanos, sizeof(nanos));
+    appendBytes(binaryLogBuffer, &id, sizeof(id));
+    appendBytes(binaryLogBuffer, &length, sizeof(length));
+    appendBytes(binaryLogBuffer, value.data(), value.size());
+}
+
+// Wrap a string as a log argument; it must outlive the LOG_EVENT that uses it
+inline LogArg logString(const std::string& value) { return { LOGARG_STRING_ID, 0, &value }; }
+
+// Return a string's binary log ID, interning it on first use. Each thread
+// caches the IDs it has looked up, so only its first use of a string locks.
+// A cached ID stays valid across sessions: IDs are never reused, and each
+// session starts by redefining every interned string.
+uint32_t internLogString(const std::string& value) {
+    thread_local std::unordered_map<std::string, uint32_t> threadIds;
+    auto cached = threadIds.find(value);
+    if (cached != threadIds.end()) {
+        return cached->second;
+    }
+
+    uint32_t id;
+    {
+        std::lock_guard<std::mutex> lock(internMutex);
+        auto it = internedStringIds.find(value);
+        if (it != internedStringIds.end()) {
+            id = it->second;
+        } else {
+            id = static_cast<uint32_t>(internedStrings.size());
+            internedStringIds.emplace(value, id);
+            internedStrings.push_back(value);
+            if (binaryLogEnabled) {
+                std::lock_guard<std::mutex> bufferLock(binaryLogBufferMutex);
+                appendStringDefinition(id, value);
+            }
+        }
+    }
+    threadIds.emplace(value, id);
+    return id;
+}
+
+// Render a format with its arguments; lookupString resolves interned string IDs
+template <typename Lookup>
+std::string renderLogEvent(uint16_t formatId, const LogArg* args, size_t argCount, Lookup lookupString) {
+    if (formatId >= LOGFMT_COUNT) {
+        return "<unknown format " + std::to_string(formatId) + ">";
+    }
+
+    std::string text;
+    size_t next = 0;
+    for (const char* p = logFormats[formatId].text; *p; ++p) {
+        if (*p != '%' || next >= argCount) {
+            text += *p;
+            continue;
+        }
+        const LogArg& arg = args[next++];
+        switch (arg.type) {
+            case LOGARG_INT: text += std::to_string(static_cast<long long>(arg.value)); break;
+            case LOGARG_STRING_ID:
+                text += arg.text ? *arg.text : lookupString(static_cast<uint32_t>(arg.value));
+                break;
+            default: text += std::to_string(arg.value); break;
+        }
+    }
+    return text;
+}
+
+// Write the buffered records to disk
+void flushBinaryLog() {
+    std::unique_lock<std::mutex> bufferLock(binaryLogBufferMutex);
+    if (binaryLogBuffer.empty()) return;
+
+    std::vector<char> pending;
+    pending.swap(binaryLogBuffer);
+    binaryLogBuffer.reserve(binaryLogFlushThreshold + 4096);  // Appends until the next flush do not reallocate
+    // Take the file lock before releasing the buffer so flushes stay in order
+    std::lock_guard<std::mutex> fileLock(binaryLogFileMutex);
+    bufferLock.unlock();
+
+    if (!binaryLogFile.isOpen() && !binaryLogFile.open(binaryLogFileName, true)) return;
+    binaryLogFile.write(pending.data(), pending.size());
+    binaryLogFile.submit();
+}
+
+// Function to finish the binary log's outstanding writes and close it
+void closeBinaryLogFile() {
+    flushBinaryLog();
+    std::lock_guard<std::mutex> fileLock(binaryLogFileMutex);
+    binaryLogFile.close();
+}
+
+// Append one event record to the binary log buffer
+void recordLogEvent(LogFormatId formatId, const LogArg* args, size_t argCount) {
+    uint64_t nanos = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    uint16_t id = formatId;
+    uint8_t count = static_cast<uint8_t>(argCount), reserved = 0;
+
+    // Assemble the record on the stack so the buffer lock covers a single append
+    char record[12 + 9 * 255];
+    char* out = record;
+    auto put = [&out](const void* data, size_t size) {
+        std::memcpy(out, data, size);
+        out += size;
+    };
+    put(&id, sizeof(id));
+    put(&count, sizeof(count));
+    put(&reserved, sizeof(reserved));
+    put(&nanos, sizeof(nanos));
+    for (size_t i = 0; i < argCount; ++i) {
+        put(&args[i].type, sizeof(args[i].type));
+        put(&args[i].value, sizeof(args[i].value));
+    }
+
+    bool flush;
+    {
+        std::lock_guard<std::mutex> lock(binaryLogBufferMutex);
+        appendBytes(binaryLogBuffer, record, out - record);
+        flush = binaryLogBuffer.size() >= binaryLogFlushThreshold;
+    }
+    if (flush) {
+        flushBinaryLog();
+    }
+}
+
+// Log a structured event: binary record when enabled, text line otherwise; LOG_EVENT has checked the level
+template <typename... Args>
+void logEvent(LogFormatId formatId, Args... args) {
+    LogArg argArray[sizeof...(Args) + 1] = { args... };
+    if (binaryLogEnabled) {
+        for (LogArg& arg : argArray) {
+            if (arg.text) arg.value = internLogString(*arg.text);
+        }
+        recordLogEvent(formatId, argArray, sizeof...(Args));
+        return;
+    }
+
+    // Every string argument carries its text, so the text path interns nothing
+    std::string text = renderLogEvent(formatId, argArray, sizeof...(Args), [](uint32_t) {
+        return std::string("<?>");
+    });
+    logFormatted(logFormats[formatId].level, text);
+}
+
+// Structured counterpart of PM_LOG: events below the compile-time level
+// generate no code, and the arguments of events below the runtime level
+// (including string interning) are never evaluated
+#define LOG_EVENT(formatId, ...)                                            \
+    do {                                                                    \
+        if constexpr (logLevelCompiledIn(logFormats[formatId].level)) {     \
+            if (logLevelEnabled(logFormats[formatId].level)) {              \
+                logEvent(formatId, ##__VA_ARGS__);                          \
+            }                                                               \
+        }                                                                   \
+    } while (0)
+
+// Switch binary logging on or off
+void setBinaryLogging(bool enabled) {
+    {
+        std::lock_guard<std::mutex> lock(internMutex);
+        if (enabled == binaryLogEnabled) return;
+
+        if (enabled) {
+            // Start a new session: magic header plus every string interned so far
+            std::lock_guard<std::mutex> bufferLock(binaryLogBufferMutex);
+            appendBytes(binaryLogBuffer, binaryLogMagic, sizeof(binaryLogMagic));
+            for (uint32_t id = 0; id < internedStrings.size(); ++id) {
+                appendStringDefinition(id, internedStrings[id]);
+            }
+        }
+        binaryLogEnabled = enabled;
+    }
+    if (enabled) {
+        flushBinaryLog();
+    } else {
+        closeBinaryLogFile();
+    }
+    if (enabled) {
+        LOG_INFO("Binary logging enabled (", binaryLogFileName, ").");
+    } else {
+        LOG_INFO("Binary logging disabled.");
+    }
+}
+
+// Function to time a log call with its level disabled and, for binary events, enabled
+int runLogBenchmark(size_t events) {
+    // Lines the benchmark logs itself go only to the memory ring
+    long long savedLevels[LOG_SINK_COUNT];
+    for (int sink = 0; sink < LOG_SINK_COUNT; ++sink) {
+        savedLevels[sink] = logSinks[sink].level;
+        logSinks[sink].level = sink == LOG_SINK_MEMORY ? static_cast<long long>(LogLevel::Info) : logSinkOff;
+    }
+    long long savedThreshold = logLevelThreshold;
+    const char* savedFileName = binaryLogFileName;
+    binaryLogFileName = "print_monitor_log_bench.tmp";
+    startWorkerPool(ioWritePool, ioWriteThreads);
+
+    const std::string printer = "Office_HP_LaserJet_4250", status = "Printing";
+    auto time = [events](const char* label, auto&& call) {
+        auto started = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < events; ++i) call(i);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        char text[128];
+        std::snprintf(text, sizeof(text), "%-44s%8.1f ns/call", label, seconds * 1e9 / std::max<size_t>(events, 1));
+        std::cout << text << std::endl;
+    };
+    std::cout << "Events: " << events << std::endl;
+
+    logLevelThreshold = static_cast<long long>(LogLevel::Error);
+    time("LOG_EVENT, level disabled", [&](size_t i) {
+        LOG_EVENT(LOGFMT_JOB_DETECTED, logUint(i), logString(printer), logString(status));
+    });
+    time("LOG_DEBUG, level disabled or compiled out", [&](size_t i) { LOG_DEBUG("Poll cycle: ", i, " jobs decoded"); });
+
+    logLevelThreshold = static_cast<long long>(LogLevel::Info);
+    setBinaryLogging(true);
+    time("LOG_EVENT, binary, two strings", [&](size_t i) {
+        LOG_EVENT(LOGFMT_JOB_DETECTED, logUint(i), logString(printer), logString(status));
+    });
+    time("LOG_EVENT, binary, integer only", [&](size_t i) {
+        LOG_EVENT(LOGFMT_ENUM_PRINTERS_FAILED, logErrorCode(static_cast<DWORD>(i)));
+    });
+    setBinaryLogging(false);
+
+    std::error_code ec;
+    uintmax_t written = std::filesystem::file_size(binaryLogFileName, ec);
+    std::filesystem::remove(binaryLogFileName, ec);
+    stopWorkerPool(ioWritePool);
+    binaryLogFileName = savedFileName;
+    logLevelThreshold = savedThreshold;
+    for (int sink = 0; sink < LOG_SINK_COUNT; ++sink) logSinks[sink].level = savedLevels[sink];
+
+    // Two records per event: 12 bytes of header, then 9 bytes per argument
+    uintmax_t expected = events * (12 + 3 * 9) + events * (12 + 9);
+    std::cout << "Binary log: " << written << " bytes, at least " << expected << " expected" << std::endl;
+    return written >= expected ? 0 : 1;
+}
+
+// Offline decoder: render a binary log file as text on stdout
+int decodeBinaryLog(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Could not open binary log: " << filename << std::endl;
+        return 1;
+    }
+    std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    std::vector<std::string> strings;
+    size_t pos = 0;
+    auto read = [&](void* out, size_t size) {
+        if (pos + size > data.size()) return false;
+        memcpy(out, data.data() + pos, size);
+        pos += size;
+        return true;
+    };
+
+    while (pos < data.size()) {
+        if (data.size() - pos >= sizeof(binaryLogMagic) &&
+            memcmp(data.data() + pos, binaryLogMagic, sizeof(binaryLogMagic)) == 0) {
+            strings.clear();
+            pos += sizeof(binaryLogMagic);
+            continue;
+        }
+
+        uint16_t formatId;
+        uint8_t argCount, reserved;
+        uint64_t nanos;
+        if (!read(&formatId, sizeof(formatId)) || !read(&argCount, sizeof(argCount)) ||
+            !read(&reserved, sizeof(reserved)) || !read(&nanos, sizeof(nanos))) {
+            std::cerr << "Truncated record at offset " << pos << std::endl;
+            return 1;
+        }
+
+        if (formatId == LOGFMT_STRING_DEFINITION) {
+            uint32_t id, length;
+            if (!read(&id, sizeof(id)) || !read(&length, sizeof(length)) || pos + length > data.size()) {
+                std::cerr << "Truncated string definition at offset " << pos << std::endl;
+                return 1;
+            }
+            if (strings.size() <= id) strings.resize(id + 1);
+            strings[id].assign(data.data() + pos, length);
+            pos += length;
+            continue;
+        }
+
+        std::vector<LogArg> args(argCount);
+        for (auto& arg : args) {
+            if (!read(&arg.type, sizeof(arg.type)) || !read(&arg.value, sizeof(arg.value))) {
+                std::cerr << "Truncated arguments at offset " << pos << std::endl;
+                return 1;
+            }
+        }
+
+        auto when = std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::nanoseconds(nanos)));
+        const char* level = formatId < LOGFMT_COUNT ? logLevelName(logFormats[formatId].level) : "UNKNOWN";
+        std::cout << "[" << formatTimestamp(when) << "] [" << level << "] "
+                  << renderLogEvent(formatId, args.data(), args.size(), [&](uint32_t id) {
+                         return id < strings.size() ? strings[id] : std::string("<?>");
+                     })
+                  << "\n";
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Log sinks
+//
+// writeLogEntry copies each line into the queue of every sink whose level
+// (log.<sink>.level) it meets. The file, console and syslog sinks each have a
+// writer thread that drains its own queue, so a slow console or a blocked
+// socket never delays the file or the caller. A queue holds at most
+// log.<sink>.buffer_lines lines; past that, lines for that sink are dropped
+// and counted. With log.<sink>.flush_ms at 0 a writer writes and flushes as
+// soon as lines arrive; otherwise it lets them collect for up to that long
+// (or until its queue is half full) and writes them as one batch. The memory
+// sink is a ring of the last log.memory.lines lines kept for `tail`; it is
+// appended to directly, as that costs no more than queueing would.
+//
+// The syslog sink sends each line as an RFC 5424 datagram (facility local0)
+// to the local syslog port, 127.0.0.1:log.syslog.port.
+//
+// The file writer owns the active print_monitor.log, so rotating it never
+// blocks anyone who logs. When
+// the active file exceeds log.max_bytes or log.max_age_hours it is renamed to
+// print_monitor-<timestamp>.log and a fresh file is opened in its place
+// before the next line is written. Rotated files are compressed with the
+// Windows Compression API (XPRESS Huffman) on a separate thread, and only the
+// newest log.retention_count archives are kept.
+// ---------------------------------------------------------------------------
+
+const char* rotatedLogPrefix = "print_monitor-";
+const char* compressedLogExtension = ".xpress";
+
+std::deque<std::string> compressionQueue;
+std::mutex compressionMutex;
+std::condition_variable compressionCondition;
+bool compressionStopRequested = false;
+std::thread compressionThread;
+
+// Function to read a whole file into memory
+bool readFileBytes(const std::string& filename, std::vector<char>& data) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) return false;
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// Function to compress a file with the Windows Compression API
+bool compressFile(const std::string& source, const std::string& target) {
+    std::vector<char> input;
+    if (!readFileBytes(source, input)) return false;
+
+    COMPRESSOR_HANDLE compressor = NULL;
+    if (!CreateCompressor(COMPRESS_ALGORITHM_XPRESS_HUFF, NULL, &compressor)) return false;
+
+    // First call to get required buffer size
+    SIZE_T compressedSize = 0;
+    Compress(compressor, input.data(), input.size(), NULL, 0, &compressedSize);
+    std::vector<char> output(compressedSize);
+    BOOL ok = Compress(compressor, input.data(), input.size(), output.data(), output.size(), &compressedSize);
+    CloseCompressor(compressor);
+    if (!ok) return false;
+
+    // Write to a temporary name first so a partial archive is never picked up
+    std::string temporary = target + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) return false;
+        file.write(output.data(), static_cast<std::streamsize>(compressedSize));
+        if (!file) return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(temporary, target, ec);
+    return !ec;
+}
+
+// Offline tool: decompress a rotated log archive to stdout
+int decompressLogFile(const std::string& filename) {
+    std::vector<char> input;
+    if (!readFileBytes(filename, input)) {
+        std::cerr << "Could not open archive: " << filename << std::endl;
+        return 1;
+    }
+
+    DECOMPRESSOR_HANDLE decompressor = NULL;
+    if (!CreateDecompressor(COMPRESS_ALGORITHM_XPRESS_HUFF, NULL, &decompressor)) {
+        std::cerr << "Could not create decompressor. Error: " << GetLastError() << std::endl;
+        return 1;
+    }
+
+    // First call to get required buffer size
+    SIZE_T size = 0;
+    Decompress(decompressor, input.data(), input.size(), NULL, 0, &size);
+    std::vector<char> output(size);
+    BOOL ok = Decompress(decompressor, input.data(), input.size(), output.data(), output.size(), &size);
+    CloseDecompressor(decompressor);
+    if (!ok) {
+        std::cerr << "Could not decompress " << filename << ". Error: " << GetLastError() << std::endl;
+        return 1;
+    }
+
+    _setmode(_fileno(stdout), _O_BINARY);
+    std::cout.write(output.data(), static_cast<std::streamsize>(size));
+    return 0;
+}
+
+// Function to delete the oldest rotated logs beyond the retention count
+void pruneRotatedLogs() {
+    std::vector<std::string> queued;
+    {
+        std::lock_guard<std::mutex> lock(compressionMutex);
+        queued.assign(compressionQueue.begin(), compressionQueue.end());
+    }
+    auto endsWith = [](const std::string& name, const char* suffix) {
+        size_t length = strlen(suffix);
+        return name.size() >= length && name.compare(name.size() - length, length, suffix) == 0;
+    };
+
+    // Finished archives only: .xpress files, and .log files whose compression failed.
+    // Logs still waiting to be compressed, and .tmp output, are neither counted nor removed.
+    std::vector<std::string> archives;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(".", ec)) {
+        std::string name = entry.path().filename().string();
+        if (name.compare(0, strlen(rotatedLogPrefix), rotatedLogPrefix) != 0) continue;
+        bool finished = endsWith(name, compressedLogExtension) ||
+                        (endsWith(name, ".log") && std::find(queued.begin(), queued.end(), name) == queued.end());
+        if (finished) archives.push_back(name);
+    }
+
+    // Timestamped names sort chronologically
+    std::sort(archives.begin(), archives.end());
+    size_t keep = static_cast<size_t>(std::max(0LL, logRetentionCount.load()));
+    for (size_t i = 0; i + keep < archives.size(); ++i) {
+        std::filesystem::remove(archives[i], ec);
+    }
+}
+
+// Compression thread: compresses rotated logs until asked to stop
+void compressRotatedLogs() {
+    std::unique_lock<std::mutex> lock(compressionMutex);
+    while (true) {
+        compressionCondition.wait(lock, [] { return compressionStopRequested || !compressionQueue.empty(); });
+        if (compressionQueue.empty()) break;
+
+        std::string path = compressionQueue.front();
+        compressionQueue.pop_front();
+        lock.unlock();
+
+        std::error_code ec;
+        if (compressFile(path, path + compressedLogExtension)) {
+            std::filesystem::remove(path, ec);
+        } else {
+            LOG_WARN("Could not compress rotated log: ", path, ". It is kept uncompressed.");
+        }
+        pruneRotatedLogs();
+
+        lock.lock();
+    }
+}
+
+// Function to rename the active log and reopen a fresh one in its place
+void rotateLogFile(AsyncFile& logFile) {
+    logFile.close();
+
+    std::string stamp = getCurrentTimestamp().substr(0, 23);
+    std::replace(stamp.begin(), stamp.end(), ':', '-');
+    std::string rotated = rotatedLogPrefix + stamp + ".log";
+    for (int n = 1; std::filesystem::exists(rotated); ++n) {
+        rotated = rotatedLogPrefix + stamp + "-" + std::to_string(n) + ".log";
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(logFileName, rotated, ec);
+    logFile.open(logFileName, true);
+
+    if (!ec) {
+        std::lock_guard<std::mutex> lock(compressionMutex);
+        compressionQueue.push_back(rotated);
+        compressionCondition.notify_one();
+    }
+}
+
+std::atomic<long long> syslogPort{514};
+
+// Function to wait for a sink's next batch under its flush policy; returns false once stopped and drained
+bool takeLogBatch(LogSink& sink, std::deque<LogLine>& pending) {
+    std::unique_lock<std::mutex> lock(sink.mutex);
+    // Wake up periodically so age-based rotation happens on quiet logs too
+    sink.condition.wait_for(lock, std::chrono::seconds(1), [&] { return sink.stopRequested || !sink.queue.empty(); });
+
+    long long flushMs = sink.flushMs.load();
+    if (flushMs > 0 && !sink.queue.empty()) {
+        size_t capacity = static_cast<size_t>(std::max(1LL, sink.bufferLines.load()));
+        sink.condition.wait_until(lock, sink.lastFlush + std::chrono::milliseconds(flushMs), [&] {
+            return sink.stopRequested || sink.queue.size() * 2 >= capacity;
+        });
+    }
+    pending.swap(sink.queue);
+    if (pending.empty() && sink.stopRequested) {
+        // Later lines fall back to direct writes in writeLogEntry
+        sink.running = false;
+        return false;
+    }
+    return true;
+}
+
+// File sink thread: drains its queue into the active file and rotates it
+void logWriterLoop() {
+    LogSink& sink = logSinks[LOG_SINK_FILE];
+    AsyncFile logFile;
+    logFile.open(logFileName, true);
+    std::error_code ec;
+    uintmax_t existingSize = std::filesystem::file_size(logFileName, ec);
+    long long fileSize = ec ? 0 : static_cast<long long>(existingSize);
+    auto openedAt = std::chrono::steady_clock::now();
+
+    std::deque<LogLine> pending;
+    while (takeLogBatch(sink, pending)) {
+        // Lines end in CRLF in the file, as they do when written in text mode
+        std::string text;
+        for (const auto& line : pending) {
+            size_t length = line.text.size() - (!line.text.empty() && line.text.back() == '\n');
+            text.append(line.text, 0, length);
+            if (length < line.text.size()) text += "\r\n";
+        }
+        logFile.write(text);
+        fileSize += static_cast<long long>(text.size());
+        sink.delivered += pending.size();
+        pending.clear();
+        logFile.submit();
+        sink.lastFlush = std::chrono::steady_clock::now();
+
+        bool tooLarge = logMaxBytes > 0 && fileSize >= logMaxBytes;
+        bool tooOld = logMaxAgeHours > 0 &&
+                      std::chrono::steady_clock::now() - openedAt >= std::chrono::hours(logMaxAgeHours.load());
+        if (fileSize > 0 && (tooLarge || tooOld)) {
+            rotateLogFile(logFile);
+            fileSize = 0;
+            openedAt = std::chrono::steady_clock::now();
+        }
+    }
+}
+
+// Console sink thread: errors go to stderr, everything else to stdout
+void consoleWriterLoop() {
+    LogSink& sink = logSinks[LOG_SINK_CONSOLE];
+    std::deque<LogLine> pending;
+    while (takeLogBatch(sink, pending)) {
+        if (pending.empty()) continue;
+        for (const auto& line : pending) {
+            (line.level == LogLevel::Error ? std::cerr : std::cout) << line.text;
+        }
+        std::cout.flush();
+        sink.delivered += pending.size();
+        pending.clear();
+        sink.lastFlush = std::chrono::steady_clock::now();
+    }
+}
+
+// Syslog sink thread: one UDP datagram per line to the local syslog port
+void syslogWriterLoop() {
+    LogSink& sink = logSinks[LOG_SINK_SYSLOG];
+    WSADATA wsaData;
+    bool winsockStarted = WSAStartup(MAKEWORD(2, 2), &wsaData) == 0;
+    SOCKET socketHandle = winsockStarted ? socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP) : INVALID_SOCKET;
+    char hostName[256] = "-";
+    if (winsockStarted) gethostname(hostName, sizeof(hostName));
+    std::string header = std::string(" ") + hostName + " print_monitor " +
+                         std::to_string(GetCurrentProcessId()) + " - - ";
+
+    std::deque<LogLine> pending;
+    while (takeLogBatch(sink, pending)) {
+        sockaddr_in target{};
+        target.sin_family = AF_INET;
+        target.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        target.sin_port = htons(static_cast<u_short>(syslogPort.load()));
+        for (const auto& line : pending) {
+            // Severity: 3 error, 4 warning, 6 informational, 7 debug; facility local0 (16)
+            int severity = line.level == LogLevel::Error ? 3 : line.level == LogLevel::Warn ? 4
+                         : line.level == LogLevel::Info ? 6 : 7;
+            // The line is "[timestamp] [LEVEL] message\n"; syslog carries the timestamp and message
+            size_t stampEnd = line.text.find(']');
+            size_t messageStart = std::min(line.text.find("] ", stampEnd + 1) + 2, line.text.size());
+            std::string datagram = "<" + std::to_string(16 * 8 + severity) + ">1 " +
+                                   line.text.substr(1, stampEnd - 1) + header;
+            datagram.append(line.text, messageStart, line.text.size() - 1 - messageStart);
+            if (socketHandle == INVALID_SOCKET ||
+                sendto(socketHandle, datagram.data(), static_cast<int>(datagram.size()), 0,
+                       reinterpret_cast<const sockaddr*>(&target), sizeof(target)) == SOCKET_ERROR) {
+                ++sink.dropped;
+            } else {
+                ++sink.delivered;
+            }
+        }
+        pending.clear();
+        sink.lastFlush = std::chrono::steady_clock::now();
+    }
+
+    if (socketHandle != INVALID_SOCKET) closesocket(socketHandle);
+    if (winsockStarted) WSACleanup();
+}
+
+// Function to start a sink's writer thread
+void startLogSink(LogSink& sink, void (*loop)()) {
+    {
+        std::lock_guard<std::mutex> lock(sink.mutex);
+        if (sink.running) return;
+        sink.running = true;
+        sink.stopRequested = false;
+    }
+    sink.lastFlush = std::chrono::steady_clock::now();
+    sink.thread = std::thread(loop);
+}
+
+// Function to let a sink's writer thread drain its queue and exit
+void stopLogSink(LogSink& sink) {
+    {
+        std::lock_guard<std::mutex> lock(sink.mutex);
+        sink.stopRequested = true;
+    }
+    sink.condition.notify_all();
+    if (sink.thread.joinable()) {
+        sink.thread.join();
+    }
+}
+
+// Start the log sink and compression threads
+void startLogWriter() {
+    if (logSinks[LOG_SINK_FILE].thread.joinable()) return;
+    compressionStopRequested = false;
+    startLogSink(logSinks[LOG_SINK_FILE], logWriterLoop);
+    startLogSink(logSinks[LOG_SINK_CONSOLE], consoleWriterLoop);
+    startLogSink(logSinks[LOG_SINK_SYSLOG], syslogWriterLoop);
+    compressionThread = std::thread(compressRotatedLogs);
+}
+
+// Flush pending lines and stop the log sink and compression threads
+void stopLogWriter() {
+    stopLogSink(logSinks[LOG_SINK_SYSLOG]);
+    stopLogSink(logSinks[LOG_SINK_CONSOLE]);
+    stopLogSink(logSinks[LOG_SINK_FILE]);
+
+    {
+        std::lock_guard<std::mutex> lock(compressionMutex);
+        compressionStopRequested = true;
+    }
+    compressionCondition.notify_all();
+    if (compressionThread.joinable()) {
+        compressionThread.join();
+    }
+}
+
+// Function to print the last lines kept by the memory sink: "tail [lines]"
+void showLogTail(const std::string& args, std::ostream& out) {
+    long long count = 20;
+    std::istringstream(args) >> count;
+    std::vector<std::string> lines;
+    {
+        LogSink& sink = logSinks[LOG_SINK_MEMORY];
+        std::lock_guard<std::mutex> lock(sink.mutex);
+        size_t first = sink.queue.size() > static_cast<size_t>(std::max(0LL, count))
+            ? sink.queue.size() - static_cast<size_t>(count) : 0;
+        for (size_t i = first; i < sink.queue.size(); ++i) {
+            lines.push_back(sink.queue[i].text);
+        }
+    }
+    for (const auto& line : lines) {
+        out << line;
+    }
+    out.flush();
+}
+
+// Function to print each sink's level and delivered/dropped counts
+void showLogSinkStatistics(std::ostream& out) {
+    out << "Log sinks:" << std::endl;
+    for (auto& sink : logSinks) {
+        long long level = sink.level.load();
+        size_t queued;
+        {
+            std::lock_guard<std::mutex> lock(sink.mutex);
+            queued = &sink == &logSinks[LOG_SINK_MEMORY] ? 0 : sink.queue.size();
+        }
+        out << "  " << std::left << std::setw(8) << sink.name << std::right
+                  << (level >= logSinkOff ? "off" : logLevelName(static_cast<LogLevel>(level)))
+                  << ", " << sink.delivered << " delivered, " << sink.dropped << " dropped, "
+                  << queued << " queued" << std::endl;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// UTF-16 to UTF-8 conversion
+//
+// Printer, location and user names come from the wide spooler APIs as UTF-16
+// and are stored as UTF-8. Almost all of them are plain ASCII, so
+// wideStringToUtf8 narrows eight code units at a time with SSE2 while they
+// stay below 0x80 and only encodes the rest of a string that is not, in one
+// pass into a buffer sized for the worst case, instead of asking
+// WideCharToMultiByte for the size and then for the bytes. Unpaired surrogates
+// become U+FFFD, as they do with WideCharToMultiByte. Names are short, so
+// converting them again on every poll costs less than looking them up in a
+// cache would. `print_monitor.exe --bench utf8 [strings]` times each path.
+// ---------------------------------------------------------------------------
+
+using WideString = std::basic_string<WCHAR>;
+
+// Function to count the code units of a NUL-terminated wide string
+size_t wideStringLength(const WCHAR* wideStr) {
+    size_t length = 0;
+    while (wideStr[length]) ++length;
+    return length;
+}
+
+// Function to encode UTF-16 as UTF-8 one code unit at a time; out needs 3 bytes per unit
+size_t encodeUtf16Scalar(const WCHAR* wideStr, size_t length, char* out) {
+    unsigned char* p = reinterpret_cast<unsigned char*>(out);
+    for (size_t i = 0; i < length; ++i) {
+        uint32_t unit = static_cast<uint16_t>(wideStr[i]);
+        if (unit < 0x80) {
+            *p++ = static_cast<unsigned char>(unit);
+            continue;
+        }
+        if (unit < 0x800) {
+            *p++ = static_cast<unsigned char>(0xC0 | (unit >> 6));
+            *p++ = static_cast<unsigned char>(0x80 | (unit & 0x3F));
+            continue;
+        }
+        uint32_t codePoint = unit;
+        if (unit >= 0xD800 && unit <= 0xDFFF) {
+            uint32_t next = i + 1 < length ? static_cast<uint16_t>(wideStr[i + 1]) : 0;
+            if (unit <= 0xDBFF && next >= 0xDC00 && next <= 0xDFFF) {
+                codePoint = 0x10000 + ((unit - 0xD800) << 10) + (next - 0xDC00);
+                ++i;
+            } else {
+                codePoint = 0xFFFD;  // Unpaired surrogate
+            }
+        }
+        if (codePoint >= 0x10000) {
+            *p++ = static_cast<unsigned char>(0xF0 | (codePoint >> 18));
+            *p++ = static_cast<unsigned char>(0x80 | ((codePoint >> 12) & 0x3F));
+        } else {
+            *p++ = static_cast<unsigned char>(0xE0 | (codePoint >> 12));
+        }
+        *p++ = static_cast<unsigned char>(0x80 | ((codePoint >> 6) & 0x3F));
+        *p++ = static_cast<unsigned char>(0x80 | (codePoint & 0x3F));
+    }
+    return p - reinterpret_cast<unsigned char*>(out);
+}
+
+// Function to copy the leading ASCII code units as bytes; returns how many were copied
+size_t narrowAsciiPrefix(const WCHAR* wideStr, size_t length, char* out) {
+    size_t i = 0;
+#ifdef PRINT_MONITOR_X86
+    static_assert(sizeof(WCHAR) == 2, "the SSE2 path reads UTF-16 code units");
+    const __m128i nonAscii = _mm_set1_epi16(static_cast<short>(0xFF80));
+    for (; i + 8 <= length; i += 8) {
+        __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i*>(wideStr + i));
+        __m128i high = _mm_and_si128(units, nonAscii);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128())) != 0xFFFF) break;
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(units, units));
+    }
+#endif
+    for (; i < length && static_cast<uint16_t>(wideStr[i]) < 0x80; ++i) {
+        out[i] = static_cast<char>(wideStr[i]);
+    }
+    return i;
+}
+
+// Function to convert a UTF-16 string of known length to UTF-8
+std::string wideStringToUtf8(const WCHAR* wideStr, size_t length) {
+    char stackBuffer[3 * 128];  // Printer and user names fit, so the result is the only allocation
+    std::string heapBuffer;
+    char* out = stackBuffer;
+    if (length > 128) {
+        heapBuffer.resize(length * 3);
+        out = heapBuffer.data();
+    }
+    size_t written = narrowAsciiPrefix(wideStr, length, out);
+    if (written < length) {
+        written += encodeUtf16Scalar(wideStr + written, length - written, out + written);
+    }
+    if (out == stackBuffer) return std::string(stackBuffer, written);
+    heapBuffer.resize(written);
+    return heapBuffer;
+}
+
+// Function to convert wide string to UTF-8 string
+std::string wideStringToUtf8(const WCHAR* wideStr) {
+    if (!wideStr) return "";
+    return wideStringToUtf8(wideStr, wideStringLength(wideStr));
+}
+
+// Function to time the converter on synthetic printer and user names and check its output
+int runUtf8Benchmark(size_t count) {
+    static const char16_t* const samples[] = {
+        u"Office_HP_LaserJet_4250", u"\\\\printsrv01\\Floor3-Color", u"jsmith", u"Brother HL-L2350DW series",
+        u"Jürgen Müller", u"第二会議室プリンタ",
+        u"Café Étage 2", u"Lab \U0001F5A8 Printer", u"Canon iR-ADV C5535",
+    };
+    std::cout << "Generating " << count << " names (two thirds ASCII)..." << std::endl;
+    std::vector<WideString> names;
+    names.reserve(count);
+    size_t totalUnits = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const char16_t* sample = samples[i % std::size(samples)];
+        WideString name;
+        for (const char16_t* p = sample; *p; ++p) name.push_back(static_cast<WCHAR>(*p));
+        if (i % 7 == 0) name += static_cast<WCHAR>('0' + i % 10);  // A few distinct variants
+        totalUnits += name.size();
+        names.push_back(std::move(name));
+    }
+
+    bool match = true;
+    for (size_t i = 0; i < std::min<size_t>(count, std::size(samples)); ++i) {
+        std::string scalar(names[i].size() * 3, '\0');
+        scalar.resize(encodeUtf16Scalar(names[i].data(), names[i].size(), scalar.data()));
+        match = match && scalar == wideStringToUtf8(names[i].c_str());
+        int size = WideCharToMultiByte(CP_UTF8, 0, names[i].c_str(), -1, NULL, 0, NULL, NULL);
+        std::string system(size > 0 ? size - 1 : 0, '\0');
+        if (size > 0) WideCharToMultiByte(CP_UTF8, 0, names[i].c_str(), -1, system.data(), size, NULL, NULL);
+        match = match && scalar == system;
+    }
+
+    // Kernels write into a reused buffer; WideCharToMultiByte and wideStringToUtf8 include building the std::string
+    char out[3 * 128];
+    auto timePath = [&](const char* label, auto&& convert) {
+        size_t bytes = 0;
+        auto started = std::chrono::steady_clock::now();
+        for (const auto& name : names) bytes += convert(name);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        char line[128];
+        std::snprintf(line, sizeof(line), "%-24s%10.1f ns/name%10.0f MB/s in  (%zu bytes out)", label,
+                      seconds * 1e9 / std::max<size_t>(1, count),
+                      totalUnits * sizeof(WCHAR) / std::max(seconds, 1e-9) / 1e6, bytes);
+        std::cout << line << std::endl;
+    };
+    timePath("WideCharToMultiByte x2", [](const WideString& name) {
+        int size = WideCharToMultiByte(CP_UTF8, 0, name.c_str(), -1, NULL, 0, NULL, NULL);
+        std::string result(size > 0 ? size - 1 : 0, '\0');
+        if (size > 0) WideCharToMultiByte(CP_UTF8, 0, name.c_str(), -1, result.data(), size, NULL, NULL);
+        return result.size();
+    });
+    timePath("scalar kernel", [&](const WideString& name) {
+        return encodeUtf16Scalar(name.data(), name.size(), out);
+    });
+    timePath("SSE2 ASCII + scalar", [&](const WideString& name) {
+        size_t ascii = narrowAsciiPrefix(name.data(), name.size(), out);
+        return ascii + encodeUtf16Scalar(name.data() + ascii, name.size() - ascii, out + ascii);
+    });
+    timePath("wideStringToUtf8", [](const WideString& name) { return wideStringToUtf8(name.c_str()).size(); });
+
+    std::cout << (match ? "All paths agree." : "MISMATCH between conversion paths.") << std::endl;
+    return match ? 0 : 1;
+}
+
+// Function to get color mode from device mode
+std::string getColorMode(const DEVMODEW* pDevMode) {
+    if (!pDevMode) return "Unknown";
+    
+    if (pDevMode->dmFields & DM_COLOR) {
+        return (pDevMode->dmColor == DMCOLOR_COLOR) ? "Color" : "Monochrome";
+    }
+    return "Unknown";
+}
+
+// Function to get duplex setting from device mode
+std::string getDuplexSetting(const DEVMODEW* pDevMode) {
+    if (!pDevMode) return "Unknown";
+    
+    if (pDevMode->dmFields & DM_DUPLEX) {
+        switch(pDevMode->dmDuplex) {
+            case DMDUP_SIMPLEX: return "Simplex";
+            case DMDUP_VERTICAL: return "Duplex Vertical";
+            case DMDUP_HORIZONTAL: return "Duplex Horizontal";
+            default: return "Unknown";
+        }
+    }
+    return "Unknown";
+}
+
+// Function to get paper size from device mode
+std::string getPaperSize(const DEVMODEW* pDevMode) {
+    if (!pDevMode) return "Unknown";
+    
+    if (pDevMode->dmFields & DM_PAPERSIZE) {
+        switch(pDevMode->dmPaperSize) {
+            case DMPAPER_LETTER: return "Letter";
+            case DMPAPER_LEGAL: return "Legal";
+            case DMPAPER_A4: return "A4";
+            case DMPAPER_A3: return "A3";
+            case DMPAPER_A5: return "A5";
+            default: return "Custom";
+        }
+    }
+    return "Unknown";
+}
+
+// Function to get current user
+std::string getCurrentUser() {
+    WCHAR username[UNLEN + 1];
+    DWORD username_len = UNLEN + 1;
+    if (GetUserNameW(username, &username_len)) {
+        return wideStringToUtf8(username);
+    }
+    return "Unknown";
+}
+
+// ---------------------------------------------------------------------------
+// Timer-wheel scheduler
+//
+// All periodic work (per-printer polls, inventory housekeeping, autosave and
+// statistics rollups) runs as timers on one hierarchical timer wheel instead
+// of a thread with its own sleep loop per activity. The wheel has
+// timerWheelLevels levels of 64 slots with a 100 ms tick; each slot holds an
+// intrusive doubly linked list of timer nodes, so inserting and cancelling a
+// timer is O(1). Timers further out than the lowest level are cascaded down
+// as the wheel turns. A single thread advances the wheel and hands due timers
+// to a small worker pool; a periodic timer is re-armed when its callback
+// returns, so a slow callback never runs concurrently with itself.
+// ---------------------------------------------------------------------------
+
+const int timerWheelLevels = 4;
+const int timerWheelSlotBits = 6;
+const uint64_t timerWheelSlots = 1ULL << timerWheelSlotBits;
+const uint64_t timerWheelMaxTicks = 1ULL << (timerWheelSlotBits * timerWheelLevels);
+const std::chrono::milliseconds timerTick(100);
+const size_t schedulerWorkerCount = 4;
+
+typedef uint64_t TimerHandle;  // 0 is never a valid handle
+
+struct TimerNode {
+    enum State : uint8_t { Free, Pending, Running };
+
+    std::function<void()> callback;
+    const char* kind = "";
+    uint64_t expiryTick = 0;
+    uint64_t periodTicks = 0;      // 0 for one-shot timers
+    uint32_t generation = 0;       // Bumped when the node is freed, invalidating old handles
+    int32_t prev = -1;             // Slot list links while Pending
+    int32_t next = -1;
+    int32_t* slotHead = nullptr;
+    State state = Free;
+    bool cancelled = false;
+};
+
+// Due timer handed to a worker
+struct TimerDispatch {
+    int32_t node;
+    std::chrono::steady_clock::time_point due;
+};
+
+// Scheduler state, guarded by schedulerMutex. Nodes live in a deque so
+// references stay valid while workers run callbacks outside the lock.
+std::deque<TimerNode> timerNodes;
+std::vector<int32_t> freeTimerNodes;
+int32_t timerWheel[timerWheelLevels][timerWheelSlots];
+uint64_t currentTimerTick = 0;
+std::chrono::steady_clock::time_point schedulerEpoch;
+std::deque<TimerDispatch> dueTimers;
+size_t runningTimerCallbacks = 0;
+bool schedulerStopRequested = false;
+std::mutex schedulerMutex;
+std::condition_variable dueTimersCondition;
+std::condition_variable timerIdleCondition;
+std::thread schedulerThread;
+std::vector<std::thread> schedulerWorkers;
+
+// Observability
+uint64_t timersFired = 0;
+uint64_t timerLatenessTotalMicros = 0;
+uint64_t timerLatenessMaxMicros = 0;
+
+inline TimerHandle makeTimerHandle(int32_t node, uint32_t generation) {
+    return (static_cast<uint64_t>(generation) << 32) | static_cast<uint32_t>(node + 1);
+}
+
+// Function to resolve a handle to its node; caller holds schedulerMutex
+TimerNode* lookupTimer(TimerHandle handle) {
+    int64_t index = static_cast<int64_t>(handle & 0xffffffffULL) - 1;
+    if (index < 0 || index >= static_cast<int64_t>(timerNodes.size())) return nullptr;
+    TimerNode& node = timerNodes[static_cast<size_t>(index)];
+    if (node.state == TimerNode::Free || node.generation != static_cast<uint32_t>(handle >> 32)) return nullptr;
+    return &node;
+}
+
+// Function to link a node into the slot for its expiry; caller holds schedulerMutex
+void linkTimer(int32_t index) {
+    TimerNode& node = timerNodes[index];
+    if (node.expiryTick < currentTimerTick) node.expiryTick = currentTimerTick;
+
+    // Timers beyond the wheel's range park in the top level and are re-placed when cascaded
+    uint64_t placeTick = std::min(node.expiryTick, currentTimerTick + timerWheelMaxTicks - 1);
+    uint64_t delta = placeTick - currentTimerTick;
+    int level = 0;
+    while (level < timerWheelLevels - 1 && delta >= (1ULL << (timerWheelSlotBits * (level + 1)))) {
+        ++level;
+    }
+    uint64_t slot = (placeTick >> (timerWheelSlotBits * level)) & (timerWheelSlots - 1);
+
+    node.slotHead = &timerWheel[level][slot];
+    node.prev = -1;
+    node.next = *node.slotHead;
+    if (node.next >= 0) timerNodes[node.next].prev = index;
+    *node.slotHead = index;
+    node.state = TimerNode::Pending;
+}
+
+// Function to unlink a pending node from its slot in O(1); caller holds schedulerMutex
+void unlinkTimer(int32_t index) {
+    TimerNode& node = timerNodes[index];
+    if (node.prev >= 0) {
+        timerNodes[node.prev].next = node.next;
+    } else {
+        *node.slotHead = node.next;
+    }
+    if (node.next >= 0) timerNodes[node.next].prev = node.prev;
+    node.prev = node.next = -1;
+    node.slotHead = nullptr;
+}
+
+// Function to return a node to the free list; caller holds schedulerMutex
+void freeTimer(int32_t index) {
+    TimerNode& node = timerNodes[index];
+    node.callback = nullptr;
+    node.state = TimerNode::Free;
+    ++node.generation;
+    freeTimerNodes.push_back(index);
+}
+
+// Schedule a callback after delay, then every period (zero for a one-shot timer)
+TimerHandle scheduleTimer(const char* kind, std::chrono::milliseconds delay, std::chrono::milliseconds period,
+                          std::function<void()> callback) {
+    std::lock_guard<std::mutex> lock(schedulerMutex);
+    int32_t index;
+    if (!freeTimerNodes.empty()) {
+        index = freeTimerNodes.back();
+        freeTimerNodes.pop_back();
+    } else {
+        index = static_cast<int32_t>(timerNodes.size());
+        timerNodes.emplace_back();
+    }
+
+    TimerNode& node = timerNodes[index];
+    node.callback = std::move(callback);
+    node.kind = kind;
+    node.cancelled = false;
+    // Round up so a timer never fires early
+    node.expiryTick = currentTimerTick + static_cast<uint64_t>((delay.count() + timerTick.count() - 1) / timerTick.count());
+    node.periodTicks = period.count() > 0
+        ? std::max<uint64_t>(1, static_cast<uint64_t>((period.count() + timerTick.count() - 1) / timerTick.count()))
+        : 0;
+    linkTimer(index);
+    return makeTimerHandle(index, node.generation);
+}
+
+// Cancel a timer in O(1). A callback that is already running finishes, but is not re-armed.
+bool cancelTimer(TimerHandle handle) {
+    std::lock_guard<std::mutex> lock(schedulerMutex);
+    TimerNode* node = lookupTimer(handle);
+    if (!node || node->cancelled) return false;
+
+    int32_t index = static_cast<int32_t>((handle & 0xffffffffULL) - 1);
+    if (node->state == TimerNode::Pending) {
+        unlinkTimer(index);
+        freeTimer(index);
+    } else {
+        node->cancelled = true;
+    }
+    return true;
+}
+
+// Wait until no timer callback is running
+void waitForTimerCallbacks() {
+    std::unique_lock<std::mutex> lock(schedulerMutex);
+    timerIdleCondition.wait(lock, [] { return runningTimerCallbacks == 0 && dueTimers.empty(); });
+}
+
+// Function to move every node of a slot back through linkTimer; caller holds schedulerMutex
+void cascadeTimerSlot(int level, uint64_t slot) {
+    int32_t index = timerWheel[level][slot];
+    timerWheel[level][slot] = -1;
+    while (index >= 0) {
+        int32_t next = timerNodes[index].next;
+        linkTimer(index);
+        index = next;
+    }
+}
+
+// Function to process one tick: cascade higher levels, then dispatch the due slot
+void advanceTimerWheel() {
+    uint64_t tick = currentTimerTick;
+
+    // Cascade every level whose lower levels just wrapped, highest first, so
+    // nodes moving down several levels are handled in this same tick
+    int top = 0;
+    while (top + 1 < timerWheelLevels && (tick & ((1ULL << (timerWheelSlotBits * (top + 1))) - 1)) == 0) {
+        ++top;
+    }
+    for (int level = top; level >= 1; --level) {
+        cascadeTimerSlot(level, (tick >> (timerWheelSlotBits * level)) & (timerWheelSlots - 1));
+    }
+
+    uint64_t slot = tick & (timerWheelSlots - 1);
+    int32_t index = timerWheel[0][slot];
+    timerWheel[0][slot] = -1;
+    while (index >= 0) {
+        TimerNode& node = timerNodes[index];
+        int32_t next = node.next;
+        node.prev = node.next = -1;
+        node.slotHead = nullptr;
+        if (node.expiryTick > tick) {
+            linkTimer(index);  // Parked beyond the wheel's range
+        } else {
+            node.state = TimerNode::Running;
+            dueTimers.push_back({ index, schedulerEpoch + timerTick * static_cast<int64_t>(node.expiryTick) });
+        }
+        index = next;
+    }
+    currentTimerTick = tick + 1;
+}
+
+// Scheduler thread: advances the wheel in real time
+void runTimerWheel() {
+    std::unique_lock<std::mutex> lock(schedulerMutex);
+    while (!schedulerStopRequested) {
+        auto nextTickAt = schedulerEpoch + timerTick * static_cast<int64_t>(currentTimerTick);
+        lock.unlock();
+        std::this_thread::sleep_until(nextTickAt);
+        lock.lock();
+
+        // Catch up on any ticks missed while the thread was descheduled
+        auto now = std::chrono::steady_clock::now();
+        bool dispatched = false;
+        while (schedulerEpoch + timerTick * static_cast<int64_t>(currentTimerTick) <= now) {
+            size_t before = dueTimers.size();
+            advanceTimerWheel();
+            dispatched = dispatched || dueTimers.size() != before;
+        }
+        if (dispatched) dueTimersCondition.notify_all();
+    }
+}
+
+// Worker thread: runs due timer callbacks and re-arms periodic timers
+void runTimerCallbacks() {
+    std::unique_lock<std::mutex> lock(schedulerMutex);
+    while (true) {
+        dueTimersCondition.wait(lock, [] { return schedulerStopRequested || !dueTimers.empty(); });
+        if (dueTimers.empty()) break;
+
+        TimerDispatch dispatch = dueTimers.front();
+        dueTimers.pop_front();
+        TimerNode& node = timerNodes[dispatch.node];
+        ++runningTimerCallbacks;
+
+        auto lateness = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - dispatch.due).count();
+        uint64_t latenessMicros = static_cast<uint64_t>(std::max<int64_t>(0, lateness));
+        ++timersFired;
+        timerLatenessTotalMicros += latenessMicros;
+        timerLatenessMaxMicros = std::max(timerLatenessMaxMicros, latenessMicros);
+
+        if (!node.cancelled) {
+            lock.unlock();
+            try {
+                node.callback();
+            } catch (const std::exception& e) {
+                LOG_ERROR("Timer '", node.kind, "' failed: ", e.what());
+            }
+            lock.lock();
+        }
+
+        if (node.periodTicks > 0 && !node.cancelled && !schedulerStopRequested) {
+            node.expiryTick = currentTimerTick + node.periodTicks;
+            linkTimer(dispatch.node);
+        } else {
+            freeTimer(dispatch.node);
+        }
+
+        --runningTimerCallbacks;
+        if (runningTimerCallbacks == 0 && dueTimers.empty()) timerIdleCondition.notify_all();
+    }
+}
+
+// Start the wheel thread and worker pool
+void startScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(schedulerMutex);
+        for (auto& level : timerWheel) {
+            std::fill(std::begin(level), std::end(level), -1);
+        }
+        currentTimerTick = 0;
+        schedulerEpoch = std::chrono::steady_clock::now();
+        schedulerStopRequested = false;
+    }
+    schedulerThread = std::thread(runTimerWheel);
+    for (size_t i = 0; i < schedulerWorkerCount; ++i) {
+        schedulerWorkers.emplace_back(runTimerCallbacks);
+    }
+}
+
+// Stop the scheduler after the callbacks already due have run
+void stopScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(schedulerMutex);
+        schedulerStopRequested = true;
+    }
+    dueTimersCondition.notify_all();
+    if (schedulerThread.joinable()) {
+        schedulerThread.join();
+    }
+    for (auto& worker : schedulerWorkers) {
+        worker.join();
+    }
+    schedulerWorkers.clear();
+}
+
+// Function to print timer counts by kind and dispatch lateness
+void showSchedulerStatistics(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(schedulerMutex);
+    std::map<std::string, int> pendingByKind;
+    size_t active = 0;
+    for (const auto& node : timerNodes) {
+        if (node.state == TimerNode::Free) continue;
+        ++active;
+        pendingByKind[node.kind]++;
+    }
+
+    out << "Scheduler: " << active << " timers, " << runningTimerCallbacks << " running, "
+              << timersFired << " fired" << std::endl;
+    for (const auto& pair : pendingByKind) {
+        out << "  " << pair.first << ": " << pair.second << std::endl;
+    }
+    if (timersFired > 0) {
+        char lateness[96];
+        snprintf(lateness, sizeof(lateness), "average %.1f ms, maximum %.1f ms",
+                 timerLatenessTotalMicros / 1000.0 / timersFired, timerLatenessMaxMicros / 1000.0);
+        out << "Timer lateness: " << lateness << std::endl;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Printer inventory
+//
+// The printer list changes rarely, so it is enumerated only when the local
+// spooler signals a printer being added or removed, or every
+// inventory.refresh_minutes as a fallback (which also picks up changes to
+// per-user connections that raise no notification). Each printer gets a
+// stable ID, its index in printerInventory, that is never reused; printers
+// that disappear stay in the table marked as absent.
+// ---------------------------------------------------------------------------
+
+struct PrinterRecord {
+    uint32_t id = 0;
+    std::string name;        // Printer name as passed to OpenPrinter
+    WideString wideName;     // The same name as UTF-16 for OpenPrinterW; set by each refresh
+    std::string location;
+    bool present = false;    // Seen in the latest enumeration
+    long long pollIntervalSeconds = 0;  // 0 uses poll.interval_seconds
+};
+
+std::vector<PrinterRecord> printerInventory;
+std::unordered_map<std::string, uint32_t> printerIdsByName;
+std::mutex inventoryMutex;
+std::atomic<long long> inventoryRefreshMinutes{60};
+std::atomic<uint64_t> inventoryRefreshCount{0};
+
+// Owned by the monitoring thread
+HANDLE printServerHandle = NULL;
+HANDLE printerChangeNotification = NULL;
+std::chrono::steady_clock::time_point lastInventoryRefresh;
+
+// Printers added, removed and present after an enumeration is applied
+struct InventoryChange {
+    size_t added = 0;
+    size_t removed = 0;
+    size_t present = 0;
+};
+
+// Function to update the inventory table from an enumeration: new printers get
+// the next ID, known ones keep theirs, and those not listed are marked absent
+InventoryChange applyPrinterEnumeration(const PRINTER_INFO_2W* printers, DWORD count) {
+    InventoryChange change;
+    std::lock_guard<std::mutex> lock(inventoryMutex);
+    std::vector<bool> seen(printerInventory.size(), false);
+
+    for (DWORD i = 0; i < count; ++i) {
+        std::string name = wideStringToUtf8(printers[i].pPrinterName);
+        auto it = printerIdsByName.find(name);
+        uint32_t id;
+        if (it == printerIdsByName.end()) {
+            id = static_cast<uint32_t>(printerInventory.size());
+            printerIdsByName.emplace(name, id);
+            printerInventory.push_back(PrinterRecord());
+            printerInventory.back().id = id;
+            printerInventory.back().name = name;
+            seen.push_back(false);
+        } else {
+            id = it->second;
+        }
+
+        PrinterRecord& record = printerInventory[id];
+        if (!record.present) ++change.added;
+        record.present = true;
+        record.wideName = printers[i].pPrinterName;
+        record.location = wideStringToUtf8(printers[i].pLocation);
+        seen[id] = true;
+    }
+
+    for (auto& record : printerInventory) {
+        if (record.present && !seen[record.id]) {
+            record.present = false;
+            ++change.removed;
+        }
+        if (record.present) ++change.present;
+    }
+    return change;
+}
+
+// Function to enumerate printers and update the inventory table
+bool refreshPrinterInventory() {
+    DWORD flags = PRINTER_ENUM_LOCAL | PRINTER_ENUM_CONNECTIONS;
+    DWORD bytesNeeded = 0;
+    DWORD numPrinters = 0;
+
+    // First call to get required buffer size
+    EnumPrintersW(flags, NULL, 2, NULL, 0, &bytesNeeded, &numPrinters);
+
+    std::vector<BYTE> buffer(bytesNeeded);
+    PRINTER_INFO_2W* pPrinterInfo2 = reinterpret_cast<PRINTER_INFO_2W*>(buffer.data());
+
+    // Get printer information
+    if (bytesNeeded > 0 &&
+        !EnumPrintersW(flags, NULL, 2, reinterpret_cast<LPBYTE>(pPrinterInfo2), bytesNeeded, &bytesNeeded, &numPrinters)) {
+        LOG_EVENT(LOGFMT_ENUM_PRINTERS_FAILED, logErrorCode(GetLastError()));
+        return false;
+    }
+    if (bytesNeeded == 0) {
+        numPrinters = 0;
+    }
+
+    InventoryChange change = applyPrinterEnumeration(pPrinterInfo2, numPrinters);
+    ++inventoryRefreshCount;
+    lastInventoryRefresh = std::chrono::steady_clock::now();
+    LOG_INFO("Printer inventory refreshed: ", change.present, " printers (", change.added, " added, ",
+             change.removed, " removed)");
+    return true;
+}
+
+// Function to register for printer add/remove notifications on the local print server
+void openPrinterChangeNotification() {
+    if (!OpenPrinterW(NULL, &printServerHandle, NULL)) {
+        LOG_WARN("Could not open the local print server for change notifications. Error: ", GetLastError(),
+                 ". Falling back to periodic inventory refresh.");
+        printServerHandle = NULL;
+        return;
+    }
+
+    printerChangeNotification = FindFirstPrinterChangeNotification(
+        printServerHandle, PRINTER_CHANGE_ADD_PRINTER | PRINTER_CHANGE_DELETE_PRINTER, 0, NULL);
+    if (printerChangeNotification == INVALID_HANDLE_VALUE) {
+        LOG_WARN("Could not register for printer change notifications. Error: ", GetLastError(),
+                 ". Falling back to periodic inventory refresh.");
+        printerChangeNotification = NULL;
+    }
+}
+
+void closePrinterChangeNotification() {
+    if (printerChangeNotification) {
+        FindClosePrinterChangeNotification(printerChangeNotification);
+        printerChangeNotification = NULL;
+    }
+    if (printServerHandle) {
+        ClosePrinter(printServerHandle);
+        printServerHandle = NULL;
+    }
+}
+
+// Function to check whether a notification or the refresh cadence calls for re-enumeration
+bool printerInventoryStale() {
+    if (printerChangeNotification && WaitForSingleObject(printerChangeNotification, 0) == WAIT_OBJECT_0) {
+        // Re-arm the notification before re-enumerating
+        DWORD change = 0;
+        FindNextPrinterChangeNotification(printerChangeNotification, &change, NULL, NULL);
+        return true;
+    }
+
+    long long minutes = inventoryRefreshMinutes;
+    return minutes > 0 && std::chrono::steady_clock::now() - lastInventoryRefresh >= std::chrono::minutes(minutes);
+}
+
+// Function to copy the printers present in the latest enumeration
+std::vector<PrinterRecord> presentPrinters() {
+    std::lock_guard<std::mutex> lock(inventoryMutex);
+    std::vector<PrinterRecord> printers;
+    for (const auto& record : printerInventory) {
+        if (record.present) printers.push_back(record);
+    }
+    return printers;
+}
+
+// Fingerprints of the JOB_INFO_2 fields we record, per printer and job ID.
+// The outer map is guarded by fingerprintsMutex; a printer's own table is
+// only changed by that printer's poll, which never runs concurrently, under
+// the table's mutex so a snapshot can read it.
+struct JobFingerprint {
+    uint64_t value = 0;
+    uint64_t lastSeenPoll = 0;
+    DWORD status = 0;           // JOB_INFO_2 Status at the last poll
+    DWORD pagesPrinted = 0;     // PagesPrinted and TotalPages at the last poll
+    DWORD totalPages = 0;
+};
+
+struct PrinterFingerprints {
+    std::unordered_map<DWORD, JobFingerprint> jobs;
+    uint64_t polls = 0;
+    std::mutex mutex;
+};
+
+// Keyed by printer ID; shared so a poll in flight keeps its table alive if the
+// printer leaves the inventory meanwhile
+std::unordered_map<uint32_t, std::shared_ptr<PrinterFingerprints>> jobFingerprints;
+std::mutex fingerprintsMutex;
+std::atomic<uint64_t> jobsDecodedTotal{0};       // New or changed jobs fully decoded
+std::atomic<uint64_t> jobsUnchangedTotal{0};     // Jobs skipped because their fingerprint matched
+std::atomic<uint64_t> lastCycleJobsDecoded{0};
+std::atomic<uint64_t> lastCycleJobsUnchanged{0};
+
+// Function to mix a value into a 64-bit fingerprint (splitmix64 finalizer)
+inline uint64_t mixFingerprint(uint64_t hash, uint64_t value) {
+    uint64_t x = hash ^ (value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2));
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Function to fingerprint Status, TotalPages, PagesPrinted, Size and the DEVMODE bits we decode
+uint64_t fingerprintJob(const JOB_INFO_2W& info) {
+    uint64_t hash = mixFingerprint(0, info.Status);
+    hash = mixFingerprint(hash, (static_cast<uint64_t>(info.TotalPages) << 32) | info.PagesPrinted);
+    hash = mixFingerprint(hash, info.Size);
+    if (info.pDevMode) {
+        const DEVMODEW* pDevMode = info.pDevMode;
+        DWORD fields = pDevMode->dmFields & (DM_COLOR | DM_DUPLEX | DM_PAPERSIZE);
+        hash = mixFingerprint(hash, (static_cast<uint64_t>(fields) << 32) |
+                                    (static_cast<uint64_t>(static_cast<uint16_t>(pDevMode->dmColor)) << 16) |
+                                    static_cast<uint16_t>(pDevMode->dmDuplex));
+        hash = mixFingerprint(hash, static_cast<uint16_t>(pDevMode->dmPaperSize));
+    }
+    return hash;
+}
+
+enum class JobChange {
+    Unchanged,
+    Changed,
+    New
+};
+
+// Function to compare a job with its last fingerprint and record the new one;
+// previous receives the fingerprint from the last poll (all zero for a new job)
+JobChange compareJobFingerprint(PrinterFingerprints& printer, const JOB_INFO_2W& info, uint64_t poll,
+                                JobFingerprint& previous) {
+    uint64_t value = fingerprintJob(info);
+    auto result = printer.jobs.try_emplace(info.JobId);
+    JobFingerprint& fingerprint = result.first->second;
+    JobChange change = result.second ? JobChange::New
+                     : fingerprint.value != value ? JobChange::Changed : JobChange::Unchanged;
+    previous = fingerprint;
+    fingerprint.value = value;
+    fingerprint.lastSeenPoll = poll;
+    fingerprint.status = info.Status;
+    fingerprint.pagesPrinted = info.PagesPrinted;
+    fingerprint.totalPages = info.TotalPages;
+    return change;
+}
+
+// Function to check whether a job has just gone into Error or Paper Out
+inline bool jobEnteredFault(DWORD previousStatus, DWORD status) {
+    const DWORD faults = JOB_STATUS_ERROR | JOB_STATUS_PAPEROUT;
+    return (status & faults) != 0 && (previousStatus & faults) == 0;
+}
+
+// Jobs that left a printer's queue, with their last fingerprint
+using DepartedJobs = std::vector<std::pair<DWORD, JobFingerprint>>;
+
+// Function to forget fingerprints of jobs not seen in the given poll; returns those jobs
+DepartedJobs pruneJobFingerprints(PrinterFingerprints& printer, uint64_t poll) {
+    DepartedJobs departed;
+    for (auto it = printer.jobs.begin(); it != printer.jobs.end();) {
+        if (it->second.lastSeenPoll == poll) {
+            ++it;
+        } else {
+            departed.push_back(*it);
+            it = printer.jobs.erase(it);
+        }
+    }
+    return departed;
+}
+
+// Function to get a printer's fingerprint table, creating it on first use
+std::shared_ptr<PrinterFingerprints> fingerprintsForPrinter(uint32_t printerId) {
+    std::lock_guard<std::mutex> lock(fingerprintsMutex);
+    std::shared_ptr<PrinterFingerprints>& table = jobFingerprints[printerId];
+    if (!table) table = std::make_shared<PrinterFingerprints>();
+    return table;
+}
+
+// Function to drop the fingerprints of a printer that left the inventory
+void forgetPrinterFingerprints(uint32_t printerId) {
+    std::lock_guard<std::mutex> lock(fingerprintsMutex);
+    jobFingerprints.erase(printerId);
+}
+
+// ---------------------------------------------------------------------------
+// Columnar job table
+//
+// Statistics only need a few numeric and enumerated fields, so alongside the
+// PrintJob rows the store keeps those fields as parallel arrays, one entry per
+// row: pages, size, status, color, duplex and paper codes, printer ID, user
+// ID, detection time and cost. Aggregates then stream through a few contiguous
+// arrays instead of dragging every row's strings through the cache. The
+// columns are guarded by jobsMutex together with printJobs and are appended
+// and evicted with them.
+//
+// Sums and code histograms run in AVX2 or SSE2 kernels, picked once from the
+// CPU's features, with a scalar fallback. `print_monitor.exe --bench columns
+// [rows]` times each kernel on synthetic columns (10M rows by default).
+// ---------------------------------------------------------------------------
+
+const char* const jobStatusNames[] = {
+    "Queued", "Paused", "Error", "Deleting", "Spooling", "Printing",
+    "Offline", "Paper Out", "Deleted", "Blocked", "User Intervention Required"
+};
+const char* const colorModeNames[] = { "Unknown", "Color", "Monochrome" };
+const char* const duplexSettingNames[] = { "Unknown", "Simplex", "Duplex Vertical", "Duplex Horizontal" };
+const char* const paperSizeNames[] = { "Unknown", "Letter", "Legal", "A4", "A3", "A5", "Custom" };
+
+const uint32_t noColumnId = 0xffffffffU;  // Printer or user not known
+
+// Function to map a JOB_INFO_2 Status to its index in jobStatusNames; the first matching bit wins
+uint8_t jobStatusCode(DWORD status) {
+    static const DWORD statusBits[] = {
+        0, JOB_STATUS_PAUSED, JOB_STATUS_ERROR, JOB_STATUS_DELETING, JOB_STATUS_SPOOLING, JOB_STATUS_PRINTING,
+        JOB_STATUS_OFFLINE, JOB_STATUS_PAPEROUT, JOB_STATUS_DELETED, JOB_STATUS_BLOCKED_DEVQ,
+        JOB_STATUS_USER_INTERVENTION
+    };
+    static_assert(std::size(statusBits) == std::size(jobStatusNames), "one status bit per status name");
+    for (uint8_t code = 1; code < std::size(statusBits); ++code) {
+        if (status & statusBits[code]) return code;
+    }
+    return 0;  // Queued
+}
+
+// Function to map a decoded field to its index in a name table; unknown values map to 0
+template <size_t N>
+uint8_t columnCode(const char* const (&names)[N], const std::string& value) {
+    for (size_t i = 0; i < N; ++i) {
+        if (value == names[i]) return static_cast<uint8_t>(i);
+    }
+    return 0;
+}
+
+struct JobColumns {
+    std::vector<int32_t> pages;
+    std::vector<int32_t> documentSize;
+    std::vector<uint8_t> status;        // Index into jobStatusNames
+    std::vector<uint8_t> colorMode;     // Index into colorModeNames
+    std::vector<uint8_t> duplex;        // Index into duplexSettingNames
+    std::vector<uint8_t> paperSize;     // Index into paperSizeNames
+    std::vector<uint32_t> printerId;    // Inventory ID
+    std::vector<uint32_t> userId;       // Index into userNames
+    std::vector<int64_t> detectedAt;    // Seconds since the epoch
+    std::vector<int64_t> cost;          // Thousandths, see "Print cost accounting"
+
+    size_t size() const { return pages.size(); }
+
+    void append(const PrintJob& job, uint32_t printer, uint32_t user, int64_t timestamp, int64_t jobCost) {
+        pages.push_back(job.pages);
+        documentSize.push_back(job.documentSize);
+        status.push_back(columnCode(jobStatusNames, job.status));
+        colorMode.push_back(columnCode(colorModeNames, job.colorMode));
+        duplex.push_back(columnCode(duplexSettingNames, job.duplexSetting));
+        paperSize.push_back(columnCode(paperSizeNames, job.paperSize));
+        printerId.push_back(printer);
+        userId.push_back(user);
+        detectedAt.push_back(timestamp);
+        cost.push_back(jobCost);
+    }
+
+    void eraseFront(size_t count) {
+        auto front = [count](auto& column) { column.erase(column.begin(), column.begin() + count); };
+        front(pages); front(documentSize); front(status); front(colorMode); front(duplex);
+        front(paperSize); front(printerId); front(userId); front(detectedAt); front(cost);
+    }
+
+    void clear() { eraseFront(size()); }
+};
+
+JobColumns jobColumns;                                   // Guarded by jobsMutex
+std::vector<std::string> userNames;                      // User IDs, guarded by jobsMutex
+std::unordered_map<std::string, uint32_t> userIdsByName;
+
+// Function to get a user's column ID, assigning one on first sight; caller holds jobsMutex
+uint32_t internUser(const std::string& name) {
+    auto result = userIdsByName.try_emplace(name, static_cast<uint32_t>(userNames.size()));
+    if (result.second) userNames.push_back(name);
+    return result.first->second;
+}
+
+// Function to turn a getCurrentTimestamp() string back into seconds since the epoch
+int64_t parseTimestamp(const std::string& timestamp) {
+    std::tm tm = {};
+    if (std::sscanf(timestamp.c_str(), "%d-%d-%dT%d:%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+                    &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6) {
+        return 0;
+    }
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    return static_cast<int64_t>(std::mktime(&tm));
+}
+
+// Aggregation kernels. Each has a scalar version and, on x86, SSE2 and AVX2
+// versions; activeColumnKernel holds the best one the CPU supports.
+enum class ColumnKernel {
+    Scalar,
+    Sse2,
+    Avx2
+};
+
+const char* columnKernelName(ColumnKernel kernel) {
+    switch (kernel) {
+        case ColumnKernel::Avx2: return "AVX2";
+        case ColumnKernel::Sse2: return "SSE2";
+        default: return "scalar";
+    }
+}
+
+// Function to check for AVX2 support in both the CPU and the OS
+bool cpuSupportsAvx2() {
+#if defined(PRINT_MONITOR_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    bool osSavesYmm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+    __cpuidex(info, 7, 0);
+    return osSavesYmm && (info[1] & (1 << 5)) != 0;
+#elif defined(PRINT_MONITOR_X86)
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+ColumnKernel detectColumnKernel() {
+#if defined(PRINT_MONITOR_X86)
+    return cpuSupportsAvx2() ? ColumnKernel::Avx2 : ColumnKernel::Sse2;
+#else
+    return ColumnKernel::Scalar;
+#endif
+}
+
+const ColumnKernel activeColumnKernel = detectColumnKernel();
+
+int64_t sumInt32Scalar(const int32_t* values, size_t count) {
+    int64_t sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        sum0 += values[i];
+        sum1 += values[i + 1];
+        sum2 += values[i + 2];
+        sum3 += values[i + 3];
+    }
+    for (; i < count; ++i) sum0 += values[i];
+    return sum0 + sum1 + sum2 + sum3;
+}
+
+// Function to count the bytes equal to each code in [0, codeCount); counts must hold codeCount entries
+void countCodesScalar(const uint8_t* values, size_t count, uint64_t* counts, size_t codeCount) {
+    uint64_t bins[4][256] = {};
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        ++bins[0][values[i]];
+        ++bins[1][values[i + 1]];
+        ++bins[2][values[i + 2]];
+        ++bins[3][values[i + 3]];
+    }
+    for (; i < count; ++i) ++bins[0][values[i]];
+    for (size_t code = 0; code < codeCount; ++code) {
+        counts[code] = bins[0][code] + bins[1][code] + bins[2][code] + bins[3][code];
+    }
+}
+
+#if defined(PRINT_MONITOR_X86)
+int64_t sumInt32Sse2(const int32_t* values, size_t count) {
+    __m128i sumLow = _mm_setzero_si128();
+    __m128i sumHigh = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+        __m128i sign = _mm_srai_epi32(v, 31);  // Sign-extend to 64 bits
+        sumLow = _mm_add_epi64(sumLow, _mm_unpacklo_epi32(v, sign));
+        sumHigh = _mm_add_epi64(sumHigh, _mm_unpackhi_epi32(v, sign));
+    }
+    alignas(16) int64_t lanes[2];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes), _mm_add_epi64(sumLow, sumHigh));
+    return lanes[0] + lanes[1] + sumInt32Scalar(values + i, count - i);
+}
+
+// Blocks of 255 vectors keep the per-lane byte counters from overflowing;
+// within a block every code is counted while the block is still in L1
+void countCodesSse2(const uint8_t* values, size_t count, uint64_t* counts, size_t codeCount) {
+    const size_t block = 255 * 16;
+    std::fill(counts, counts + codeCount, 0);
+    size_t i = 0;
+    for (; i + 16 <= count;) {
+        size_t vectors = std::min(block, (count - i) & ~size_t(15)) / 16;
+        for (size_t code = 0; code < codeCount; ++code) {
+            __m128i needle = _mm_set1_epi8(static_cast<char>(code));
+            __m128i hits = _mm_setzero_si128();
+            for (size_t v = 0; v < vectors; ++v) {
+                __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i + v * 16));
+                hits = _mm_sub_epi8(hits, _mm_cmpeq_epi8(data, needle));
+            }
+            __m128i total = _mm_sad_epu8(hits, _mm_setzero_si128());
+            counts[code] += static_cast<uint64_t>(_mm_cvtsi128_si32(total)) +
+                            static_cast<uint64_t>(_mm_cvtsi128_si32(_mm_srli_si128(total, 8)));
+        }
+        i += vectors * 16;
+    }
+    for (; i < count; ++i) {
+        if (values[i] < codeCount) ++counts[values[i]];
+    }
+}
+
+PRINT_MONITOR_TARGET_AVX2
+int64_t sumInt32Avx2(const int32_t* values, size_t count) {
+    __m256i sumLow = _mm256_setzero_si256();
+    __m256i sumHigh = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        sumLow = _mm256_add_epi64(sumLow, _mm256_cvtepi32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i))));
+        sumHigh = _mm256_add_epi64(sumHigh, _mm256_cvtepi32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i + 4))));
+    }
+    alignas(32) int64_t lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), _mm256_add_epi64(sumLow, sumHigh));
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sumInt32Scalar(values + i, count - i);
+}
+
+PRINT_MONITOR_TARGET_AVX2
+void countCodesAvx2(const uint8_t* values, size_t count, uint64_t* counts, size_t codeCount) {
+    const size_t block = 255 * 32;
+    std::fill(counts, counts + codeCount, 0);
+    size_t i = 0;
+    for (; i + 32 <= count;) {
+        size_t vectors = std::min(block, (count - i) & ~size_t(31)) / 32;
+        for (size_t code = 0; code < codeCount; ++code) {
+            __m256i needle = _mm256_set1_epi8(static_cast<char>(code));
+            __m256i hits = _mm256_setzero_si256();
+            for (size_t v = 0; v < vectors; ++v) {
+                __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i + v * 32));
+                hits = _mm256_sub_epi8(hits, _mm256_cmpeq_epi8(data, needle));
+            }
+            alignas(32) uint64_t lanes[4];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), _mm256_sad_epu8(hits, _mm256_setzero_si256()));
+            counts[code] += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+        }
+        i += vectors * 32;
+    }
+    for (; i < count; ++i) {
+        if (values[i] < codeCount) ++counts[values[i]];
+    }
+}
+#endif
+
+// Function to sum an int32 column into 64 bits
+int64_t sumInt32Column(const int32_t* values, size_t count, ColumnKernel kernel = activeColumnKernel) {
+#if defined(PRINT_MONITOR_X86)
+    if (kernel == ColumnKernel::Avx2) return sumInt32Avx2(values, count);
+    if (kernel == ColumnKernel::Sse2) return sumInt32Sse2(values, count);
+#endif
+    (void)kernel;
+    return sumInt32Scalar(values, count);
+}
+
+// Function to histogram a code column; codes at or above codeCount are not counted
+void countCodesColumn(const uint8_t* values, size_t count, uint64_t* counts, size_t codeCount,
+                      ColumnKernel kernel = activeColumnKernel) {
+#if defined(PRINT_MONITOR_X86)
+    if (kernel == ColumnKernel::Avx2) return countCodesAvx2(values, count, counts, codeCount);
+    if (kernel == ColumnKernel::Sse2) return countCodesSse2(values, count, counts, codeCount);
+#endif
+    (void)kernel;
+    countCodesScalar(values, count, counts, codeCount);
+}
+
+// Function to group an ID column; scattered increments do not vectorize, so this one stays scalar
+std::vector<uint64_t> countIdsColumn(const uint32_t* values, size_t count, size_t idCount) {
+    std::vector<uint64_t> counts(idCount, 0);
+    for (size_t i = 0; i < count; ++i) {
+        if (values[i] < idCount) ++counts[values[i]];
+    }
+    return counts;
+}
+
+// Offline benchmark: time each kernel over synthetic columns and check it against the scalar result
+int runColumnBenchmark(size_t rows) {
+    std::cout << "Generating " << rows << " synthetic rows..." << std::endl;
+    std::vector<int32_t> pages(rows), sizes(rows);
+    std::vector<uint8_t> status(rows);
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    for (size_t i = 0; i < rows; ++i) {
+        state = mixFingerprint(state, i);
+        pages[i] = static_cast<int32_t>(1 + state % 200);
+        sizes[i] = static_cast<int32_t>((state >> 8) % (64 * 1024 * 1024));
+        status[i] = static_cast<uint8_t>((state >> 40) % std::size(jobStatusNames));
+    }
+
+    std::vector<ColumnKernel> kernels{ ColumnKernel::Scalar };
+#if defined(PRINT_MONITOR_X86)
+    kernels.push_back(ColumnKernel::Sse2);
+    if (cpuSupportsAvx2()) kernels.push_back(ColumnKernel::Avx2);
+#endif
+
+    // Best of several runs, in milliseconds
+    auto time = [](auto&& body) {
+        double best = 1e300;
+        for (int run = 0; run < 5; ++run) {
+            auto started = std::chrono::steady_clock::now();
+            body();
+            best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count());
+        }
+        return best;
+    };
+
+    int64_t expectedPages = sumInt32Column(pages.data(), rows, ColumnKernel::Scalar);
+    int64_t expectedSize = sumInt32Column(sizes.data(), rows, ColumnKernel::Scalar);
+    uint64_t expectedStatus[std::size(jobStatusNames)];
+    countCodesColumn(status.data(), rows, expectedStatus, std::size(jobStatusNames), ColumnKernel::Scalar);
+
+    std::cout << std::left << std::setw(8) << "kernel" << std::right << std::setw(16) << "sum pages ms"
+              << std::setw(16) << "sum size ms" << std::setw(18) << "status hist ms" << std::endl;
+    bool allMatch = true;
+    for (ColumnKernel kernel : kernels) {
+        int64_t pagesSum = 0, sizeSum = 0;
+        uint64_t statusCounts[std::size(jobStatusNames)];
+        double pagesMs = time([&] { pagesSum = sumInt32Column(pages.data(), rows, kernel); });
+        double sizeMs = time([&] { sizeSum = sumInt32Column(sizes.data(), rows, kernel); });
+        double statusMs = time([&] {
+            countCodesColumn(status.data(), rows, statusCounts, std::size(jobStatusNames), kernel);
+        });
+        bool match = pagesSum == expectedPages && sizeSum == expectedSize &&
+                     std::equal(statusCounts, statusCounts + std::size(jobStatusNames), expectedStatus);
+        allMatch = allMatch && match;
+
+        char line[128];
+        std::snprintf(line, sizeof(line), "%-8s%16.2f%16.2f%18.2f%s", columnKernelName(kernel),
+                      pagesMs, sizeMs, statusMs, match ? "" : "  MISMATCH");
+        std::cout << line << std::endl;
+    }
+    std::cout << "Active kernel: " << columnKernelName(activeColumnKernel) << std::endl;
+    return allMatch ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------------
+// Print cost accounting
+//
+// Each job is priced once, when it is recorded, and re-priced only if its
+// page count or the fields the price depends on change. The price comes from
+// cost rates: a price per page for a pattern of printer, paper size, color
+// mode and duplex setting, any of which may be a wildcard. The most specific
+// matching rate applies (ties go to the rate set last). Rates are resolved
+// into a dense per-printer table whenever they change, so pricing a job is an
+// array lookup. Costs accumulate into per-user and per-printer totals, which
+// cover all history rather than just the jobs still held in memory, so the
+// `cost` report costs the same however many jobs have been seen. Changing a
+// rate does not re-price jobs already recorded.
+//
+// Amounts are kept in thousandths of the currency unit to avoid rounding drift.
+// Cost state is guarded by jobsMutex.
+// ---------------------------------------------------------------------------
+
+const uint32_t anyCodeMask = 0xffffffffU;
+
+struct CostRate {
+    uint32_t printerId = noColumnId;  // noColumnId matches any printer
+    uint32_t paperMask = anyCodeMask;  // Bit per paperSizeNames code
+    uint32_t colorMask = anyCodeMask;  // Bit per colorModeNames code
+    uint32_t duplexMask = anyCodeMask; // Bit per duplexSettingNames code
+    int64_t pricePerPage = 0;          // Thousandths
+};
+
+const size_t costTableSize = std::size(paperSizeNames) * std::size(colorModeNames) * std::size(duplexSettingNames);
+using CostTable = std::vector<int64_t>;  // Price per page indexed by costTableIndex
+
+std::vector<CostRate> costRates;
+std::vector<CostTable> costTables;      // Resolved rates per printer ID
+std::vector<int64_t> costByUser;        // Indexed by user ID
+std::vector<int64_t> costByPrinter;     // Indexed by printer ID
+int64_t costTotal = 0;
+
+inline size_t costTableIndex(uint8_t paper, uint8_t color, uint8_t duplex) {
+    return (static_cast<size_t>(paper) * std::size(colorModeNames) + color) * std::size(duplexSettingNames) + duplex;
+}
+
+// Function to count the fields a rate pins down; the most specific matching rate wins
+int costRateSpecificity(const CostRate& rate) {
+    return (rate.printerId != noColumnId) + (rate.paperMask != anyCodeMask) +
+           (rate.colorMask != anyCodeMask) + (rate.duplexMask != anyCodeMask);
+}
+
+// Function to resolve the rates that apply to one printer into a dense table
+CostTable resolveCostTable(uint32_t printerId) {
+    CostTable table(costTableSize, 0);
+    for (uint8_t paper = 0; paper < std::size(paperSizeNames); ++paper) {
+        for (uint8_t color = 0; color < std::size(colorModeNames); ++color) {
+            for (uint8_t duplex = 0; duplex < std::size(duplexSettingNames); ++duplex) {
+                int best = -1;
+                for (const auto& rate : costRates) {
+                    bool matches = (rate.printerId == noColumnId || rate.printerId == printerId) &&
+                                   (rate.paperMask >> paper & 1) && (rate.colorMask >> color & 1) &&
+                                   (rate.duplexMask >> duplex & 1);
+                    if (matches && costRateSpecificity(rate) >= best) {
+                        best = costRateSpecificity(rate);
+                        table[costTableIndex(paper, color, duplex)] = rate.pricePerPage;
+                    }
+                }
+            }
+        }
+    }
+    return table;
+}
+
+// Function to price a job from its column codes; caller holds jobsMutex
+int64_t priceJob(uint32_t printerId, int32_t pages, uint8_t paper, uint8_t color, uint8_t duplex) {
+    if (costRates.empty() || pages <= 0) return 0;
+    if (printerId == noColumnId) {
+        return resolveCostTable(noColumnId)[costTableIndex(paper, color, duplex)] * pages;
+    }
+    while (costTables.size() <= printerId) {
+        costTables.push_back(resolveCostTable(static_cast<uint32_t>(costTables.size())));
+    }
+    return costTables[printerId][costTableIndex(paper, color, duplex)] * pages;
+}
+
+// Function to add a job's cost, or a change in it, to the totals; caller holds jobsMutex
+void accumulateCost(uint32_t printerId, uint32_t userId, int64_t cost) {
+    if (cost == 0) return;
+    costTotal += cost;
+    if (costByUser.size() <= userId) costByUser.resize(userId + 1, 0);
+    costByUser[userId] += cost;
+    if (printerId != noColumnId) {
+        if (costByPrinter.size() <= printerId) costByPrinter.resize(printerId + 1, 0);
+        costByPrinter[printerId] += cost;
+    }
+}
+
+// Function to set a rate, replacing one with the same pattern; a negative price removes it
+void setCostRate(const CostRate& rate) {
+    std::lock_guard<std::mutex> lock(jobsMutex);
+    auto samePattern = [&rate](const CostRate& other) {
+        return other.printerId == rate.printerId && other.paperMask == rate.paperMask &&
+               other.colorMask == rate.colorMask && other.duplexMask == rate.duplexMask;
+    };
+    costRates.erase(std::remove_if(costRates.begin(), costRates.end(), samePattern), costRates.end());
+    if (rate.pricePerPage >= 0) costRates.push_back(rate);
+    for (uint32_t id = 0; id < costTables.size(); ++id) {
+        costTables[id] = resolveCostTable(id);
+    }
+}
+
+// Function to format thousandths as a decimal amount
+std::string formatCost(int64_t thousandths) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%s%lld.%03lld", thousandths < 0 ? "-" : "",
+                  static_cast<long long>(std::llabs(thousandths) / 1000),
+                  static_cast<long long>(std::llabs(thousandths) % 1000));
+    return text;
+}
+
+// ---------------------------------------------------------------------------
+// Job history filter
+//
+// The store keeps the last 1000 jobs, but a job can sit in a queue for much
+// longer than it takes 1000 others to arrive, and once evicted it would be
+// recorded again as new the next time it changed. So each evicted job's
+// history key, a hash of its printer, job ID and submission time, is added
+// to the current generation's Bloom filter and its in-memory key list. A poll
+// looks up its new and changed jobs on the I/O pool, holding no lock, before
+// it records them. If no filter has all of its bits set the job is new; that
+// is the answer for nearly every job, and it needs no disk access. Otherwise the key is looked
+// for in the matching generations, newest first: in memory for the current
+// one, and in the others' files (history/job_keys_<n>.bin, 8 bytes per key),
+// which are sorted and binary-searched. File search results are remembered
+// until a generation is sealed or dropped, so a job that stays queued is not
+// searched for on every poll.
+//
+// Recording only touches memory, under jobsMutex. writeJobHistory, called
+// from housekeeping, appends new keys to the current generation's journal,
+// writes each full generation out sorted and deletes dropped generations' files.
+//
+// A generation takes as many keys as its filter can hold at the target
+// false-positive rate. When it is full a new generation is started, and
+// beyond history.generations the oldest one is dropped together with its
+// file, so the filters never use more than history.filter_kb; only the
+// current generation's keys are held in memory besides. Each filter is sized
+// for the target rate divided by the number of generations, so a lookup
+// against all of them still meets the target. Changed settings apply from the
+// next generation. The generation files are read back when monitoring starts.
+// `stats` shows keys, memory, file searches and the estimated and observed
+// false-positive rates, and `print_monitor.exe --bench history [keys]` times
+// the filter and measures its false-positive rate.
+// ---------------------------------------------------------------------------
+
+std::atomic<long long> historyFilterKb{1024};            // Memory for all filters; 0 turns the history off
+std::atomic<long long> historyFalsePositivePpm{10000};   // Target false-positive rate, per million lookups
+std::atomic<long long> historyGenerationCount{4};
+const char* historyDirectory = "history";
+
+// Bloom filter over 64-bit keys; the probes are h1 + i * h2 for two hashes of the key
+struct BloomFilter {
+    std::vector<uint64_t> words;
+    uint32_t bitCount = 0;
+    uint32_t probes = 0;
+    uint64_t capacity = 0;  // Keys it holds before passing its false-positive rate
+    uint64_t keys = 0;
+
+    // Function to size the filter to `bits` bits (at most 2^32 - 64) for a false-positive rate
+    void configure(uint64_t bits, double falsePositiveRate) {
+        double bitsPerKey = -std::log(falsePositiveRate) / (std::log(2.0) * std::log(2.0));
+        bitCount = static_cast<uint32_t>(std::clamp<uint64_t>(bits / 64 * 64, 64, 0xffffffc0ULL));
+        words.assign(bitCount / 64, 0);
+        probes = static_cast<uint32_t>(std::clamp(std::lround(bitsPerKey * std::log(2.0)), 1L, 30L));
+        capacity = std::max<uint64_t>(1, static_cast<uint64_t>(bitCount / bitsPerKey));
+        keys = 0;
+    }
+
+    // Function to map the i-th probe of a key onto a bit, by multiplying instead of dividing
+    uint32_t probeBit(uint64_t h1, uint64_t h2, uint32_t i) const {
+        uint64_t hash = h1 + i * h2;
+        return static_cast<uint32_t>(((hash >> 32) * bitCount) >> 32);
+    }
+
+    void insert(uint64_t key) {
+        uint64_t h1 = mixFingerprint(0, key), h2 = mixFingerprint(h1, key) | 1;
+        for (uint32_t i = 0; i < probes; ++i) {
+            uint32_t bit = probeBit(h1, h2, i);
+            words[bit / 64] |= 1ULL << (bit % 64);
+        }
+        ++keys;
+    }
+
+    bool mightContain(uint64_t key) const {
+        uint64_t h1 = mixFingerprint(0, key), h2 = mixFingerprint(h1, key) | 1;
+        for (uint32_t i = 0; i < probes; ++i) {
+            uint32_t bit = probeBit(h1, h2, i);
+            if (!(words[bit / 64] & (1ULL << (bit % 64)))) return false;
+        }
+        return true;
+    }
+
+    // Expected false-positive rate with the keys inserted so far
+    double estimatedFalsePositiveRate() const {
+        return std::pow(1.0 - std::exp(-static_cast<double>(probes) * keys / bitCount), probes);
+    }
+};
+
+struct HistoryGeneration {
+    uint64_t number = 0;         // From the file name; the newest generation has the highest
+    BloomFilter filter;
+    std::vector<uint64_t> keys;  // Held until the generation's sorted file is written
+    size_t sortedKeys = 0;       // keys[0, sortedKeys) are sorted; the newest few after them are not
+    bool sealed = false;         // Full, and its file holds its keys sorted; keys is then empty
+};
+
+const size_t historyUnsortedLimit = 1024;     // Unsorted keys searched linearly before they are merged in
+const size_t historyAnswerCapacity = 65536;   // Remembered file search results; cleared when full
+const size_t historyRecentCapacity = 16384;   // Ring of the latest recorded keys
+
+std::deque<HistoryGeneration> historyGenerations;  // Oldest first; guarded by historyMutex
+std::unordered_map<uint64_t, bool> historyAnswers; // File search results by key; guarded by historyMutex
+uint64_t historyAnswersEpoch = 0;                  // Bumped when historyAnswers is cleared; guarded by historyMutex
+std::vector<std::pair<uint64_t, uint64_t>> historyUnwritten;  // Generation and key, not yet in a file; guarded by historyMutex
+std::vector<uint64_t> historyToSeal;               // Full generations whose sorted file is not written; guarded by historyMutex
+std::vector<uint64_t> historyToRemove;             // Dropped generations whose file is still there; guarded by historyMutex
+bool historyLoaded = false;                        // Generation files read back; guarded by historyMutex
+std::mutex historyMutex;                           // Taken inside jobsMutex, never held over disk I/O
+std::mutex historyFilesMutex;                      // Held while loading or writing files; never taken inside jobsMutex
+AsyncFile historyFile;                             // Journal of the newest generation; guarded by historyFilesMutex
+uint64_t historyFileNumber = 0;                    // Generation historyFile belongs to
+std::vector<uint64_t> recentHistoryKeys(historyRecentCapacity);  // Indexed by historyKeysRecorded; guarded by jobsMutex
+std::atomic<uint64_t> historyKeysRecorded{0};      // Written under jobsMutex
+std::atomic<uint64_t> historyAnsweredNew{0};       // Lookups no filter matched
+std::atomic<uint64_t> historyConfirmed{0};         // Matched, and the key was in a generation
+std::atomic<uint64_t> historyFalsePositives{0};    // Matched, but the key was in no generation
+std::atomic<uint64_t> historyFileSearches{0};      // Binary searches of a sealed generation's file
+
+// Function to pack a SYSTEMTIME as the decimal digits YYYYMMDDhhmmssmmm
+uint64_t packSystemTime(const SYSTEMTIME& time) {
+    uint64_t packed = time.wYear;
+    for (WORD part : {time.wMonth, time.wDay, time.wHour, time.wMinute, time.wSecond}) packed = packed * 100 + part;
+    return packed * 1000 + time.wMilliseconds;
+}
+
+// Function to hash the fields that identify a job across its whole life: printer, job ID and submission time
+uint64_t jobHistoryKey(const std::string& printerName, const std::string& jobId, uint64_t submitted) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (char c : printerName) hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+    hash = (hash ^ 0x1f) * 0x100000001b3ULL;
+    for (char c : jobId) hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+    return mixFingerprint(hash, submitted);
+}
+
+uint64_t jobHistoryKey(const PrintJob& job) {
+    return jobHistoryKey(job.printerName, job.jobId, job.submitted);
+}
+
+std::string historyFilePath(uint64_t number) {
+    return (std::filesystem::path(historyDirectory) / ("job_keys_" + std::to_string(number) + ".bin")).string();
+}
+
+// Function to size a new generation's filter from the current settings
+void configureHistoryFilter(BloomFilter& filter) {
+    long long generations = std::max(1LL, historyGenerationCount.load());
+    double rate = std::clamp(historyFalsePositivePpm.load(), 1LL, 500000LL) / 1e6 / generations;
+    filter.configure(static_cast<uint64_t>(historyFilterKb.load()) * 8192 / generations, rate);
+}
+
+// Function to find a generation by number; caller holds historyMutex
+HistoryGeneration* findHistoryGeneration(uint64_t number) {
+    for (auto& generation : historyGenerations) {
+        if (generation.number == number) return &generation;
+    }
+    return nullptr;
+}
+
+// Function to forget remembered file search results, which a sealed or dropped generation can change; caller holds historyMutex
+void clearHistoryAnswers() {
+    historyAnswers.clear();
+    ++historyAnswersEpoch;
+}
+
+// Function to check a generation's keys held in memory; caller holds historyMutex
+bool generationKeysContain(const HistoryGeneration& generation, uint64_t key) {
+    auto sortedEnd = generation.keys.begin() + generation.sortedKeys;
+    return std::binary_search(generation.keys.begin(), sortedEnd, key) ||
+           std::find(sortedEnd, generation.keys.end(), key) != generation.keys.end();
+}
+
+// Function to start a generation after the newest, dropping the oldest beyond history.generations; caller holds historyMutex
+void startHistoryGeneration() {
+    uint64_t number = historyGenerations.empty() ? 1 : historyGenerations.back().number + 1;
+    if (!historyGenerations.empty()) historyToSeal.push_back(historyGenerations.back().number);
+    historyGenerations.emplace_back();
+    historyGenerations.back().number = number;
+    configureHistoryFilter(historyGenerations.back().filter);
+    while (historyGenerations.size() > static_cast<size_t>(std::max(1LL, historyGenerationCount.load()))) {
+        historyToRemove.push_back(historyGenerations.front().number);
+        historyGenerations.pop_front();
+        clearHistoryAnswers();
+    }
+}
+
+// Function to read a generation file's keys
+std::vector<uint64_t> readHistoryFile(uint64_t number) {
+    std::vector<uint64_t> keys;
+    std::ifstream file(historyFilePath(number), std::ios::binary);
+    uint64_t chunk[8192];
+    while (file.read(reinterpret_cast<char*>(chunk), sizeof(chunk)) || file.gcount() > 0) {
+        keys.insert(keys.end(), chunk, chunk + static_cast<size_t>(file.gcount()) / sizeof(uint64_t));
+    }
+    return keys;
+}
+
+// Function to replace a generation file with its keys in sorted order, through a temporary file
+bool writeSortedHistoryFile(uint64_t number, const std::vector<uint64_t>& keys) {
+    std::string path = historyFilePath(number);
+    AsyncFile file;
+    std::error_code error;
+    std::filesystem::create_directories(historyDirectory, error);
+    if (!file.open(path + ".tmp", false, 64 * 1024)) {
+        LOG_ERROR("Could not open job history file for writing: ", path, ".tmp");
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(keys.data()), keys.size() * sizeof(uint64_t));
+    if (!file.close()) {
+        LOG_ERROR("Failed to write job history file. Error: ", file.error);
+        return false;
+    }
+    std::filesystem::rename(path + ".tmp", path, error);
+    if (error) {
+        LOG_ERROR("Could not replace job history file ", path, ": ", error.message());
+        return false;
+    }
+    return true;
+}
+
+// Function to binary-search a sealed generation's sorted file for a key
+bool historyFileContains(uint64_t number, uint64_t key) {
+    std::ifstream file(historyFilePath(number), std::ios::binary | std::ios::ate);
+    if (!file) return false;
+    uint64_t low = 0, high = static_cast<uint64_t>(file.tellg()) / sizeof(uint64_t);
+    while (low < high) {
+        uint64_t middle = low + (high - low) / 2, value = 0;
+        file.seekg(static_cast<std::streamoff>(middle * sizeof(uint64_t)));
+        if (!file.read(reinterpret_cast<char*>(&value), sizeof(value))) return false;
+        if (value == key) return true;
+        if (value < key) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return false;
+}
+
+// Function to read the generation files left by an earlier run; caller holds historyFilesMutex
+void loadJobHistory() {
+    namespace fs = std::filesystem;
+    std::error_code error;
+    std::vector<uint64_t> numbers;
+    for (const auto& entry : fs::directory_iterator(historyDirectory, error)) {
+        unsigned long long number = 0;
+        std::string name = entry.path().filename().string();
+        if (std::sscanf(name.c_str(), "job_keys_%llu.bin", &number) == 1 && name == "job_keys_" + std::to_string(number) + ".bin") {
+            numbers.push_back(number);
+        }
+    }
+    std::sort(numbers.begin(), numbers.end());
+    size_t keep = static_cast<size_t>(std::max(1LL, historyGenerationCount.load()));
+    std::deque<HistoryGeneration> generations;
+    std::vector<uint64_t> toSeal;
+    for (size_t i = 0; i < numbers.size(); ++i) {
+        if (i + keep < numbers.size()) {
+            fs::remove(historyFilePath(numbers[i]), error);  // Older than the generations we keep
+            continue;
+        }
+        HistoryGeneration& generation = generations.emplace_back();
+        generation.number = numbers[i];
+        configureHistoryFilter(generation.filter);
+        generation.keys = readHistoryFile(numbers[i]);
+        for (uint64_t key : generation.keys) generation.filter.insert(key);
+        // The newest generation goes on taking keys unless it is full. The rest
+        // are sealed; a journal left unsorted by the last run stays in memory
+        // until writeJobHistory has rewritten it sorted.
+        bool open = i + 1 == numbers.size() && generation.filter.keys < generation.filter.capacity;
+        if (!open && std::is_sorted(generation.keys.begin(), generation.keys.end())) {
+            generation.keys = std::vector<uint64_t>();
+            generation.sealed = true;
+            continue;
+        }
+        if (!open) toSeal.push_back(generation.number);
+        std::sort(generation.keys.begin(), generation.keys.end());
+        generation.sortedKeys = generation.keys.size();
+    }
+
+    std::lock_guard<std::mutex> lock(historyMutex);
+    historyGenerations = std::move(generations);
+    historyToSeal = std::move(toSeal);
+    historyLoaded = true;
+    if (!historyGenerations.empty()) {
+        LOG_INFO("Loaded job history: ", historyGenerations.size(), " generations, ",
+                 historyGenerations.back().filter.keys, " keys in the newest");
+    }
+}
+
+// Function to read the job history back once, when monitoring starts or before the first lookup; not called under jobsMutex
+void prepareJobHistory() {
+    if (historyFilterKb <= 0) return;
+    {
+        std::lock_guard<std::mutex> lock(historyMutex);
+        if (historyLoaded) return;
+    }
+    std::lock_guard<std::mutex> filesLock(historyFilesMutex);
+    bool loaded;
+    {
+        std::lock_guard<std::mutex> lock(historyMutex);
+        loaded = historyLoaded;
+    }
+    if (!loaded) loadJobHistory();
+}
+
+// Function to add the history keys of jobs leaving the store to memory; writeJobHistory
+// puts them on disk once the store lock is released; caller holds jobsMutex
+void recordJobHistory(const std::vector<uint64_t>& keys) {
+    if (historyFilterKb <= 0 || keys.empty()) return;
+    std::lock_guard<std::mutex> lock(historyMutex);
+    if (!historyLoaded) return;  // Only when the history was turned on between lookup and eviction
+    for (uint64_t key : keys) {
+        if (historyGenerations.empty() || historyGenerations.back().filter.keys >= historyGenerations.back().filter.capacity) {
+            startHistoryGeneration();
+        }
+        HistoryGeneration& generation = historyGenerations.back();
+        generation.filter.insert(key);
+        generation.keys.push_back(key);
+        if (generation.keys.size() - generation.sortedKeys > historyUnsortedLimit) {
+            auto sortedEnd = generation.keys.begin() + generation.sortedKeys;
+            std::sort(sortedEnd, generation.keys.end());
+            std::inplace_merge(generation.keys.begin(), sortedEnd, generation.keys.end());
+            generation.sortedKeys = generation.keys.size();
+        }
+        historyUnwritten.emplace_back(generation.number, key);
+        recentHistoryKeys[historyKeysRecorded++ % historyRecentCapacity] = key;
+    }
+}
+
+// Function to check whether a key was among the last `count` recorded; caller holds jobsMutex
+bool recentlyRecordedInHistory(uint64_t key, uint64_t count) {
+    uint64_t end = historyKeysRecorded;
+    for (uint64_t i = end - std::min<uint64_t>(count, historyRecentCapacity); i < end; ++i) {
+        if (recentHistoryKeys[i % historyRecentCapacity] == key) return true;
+    }
+    return false;
+}
+
+// Function to check whether a job was recorded and then evicted. The filters
+// answer "new"; a match is confirmed from the keys in memory, from a
+// remembered answer, or by searching sealed generation files. Not called under jobsMutex.
+bool jobHistoryContains(uint64_t key) {
+    if (historyFilterKb <= 0) return false;
+    prepareJobHistory();
+    std::vector<uint64_t> sealedMatches;
+    uint64_t epoch;
+    {
+        std::lock_guard<std::mutex> lock(historyMutex);
+        bool matched = false;
+        for (auto it = historyGenerations.rbegin(); it != historyGenerations.rend(); ++it) {
+            if (!it->filter.mightContain(key)) continue;
+            matched = true;
+            if (it->sealed) {
+                sealedMatches.push_back(it->number);
+            } else if (generationKeysContain(*it, key)) {
+                ++historyConfirmed;
+                return true;
+            }
+        }
+        if (!matched) {
+            ++historyAnsweredNew;
+            return false;
+        }
+        if (sealedMatches.empty()) {
+            ++historyFalsePositives;
+            return false;
+        }
+        auto answer = historyAnswers.find(key);
+        if (answer != historyAnswers.end()) {
+            ++(answer->second ? historyConfirmed : historyFalsePositives);
+            return answer->second;
+        }
+        epoch = historyAnswersEpoch;
+    }
+
+    bool found = false;
+    for (uint64_t number : sealedMatches) {
+        ++historyFileSearches;
+        if (historyFileContains(number, key)) {
+            found = true;
+            break;
+        }
+    }
+    ++(found ? historyConfirmed : historyFalsePositives);
+    std::lock_guard<std::mutex> lock(historyMutex);
+    if (epoch == historyAnswersEpoch) {
+        if (historyAnswers.size() >= historyAnswerCapacity) clearHistoryAnswers();
+        historyAnswers.emplace(key, found);
+    }
+    return found;
+}
+
+// History lookups of a batch of jobs, made before commitJobBatch takes jobsMutex
+struct HistoryLookup {
+    std::vector<uint8_t> recordedBefore;  // Per job: recorded, and evicted, before the lookup
+    uint64_t recordedAtLookup = 0;        // historyKeysRecorded when the lookups started
+};
+
+// Function to look up history keys. A lookup may search generation files, so
+// polls do this on the I/O pool without holding any lock.
+HistoryLookup lookUpJobHistory(const std::vector<uint64_t>& keys) {
+    HistoryLookup lookup;
+    lookup.recordedAtLookup = historyKeysRecorded;
+    lookup.recordedBefore.resize(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) lookup.recordedBefore[i] = jobHistoryContains(keys[i]);
+    return lookup;
+}
+
+// Function to close the newest generation's journal; caller holds historyFilesMutex
+void closeHistoryFile() {
+    if (historyFile.isOpen() && !historyFile.close()) {
+        LOG_ERROR("Failed to write job history file. Error: ", historyFile.error);
+    }
+}
+
+// Function to put recorded keys on disk: append them to the newest generation's
+// journal, write full generations out sorted and delete dropped ones. Not called under jobsMutex.
+void writeJobHistory() {
+    std::lock_guard<std::mutex> filesLock(historyFilesMutex);
+    std::vector<std::pair<uint64_t, uint64_t>> unwritten;
+    std::vector<std::pair<uint64_t, std::vector<uint64_t>>> toSeal;
+    std::vector<uint64_t> toRemove;
+    {
+        std::lock_guard<std::mutex> lock(historyMutex);
+        unwritten.swap(historyUnwritten);
+        for (uint64_t number : historyToSeal) {
+            if (const HistoryGeneration* generation = findHistoryGeneration(number)) toSeal.emplace_back(number, generation->keys);
+        }
+        historyToSeal.clear();
+        toRemove.swap(historyToRemove);
+    }
+
+    // Keys of generations about to be written out whole, or dropped, need no journal
+    auto skipped = [&](uint64_t number) {
+        return std::find(toRemove.begin(), toRemove.end(), number) != toRemove.end() ||
+               std::any_of(toSeal.begin(), toSeal.end(), [number](const auto& seal) { return seal.first == number; });
+    };
+    for (const auto& [number, key] : unwritten) {
+        if (skipped(number)) continue;
+        if (historyFile.isOpen() && historyFileNumber != number) closeHistoryFile();
+        if (!historyFile.isOpen()) {
+            std::error_code error;
+            std::filesystem::create_directories(historyDirectory, error);
+            if (!historyFile.open(historyFilePath(number), true, 16 * 1024)) {
+                LOG_ERROR("Could not open job history file for writing: ", historyFilePath(number));
+                break;  // The keys stay in memory until their generation is written out sorted
+            }
+            historyFileNumber = number;
+        }
+        historyFile.write(reinterpret_cast<const char*>(&key), sizeof(key));
+    }
+
+    for (auto& [number, keys] : toSeal) {
+        if (historyFileNumber == number) closeHistoryFile();
+        std::sort(keys.begin(), keys.end());
+        bool written = writeSortedHistoryFile(number, keys);
+        std::lock_guard<std::mutex> lock(historyMutex);
+        HistoryGeneration* generation = findHistoryGeneration(number);
+        if (!generation) continue;
+        if (!written) {
+            historyToSeal.push_back(number);  // Lookups keep using its keys in memory; try again later
+            continue;
+        }
+        generation->keys = std::vector<uint64_t>();
+        generation->sortedKeys = 0;
+        generation->sealed = true;
+        clearHistoryAnswers();
+    }
+
+    for (uint64_t number : toRemove) {
+        if (historyFileNumber == number) closeHistoryFile();
+        std::error_code error;
+        std::filesystem::remove(historyFilePath(number), error);
+    }
+}
+
+// Housekeeping: write recorded history keys and hand buffered ones to the OS
+void maintainJobHistory() {
+    writeJobHistory();
+    std::lock_guard<std::mutex> filesLock(historyFilesMutex);
+    if (historyFile.isOpen()) historyFile.submit();
+}
+
+// Function to close the history file when monitoring stops; it is reopened by the next eviction
+void suspendJobHistory() {
+    writeJobHistory();
+    std::lock_guard<std::mutex> filesLock(historyFilesMutex);
+    closeHistoryFile();
+}
+
+// Function to show the history filters' size and how their lookups were answered
+void showJobHistoryStatistics(std::ostream& out) {
+    if (historyFilterKb <= 0 && historyKeysRecorded == 0) return;
+    std::lock_guard<std::mutex> lock(historyMutex);
+    uint64_t keys = 0, bytes = historyAnswers.size() * 4 * sizeof(uint64_t);
+    double estimated = 0;
+    for (const auto& generation : historyGenerations) {
+        keys += generation.filter.keys;
+        bytes += (generation.filter.words.size() + generation.keys.capacity()) * sizeof(uint64_t);
+        estimated += generation.filter.estimatedFalsePositiveRate();
+    }
+    uint64_t absent = historyAnsweredNew + historyFalsePositives;
+    char text[256];
+    std::snprintf(text, sizeof(text),
+                  "Job history: %llu keys in %zu generations, %llu KB in memory; false positives %.3f%% "
+                  "estimated, %.3f%% observed, %.3f%% target",
+                  static_cast<unsigned long long>(keys), historyGenerations.size(),
+                  static_cast<unsigned long long>(bytes / 1024), 100 * std::min(estimated, 1.0),
+                  absent ? 100.0 * historyFalsePositives / absent : 0.0, historyFalsePositivePpm / 1e4);
+    out << text << std::endl;
+    out << "  Lookups: " << historyAnsweredNew << " new by the filters alone, " << historyConfirmed
+              << " already recorded, " << historyFalsePositives << " false positives; "
+              << historyFileSearches << " generation file searches" << std::endl;
+}
+
+// Function to time the filter against std::unordered_set and measure its false-positive rate
+int runHistoryBenchmark(size_t count) {
+    std::vector<uint64_t> present(count), absent(count);
+    for (size_t i = 0; i < count; ++i) {
+        present[i] = mixFingerprint(0, 2 * i);
+        absent[i] = mixFingerprint(0, 2 * i + 1);
+    }
+    auto seconds = [](std::chrono::steady_clock::time_point started) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    };
+    bool allOk = true;
+    std::cout << "Keys: " << count << std::endl;
+    for (double rate : {0.01, 0.001, 0.0001}) {
+        BloomFilter filter;
+        double bitsPerKey = -std::log(rate) / (std::log(2.0) * std::log(2.0));
+        filter.configure(static_cast<uint64_t>(std::ceil(bitsPerKey * count)) + 64, rate);
+        auto started = std::chrono::steady_clock::now();
+        for (uint64_t key : present) filter.insert(key);
+        double insertSeconds = seconds(started);
+        size_t found = 0, falsePositives = 0;
+        started = std::chrono::steady_clock::now();
+        for (uint64_t key : absent) falsePositives += filter.mightContain(key);
+        double lookupSeconds = seconds(started);
+        for (uint64_t key : present) found += filter.mightContain(key);
+        bool ok = found == count;  // A Bloom filter has no false negatives
+        allOk = allOk && ok;
+        char text[192];
+        std::snprintf(text, sizeof(text),
+                      "Bloom %.2f%%  %8.1f KB  %2u probes  insert %6.1f ns  lookup %6.1f ns  false positives %.3f%%%s",
+                      rate * 100, filter.words.size() * 8 / 1024.0, filter.probes, insertSeconds * 1e9 / count,
+                      lookupSeconds * 1e9 / count, 100.0 * falsePositives / count, ok ? "" : "  FALSE NEGATIVE");
+        std::cout << text << std::endl;
+    }
+    {
+        std::unordered_set<uint64_t> set;
+        auto started = std::chrono::steady_clock::now();
+        for (uint64_t key : present) set.insert(key);
+        double insertSeconds = seconds(started);
+        size_t hits = 0;
+        started = std::chrono::steady_clock::now();
+        for (uint64_t key : absent) hits += set.count(key);
+        double lookupSeconds = seconds(started);
+        // Nodes of a key and a next pointer, plus the bucket array
+        double kilobytes = (set.size() * 2 * sizeof(void*) + set.bucket_count() * sizeof(void*)) / 1024.0;
+        char text[160];
+        std::snprintf(text, sizeof(text), "unordered_set  %8.1f KB              insert %6.1f ns  lookup %6.1f ns  (%zu hits)",
+                      kilobytes, insertSeconds * 1e9 / count, lookupSeconds * 1e9 / count, hits);
+        std::cout << text << std::endl;
+    }
+    return allOk ? 0 : 1;
+}
+
+// Key identifying a job in the store: printer name and job ID
+std::string jobKey(const std::string& printerName, const std::string& jobId) {
+    std::string key;
+    key.reserve(printerName.size() + jobId.size() + 1);
+    key += printerName;
+    key += '\x1f';
+    key += jobId;
+    return key;
+}
+
+// Function to update a recorded job's status, and re-price it if its pages or
+// print settings changed; caller holds jobsMutex
+void updateRecordedJob(size_t row, const PrintJob& job) {
+    PrintJob& recorded = printJobs[row];
+    JobColumns& columns = jobColumns;
+    if (recorded.status != job.status) {
+        recorded.status = job.status;
+        columns.status[row] = columnCode(jobStatusNames, job.status);
+    }
+    if (recorded.pages == job.pages && recorded.colorMode == job.colorMode &&
+        recorded.duplexSetting == job.duplexSetting && recorded.paperSize == job.paperSize) {
+        return;
+    }
+    recorded.pages = job.pages;
+    recorded.colorMode = job.colorMode;
+    recorded.duplexSetting = job.duplexSetting;
+    recorded.paperSize = job.paperSize;
+
+    columns.pages[row] = job.pages;
+    columns.colorMode[row] = columnCode(colorModeNames, job.colorMode);
+    columns.duplex[row] = columnCode(duplexSettingNames, job.duplexSetting);
+    columns.paperSize[row] = columnCode(paperSizeNames, job.paperSize);
+    int64_t cost = priceJob(columns.printerId[row], columns.pages[row], columns.paperSize[row],
+                            columns.colorMode[row], columns.duplex[row]);
+    accumulateCost(columns.printerId[row], columns.userId[row], cost - columns.cost[row]);
+    columns.cost[row] = cost;
+}
+
+// Record one printer's jobs under a single acquisition of jobsMutex.
+// New jobs are appended and priced; jobs already in the store take their
+// current status and are re-priced if their pages or print settings changed. The dedupe index is updated
+// together with the job list; jobs it no longer holds are checked against the job history, and evicted
+// jobs are added to it. Housekeeping puts the evicted jobs' keys on disk.
+//
+// The batch was looked up in the history beforehand. Jobs evicted by other polls
+// since then are found among the recently recorded keys; if more were recorded
+// than those hold, the new jobs are not recorded and their positions in the
+// batch are returned, for the caller to look up and commit again.
+std::vector<size_t> commitJobBatch(uint32_t printerId, const std::vector<PrintJob>& batch, const HistoryLookup& lookup) {
+    std::lock_guard<std::mutex> lock(jobsMutex);
+    ++storeLockAcquisitions;
+    uint64_t recordedSinceLookup = historyKeysRecorded - lookup.recordedAtLookup;
+    bool stale = recordedSinceLookup > historyRecentCapacity;
+
+    std::vector<size_t> notRecorded;
+    for (size_t i = 0; i < batch.size(); ++i) {
+        const PrintJob& job = batch[i];
+        uint64_t sequence = firstJobSequence + printJobs.size();
+        auto result = recordedJobKeys.try_emplace(jobKey(job.printerName, job.jobId), sequence);
+        if (!result.second) {
+            updateRecordedJob(static_cast<size_t>(result.first->second - firstJobSequence), job);
+            continue;
+        }
+        if (stale) {
+            recordedJobKeys.erase(result.first);
+            notRecorded.push_back(i);
+            continue;
+        }
+        if (lookup.recordedBefore[i] ||
+            (recordedSinceLookup && recentlyRecordedInHistory(jobHistoryKey(job), recordedSinceLookup))) {
+            recordedJobKeys.erase(result.first);  // Recorded before and evicted since
+            continue;
+        }
+        uint32_t userId = internUser(job.userAccount);
+        int64_t cost = priceJob(printerId, job.pages, columnCode(paperSizeNames, job.paperSize),
+                                columnCode(colorModeNames, job.colorMode),
+                                columnCode(duplexSettingNames, job.duplexSetting));
+        printJobs.push_back(job);
+        jobColumns.append(job, printerId, userId, parseTimestamp(job.timestamp), cost);
+        accumulateCost(printerId, userId, cost);
+    }
+
+    // Keep only the last 1000 jobs to prevent memory issues
+    if (printJobs.size() > 1000) {
+        size_t evict = std::max<size_t>(100, printJobs.size() - 1000); // Remove oldest 100 or more
+        std::vector<uint64_t> evictedKeys(evict);
+        for (size_t i = 0; i < evict; ++i) {
+            recordedJobKeys.erase(jobKey(printJobs[i].printerName, printJobs[i].jobId));
+            evictedKeys[i] = jobHistoryKey(printJobs[i]);
+        }
+        recordJobHistory(evictedKeys);
+        printJobs.erase(printJobs.begin(), printJobs.begin() + evict);
+        jobColumns.eraseFront(evict);
+        firstJobSequence += evict;
+    }
+    return notRecorded;
+}
+
+// Function to look up and record a batch on the calling thread, for callers other than polls
+void commitJobBatch(uint32_t printerId, const std::vector<PrintJob>& batch) {
+    std::vector<PrintJob> pending = batch;
+    while (!pending.empty()) {
+        std::vector<uint64_t> keys(pending.size());
+        for (size_t i = 0; i < pending.size(); ++i) keys[i] = jobHistoryKey(pending[i]);
+        std::vector<PrintJob> retry;
+        for (size_t i : commitJobBatch(printerId, pending, lookUpJobHistory(keys))) retry.push_back(pending[i]);
+        pending.swap(retry);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Stuck-job detection
+//
+// A job that stays Spooling, Paused, in Error or waiting for user
+// intervention for longer than that status's stuck.*_minutes threshold is
+// reported as stuck. When a poll sees a job enter one of those statuses, the
+// job gets a tracking record with a fresh generation and its deadline (entry
+// time plus threshold) is pushed on a min-heap. A job that changes status or
+// leaves the queue only has its record replaced or dropped; the heap entry
+// it leaves behind no longer matches and is discarded when it reaches the
+// top. Housekeeping pops the expired deadlines, O(log n) each, logs each
+// stuck job once and adds it to the stuck set, which the `stuck` command
+// lists without touching the job store. A threshold change applies to jobs
+// that enter the status afterwards; 0 stops tracking that status.
+//
+// The records are guarded by stuckMutex. A poll updates them while holding
+// its printer's fingerprint lock, so they are taken in that order.
+// ---------------------------------------------------------------------------
+
+std::atomic<long long> stuckSpoolingMinutes{30};
+std::atomic<long long> stuckPausedMinutes{60};
+std::atomic<long long> stuckErrorMinutes{15};
+std::atomic<long long> stuckInterventionMinutes{15};
+
+// Threshold setting per status code, in jobStatusNames order; null for statuses that are not tracked
+std::atomic<long long>* const stuckThresholds[] = {
+    nullptr, &stuckPausedMinutes, &stuckErrorMinutes, nullptr, &stuckSpoolingMinutes, nullptr,
+    nullptr, nullptr, nullptr, nullptr, &stuckInterventionMinutes
+};
+static_assert(std::size(stuckThresholds) == std::size(jobStatusNames), "one threshold slot per status name");
+
+struct TrackedJob {
+    uint8_t status = 0;          // Index into jobStatusNames
+    int64_t since = 0;           // When the job entered the status, seconds since the epoch
+    int64_t deadline = 0;        // When it counts as stuck
+    uint64_t generation = 0;     // Matches this record's live heap entry
+    bool stuck = false;
+};
+
+struct StuckDeadline {
+    int64_t deadline;
+    uint64_t key;
+    uint64_t generation;
+
+    bool operator>(const StuckDeadline& other) const { return deadline > other.deadline; }
+};
+
+std::unordered_map<uint64_t, TrackedJob> trackedJobs;  // Keyed by stuckJobKey
+std::unordered_set<uint64_t> stuckJobKeys;
+std::priority_queue<StuckDeadline, std::vector<StuckDeadline>, std::greater<StuckDeadline>> stuckDeadlines;
+uint64_t nextTrackingGeneration = 1;
+std::mutex stuckMutex;
+std::atomic<uint64_t> stuckJobsDetected{0};
+
+// Key of a tracked job: printer ID in the high half, job ID in the low half
+inline uint64_t stuckJobKey(uint32_t printerId, DWORD jobId) {
+    return (static_cast<uint64_t>(printerId) << 32) | jobId;
+}
+
+// Function to get a status code's stuck threshold in seconds; 0 if the status is not tracked
+int64_t stuckThresholdSeconds(uint8_t status) {
+    std::atomic<long long>* minutes = status < std::size(stuckThresholds) ? stuckThresholds[status] : nullptr;
+    return minutes ? static_cast<int64_t>(minutes->load()) * 60 : 0;
+}
+
+// Function to rebuild the deadline heap from the records, dropping stale entries; caller holds stuckMutex
+void rebuildStuckDeadlines() {
+    std::vector<StuckDeadline> live;
+    live.reserve(trackedJobs.size());
+    for (const auto& pair : trackedJobs) {
+        if (!pair.second.stuck) live.push_back({ pair.second.deadline, pair.first, pair.second.generation });
+    }
+    stuckDeadlines = decltype(stuckDeadlines)(std::greater<StuckDeadline>(), std::move(live));
+}
+
+// Function to note a job's status after a poll saw it new or changed
+void trackJobState(uint32_t printerId, DWORD jobId, DWORD status, int64_t now) {
+    uint8_t code = jobStatusCode(status);
+    int64_t threshold = stuckThresholdSeconds(code);
+    uint64_t key = stuckJobKey(printerId, jobId);
+
+    std::lock_guard<std::mutex> lock(stuckMutex);
+    auto it = trackedJobs.find(key);
+    if (it != trackedJobs.end() && it->second.status == code) return;
+    if (threshold <= 0) {
+        if (it != trackedJobs.end()) {
+            stuckJobKeys.erase(key);
+            trackedJobs.erase(it);
+        }
+        return;
+    }
+    stuckJobKeys.erase(key);
+    TrackedJob& job = trackedJobs[key];
+    job = TrackedJob{ code, now, now + threshold, nextTrackingGeneration++, false };
+    stuckDeadlines.push({ job.deadline, key, job.generation });
+}
+
+// Function to stop tracking jobs that left a printer's queue
+void untrackJobs(uint32_t printerId, const DepartedJobs& jobs) {
+    std::lock_guard<std::mutex> lock(stuckMutex);
+    for (const auto& job : jobs) {
+        uint64_t key = stuckJobKey(printerId, job.first);
+        trackedJobs.erase(key);
+        stuckJobKeys.erase(key);
+    }
+}
+
+// Function to drop the tracked jobs of a printer that left the inventory
+void forgetPrinterStuckJobs(uint32_t printerId) {
+    std::lock_guard<std::mutex> lock(stuckMutex);
+    for (auto it = trackedJobs.begin(); it != trackedJobs.end();) {
+        if (it->first >> 32 == printerId) {
+            stuckJobKeys.erase(it->first);
+            it = trackedJobs.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// Function to look up a printer's name by inventory ID
+std::string printerNameById(uint32_t printerId) {
+    std::lock_guard<std::mutex> lock(inventoryMutex);
+    return printerId < printerInventory.size() ? printerInventory[printerId].name : "?";
+}
+
+// Function to fire the deadlines that have passed and report the jobs as stuck
+void expireStuckJobs(int64_t now) {
+    std::vector<std::pair<uint64_t, TrackedJob>> expired;
+    {
+        std::lock_guard<std::mutex> lock(stuckMutex);
+        while (!stuckDeadlines.empty() && stuckDeadlines.top().deadline <= now) {
+            StuckDeadline due = stuckDeadlines.top();
+            stuckDeadlines.pop();
+            auto it = trackedJobs.find(due.key);
+            if (it == trackedJobs.end() || it->second.generation != due.generation) continue;  // Superseded
+            it->second.stuck = true;
+            stuckJobKeys.insert(due.key);
+            expired.emplace_back(due.key, it->second);
+        }
+        // Superseded entries are only dropped when they reach the top; compact if they pile up
+        if (stuckDeadlines.size() > 2 * trackedJobs.size() + 64) {
+            rebuildStuckDeadlines();
+        }
+    }
+
+    for (const auto& pair : expired) {
+        LOG_WARN("Job ", static_cast<uint32_t>(pair.first), " on printer ", printerNameById(pair.first >> 32),
+                 " stuck in ", jobStatusNames[pair.second.status], " for ",
+                 (now - pair.second.since) / 60, " minutes.");
+    }
+    stuckJobsDetected += expired.size();
+}
+
+// Function to format a duration in seconds as hours and minutes
+std::string formatStuckDuration(int64_t seconds) {
+    char text[32];
+    int64_t minutes = std::max<int64_t>(0, seconds) / 60;
+    std::snprintf(text, sizeof(text), "%lldh %02lldm", static_cast<long long>(minutes / 60),
+                  static_cast<long long>(minutes % 60));
+    return text;
+}
+
+// Function to list the jobs currently stuck, longest first
+void showStuckJobs(std::ostream& out) {
+    std::vector<std::pair<uint64_t, TrackedJob>> stuck;
+    {
+        std::lock_guard<std::mutex> lock(stuckMutex);
+        stuck.reserve(stuckJobKeys.size());
+        for (uint64_t key : stuckJobKeys) {
+            stuck.emplace_back(key, trackedJobs[key]);
+        }
+    }
+    std::sort(stuck.begin(), stuck.end(), [](const auto& a, const auto& b) {
+        return a.second.since < b.second.since;
+    });
+
+    int64_t now = time(nullptr);
+    out << "\n=== Stuck Jobs ===" << std::endl;
+    out << "Stuck now: " << stuck.size() << " (" << stuckJobsDetected << " detected since startup)" << std::endl;
+    for (const auto& pair : stuck) {
+        std::string printerName = printerNameById(static_cast<uint32_t>(pair.first >> 32));
+        std::string jobId = std::to_string(static_cast<uint32_t>(pair.first));
+        std::string user;
+        {
+            std::lock_guard<std::mutex> lock(jobsMutex);
+            auto recorded = recordedJobKeys.find(jobKey(printerName, jobId));
+            if (recorded != recordedJobKeys.end()) {
+                user = printJobs[static_cast<size_t>(recorded->second - firstJobSequence)].userAccount;
+            }
+        }
+        out << "  " << printerName << " job " << jobId << ": " << jobStatusNames[pair.second.status]
+                  << " for " << formatStuckDuration(now - pair.second.since);
+        if (!user.empty()) out << ", user " << user;
+        out << std::endl;
+    }
+    out << "==================\n" << std::endl;
+}
+
+// ---------------------------------------------------------------------------
+// Per-printer time series
+//
+// Every successful poll appends one sample to each of a printer's gauges:
+// queue depth, jobs printing, and pages printed per minute (pages printed
+// since the last poll, counting a job that left the queue without being
+// deleted as having printed its remaining pages). Samples are compressed as
+// they arrive, Gorilla style, into chunks covering series.chunk_minutes each:
+// a chunk stores its first timestamp and value in full, then each
+// timestamp as the change in the interval since the previous sample
+// (delta-of-delta; one bit when polls stay on schedule) and each value as
+// the XOR with the previous one (one bit when it is unchanged, otherwise only
+// the bits that differ). Steady gauges cost well under 2 bytes a sample.
+// Chunks older than series.retention_days are dropped. A range read decodes
+// only the chunks overlapping the range; downsampled reads fold the samples
+// into fixed buckets with min, mean and max. Series survive restarts in the
+// warm-start snapshot and are kept for printers that leave the inventory.
+// Everything here is guarded by seriesMutex.
+// ---------------------------------------------------------------------------
+
+enum SeriesMetric {
+    SERIES_DEPTH,
+    SERIES_ACTIVE,
+    SERIES_PAGES_PER_MINUTE,
+    SERIES_METRIC_COUNT
+};
+
+const char* const seriesMetricNames[SERIES_METRIC_COUNT] = { "depth", "active", "ppm" };
+const char* const seriesMetricDescriptions[SERIES_METRIC_COUNT] = {
+    "queue depth", "jobs printing", "pages per minute"
+};
+
+std::atomic<long long> seriesChunkMinutes{120};
+std::atomic<long long> seriesRetentionDays{90};
+
+// One compressed run of samples
+struct SeriesChunk {
+    int64_t start = 0;           // First sample's timestamp, seconds since the epoch
+    int64_t last = 0;            // Last sample's timestamp
+    int64_t lastDelta = 0;       // Interval between the last two samples
+    uint64_t lastValue = 0;      // Bits of the last value
+    uint8_t leading = 0xff;      // Bit window of the last XOR written with a header; 0xff = none yet
+    uint8_t trailing = 0;
+    uint32_t count = 0;
+    uint64_t bitLength = 0;
+    std::vector<uint8_t> bits;   // Most significant bit first
+
+    // Function to append the low count bits of value
+    void writeBits(uint64_t value, unsigned count) {
+        while (count > 0) {
+            unsigned used = static_cast<unsigned>(bitLength % 8);
+            if (used == 0) bits.push_back(0);
+            unsigned take = std::min(count, 8 - used);
+            uint8_t part = static_cast<uint8_t>((value >> (count - take)) & ((1u << take) - 1));
+            bits.back() |= static_cast<uint8_t>(part << (8 - used - take));
+            bitLength += take;
+            count -= take;
+        }
+    }
+
+    // Function to append a sample; timestamps must not go backwards
+    void append(int64_t timestamp, double value) {
+        uint64_t valueBits = std::bit_cast<uint64_t>(value);
+        if (count == 0) {
+            start = last = timestamp;
+            writeBits(valueBits, 64);
+            lastValue = valueBits;
+            count = 1;
+            return;
+        }
+
+        int64_t delta = timestamp - last;
+        int64_t deltaOfDelta = delta - lastDelta;
+        if (deltaOfDelta == 0) {
+            writeBits(0, 1);
+        } else if (deltaOfDelta >= -63 && deltaOfDelta <= 64) {
+            writeBits(0b10, 2);
+            writeBits(static_cast<uint64_t>(deltaOfDelta + 63), 7);
+        } else if (deltaOfDelta >= -255 && deltaOfDelta <= 256) {
+            writeBits(0b110, 3);
+            writeBits(static_cast<uint64_t>(deltaOfDelta + 255), 9);
+        } else if (deltaOfDelta >= -2047 && deltaOfDelta <= 2048) {
+            writeBits(0b1110, 4);
+            writeBits(static_cast<uint64_t>(deltaOfDelta + 2047), 12);
+        } else {
+            writeBits(0b1111, 4);
+            writeBits(static_cast<uint32_t>(deltaOfDelta), 32);
+        }
+        lastDelta = delta;
+        last = timestamp;
+
+        uint64_t xored = valueBits ^ lastValue;
+        if (xored == 0) {
+            writeBits(0, 1);
+        } else {
+            unsigned lead = std::min(static_cast<unsigned>(std::countl_zero(xored)), 31u);
+            unsigned trail = static_cast<unsigned>(std::countr_zero(xored));
+            if (leading != 0xff && lead >= leading && trail >= trailing) {
+                // Fits the previous window: no header
+                writeBits(0b10, 2);
+                writeBits(xored >> trailing, 64 - leading - trailing);
+            } else {
+                unsigned length = 64 - lead - trail;
+                writeBits(0b11, 2);
+                writeBits(lead, 5);
+                writeBits(length & 63, 6);  // 64 is written as 0
+                writeBits(xored >> trail, length);
+                leading = static_cast<uint8_t>(lead);
+                trailing = static_cast<uint8_t>(trail);
+            }
+        }
+        lastValue = valueBits;
+        ++count;
+    }
+};
+
+// Reads a chunk's bit stream back
+struct SeriesBitReader {
+    const std::vector<uint8_t>& bits;
+    uint64_t position = 0;
+
+    uint64_t read(unsigned count) {
+        uint64_t value = 0;
+        while (count > 0) {
+            unsigned used = static_cast<unsigned>(position % 8);
+            unsigned take = std::min(count, 8 - used);
+            uint8_t byte = bits[position / 8];
+            value = (value << take) | ((byte >> (8 - used - take)) & ((1u << take) - 1));
+            position += take;
+            count -= take;
+        }
+        return value;
+    }
+};
+
+// Function to decode a chunk, calling visit(timestamp, value) for each sample in order
+template <typename Visit>
+void decodeSeriesChunk(const SeriesChunk& chunk, Visit visit) {
+    if (chunk.count == 0) return;
+    SeriesBitReader in{ chunk.bits };
+    int64_t timestamp = chunk.start;
+    uint64_t value = in.read(64);
+    visit(timestamp, std::bit_cast<double>(value));
+
+    int64_t delta = 0;
+    unsigned leading = 0, trailing = 0;
+    for (uint32_t i = 1; i < chunk.count; ++i) {
+        int64_t deltaOfDelta;
+        if (in.read(1) == 0) deltaOfDelta = 0;
+        else if (in.read(1) == 0) deltaOfDelta = static_cast<int64_t>(in.read(7)) - 63;
+        else if (in.read(1) == 0) deltaOfDelta = static_cast<int64_t>(in.read(9)) - 255;
+        else if (in.read(1) == 0) deltaOfDelta = static_cast<int64_t>(in.read(12)) - 2047;
+        else deltaOfDelta = static_cast<int32_t>(in.read(32));
+        delta += deltaOfDelta;
+        timestamp += delta;
+
+        if (in.read(1) != 0) {
+            if (in.read(1) != 0) {
+                leading = static_cast<unsigned>(in.read(5));
+                unsigned length = static_cast<unsigned>(in.read(6));
+                if (length == 0) length = 64;
+                trailing = 64 - leading - length;
+            }
+            value ^= in.read(64 - leading - trailing) << trailing;
+        }
+        visit(timestamp, std::bit_cast<double>(value));
+    }
+}
+
+struct TimeSeries {
+    std::deque<SeriesChunk> chunks;
+};
+
+struct PrinterSeries {
+    TimeSeries metrics[SERIES_METRIC_COUNT];
+    int64_t lastSampleAt = 0;
+};
+
+std::unordered_map<uint32_t, PrinterSeries> printerSeries;  // Keyed by printer ID
+std::mutex seriesMutex;
+
+// Function to append a sample to a series, starting a new chunk when the current one is full
+void appendSeriesSample(TimeSeries& series, int64_t timestamp, double value) {
+    int64_t chunkSeconds = std::max(1LL, seriesChunkMinutes.load()) * 60;
+    if (series.chunks.empty() || timestamp < series.chunks.back().last ||
+        timestamp - series.chunks.back().start >= chunkSeconds) {
+        if (!series.chunks.empty()) series.chunks.back().bits.shrink_to_fit();
+        series.chunks.emplace_back();
+    }
+    series.chunks.back().append(timestamp, value);
+
+    int64_t cutoff = timestamp - std::max(1LL, seriesRetentionDays.load()) * 86400;
+    while (series.chunks.size() > 1 && series.chunks.front().last < cutoff) {
+        series.chunks.pop_front();
+    }
+}
+
+// Function to record one poll's gauges for a printer
+void recordPrinterSeries(uint32_t printerId, int64_t now, size_t depth, size_t active, uint64_t pagesPrinted) {
+    std::lock_guard<std::mutex> lock(seriesMutex);
+    PrinterSeries& series = printerSeries[printerId];
+    double minutes = series.lastSampleAt == 0 || now <= series.lastSampleAt
+        ? 1.0 : static_cast<double>(now - series.lastSampleAt) / 60;
+    series.lastSampleAt = now;
+
+    appendSeriesSample(series.metrics[SERIES_DEPTH], now, static_cast<double>(depth));
+    appendSeriesSample(series.metrics[SERIES_ACTIVE], now, static_cast<double>(active));
+    appendSeriesSample(series.metrics[SERIES_PAGES_PER_MINUTE], now, static_cast<double>(pagesPrinted) / minutes);
+}
+
+// Function to read a printer's samples with from <= timestamp < to
+std::vector<std::pair<int64_t, double>> readSeries(uint32_t printerId, SeriesMetric metric, int64_t from, int64_t to) {
+    std::vector<std::pair<int64_t, double>> samples;
+    std::lock_guard<std::mutex> lock(seriesMutex);
+    auto found = printerSeries.find(printerId);
+    if (found == printerSeries.end()) return samples;
+    for (const auto& chunk : found->second.metrics[metric].chunks) {
+        if (chunk.count == 0 || chunk.last < from || chunk.start >= to) continue;
+        decodeSeriesChunk(chunk, [&](int64_t timestamp, double value) {
+            if (timestamp >= from && timestamp < to) samples.emplace_back(timestamp, value);
+        });
+    }
+    return samples;
+}
+
+struct SeriesBucket {
+    int64_t start = 0;
+    uint32_t count = 0;
+    double min = 0, max = 0, sum = 0;
+};
+
+// Function to fold samples into buckets of step seconds starting at from
+std::vector<SeriesBucket> downsampleSeries(const std::vector<std::pair<int64_t, double>>& samples,
+                                           int64_t from, int64_t to, int64_t step) {
+    std::vector<SeriesBucket> buckets(static_cast<size_t>((to - from + step - 1) / step));
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        buckets[i].start = from + static_cast<int64_t>(i) * step;
+    }
+    for (const auto& sample : samples) {
+        SeriesBucket& bucket = buckets[static_cast<size_t>((sample.first - from) / step)];
+        if (bucket.count == 0 || sample.second < bucket.min) bucket.min = sample.second;
+        if (bucket.count == 0 || sample.second > bucket.max) bucket.max = sample.second;
+        bucket.sum += sample.second;
+        ++bucket.count;
+    }
+    return buckets;
+}
+
+// Function to print per-printer sample counts and compressed sizes
+void showSeriesSummary(std::ostream& out) {
+    struct Usage { uint32_t printerId; uint64_t samples, bytes, chunks; };
+    std::vector<Usage> usage;
+    {
+        std::lock_guard<std::mutex> lock(seriesMutex);
+        for (const auto& pair : printerSeries) {
+            Usage entry{ pair.first, 0, 0, 0 };
+            for (const auto& series : pair.second.metrics) {
+                for (const auto& chunk : series.chunks) {
+                    entry.samples += chunk.count;
+                    entry.bytes += (chunk.bitLength + 7) / 8;
+                    ++entry.chunks;
+                }
+            }
+            usage.push_back(entry);
+        }
+    }
+    std::sort(usage.begin(), usage.end(), [](const Usage& a, const Usage& b) { return a.printerId < b.printerId; });
+
+    uint64_t totalSamples = 0, totalBytes = 0;
+    out << "\n=== Time Series ===" << std::endl;
+    for (const auto& entry : usage) {
+        out << "  [" << entry.printerId << "] " << printerNameById(entry.printerId) << ": "
+                  << entry.samples << " samples in " << entry.chunks << " chunks, " << entry.bytes << " bytes"
+                  << std::endl;
+        totalSamples += entry.samples;
+        totalBytes += entry.bytes;
+    }
+    char ratio[32];
+    std::snprintf(ratio, sizeof(ratio), "%.2f", totalSamples ? static_cast<double>(totalBytes) / totalSamples : 0.0);
+    out << "Total: " << totalSamples << " samples, " << totalBytes << " bytes (" << ratio
+              << " bytes per sample)" << std::endl;
+    out << "===================\n" << std::endl;
+}
+
+const long long seriesMaxRows = 10000;  // Longest table `series` prints; the step grows to fit
+
+// Series command: "series" for storage use, or
+// "series <printer id> <depth|active|ppm> [hours] [step minutes]" for a downsampled read
+
+void handleSeriesCommand(const std::string& args, std::ostream& out) {
+    std::istringstream in(args);
+    uint32_t printerId = 0;
+    std::string metricName;
+    if (!(in >> printerId)) {
+        showSeriesSummary(out);
+        return;
+    }
+    in >> metricName;
+    int metric = 0;
+    while (metric < SERIES_METRIC_COUNT && metricName != seriesMetricNames[metric]) ++metric;
+    if (metric == SERIES_METRIC_COUNT) {
+        out << "Usage: series [<printer id> <depth|active|ppm> [hours] [step minutes]]" << std::endl;
+        return;
+    }
+    long long hours = 24, stepMinutes = 0;
+    in >> hours >> stepMinutes;
+    if (hours <= 0) hours = 24;
+    hours = std::min(hours, std::clamp(seriesRetentionDays.load(), 1LL, 36500LL) * 24);  // Nothing older is kept
+    if (stepMinutes <= 0) stepMinutes = std::max(1LL, hours * 60 / 24);  // About 24 rows by default
+    stepMinutes = std::clamp(stepMinutes, (hours * 60 + seriesMaxRows - 1) / seriesMaxRows, hours * 60);
+
+    int64_t step = stepMinutes * 60;
+    int64_t to = (time(nullptr) / step + 1) * step;
+    int64_t from = to - (hours * 3600 + step - 1) / step * step;
+    auto samples = readSeries(printerId, static_cast<SeriesMetric>(metric), from, to);
+    auto buckets = downsampleSeries(samples, from, to, step);
+
+    out << "\n=== " << printerNameById(printerId) << ": " << seriesMetricDescriptions[metric]
+              << ", last " << hours << "h in " << stepMinutes << "-minute steps ===" << std::endl;
+    out << "  " << std::left << std::setw(18) << "From" << std::right << std::setw(9) << "Samples"
+              << std::setw(10) << "Min" << std::setw(10) << "Mean" << std::setw(10) << "Max" << std::endl;
+    for (const auto& bucket : buckets) {
+        std::string label = formatTimestamp(std::chrono::system_clock::from_time_t(bucket.start)).substr(0, 16);
+        out << "  " << std::left << std::setw(18) << label << std::right << std::setw(9) << bucket.count;
+        if (bucket.count > 0) {
+            char text[64];
+            std::snprintf(text, sizeof(text), "%10.2f%10.2f%10.2f", bucket.min, bucket.sum / bucket.count, bucket.max);
+            out << text;
+        }
+        out << std::endl;
+    }
+    out << samples.size() << " samples read." << std::endl;
+}
+
+// Function to time the series codec on synthetic gauges and check that they round-trip
+int runSeriesBenchmark(size_t samples) {
+    std::cout << "Generating " << samples << " synthetic samples per gauge (30 s polls)..." << std::endl;
+    std::vector<int64_t> timestamps(samples);
+    std::vector<double> values[SERIES_METRIC_COUNT];
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    int64_t timestamp = 1700000000;
+    double depth = 3;
+    for (size_t i = 0; i < samples; ++i) {
+        state = mixFingerprint(state, i);
+        timestamp += 30 + (state % 16 == 0 ? static_cast<int64_t>(state >> 60) % 3 - 1 : 0);  // Occasional jitter
+        if ((state >> 8) % 6 == 0) depth = std::max(0.0, depth + ((state >> 16) % 2 ? 1 : -1));
+        timestamps[i] = timestamp;
+        values[SERIES_DEPTH].push_back(depth);
+        values[SERIES_ACTIVE].push_back(depth > 0 ? 1 : 0);
+        values[SERIES_PAGES_PER_MINUTE].push_back(depth > 0 && (state >> 24) % 4 == 0 ? static_cast<double>((state >> 32) % 40) / 0.5 : 0);
+    }
+
+    int64_t chunkSeconds = std::max(1LL, seriesChunkMinutes.load()) * 60;
+    std::cout << std::left << std::setw(8) << "gauge" << std::right << std::setw(14) << "bytes/sample"
+              << std::setw(16) << "encode ns/smp" << std::setw(16) << "decode ns/smp" << std::endl;
+    bool allMatch = true;
+    for (int metric = 0; metric < SERIES_METRIC_COUNT; ++metric) {
+        std::vector<SeriesChunk> chunks;
+        auto started = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < samples; ++i) {
+            if (chunks.empty() || timestamps[i] - chunks.back().start >= chunkSeconds) chunks.emplace_back();
+            chunks.back().append(timestamps[i], values[metric][i]);
+        }
+        auto encoded = std::chrono::steady_clock::now();
+        size_t position = 0, bytes = 0;
+        bool match = true;
+        for (const auto& chunk : chunks) {
+            bytes += (chunk.bitLength + 7) / 8;
+            decodeSeriesChunk(chunk, [&](int64_t decodedTime, double value) {
+                match = match && position < samples && decodedTime == timestamps[position] &&
+                        value == values[metric][position];
+                ++position;
+            });
+        }
+        auto decoded = std::chrono::steady_clock::now();
+        match = match && position == samples;
+        allMatch = allMatch && match;
+
+        char line[128];
+        std::snprintf(line, sizeof(line), "%-8s%14.3f%16.1f%16.1f%s", seriesMetricNames[metric],
+                      static_cast<double>(bytes) / std::max<size_t>(1, samples),
+                      std::chrono::duration<double, std::nano>(encoded - started).count() / std::max<size_t>(1, samples),
+                      std::chrono::duration<double, std::nano>(decoded - encoded).count() / std::max<size_t>(1, samples),
+                      match ? "" : "  MISMATCH");
+        std::cout << line << std::endl;
+    }
+    return allMatch ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------------
+// Warm-start snapshot
+//
+// The job store, printer inventory, per-printer job fingerprints and running
+// totals are written to print_monitor.snap on quit and every
+// snapshot.interval_minutes while monitoring. At startup the file is mapped
+// read-only and parsed in place, so a restart resumes where it left off: jobs
+// still sitting in a queue keep their fingerprint and are neither logged nor
+// recorded again. The inventory is restored as absent printers with their
+// IDs, which the first refresh marks present again, so the fingerprints line
+// up with the same printers. The dedupe index and job columns are derived
+// from the job list and are rebuilt on load rather than stored, apart from
+// each job's cost, which was fixed when the job was priced.
+//
+// Layout (little endian): a 32-byte header { "PMSNAP\0\0", uint32 version,
+// uint32 reserved, uint64 payload size, uint64 FNV-1a of the payload }, then
+// the payload: saved-at time, counters, printers, jobs, cost rates and
+// totals, fingerprints with each queued job's last status and page counts,
+// the stuck-job tracking records, and the per-printer time series chunks
+// as their raw bit streams, with strings as a uint32 length followed by the bytes. A file with another
+// version, or that fails the size or checksum test, is ignored.
+// ---------------------------------------------------------------------------
+
+const char* snapshotFileName = "print_monitor.snap";
+const char snapshotMagic[8] = { 'P', 'M', 'S', 'N', 'A', 'P', 0, 0 };
+const uint32_t snapshotVersion = 6;
+const size_t snapshotHeaderSize = 32;
+
+std::atomic<long long> snapshotIntervalMinutes{5};
+std::mutex snapshotMutex;  // Serializes snapshot writers
+
+// Function to hash the snapshot payload (FNV-1a)
+uint64_t snapshotChecksum(const uint8_t* data, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Appends fixed-size values and length-prefixed strings to a byte buffer
+struct SnapshotWriter {
+    std::string buffer;
+
+    template <typename T>
+    void put(T value) {
+        static_assert(std::is_trivially_copyable<T>::value, "snapshot fields must be plain values");
+        buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+    void putString(const std::string& value) {
+        put(static_cast<uint32_t>(value.size()));
+        buffer.append(value);
+    }
+};
+
+// Reads the same encoding back from a mapped view; any read past the end fails the whole load
+struct SnapshotReader {
+    const uint8_t* cursor;
+    const uint8_t* end;
+    bool ok = true;
+
+    template <typename T>
+    T get() {
+        T value{};
+        if (!ok || static_cast<size_t>(end - cursor) < sizeof(T)) {
+            ok = false;
+            return value;
+        }
+        std::memcpy(&value, cursor, sizeof(T));
+        cursor += sizeof(T);
+        return value;
+    }
+    std::string getString() {
+        uint32_t size = get<uint32_t>();
+        if (!ok || static_cast<size_t>(end - cursor) < size) {
+            ok = false;
+            return std::string();
+        }
+        std::string value(reinterpret_cast<const char*>(cursor), size);
+        cursor += size;
+        return value;
+    }
+};
+
+// Function to serialize the current state into a snapshot payload
+std::string buildSnapshotPayload() {
+    SnapshotWriter out;
+    out.put(static_cast<int64_t>(time(nullptr)));
+    out.put(static_cast<uint64_t>(jobsDecodedTotal));
+    out.put(static_cast<uint64_t>(jobsUnchangedTotal));
+    out.put(static_cast<uint64_t>(storeLockAcquisitions));
+
+    {
+        std::lock_guard<std::mutex> lock(inventoryMutex);
+        out.put(static_cast<uint32_t>(printerInventory.size()));
+        for (const auto& printer : printerInventory) {
+            out.putString(printer.name);
+            out.putString(printer.location);
+            out.put(static_cast<int64_t>(printer.pollIntervalSeconds));
+        }
+    }
+
+    // A poll updates its fingerprints and commits its jobs under the printer's
+    // fingerprint lock, so holding every one of them while copying the store
+    // yields fingerprints that match the recorded jobs exactly
+    std::lock_guard<std::mutex> tablesLock(fingerprintsMutex);
+    std::vector<std::unique_lock<std::mutex>> printerLocks;
+    printerLocks.reserve(jobFingerprints.size());
+    for (auto& pair : jobFingerprints) {
+        printerLocks.emplace_back(pair.second->mutex);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        out.put(static_cast<uint32_t>(printJobs.size()));
+        for (size_t row = 0; row < printJobs.size(); ++row) {
+            const PrintJob& job = printJobs[row];
+            out.putString(job.printerName);
+            out.putString(job.timestamp);
+            out.putString(job.status);
+            out.put(static_cast<int32_t>(job.pages));
+            out.put(static_cast<int32_t>(job.documentSize));
+            out.putString(job.colorMode);
+            out.putString(job.duplexSetting);
+            out.putString(job.paperSize);
+            out.putString(job.userAccount);
+            out.putString(job.jobId);
+            out.put(job.submitted);
+            out.put(jobColumns.cost[row]);
+        }
+
+        out.put(static_cast<uint32_t>(costRates.size()));
+        for (const auto& rate : costRates) {
+            out.put(rate.printerId);
+            out.put(rate.paperMask);
+            out.put(rate.colorMask);
+            out.put(rate.duplexMask);
+            out.put(rate.pricePerPage);
+        }
+        out.put(costTotal);
+        out.put(static_cast<uint32_t>(userNames.size()));
+        for (uint32_t id = 0; id < userNames.size(); ++id) {
+            out.putString(userNames[id]);
+            out.put(id < costByUser.size() ? costByUser[id] : int64_t(0));
+        }
+        out.put(static_cast<uint32_t>(costByPrinter.size()));
+        for (int64_t cost : costByPrinter) {
+            out.put(cost);
+        }
+    }
+
+    out.put(static_cast<uint32_t>(jobFingerprints.size()));
+    for (const auto& pair : jobFingerprints) {
+        out.put(pair.first);
+        out.put(pair.second->polls);
+        out.put(static_cast<uint32_t>(pair.second->jobs.size()));
+        for (const auto& job : pair.second->jobs) {
+            out.put(static_cast<uint32_t>(job.first));
+            out.put(job.second.value);
+            out.put(job.second.lastSeenPoll);
+            out.put(static_cast<uint32_t>(job.second.status));
+            out.put(static_cast<uint32_t>(job.second.pagesPrinted));
+            out.put(static_cast<uint32_t>(job.second.totalPages));
+        }
+    }
+
+    std::lock_guard<std::mutex> stuckLock(stuckMutex);
+    out.put(static_cast<uint32_t>(trackedJobs.size()));
+    for (const auto& pair : trackedJobs) {
+        out.put(pair.first);
+        out.put(pair.second.status);
+        out.put(pair.second.since);
+        out.put(pair.second.deadline);
+        out.put(static_cast<uint8_t>(pair.second.stuck));
+    }
+
+    std::lock_guard<std::mutex> seriesLock(seriesMutex);
+    out.put(static_cast<uint32_t>(printerSeries.size()));
+    for (const auto& pair : printerSeries) {
+        out.put(pair.first);
+        out.put(pair.second.lastSampleAt);
+        for (const auto& series : pair.second.metrics) {
+            out.put(static_cast<uint32_t>(series.chunks.size()));
+            for (const auto& chunk : series.chunks) {
+                out.put(chunk.start);
+                out.put(chunk.last);
+                out.put(chunk.lastDelta);
+                out.put(chunk.lastValue);
+                out.put(chunk.leading);
+                out.put(chunk.trailing);
+                out.put(chunk.count);
+                out.put(chunk.bitLength);
+                out.putString(std::string(chunk.bits.begin(), chunk.bits.end()));
+            }
+        }
+    }
+    return std::move(out.buffer);
+}
+
+// Function to write a snapshot to a temporary file and move it over the previous one
+bool saveSnapshot() {
+    std::lock_guard<std::mutex> writerLock(snapshotMutex);
+    auto started = std::chrono::steady_clock::now();
+    std::string payload = buildSnapshotPayload();
+
+    SnapshotWriter header;
+    header.buffer.append(snapshotMagic, sizeof(snapshotMagic));
+    header.put(snapshotVersion);
+    header.put(static_cast<uint32_t>(0));
+    header.put(static_cast<uint64_t>(payload.size()));
+    header.put(snapshotChecksum(reinterpret_cast<const uint8_t*>(payload.data()), payload.size()));
+
+    std::string temporary = std::string(snapshotFileName) + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        file.write(header.buffer.data(), static_cast<std::streamsize>(header.buffer.size()));
+        file.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+        file.close();
+        if (!file) {
+            LOG_ERROR("Failed to write snapshot file: ", temporary);
+            return false;
+        }
+    }
+    if (!MoveFileExA(temporary.c_str(), snapshotFileName, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        LOG_ERROR("Failed to replace snapshot file ", snapshotFileName, ". Error: ", GetLastError());
+        return false;
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+    LOG_DEBUG("Snapshot written: ", header.buffer.size() + payload.size(), " bytes in ", elapsed.count(), " ms");
+    return true;
+}
+
+// Function to parse a mapped snapshot and install it; returns false if it is unusable
+bool restoreSnapshot(const uint8_t* data, size_t size) {
+    if (size < snapshotHeaderSize || std::memcmp(data, snapshotMagic, sizeof(snapshotMagic)) != 0) {
+        LOG_WARN("Ignoring ", snapshotFileName, ": not a snapshot file.");
+        return false;
+    }
+    SnapshotReader header{ data + sizeof(snapshotMagic), data + snapshotHeaderSize };
+    uint32_t version = header.get<uint32_t>();
+    header.get<uint32_t>();
+    uint64_t payloadSize = header.get<uint64_t>();
+    uint64_t checksum = header.get<uint64_t>();
+    if (version != snapshotVersion) {
+        LOG_WARN("Ignoring ", snapshotFileName, ": version ", version, ", expected ", snapshotVersion, ".");
+        return false;
+    }
+    const uint8_t* payload = data + snapshotHeaderSize;
+    if (payloadSize != size - snapshotHeaderSize || snapshotChecksum(payload, size - snapshotHeaderSize) != checksum) {
+        LOG_WARN("Ignoring ", snapshotFileName, ": truncated or corrupt.");
+        return false;
+    }
+
+    SnapshotReader in{ payload, payload + payloadSize };
+    int64_t savedAt = in.get<int64_t>();
+    uint64_t decodedTotal = in.get<uint64_t>();
+    uint64_t unchangedTotal = in.get<uint64_t>();
+    uint64_t lockAcquisitions = in.get<uint64_t>();
+
+    std::vector<PrinterRecord> printers(in.get<uint32_t>());
+    for (uint32_t id = 0; id < printers.size() && in.ok; ++id) {
+        printers[id].id = id;
+        printers[id].name = in.getString();
+        printers[id].location = in.getString();
+        printers[id].pollIntervalSeconds = in.get<int64_t>();
+    }
+
+    std::vector<PrintJob> jobs(in.ok ? in.get<uint32_t>() : 0);
+    std::vector<int64_t> jobCosts;
+    jobCosts.reserve(jobs.size());
+    for (auto& job : jobs) {
+        job.printerName = in.getString();
+        job.timestamp = in.getString();
+        job.status = in.getString();
+        job.pages = in.get<int32_t>();
+        job.documentSize = in.get<int32_t>();
+        job.colorMode = in.getString();
+        job.duplexSetting = in.getString();
+        job.paperSize = in.getString();
+        job.userAccount = in.getString();
+        job.jobId = in.getString();
+        job.submitted = in.get<uint64_t>();
+        jobCosts.push_back(in.get<int64_t>());
+        if (!in.ok) break;
+    }
+
+    std::vector<CostRate> rates(in.ok ? in.get<uint32_t>() : 0);
+    for (auto& rate : rates) {
+        rate.printerId = in.get<uint32_t>();
+        rate.paperMask = in.get<uint32_t>();
+        rate.colorMask = in.get<uint32_t>();
+        rate.duplexMask = in.get<uint32_t>();
+        rate.pricePerPage = in.get<int64_t>();
+    }
+    int64_t totalCost = in.get<int64_t>();
+    std::vector<std::pair<std::string, int64_t>> userCosts(in.ok ? in.get<uint32_t>() : 0);
+    for (auto& user : userCosts) {
+        user.first = in.getString();
+        user.second = in.get<int64_t>();
+        if (!in.ok) break;
+    }
+    std::vector<int64_t> printerCosts(in.ok ? in.get<uint32_t>() : 0);
+    for (auto& cost : printerCosts) {
+        cost = in.get<int64_t>();
+    }
+
+    std::unordered_map<uint32_t, std::shared_ptr<PrinterFingerprints>> fingerprints;
+    size_t fingerprintCount = 0;
+    uint32_t printerTables = in.ok ? in.get<uint32_t>() : 0;
+    for (uint32_t i = 0; i < printerTables && in.ok; ++i) {
+        std::shared_ptr<PrinterFingerprints>& entry = fingerprints[in.get<uint32_t>()];
+        if (!entry) entry = std::make_shared<PrinterFingerprints>();
+        PrinterFingerprints& table = *entry;
+        table.polls = in.get<uint64_t>();
+        uint32_t count = in.get<uint32_t>();
+        for (uint32_t j = 0; j < count && in.ok; ++j) {
+            JobFingerprint& fingerprint = table.jobs[in.get<uint32_t>()];
+            fingerprint.value = in.get<uint64_t>();
+            fingerprint.lastSeenPoll = in.get<uint64_t>();
+            fingerprint.status = in.get<uint32_t>();
+            fingerprint.pagesPrinted = in.get<uint32_t>();
+            fingerprint.totalPages = in.get<uint32_t>();
+        }
+        fingerprintCount += count;
+    }
+    std::unordered_map<uint64_t, TrackedJob> tracked;
+    uint32_t trackedCount = in.ok ? in.get<uint32_t>() : 0;
+    for (uint32_t i = 0; i < trackedCount && in.ok; ++i) {
+        TrackedJob& job = tracked[in.get<uint64_t>()];
+        job.status = in.get<uint8_t>();
+        job.since = in.get<int64_t>();
+        job.deadline = in.get<int64_t>();
+        job.stuck = in.get<uint8_t>() != 0;
+    }
+    std::unordered_map<uint32_t, PrinterSeries> series;
+    uint32_t seriesCount = in.ok ? in.get<uint32_t>() : 0;
+    for (uint32_t i = 0; i < seriesCount && in.ok; ++i) {
+        PrinterSeries& printerSamples = series[in.get<uint32_t>()];
+        printerSamples.lastSampleAt = in.get<int64_t>();
+        for (auto& metric : printerSamples.metrics) {
+            uint32_t chunkCount = in.get<uint32_t>();
+            for (uint32_t c = 0; c < chunkCount && in.ok; ++c) {
+                SeriesChunk& chunk = metric.chunks.emplace_back();
+                chunk.start = in.get<int64_t>();
+                chunk.last = in.get<int64_t>();
+                chunk.lastDelta = in.get<int64_t>();
+                chunk.lastValue = in.get<uint64_t>();
+                chunk.leading = in.get<uint8_t>();
+                chunk.trailing = in.get<uint8_t>();
+                chunk.count = in.get<uint32_t>();
+                chunk.bitLength = in.get<uint64_t>();
+                std::string bits = in.getString();
+                chunk.bits.assign(bits.begin(), bits.end());
+                if (chunk.bits.size() != (chunk.bitLength + 7) / 8) in.ok = false;
+            }
+        }
+    }
+    if (!in.ok) {
+        LOG_WARN("Ignoring ", snapshotFileName, ": truncated or corrupt.");
+        return false;
+    }
+
+    std::unordered_map<std::string, uint32_t> printerIds;
+    for (const auto& printer : printers) {
+        printerIds.emplace(printer.name, printer.id);
+    }
+    {
+        std::lock_guard<std::mutex> lock(inventoryMutex);
+        printerIdsByName = printerIds;
+        printerInventory = std::move(printers);
+    }
+    {
+        std::lock_guard<std::mutex> lock(fingerprintsMutex);
+        jobFingerprints = std::move(fingerprints);
+    }
+    {
+        std::lock_guard<std::mutex> lock(stuckMutex);
+        trackedJobs = std::move(tracked);
+        stuckJobKeys.clear();
+        for (auto& pair : trackedJobs) {
+            pair.second.generation = nextTrackingGeneration++;
+            if (pair.second.stuck) stuckJobKeys.insert(pair.first);
+        }
+        rebuildStuckDeadlines();
+    }
+    {
+        std::lock_guard<std::mutex> lock(seriesMutex);
+        printerSeries = std::move(series);
+    }
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        costRates = std::move(rates);
+        costTables.clear();
+        costTotal = totalCost;
+        costByPrinter = std::move(printerCosts);
+        userNames.clear();
+        userIdsByName.clear();
+        costByUser.assign(userCosts.size(), 0);
+        for (const auto& user : userCosts) {
+            costByUser[internUser(user.first)] = user.second;
+        }
+
+        recordedJobKeys.clear();
+        recordedJobKeys.reserve(jobs.size());
+        jobColumns.clear();
+        firstJobSequence = 0;
+        for (size_t row = 0; row < jobs.size(); ++row) {
+            const PrintJob& job = jobs[row];
+            recordedJobKeys.emplace(jobKey(job.printerName, job.jobId), row);
+            auto printer = printerIds.find(job.printerName);
+            jobColumns.append(job, printer == printerIds.end() ? noColumnId : printer->second,
+                              internUser(job.userAccount), parseTimestamp(job.timestamp), jobCosts[row]);
+        }
+        printJobs = std::move(jobs);
+    }
+    jobsDecodedTotal = decodedTotal;
+    jobsUnchangedTotal = unchangedTotal;
+    storeLockAcquisitions = lockAcquisitions;
+
+    LOG_INFO("Restored snapshot from ", std::max<int64_t>(0, time(nullptr) - savedAt), "s ago: ",
+             printJobs.size(), " jobs, ", printerInventory.size(), " printers, ",
+             fingerprintCount, " queued job fingerprints");
+    return true;
+}
+
+// Function to map the snapshot file, if there is one, and restore it
+void loadSnapshot() {
+    auto started = std::chrono::steady_clock::now();
+    HANDLE file = CreateFileA(snapshotFileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        DWORD error = GetLastError();
+        if (error != ERROR_FILE_NOT_FOUND) {
+            LOG_WARN("Could not open ", snapshotFileName, ". Error: ", error);
+        }
+        return;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart < static_cast<LONGLONG>(snapshotHeaderSize)) {
+        LOG_WARN("Ignoring ", snapshotFileName, ": not a snapshot file.");
+        CloseHandle(file);
+        return;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (view) {
+        if (restoreSnapshot(static_cast<const uint8_t*>(view), static_cast<size_t>(size.QuadPart))) {
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+            LOG_DEBUG("Snapshot loaded in ", elapsed.count(), " ms");
+        }
+        UnmapViewOfFile(view);
+    } else {
+        LOG_WARN("Could not map ", snapshotFileName, ". Error: ", GetLastError());
+    }
+    if (mapping) CloseHandle(mapping);
+    CloseHandle(file);
+}
+
+// Snapshot timer
+void periodicSnapshot() {
+    saveSnapshot();
+}
+
+// ---------------------------------------------------------------------------
+// Partitioned exports
+//
+// With export.partition set to 1 (hourly) or 2 (daily), every job is also
+// appended to a partition file for the period in which it was finalized,
+// that is, when it left the print queue and its record stopped changing.
+// The current partition stays open as
+// partitions/print_jobs_<period>.csv.partial, an AsyncFile with buffers of
+// export.partition_buffer_kb that are submitted as they fill and on each
+// housekeeping run. Once the period is over, housekeeping closes the file,
+// renames it to .csv and appends a line to partitions/manifest.csv:
+//   sequence,file,rows,bytes,fnv1a64,sealed at
+// A sealed file is never written again. A consumer remembers the last
+// sequence it loaded and picks up only the lines after it. A .partial file
+// left by an earlier run is reopened if its period is still current, and
+// sealed otherwise.
+// ---------------------------------------------------------------------------
+
+std::atomic<long long> partitionMode{0};          // 0 = off, 1 = hourly, 2 = daily
+std::atomic<long long> partitionBufferKb{64};
+const char* partitionDirectory = "partitions";
+const char* partitionManifestName = "manifest.csv";
+
+struct CurrentPartition {
+    bool active = false;     // A partition has been started and not sealed yet
+    long long mode = 0;      // partitionMode it was opened under
+    int64_t start = 0;       // Period, [start, end) local time
+    int64_t end = 0;
+    std::string name;        // print_jobs_<period>.csv; the open file has .partial appended
+    AsyncFile file;
+};
+
+CurrentPartition currentPartition;  // Guarded by partitionMutex
+std::mutex partitionMutex;
+bool partitionsRecovered = false;   // Leftover .partial files handled; guarded by partitionMutex
+uint64_t nextManifestSequence = 1;  // Guarded by partitionMutex
+std::atomic<uint64_t> partitionRowsWritten{0};
+std::atomic<uint64_t> partitionsSealed{0};
+
+// Function to work out the hourly or daily period containing a time, and its file name
+void partitionPeriod(int64_t when, long long mode, int64_t& start, int64_t& end, std::string& name) {
+    time_t seconds = static_cast<time_t>(when);
+    std::tm tm = {};
+    localtime_s(&tm, &seconds);
+    tm.tm_min = 0;
+    tm.tm_sec = 0;
+    if (mode != 1) tm.tm_hour = 0;
+    tm.tm_isdst = -1;
+    start = static_cast<int64_t>(std::mktime(&tm));
+    char label[32];
+    std::strftime(label, sizeof(label), mode == 1 ? "%Y-%m-%dT%H" : "%Y-%m-%d", &tm);
+    name = std::string("print_jobs_") + label + ".csv";
+    if (mode == 1) {
+        tm.tm_hour += 1;
+    } else {
+        tm.tm_mday += 1;  // mktime normalizes, and copes with DST changes in between
+    }
+    tm.tm_isdst = -1;
+    end = static_cast<int64_t>(std::mktime(&tm));
+}
+
+// Function to recover the period of a partition from its file name; returns the mode, or 0
+long long parsePartitionName(const std::string& name, int64_t& start, int64_t& end) {
+    int year = 0, month = 0, day = 0, hour = 0;
+    char tail[16] = {};
+    long long mode = 0;
+    if (std::sscanf(name.c_str(), "print_jobs_%d-%d-%dT%d.%15s", &year, &month, &day, &hour, tail) == 5) {
+        mode = 1;
+    } else if (std::sscanf(name.c_str(), "print_jobs_%d-%d-%d.%15s", &year, &month, &day, tail) == 4) {
+        mode = 2;
+    } else {
+        return 0;
+    }
+    std::tm tm = {};
+    tm.tm_year = year - 1900;
+    tm.tm_mon = month - 1;
+    tm.tm_mday = day;
+    tm.tm_hour = hour;
+    tm.tm_isdst = -1;
+    std::string unused;
+    partitionPeriod(static_cast<int64_t>(std::mktime(&tm)), mode, start, end, unused);
+    return mode;
+}
+
+// Function to hand a partition's buffered rows to the OS; caller holds partitionMutex
+void flushPartition(CurrentPartition& partition) {
+    if (!partition.file.isOpen()) return;
+    partition.file.submit();
+    if (partition.file.failed) {
+        LOG_ERROR("Failed to write partition ", partition.name, ".partial. Error: ", partition.file.error);
+    }
+}
+
+// Function to seal a closed partition file: rename it and add it to the
+// manifest with its row count, size and checksum; caller holds partitionMutex
+void sealPartitionFile(const std::string& name) {
+    namespace fs = std::filesystem;
+    fs::path directory(partitionDirectory);
+    std::error_code error;
+    fs::rename(directory / (name + ".partial"), directory / name, error);
+    if (error) {
+        LOG_ERROR("Failed to seal partition ", name, ": ", error.message());
+        return;
+    }
+
+    std::ifstream sealed(directory / name, std::ios::binary);
+    std::string content((std::istreambuf_iterator<char>(sealed)), std::istreambuf_iterator<char>());
+    size_t rows = std::count(content.begin(), content.end(), '\n');
+    if (rows > 0) --rows;  // Header
+    uint64_t checksum = snapshotChecksum(reinterpret_cast<const uint8_t*>(content.data()), content.size());
+
+    fs::path manifestPath = directory / partitionManifestName;
+    bool newManifest = !fs::exists(manifestPath);
+    std::ofstream manifest(manifestPath, std::ios::app);
+    if (newManifest) manifest << "sequence,file,rows,bytes,fnv1a64,sealed_at\n";
+    char hash[17];
+    std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(checksum));
+    manifest << nextManifestSequence++ << ',' << name << ',' << rows << ',' << content.size() << ','
+             << hash << ',' << getCurrentTimestamp() << '\n';
+    if (!manifest) {
+        LOG_ERROR("Failed to append partition ", name, " to the manifest");
+        return;
+    }
+    ++partitionsSealed;
+    LOG_INFO("Partition sealed: ", name, " (", rows, " jobs)");
+}
+
+// Function to close the current partition's file, sealing the partition if asked; caller holds partitionMutex
+void closeCurrentPartition(bool seal) {
+    CurrentPartition& partition = currentPartition;
+    if (partition.file.isOpen() && !partition.file.close()) {
+        LOG_ERROR("Failed to write partition ", partition.name, ".partial. Error: ", partition.file.error);
+    }
+    if (seal && partition.active) {
+        sealPartitionFile(partition.name);
+        partition.active = false;
+    }
+}
+
+// Function to open the partition for a time as the current one, appending to
+// a file left by an earlier run; caller holds partitionMutex
+bool openPartition(int64_t when, long long mode) {
+    namespace fs = std::filesystem;
+    CurrentPartition& partition = currentPartition;
+    partitionPeriod(when, mode, partition.start, partition.end, partition.name);
+    partition.mode = mode;
+    partition.active = true;
+
+    std::error_code error;
+    fs::create_directories(partitionDirectory, error);
+    fs::path path = fs::path(partitionDirectory) / (partition.name + ".partial");
+    bool fresh = !fs::exists(path) || fs::file_size(path, error) == 0;
+    size_t bufferBytes = static_cast<size_t>(std::max(1LL, partitionBufferKb.load())) * 1024;
+    if (!partition.file.open(path.string(), true, bufferBytes)) {
+        LOG_ERROR("Could not open partition file for writing: ", path.string());
+        partition.active = false;
+        return false;
+    }
+    if (fresh) partition.file.write(csvHeader);
+    return true;
+}
+
+// Function to pick up after an earlier run: read the manifest's last sequence
+// and seal the .partial files whose period is over; caller holds partitionMutex
+void recoverPartitions(int64_t now) {
+    namespace fs = std::filesystem;
+    partitionsRecovered = true;
+    std::error_code error;
+    if (!fs::is_directory(partitionDirectory, error)) return;
+
+    std::ifstream manifest(fs::path(partitionDirectory) / partitionManifestName);
+    std::string line;
+    while (std::getline(manifest, line)) {
+        unsigned long long sequence = std::strtoull(line.c_str(), nullptr, 10);
+        if (sequence >= nextManifestSequence) nextManifestSequence = sequence + 1;
+    }
+
+    std::vector<std::string> leftovers;
+    for (const auto& entry : fs::directory_iterator(partitionDirectory, error)) {
+        std::string name = entry.path().filename().string();
+        if (name.size() > 8 && name.compare(name.size() - 8, 8, ".partial") == 0) {
+            leftovers.push_back(name.substr(0, name.size() - 8));
+        }
+    }
+    std::sort(leftovers.begin(), leftovers.end());
+    for (const auto& name : leftovers) {
+        int64_t start = 0, end = 0;
+        long long mode = parsePartitionName(name, start, end);
+        if (mode == 0) continue;
+        if (end > now && !currentPartition.active) {
+            // Still current; it is reopened by the next write, or sealed once it ends
+            currentPartition.active = true;
+            currentPartition.mode = mode;
+            currentPartition.start = start;
+            currentPartition.end = end;
+            currentPartition.name = name;
+        } else {
+            sealPartitionFile(name);
+        }
+    }
+}
+
+// Function to append jobs finalized at `now` to the current partition, starting a new one as periods change
+void writeFinalizedJobs(const std::vector<PrintJob>& jobs, int64_t now) {
+    long long mode = partitionMode;
+    if (mode != 1 && mode != 2) return;
+
+    std::lock_guard<std::mutex> lock(partitionMutex);
+    if (!partitionsRecovered) recoverPartitions(now);
+    CurrentPartition& partition = currentPartition;
+    if (partition.active && (partition.mode != mode || now < partition.start || now >= partition.end)) {
+        closeCurrentPartition(true);
+    }
+    if (!partition.active && !openPartition(now, mode)) return;
+    if (!partition.file.isOpen() && !openPartition(partition.start, partition.mode)) return;
+
+    std::string rows;
+    for (const auto& job : jobs) {
+        appendCsvRow(rows, job);
+    }
+    partition.file.write(rows);
+    partitionRowsWritten += jobs.size();
+}
+
+// Function to write out a printer's departed jobs as their final records
+void finalizeDepartedJobs(const std::string& printerName, const DepartedJobs& departed, int64_t now) {
+    if (partitionMode != 1 && partitionMode != 2) return;
+    std::vector<PrintJob> finalized;
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        for (const auto& job : departed) {
+            auto recorded = recordedJobKeys.find(jobKey(printerName, std::to_string(job.first)));
+            if (recorded == recordedJobKeys.end()) continue;  // Already evicted from the store
+            finalized.push_back(printJobs[static_cast<size_t>(recorded->second - firstJobSequence)]);
+        }
+    }
+    if (!finalized.empty()) writeFinalizedJobs(finalized, now);
+}
+
+// Housekeeping: write out buffered rows and seal the current partition once its period is over
+void maintainPartitions(int64_t now) {
+    std::lock_guard<std::mutex> lock(partitionMutex);
+    if (!partitionsRecovered) {
+        if (partitionMode != 1 && partitionMode != 2) return;
+        recoverPartitions(now);
+    }
+    if (!currentPartition.active) return;
+    if (now >= currentPartition.end) {
+        closeCurrentPartition(true);
+    } else {
+        flushPartition(currentPartition);
+    }
+}
+
+// Function to flush and close the current partition file without sealing it (monitoring stopped)
+void suspendPartitions() {
+    std::lock_guard<std::mutex> lock(partitionMutex);
+    closeCurrentPartition(false);
+}
+
+// ---------------------------------------------------------------------------
+// Asynchronous poll pipeline
+//
+// Each printer poll is a C++20 coroutine that runs on a small executor.
+// The Win32 spooler APIs are synchronous, so every spooler call is
+// co_awaited through spoolerCall(), which runs it on a pool of blocking-call
+// threads and resumes the coroutine on the executor when it returns or its
+// deadline (spooler.call_timeout_ms) passes. Executor threads therefore never
+// wait on a slow print server, and many printers' enumerations can be in
+// flight at once; the CPU-side work (fingerprinting, decoding, batching)
+// stays on the few executor threads.
+// ---------------------------------------------------------------------------
+
+const size_t pollExecutorThreads = 2;
+const size_t spoolerCallThreads = 16;
+
+WorkerPool pollExecutor;
+WorkerPool spoolerCallPool;
+
+// Awaiter that moves the awaiting coroutine onto the poll executor
+struct ResumeOnExecutor {
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) const {
+        postToPool(pollExecutor, [handle] { handle.resume(); });
+    }
+    void await_resume() const noexcept {}
+};
+
+// Awaiter that moves the awaiting coroutine onto another pool, such as the I/O
+// pool for work that may wait on the disk; it stays put if that pool is not running
+struct ResumeOnPool {
+    WorkerPool& pool;
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> handle) const {
+        std::function<void()> resume = [handle] { handle.resume(); };
+        return tryPostToPool(pool, resume);
+    }
+    void await_resume() const noexcept {}
+};
+
+// Fire-and-forget coroutine for one printer poll; the frame frees itself when the poll ends
+struct PollTask {
+    struct promise_type {
+        PollTask get_return_object() noexcept { return {}; }
+        ResumeOnExecutor initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept {}
+        void unhandled_exception() const noexcept {
+            try {
+                throw;
+            } catch (const std::exception& e) {
+                LOG_ERROR("Printer poll failed: ", e.what());
+            } catch (...) {
+                LOG_ERROR("Printer poll failed with an unknown exception.");
+            }
+        }
+    };
+};
+
+// Outcome of a spooler call, with GetLastError captured on the thread that made it
+struct SpoolerResult {
+    BOOL ok = FALSE;
+    DWORD error = 0;
+    bool timedOut = false;
+};
+
+// Deadline for each spooler call (see the `config` command)
+std::atomic<long long> spoolerCallTimeoutMs{5000};
+std::atomic<uint64_t> spoolerCallsTimedOut{0};
+
+// Rendezvous between a spooler call, its deadline timer and the waiting coroutine
+struct SpoolerCallState {
+    std::mutex mutex;
+    bool completed = false;
+    bool abandoned = false;
+    SpoolerResult result;
+    TimerHandle deadlineTimer = 0;
+    std::coroutine_handle<> waiter;
+};
+
+// Function to finish a call that returned; runs on the blocking-call thread
+void completeSpoolerCall(const std::shared_ptr<SpoolerCallState>& state, BOOL ok, DWORD error) {
+    TimerHandle deadline;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (state->abandoned) {
+            // The coroutine moved on at the deadline; this thread was replaced
+            retireCurrentWorker = true;
+            return;
+        }
+        state->completed = true;
+        state->result.ok = ok;
+        state->result.error = error;
+        deadline = state->deadlineTimer;
+    }
+    cancelTimer(deadline);
+    postToPool(pollExecutor, [state] { state->waiter.resume(); });
+}
+
+// Deadline timer: resume the coroutine with a timeout and replace the stuck thread
+void expireSpoolerCall(const std::shared_ptr<SpoolerCallState>& state) {
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (state->completed) return;
+        state->abandoned = true;
+        state->result.ok = FALSE;
+        state->result.error = ERROR_TIMEOUT;
+        state->result.timedOut = true;
+    }
+    ++spoolerCallsTimedOut;
+    {
+        // Release the stuck thread from the pool and start its replacement
+        std::lock_guard<std::mutex> lock(spoolerCallPool.mutex);
+        --spoolerCallPool.liveThreads;
+        addPoolWorker(spoolerCallPool);
+    }
+    postToPool(pollExecutor, [state] { state->waiter.resume(); });
+}
+
+// Memory the spooler calls of one poll touch, shared with the blocking-call
+// threads so an abandoned call can finish safely after the poll has ended
+struct SpoolerSession {
+    std::string printerName;
+    WideString widePrinterName;
+    HANDLE printer = NULL;
+    std::vector<BYTE> jobBuffer;
+    DWORD bytesNeeded = 0;
+    DWORD jobCount = 0;
+
+    ~SpoolerSession() {
+        // Only reached with an open handle when a spooler call on it was abandoned; the
+        // abandoned call holds the session, so this runs after it has returned
+        if (printer) ClosePrinter(printer);
+    }
+};
+
+// Awaiter that runs a spooler call on the blocking pool and resumes on the
+// executor when it returns or its deadline passes, whichever comes first.
+// The call only touches the session it is handed, which it keeps alive, since
+// an abandoned call keeps running after the coroutine has moved on.
+template <typename Call>
+struct SpoolerCallAwaiter {
+    std::shared_ptr<SpoolerSession> session;
+    Call call;
+    std::shared_ptr<SpoolerCallState> state;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+        state->waiter = handle;
+        auto timeout = std::chrono::milliseconds(std::max(100LL, spoolerCallTimeoutMs.load()));
+        {
+            // Arm the deadline before the call starts so completion always finds it
+            std::lock_guard<std::mutex> lock(state->mutex);
+            std::shared_ptr<SpoolerCallState> shared = state;
+            state->deadlineTimer = scheduleTimer("spooler deadline", timeout, std::chrono::milliseconds(0),
+                                                 [shared] { expireSpoolerCall(shared); });
+        }
+        postToPool(spoolerCallPool, [shared = state, session = session, call = call] {
+            BOOL ok = call(*session);
+            completeSpoolerCall(shared, ok, ok ? 0 : GetLastError());
+        });
+    }
+    SpoolerResult await_resume() const noexcept { return state->result; }
+};
+
+template <typename Call>
+SpoolerCallAwaiter<Call> spoolerCall(const std::shared_ptr<SpoolerSession>& session, Call call) {
+    return SpoolerCallAwaiter<Call>{ session, call, std::make_shared<SpoolerCallState>() };
+}
+
+// ---------------------------------------------------------------------------
+// Per-printer circuit breakers
+//
+// A printer whose polls keep failing or timing out is taken out of rotation
+// so it stops occupying blocking-call threads and flooding the log. After
+// breaker.failure_threshold consecutive failures the breaker opens; when
+// its backoff (breaker.base_backoff_seconds, doubling per consecutive trip up
+// to breaker.max_backoff_seconds) expires it goes half-open and lets a single
+// trial poll through. Success closes it, failure re-opens it with a longer
+// backoff. Failures are logged only while the breaker is closed, plus one
+// line per state change.
+// ---------------------------------------------------------------------------
+
+enum class BreakerState {
+    Closed,
+    Open,
+    HalfOpen
+};
+
+struct CircuitBreaker {
+    BreakerState state = BreakerState::Closed;
+    int consecutiveFailures = 0;
+    int consecutiveTrips = 0;
+    uint64_t totalFailures = 0;
+    DWORD lastError = 0;
+    std::chrono::steady_clock::time_point retryAt;
+};
+
+std::atomic<long long> breakerFailureThreshold{3};
+std::atomic<long long> breakerBaseBackoffSeconds{30};
+std::atomic<long long> breakerMaxBackoffSeconds{1800};
+
+std::unordered_map<uint32_t, CircuitBreaker> printerBreakers;  // Keyed by printer ID
+std::mutex breakersMutex;
+std::atomic<uint64_t> pollsSkippedByBreaker{0};
+
+const char* breakerStateName(BreakerState state) {
+    switch (state) {
+        case BreakerState::Open: return "OPEN";
+        case BreakerState::HalfOpen: return "HALF-OPEN";
+        default: return "CLOSED";
+    }
+}
+
+// Function to decide whether a printer may be polled now
+bool breakerAllowsPoll(uint32_t printerId) {
+    std::lock_guard<std::mutex> lock(breakersMutex);
+    CircuitBreaker& breaker = printerBreakers[printerId];
+    if (breaker.state == BreakerState::Closed) return true;
+    if (breaker.state == BreakerState::Open && std::chrono::steady_clock::now() >= breaker.retryAt) {
+        breaker.state = BreakerState::HalfOpen;  // Let one trial poll through
+        return true;
+    }
+    return false;
+}
+
+// Function to record a successful poll
+void breakerRecordSuccess(const PrinterRecord& printer) {
+    std::lock_guard<std::mutex> lock(breakersMutex);
+    CircuitBreaker& breaker = printerBreakers[printer.id];
+    if (breaker.state != BreakerState::Closed) {
+        LOG_INFO("Printer ", printer.name, " is responding again; circuit closed.");
+    }
+    breaker.state = BreakerState::Closed;
+    breaker.consecutiveFailures = 0;
+    breaker.consecutiveTrips = 0;
+}
+
+// Function to check whether failures on a printer are still being logged
+bool breakerClosed(uint32_t printerId) {
+    std::lock_guard<std::mutex> lock(breakersMutex);
+    auto it = printerBreakers.find(printerId);
+    return it == printerBreakers.end() || it->second.state == BreakerState::Closed;
+}
+
+// Function to get a printer's breaker state
+BreakerState breakerStateOf(uint32_t printerId) {
+    std::lock_guard<std::mutex> lock(breakersMutex);
+    auto it = printerBreakers.find(printerId);
+    return it == printerBreakers.end() ? BreakerState::Closed : it->second.state;
+}
+
+// Function to record a failed or timed-out spooler call
+void breakerRecordFailure(const PrinterRecord& printer, const SpoolerResult& result) {
+    std::lock_guard<std::mutex> lock(breakersMutex);
+    CircuitBreaker& breaker = printerBreakers[printer.id];
+    ++breaker.consecutiveFailures;
+    ++breaker.totalFailures;
+    breaker.lastError = result.error;
+
+    if (breaker.state == BreakerState::HalfOpen || breaker.consecutiveFailures >= breakerFailureThreshold) {
+        ++breaker.consecutiveTrips;
+        long long backoff = std::max(1LL, breakerBaseBackoffSeconds.load());
+        for (int i = 1; i < breaker.consecutiveTrips && backoff < breakerMaxBackoffSeconds; ++i) {
+            backoff *= 2;
+        }
+        backoff = std::min(backoff, std::max(1LL, breakerMaxBackoffSeconds.load()));
+        breaker.state = BreakerState::Open;
+        breaker.retryAt = std::chrono::steady_clock::now() + std::chrono::seconds(backoff);
+        LOG_WARN("Circuit opened for printer ", printer.name, " after ", breaker.consecutiveFailures,
+                 " consecutive failures (last error ", result.error, result.timedOut ? ", timed out" : "",
+                 "); next attempt in ", backoff, "s.");
+    }
+}
+
+// Function to drop the breaker of a printer that left the inventory
+void forgetPrinterBreaker(uint32_t printerId) {
+    std::lock_guard<std::mutex> lock(breakersMutex);
+    printerBreakers.erase(printerId);
+}
+
+// Function to print breakers that are not closed
+void showBreakerStatistics(std::ostream& out) {
+    std::vector<std::pair<uint32_t, CircuitBreaker>> tripped;
+    {
+        std::lock_guard<std::mutex> lock(breakersMutex);
+        for (const auto& pair : printerBreakers) {
+            if (pair.second.state != BreakerState::Closed) tripped.push_back(pair);
+        }
+    }
+    size_t open = 0;
+    for (const auto& pair : tripped) {
+        if (pair.second.state == BreakerState::Open) ++open;
+    }
+    out << "Circuit breakers: " << open << " open, " << tripped.size() - open << " half-open ("
+              << pollsSkippedByBreaker << " polls skipped, " << spoolerCallsTimedOut
+              << " spooler calls timed out)" << std::endl;
+
+    auto now = std::chrono::steady_clock::now();
+    for (const auto& pair : tripped) {
+        const CircuitBreaker& breaker = pair.second;
+        std::string name;
+        {
+            std::lock_guard<std::mutex> lock(inventoryMutex);
+            name = pair.first < printerInventory.size() ? printerInventory[pair.first].name : "?";
+        }
+        long long retryIn = std::max<long long>(0, std::chrono::duration_cast<std::chrono::seconds>(
+            breaker.retryAt - now).count());
+        out << "  [" << pair.first << "] " << name << ": " << breakerStateName(breaker.state)
+                  << ", " << breaker.consecutiveFailures << " consecutive failures, last error "
+                  << breaker.lastError << ", retry in " << retryIn << "s" << std::endl;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Queue anomaly detection
+//
+// Every successful poll feeds three per-printer detectors: queue depth, job
+// arrivals per minute, and the number of jobs that went into Error or Paper
+// Out. Each detector keeps an exponentially weighted mean and variance
+// (half-life anomaly.half_life_polls) and scores each new observation
+// against them before folding it in, so an update is O(1) and no history is
+// kept. A score of anomaly.z_threshold or more, once the detector has seen
+// anomaly.warmup_polls observations, raises a warning; the detector then
+// stays quiet until its score drops back below the threshold. Only upward
+// deviations alert. Standard deviations have a floor, so a printer whose
+// queue is always empty does not alert on a single job.
+// ---------------------------------------------------------------------------
+
+std::atomic<long long> anomalyZThreshold{4};
+std::atomic<long long> anomalyHalfLifePolls{30};
+std::atomic<long long> anomalyWarmupPolls{20};
+std::atomic<uint64_t> anomalyAlertsTotal{0};
+
+struct EwmaDetector {
+    double mean = 0;
+    double variance = 0;
+    uint64_t samples = 0;
+    bool alerting = false;
+    double lastScore = 0;
+
+    // Score a value against the baseline, then fold it in
+    double observe(double value, double alpha, double minDeviation) {
+        if (samples++ == 0) {
+            mean = value;
+            return lastScore = 0;
+        }
+        double deviation = std::max(std::sqrt(variance), minDeviation);
+        lastScore = (value - mean) / deviation;
+        double difference = value - mean;
+        double increment = alpha * difference;
+        mean += increment;
+        variance = (1 - alpha) * (variance + difference * increment);
+        return lastScore;
+    }
+};
+
+enum QueueMetric {
+    QUEUE_DEPTH,
+    QUEUE_ARRIVALS,
+    QUEUE_FAULTS,
+    QUEUE_METRIC_COUNT
+};
+
+struct QueueMetricInfo {
+    const char* name;
+    double minDeviation;
+};
+
+constexpr QueueMetricInfo queueMetrics[QUEUE_METRIC_COUNT] = {
+    { "queue depth", 1.0 },
+    { "arrivals per minute", 1.0 },
+    { "jobs entering error or paper out", 0.5 },
+};
+
+struct PrinterDetectors {
+    EwmaDetector metrics[QUEUE_METRIC_COUNT];
+    std::chrono::steady_clock::time_point lastObservation;
+};
+
+std::unordered_map<uint32_t, PrinterDetectors> printerDetectors;  // Keyed by printer ID
+std::mutex detectorsMutex;
+
+// Function to feed one poll's observations to a printer's detectors
+void observeQueue(const PrinterRecord& printer, size_t depth, size_t arrivals, size_t faults) {
+    double alpha = 1 - std::exp(std::log(0.5) / static_cast<double>(std::max(1LL, anomalyHalfLifePolls.load())));
+    double threshold = static_cast<double>(std::max(1LL, anomalyZThreshold.load()));
+    uint64_t warmup = static_cast<uint64_t>(std::max(0LL, anomalyWarmupPolls.load()));
+    auto now = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(detectorsMutex);
+    PrinterDetectors& detectors = printerDetectors[printer.id];
+    double minutes = detectors.metrics[QUEUE_ARRIVALS].samples == 0
+        ? 1.0 : std::chrono::duration<double, std::ratio<60>>(now - detectors.lastObservation).count();
+    detectors.lastObservation = now;
+
+    double values[QUEUE_METRIC_COUNT] = {
+        static_cast<double>(depth),
+        static_cast<double>(arrivals) / std::max(minutes, 1.0 / 60),
+        static_cast<double>(faults),
+    };
+    for (int metric = 0; metric < QUEUE_METRIC_COUNT; ++metric) {
+        EwmaDetector& detector = detectors.metrics[metric];
+        double baseline = detector.mean;
+        double deviation = std::max(std::sqrt(detector.variance), queueMetrics[metric].minDeviation);
+        double score = detector.observe(values[metric], alpha, queueMetrics[metric].minDeviation);
+        bool anomalous = detector.samples > warmup && score >= threshold;
+        if (anomalous && !detector.alerting) {
+            ++anomalyAlertsTotal;
+            char text[160];
+            std::snprintf(text, sizeof(text), "%.1f (baseline %.1f +/- %.1f, z=%.1f)",
+                          values[metric], baseline, deviation, score);
+            LOG_WARN("Anomaly on printer ", printer.name, ": ", queueMetrics[metric].name, " ", text);
+        } else if (!anomalous && detector.alerting) {
+            LOG_INFO("Printer ", printer.name, ": ", queueMetrics[metric].name, " back to normal.");
+        }
+        detector.alerting = anomalous;
+    }
+}
+
+// Function to drop the detectors of a printer that left the inventory
+void forgetPrinterDetectors(uint32_t printerId) {
+    std::lock_guard<std::mutex> lock(detectorsMutex);
+    printerDetectors.erase(printerId);
+}
+
+// Function to print the alert count and the detectors currently alerting
+void showAnomalyStatistics(std::ostream& out) {
+    std::vector<std::pair<uint32_t, std::string>> active;
+    {
+        std::lock_guard<std::mutex> lock(detectorsMutex);
+        for (const auto& pair : printerDetectors) {
+            for (int metric = 0; metric < QUEUE_METRIC_COUNT; ++metric) {
+                const EwmaDetector& detector = pair.second.metrics[metric];
+                if (!detector.alerting) continue;
+                char text[160];
+                std::snprintf(text, sizeof(text), "%s, z=%.1f over baseline %.1f",
+                              queueMetrics[metric].name, detector.lastScore, detector.mean);
+                active.emplace_back(pair.first, text);
+            }
+        }
+    }
+    out << "Anomaly alerts: " << anomalyAlertsTotal << " raised, " << active.size() << " active" << std::endl;
+    for (const auto& alert : active) {
+        std::string name;
+        {
+            std::lock_guard<std::mutex> lock(inventoryMutex);
+            name = alert.first < printerInventory.size() ? printerInventory[alert.first].name : "?";
+        }
+        out << "  [" << alert.first << "] " << name << ": " << alert.second << std::endl;
+    }
+}
+
+// Printers with a poll coroutine in flight; a timer tick for such a printer is skipped
+std::unordered_set<uint32_t> pollsInFlight;
+std::mutex pollsInFlightMutex;
+std::condition_variable pollsInFlightCondition;
+std::atomic<uint64_t> pollsSkippedInFlight{0};
+
+// Function to clear a printer's in-flight mark when its poll coroutine ends
+struct PollInFlightGuard {
+    uint32_t printerId;
+    ~PollInFlightGuard() {
+        std::lock_guard<std::mutex> lock(pollsInFlightMutex);
+        pollsInFlight.erase(printerId);
+        if (pollsInFlight.empty()) pollsInFlightCondition.notify_all();
+    }
+};
+
+// Wait until every poll coroutine has finished
+void waitForPollsInFlight() {
+    std::unique_lock<std::mutex> lock(pollsInFlightMutex);
+    pollsInFlightCondition.wait(lock, [] { return pollsInFlight.empty(); });
+}
+
+// Poll one printer's queue. Started by the printer's poll timer via
+// startPrinterPoll, which guarantees only one poll per printer is in flight.
+PollTask pollPrinter(uint32_t printerId) {
+    PollInFlightGuard inFlight{ printerId };
+    PrinterRecord printer;
+    {
+        std::lock_guard<std::mutex> lock(inventoryMutex);
+        if (printerId >= printerInventory.size() || !printerInventory[printerId].present) co_return;
+        printer = printerInventory[printerId];
+    }
+
+    // Open the printer
+    auto session = std::make_shared<SpoolerSession>();
+    session->printerName = printer.name;
+    session->widePrinterName = printer.wideName;
+
+    SpoolerResult opened = co_await spoolerCall(session, [](SpoolerSession& s) {
+        PRINTER_DEFAULTSW pd = { NULL, NULL, PRINTER_ACCESS_USE };
+        return OpenPrinterW(s.widePrinterName.data(), &s.printer, &pd);
+    });
+    if (!opened.ok) {
+        if (breakerClosed(printer.id)) {
+            if (opened.timedOut) {
+                LOG_EVENT(LOGFMT_SPOOLER_CALL_TIMED_OUT, logString(printer.name), logErrorCode(opened.error));
+            } else {
+                LOG_EVENT(LOGFMT_OPEN_PRINTER_FAILED, logString(printer.name), logErrorCode(opened.error));
+            }
+        }
+        breakerRecordFailure(printer, opened);
+        co_return;
+    }
+
+    // Enumerate jobs on this printer
+    SpoolerResult enumerated;
+    enumerated.ok = TRUE;
+    
+    // First call to get required buffer size
+    SpoolerResult sized = co_await spoolerCall(session, [](SpoolerSession& s) {
+        return EnumJobsW(s.printer, 0, 1000, 2, NULL, 0, &s.bytesNeeded, &s.jobCount);
+    });
+    if (sized.timedOut || (!sized.ok && sized.error != ERROR_INSUFFICIENT_BUFFER)) {
+        // Not an empty queue: without the sizing call we know nothing about the jobs
+        enumerated = sized;
+    } else if (session->bytesNeeded > 0) {
+        session->jobBuffer.resize(session->bytesNeeded);
+        enumerated = co_await spoolerCall(session, [](SpoolerSession& s) {
+            return EnumJobsW(s.printer, 0, 1000, 2, s.jobBuffer.data(), s.bytesNeeded, &s.bytesNeeded, &s.jobCount);
+        });
+    }
+    JOB_INFO_2W* pJobInfo = reinterpret_cast<JOB_INFO_2W*>(session->jobBuffer.data());
+    DWORD numJobs = session->jobBuffer.empty() ? 0 : session->jobCount;
+
+    if (enumerated.ok) {
+        std::vector<PrintJob> batch;
+        uint64_t jobsDecoded = 0, jobsUnchanged = 0;
+        size_t arrivals = 0, faults = 0, active = 0;
+        uint64_t pagesPrinted = 0;
+        // The shared_ptr keeps the table alive if reconcilePollTimers forgets the printer mid-poll
+        std::shared_ptr<PrinterFingerprints> fingerprintsTable = fingerprintsForPrinter(printer.id);
+        PrinterFingerprints& fingerprints = *fingerprintsTable;
+
+        // Look up the jobs this poll will record in the job history first. A lookup
+        // may search files, so it runs on the I/O pool with no lock held; only this
+        // poll changes the table, so the same jobs are found changed below.
+        std::vector<uint64_t> historyKeys;
+        std::vector<size_t> historyKeyOf(numJobs);
+        {
+            std::lock_guard<std::mutex> lock(fingerprints.mutex);
+            for (DWORD j = 0; j < numJobs; ++j) {
+                auto known = fingerprints.jobs.find(pJobInfo[j].JobId);
+                if (known != fingerprints.jobs.end() && known->second.value == fingerprintJob(pJobInfo[j])) continue;
+                historyKeyOf[j] = historyKeys.size();
+                historyKeys.push_back(jobHistoryKey(printer.name, std::to_string(pJobInfo[j].JobId),
+                                                    packSystemTime(pJobInfo[j].Submitted)));
+            }
+        }
+        HistoryLookup lookup;
+        if (historyFilterKb > 0 && !historyKeys.empty()) {
+            co_await ResumeOnPool{ ioWritePool };
+            lookup = lookUpJobHistory(historyKeys);
+            co_await ResumeOnExecutor{};
+        } else {
+            lookup.recordedAtLookup = historyKeysRecorded;
+            lookup.recordedBefore.assign(historyKeys.size(), 0);
+        }
+        HistoryLookup batchLookup;
+        batchLookup.recordedAtLookup = lookup.recordedAtLookup;
+        std::vector<DWORD> batchJobIds;
+
+        // Fingerprints and the store change together, so a snapshot never sees one without the other
+        std::lock_guard<std::mutex> lock(fingerprints.mutex);
+        uint64_t poll = ++fingerprints.polls;
+        int64_t now = time(nullptr);
+
+        // Jobs after an early exit were not looked at, so they must not count as departed
+        bool sawEveryJob = true;
+        for (DWORD j = 0; j < numJobs; ++j) {
+            if (!monitoringActive) {
+                sawEveryJob = false;
+                break;
+            }
+            JobFingerprint previous;
+            JobChange change = compareJobFingerprint(fingerprints, pJobInfo[j], poll, previous);
+            if (change == JobChange::New) ++arrivals;
+            if (jobEnteredFault(previous.status, pJobInfo[j].Status)) ++faults;
+            if (pJobInfo[j].Status & JOB_STATUS_PRINTING) ++active;
+            if (change == JobChange::Changed && pJobInfo[j].PagesPrinted > previous.pagesPrinted) {
+                pagesPrinted += pJobInfo[j].PagesPrinted - previous.pagesPrinted;
+            }
+
+            // Skip the full decode when nothing we record has changed
+            if (change == JobChange::Unchanged) {
+                ++jobsUnchanged;
+                continue;
+            }
+            ++jobsDecoded;
+            trackJobState(printer.id, pJobInfo[j].JobId, pJobInfo[j].Status, now);
+
+            PrintJob job;
+            job.printerName = printer.name;
+            job.timestamp = getCurrentTimestamp();
+
+            job.status = jobStatusNames[jobStatusCode(pJobInfo[j].Status)];
+
+            job.pages = pJobInfo[j].TotalPages > 0 ? pJobInfo[j].TotalPages : pJobInfo[j].PagesPrinted;
+            job.documentSize = static_cast<int>(pJobInfo[j].Size);
+            job.userAccount = wideStringToUtf8(pJobInfo[j].pUserName);
+            job.jobId = std::to_string(pJobInfo[j].JobId);
+            job.submitted = packSystemTime(pJobInfo[j].Submitted);
+
+            if (pJobInfo[j].pDevMode) {
+                const DEVMODEW* pDevMode = pJobInfo[j].pDevMode;
+                job.colorMode = getColorMode(pDevMode);
+                job.duplexSetting = getDuplexSetting(pDevMode);
+                job.paperSize = getPaperSize(pDevMode);
+            }
+            
+            if (monitoringActive) {
+                LOG_EVENT(LOGFMT_JOB_DETECTED, logUint(pJobInfo[j].JobId),
+                          logString(job.printerName), logString(job.status));
+            }
+            batch.push_back(std::move(job));
+            batchLookup.recordedBefore.push_back(lookup.recordedBefore[historyKeyOf[j]]);
+            batchJobIds.push_back(pJobInfo[j].JobId);
+        }
+
+        // Jobs that left the queue no longer need a fingerprint or a stuck deadline
+        DepartedJobs departed;
+        if (sawEveryJob) departed = pruneJobFingerprints(fingerprints, poll);
+        if (!departed.empty()) {
+            untrackJobs(printer.id, departed);
+            finalizeDepartedJobs(printer.name, departed, now);
+        }
+        // A job that left without being deleted finished printing its remaining pages
+        for (const auto& job : departed) {
+            const JobFingerprint& last = job.second;
+            if (!(last.status & (JOB_STATUS_DELETING | JOB_STATUS_DELETED)) && last.totalPages > last.pagesPrinted) {
+                pagesPrinted += last.totalPages - last.pagesPrinted;
+            }
+        }
+
+        // Record the printer's jobs with a single store lock acquisition. Jobs it
+        // could not record are made to look changed, so the next poll looks them up again.
+        if (!batch.empty()) {
+            for (size_t i : commitJobBatch(printer.id, batch, batchLookup)) {
+                fingerprints.jobs[batchJobIds[i]].value = 0;
+            }
+        }
+        jobsDecodedTotal += jobsDecoded;
+        jobsUnchangedTotal += jobsUnchanged;
+
+        if (monitoringActive) {
+            observeQueue(printer, numJobs, arrivals, faults);
+            recordPrinterSeries(printer.id, now, numJobs, active, pagesPrinted);
+        }
+    }
+
+    if (enumerated.ok) {
+        breakerRecordSuccess(printer);
+    } else {
+        if (breakerClosed(printer.id)) {
+            if (enumerated.timedOut) {
+                LOG_EVENT(LOGFMT_SPOOLER_CALL_TIMED_OUT, logString(printer.name), logErrorCode(enumerated.error));
+            } else {
+                LOG_EVENT(LOGFMT_ENUM_JOBS_FAILED, logString(printer.name), logErrorCode(enumerated.error));
+            }
+        }
+        breakerRecordFailure(printer, enumerated);
+    }
+    
+    // An abandoned EnumJobs may still be using the handle; the session closes it once that call returns
+    if (sized.timedOut || enumerated.timedOut) co_return;
+    co_await spoolerCall(session, [](SpoolerSession& s) {
+        BOOL closed = ClosePrinter(s.printer);
+        s.printer = NULL;
+        return closed;
+    });
+}
+
+// Poll timer callback: start the printer's poll coroutine unless the previous one is still running
+void startPrinterPoll(uint32_t printerId) {
+    {
+        std::lock_guard<std::mutex> lock(pollsInFlightMutex);
+        if (!monitoringActive) return;
+        if (!pollsInFlight.insert(printerId).second) {
+            ++pollsSkippedInFlight;
+            return;
+        }
+    }
+    if (!breakerAllowsPoll(printerId)) {
+        ++pollsSkippedByBreaker;
+        PollInFlightGuard release{ printerId };
+        return;
+    }
+    pollPrinter(printerId);
+}
+
+// ---------------------------------------------------------------------------
+// Monitoring timers
+//
+// Starting the monitor arms a housekeeping timer (inventory refresh, poll
+// timer reconciliation, binary log flush), the autosave and snapshot timers
+// and a statistics rollup. Housekeeping keeps one periodic poll timer per present
+// printer, using the printer's own interval when one is set.
+// ---------------------------------------------------------------------------
+
+const std::chrono::seconds housekeepingInterval(5);
+
+std::atomic<long long> pollIntervalSeconds{10};
+std::atomic<long long> autosaveIntervalMinutes{30};
+
+struct PollTimer {
+    TimerHandle handle = 0;
+    long long intervalSeconds = 0;
+};
+
+std::unordered_map<uint32_t, PollTimer> printerPollTimers;  // Keyed by printer ID
+std::mutex pollTimersMutex;
+TimerHandle housekeepingTimer = 0;
+TimerHandle autosaveTimer = 0;
+TimerHandle snapshotTimer = 0;
+TimerHandle rollupTimer = 0;
+bool inventoryLoaded = false;  // Housekeeping timer only
+
+// Function to get the poll interval in effect for a printer
+long long effectivePollInterval(const PrinterRecord& printer) {
+    long long seconds = printer.pollIntervalSeconds > 0 ? printer.pollIntervalSeconds : pollIntervalSeconds.load();
+    return std::max(1LL, seconds);
+}
+
+// Function to keep exactly one poll timer per present printer at its current interval
+void reconcilePollTimers() {
+    std::vector<PrinterRecord> printers = presentPrinters();
+    std::unordered_map<uint32_t, long long> wanted;
+    for (const auto& printer : printers) {
+        wanted[printer.id] = effectivePollInterval(printer);
+    }
+
+    std::lock_guard<std::mutex> lock(pollTimersMutex);
+    for (auto it = printerPollTimers.begin(); it != printerPollTimers.end();) {
+        auto want = wanted.find(it->first);
+        if (want == wanted.end() || want->second != it->second.intervalSeconds) {
+            cancelTimer(it->second.handle);
+            if (want == wanted.end()) {
+                forgetPrinterFingerprints(it->first);
+                forgetPrinterBreaker(it->first);
+                forgetPrinterDetectors(it->first);
+                forgetPrinterStuckJobs(it->first);
+            }
+            it = printerPollTimers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // Stagger first polls across the interval so printers are not all polled on the same tick
+    size_t position = 0;
+    for (const auto& printer : printers) {
+        ++position;
+        if (printerPollTimers.count(printer.id)) continue;
+
+        long long interval = wanted[printer.id];
+        auto period = std::chrono::milliseconds(interval * 1000);
+        auto delay = std::chrono::milliseconds(interval * 1000 * static_cast<long long>(position - 1) /
+                                               static_cast<long long>(printers.size()));
+        uint32_t printerId = printer.id;
+        PollTimer timer;
+        timer.handle = scheduleTimer("printer poll", delay, period, [printerId] { startPrinterPoll(printerId); });
+        timer.intervalSeconds = interval;
+        printerPollTimers[printerId] = timer;
+    }
+}
+
+// Housekeeping timer: refresh the inventory when needed and keep poll timers in step with it
+void runHousekeeping() {
+    if (!monitoringActive) return;
+
+    if (!inventoryLoaded || printerInventoryStale()) {
+        inventoryLoaded = refreshPrinterInventory();
+        if (inventoryLoaded && presentPrinters().empty()) {
+            LOG_EVENT(LOGFMT_NO_PRINTERS);
+            inventoryLoaded = false;  // Retry on the next housekeeping run
+        }
+    }
+    reconcilePollTimers();
+    expireStuckJobs(time(nullptr));
+    maintainPartitions(time(nullptr));
+    maintainJobHistory();
+    flushBinaryLog();
+}
+
+// Rollup timer: turn running totals into per-cycle figures, one cycle per poll interval
+void rollupCycleStatistics() {
+    static uint64_t previousLockAcquisitions = 0, previousDecoded = 0, previousUnchanged = 0;
+
+    uint64_t lockAcquisitions = storeLockAcquisitions, decoded = jobsDecodedTotal, unchanged = jobsUnchangedTotal;
+    lastCycleLockAcquisitions = lockAcquisitions - previousLockAcquisitions;
+    lastCycleJobsDecoded = decoded - previousDecoded;
+    lastCycleJobsUnchanged = unchanged - previousUnchanged;
+    previousLockAcquisitions = lockAcquisitions;
+    previousDecoded = decoded;
+    previousUnchanged = unchanged;
+
+    LOG_DEBUG("Poll cycle: ", lastCycleJobsDecoded.load(), " jobs decoded, ", lastCycleJobsUnchanged.load(),
+              " unchanged, ", lastCycleLockAcquisitions.load(), " store lock acquisitions");
+}
+
+// Start monitoring print jobs
+void startMonitoring() {
+    if (monitoringActive) {
+        LOG_INFO("Monitoring is already active.");
+        return;
+    }
+    
+    try {
+        monitoringActive = true;
+        openPrinterChangeNotification();
+        prepareJobHistory();
+
+        auto cycle = std::chrono::seconds(std::max(1LL, pollIntervalSeconds.load()));
+        auto autosave = std::chrono::minutes(std::max(1LL, autosaveIntervalMinutes.load()));
+        housekeepingTimer = scheduleTimer("housekeeping", std::chrono::milliseconds(0), housekeepingInterval, runHousekeeping);
+        auto snapshot = std::chrono::minutes(std::max(1LL, snapshotIntervalMinutes.load()));
+        autosaveTimer = scheduleTimer("autosave", autosave, autosave, autoSave);
+        snapshotTimer = scheduleTimer("snapshot", snapshot, snapshot, periodicSnapshot);
+        rollupTimer = scheduleTimer("rollup", cycle, cycle, rollupCycleStatistics);
+        LOG_INFO("Print job monitoring started.");
+    } catch (const std::exception& e) {
+        LOG_ERROR("Failed to start monitoring: ", e.what());
+    }
+}
+
+// Stop monitoring print jobs
+void stopMonitoring() {
+    if (!monitoringActive) {
+        LOG_INFO("Monitoring is not active.");
+        return;
+    }
+    
+    try {
+        monitoringActive = false;
+
+        // Stop housekeeping first so it cannot re-arm poll timers behind our back
+        cancelTimer(housekeepingTimer);
+        cancelTimer(autosaveTimer);
+        cancelTimer(snapshotTimer);
+        cancelTimer(rollupTimer);
+        waitForTimerCallbacks();
+        {
+            std::lock_guard<std::mutex> lock(pollTimersMutex);
+            for (const auto& pair : printerPollTimers) {
+                cancelTimer(pair.second.handle);
+            }
+            printerPollTimers.clear();
+        }
+        waitForTimerCallbacks();
+        waitForPollsInFlight();
+
+        closePrinterChangeNotification();
+        suspendPartitions();
+        suspendJobHistory();
+        inventoryLoaded = false;
+        LOG_INFO("Print job monitoring stopped.");
+    } catch (const std::exception& e) {
+        LOG_ERROR("Failed to stop monitoring: ", e.what());
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Filtered exports
+//
+// `export [file] [from=..] [to=..] [printer=..] [user=..] [status=..]
+// [color=..]` writes only the matching jobs. Predicates are tested against
+// the job columns rather than the job rows: at most 1000 rows are kept, so
+// one pass over the time, code and ID arrays is cheaper than keeping
+// per-printer, per-user or time indexes up to date on every insert and
+// eviction. The job rows themselves are read just for the matches, when
+// they are written out.
+// ---------------------------------------------------------------------------
+
+struct ExportFilter {
+    int64_t from = INT64_MIN;            // Detection time, inclusive
+    int64_t to = INT64_MAX;              // Detection time, exclusive
+    bool byPrinter = false;
+    std::vector<uint32_t> printerIds;
+    bool byUser = false;
+    std::vector<uint32_t> userIds;
+    uint32_t statusMask = anyCodeMask;   // Bit per jobStatusNames code
+    uint32_t colorMask = anyCodeMask;    // Bit per colorModeNames code
+
+    bool active() const {
+        return from != INT64_MIN || to != INT64_MAX || byPrinter || byUser ||
+               statusMask != anyCodeMask || colorMask != anyCodeMask;
+    }
+};
+
+// Function to split export arguments on whitespace, keeping double-quoted runs
+// together; "" inside quotes is a literal quote, as in the CSV
+std::vector<std::string> splitExportArguments(const std::string& args) {
+    std::vector<std::string> tokens;
+    std::string token;
+    bool quoted = false, pending = false;
+    for (size_t i = 0; i < args.size(); ++i) {
+        char c = args[i];
+        if (c == '"' && quoted && i + 1 < args.size() && args[i + 1] == '"') {
+            token += c;
+            ++i;
+        } else if (c == '"') {
+            quoted = !quoted;
+            pending = true;
+        } else if (!quoted && std::isspace(static_cast<unsigned char>(c))) {
+            if (pending) tokens.push_back(token);
+            token.clear();
+            pending = false;
+        } else {
+            token += c;
+            pending = true;
+        }
+    }
+    if (pending) tokens.push_back(token);
+    return tokens;
+}
+
+// Function to parse a filter time: YYYY-MM-DD[THH:MM[:SS]] local time, or <n>h / <n>d before now
+bool parseFilterTime(const std::string& text, int64_t& seconds) {
+    char* end = nullptr;
+    long long amount = std::strtoll(text.c_str(), &end, 10);
+    if (end != text.c_str() && (std::strcmp(end, "h") == 0 || std::strcmp(end, "d") == 0) && amount >= 0) {
+        seconds = static_cast<int64_t>(time(nullptr)) - amount * (*end == 'h' ? 3600 : 86400);
+        return true;
+    }
+    std::tm tm = {};
+    char separator = 0;
+    int fields = std::sscanf(text.c_str(), "%d-%d-%d%c%d:%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+                             &separator, &tm.tm_hour, &tm.tm_min, &tm.tm_sec);
+    if (fields != 3 && !(fields >= 6 && (separator == 't' || separator == 'T'))) return false;
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    seconds = static_cast<int64_t>(std::mktime(&tm));
+    return seconds != -1;
+}
+
+// Function to parse a comma-separated list of names from a code table into a mask;
+// names are matched without case or spaces, so "paperout" selects "Paper Out"
+template <size_t N>
+bool parseFilterCodes(const std::string& list, const char* const (&names)[N], uint32_t& mask) {
+    auto squash = [](std::string text) {
+        text.erase(std::remove(text.begin(), text.end(), ' '), text.end());
+        std::transform(text.begin(), text.end(), text.begin(), ::tolower);
+        return text;
+    };
+    mask = 0;
+    std::istringstream in(list);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        item = squash(item);
+        if (item == "mono") item = "monochrome";
+        size_t code = 0;
+        while (code < N && squash(names[code]) != item) ++code;
+        if (code == N) return false;
+        mask |= 1U << code;
+    }
+    return mask != 0;
+}
+
+// Function to compare two strings without case
+bool equalsIgnoringCase(const std::string& a, const std::string& b) {
+    return a.size() == b.size() &&
+           std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+               return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+           });
+}
+
+// Function to parse the arguments of the export command; the words that are
+// not key=value filters, if any, make up the filename
+bool parseExportFilter(const std::string& args, std::string& filename, ExportFilter& filter, std::ostream& out) {
+    std::string words;
+    for (const auto& token : splitExportArguments(args)) {
+        size_t equals = token.find('=');
+        if (equals == std::string::npos) {
+            words += (words.empty() ? "" : " ") + token;
+            continue;
+        }
+        std::string key = token.substr(0, equals);
+        std::string value = token.substr(equals + 1);
+        bool valid = !value.empty();
+        if (key == "from") {
+            valid = valid && parseFilterTime(value, filter.from);
+        } else if (key == "to") {
+            valid = valid && parseFilterTime(value, filter.to);
+        } else if (key == "status") {
+            valid = valid && parseFilterCodes(value, jobStatusNames, filter.statusMask);
+        } else if (key == "color") {
+            valid = valid && parseFilterCodes(value, colorModeNames, filter.colorMask);
+        } else if (key == "printer" || key == "user") {
+            bool printer = key == "printer";
+            (printer ? filter.byPrinter : filter.byUser) = true;
+            std::vector<uint32_t>& ids = printer ? filter.printerIds : filter.userIds;
+            std::istringstream in(value);
+            std::string item;
+            while (valid && std::getline(in, item, ',')) {
+                size_t matched = ids.size();
+                if (printer) {
+                    // A printer ID from `printers`, or a name
+                    char* end = nullptr;
+                    unsigned long id = std::strtoul(item.c_str(), &end, 10);
+                    std::lock_guard<std::mutex> lock(inventoryMutex);
+                    if (!item.empty() && *end == '\0' && id < printerInventory.size()) {
+                        ids.push_back(static_cast<uint32_t>(id));
+                    }
+                    for (const auto& record : printerInventory) {
+                        if (equalsIgnoringCase(record.name, item)) ids.push_back(record.id);
+                    }
+                } else {
+                    std::lock_guard<std::mutex> lock(jobsMutex);
+                    for (uint32_t id = 0; id < userNames.size(); ++id) {
+                        if (equalsIgnoringCase(userNames[id], item)) ids.push_back(id);
+                    }
+                }
+                // An unknown name is not an error; it just matches nothing
+                if (ids.size() == matched) {
+                    out << "No " << key << " matches \"" << item << "\"." << std::endl;
+                }
+            }
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            out << "Invalid export filter: " << token << std::endl;
+            return false;
+        }
+    }
+    if (!words.empty()) filename = words;
+    return true;
+}
+
+// Function to pick the rows of the job store that match a filter, in store order; caller holds jobsMutex
+std::vector<size_t> selectExportRows(const ExportFilter& filter) {
+    std::vector<size_t> rows;
+    const JobColumns& columns = jobColumns;
+    if (!filter.active()) {
+        rows.resize(columns.size());
+        for (size_t row = 0; row < rows.size(); ++row) rows[row] = row;
+        return rows;
+    }
+
+    auto matches = [&](size_t row) {
+        return columns.detectedAt[row] >= filter.from && columns.detectedAt[row] < filter.to &&
+               (filter.statusMask >> columns.status[row] & 1) && (filter.colorMask >> columns.colorMode[row] & 1) &&
+               (!filter.byPrinter || std::find(filter.printerIds.begin(), filter.printerIds.end(),
+                                               columns.printerId[row]) != filter.printerIds.end()) &&
+               (!filter.byUser || std::find(filter.userIds.begin(), filter.userIds.end(),
+                                            columns.userId[row]) != filter.userIds.end());
+    };
+
+    for (size_t row = 0; row < columns.size(); ++row) {
+        if (matches(row)) rows.push_back(row);
+    }
+    return rows;
+}
+
+// Export print jobs to CSV file, optionally only those matching a filter
+bool exportToCSV(const std::string& filename, const ExportFilter& filter = ExportFilter()) {
+    try {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        std::vector<size_t> rows = selectExportRows(filter);
+        
+        // Size the file for the rows as they are; quotes to escape may still grow it
+        uint64_t estimate = csvHeader.size();
+        for (size_t row : rows) {
+            estimate += csvTextLength(printJobs[row]) + csvRowOverhead;
+        }
+        MappedFileWriter file;
+        if (!file.open(filename, estimate)) {
+            LOG_ERROR("Could not open file for writing: ", filename, ". Error: ", file.error);
+            return false;
+        }
+        
+        // Write CSV header following RFC-4180
+        file.write(csvHeader);
+
+        // Format each print job as a CSV row straight into the mapping, escaping values per RFC-4180
+        for (size_t row : rows) {
+            char* out = file.reserve(csvRowBound(printJobs[row]));
+            if (!out) break;
+            file.commit(formatCsvRow(out, printJobs[row]));
+        }
+        
+        if (!file.close()) {
+            LOG_ERROR("Failed to write ", filename, ". Error: ", file.error);
+            return false;
+        }
+        if (filter.active()) {
+            LOG_INFO("Data exported to: ", filename, " (", rows.size(), " of ", printJobs.size(),
+                     " records matched the filter)");
+        } else {
+            LOG_INFO("Data exported to: ", filename, " (", rows.size(), " records)");
+        }
+        return true;
+    } catch (const std::exception& e) {
+        LOG_ERROR("Exception during CSV export: ", e.what());
+        return false;
+    }
+}
+
+// Autosave timer: export the current data to a timestamped file
+void autoSave() {
+    std::string filename = "print_jobs_auto_save_" + getCurrentTimestamp().substr(0, 19) + ".csv";
+    // Replace colons in timestamp with hyphens for valid filename
+    std::replace(filename.begin(), filename.end(), ':', '-');
+    exportToCSV(filename);
+}
+
+// Force save data to default file
+void forceSave() {
+    std::string filename = "print_jobs_" + getCurrentTimestamp().substr(0, 19) + ".csv";
+    // Replace colons in timestamp with hyphens for valid filename
+    std::replace(filename.begin(), filename.end(), ':', '-');
+    exportToCSV(filename);
+}
+
+// ---------------------------------------------------------------------------
+// RFC-4180 CSV parsing
+//
+// Reading exports back (analyze, or anything else that loads them) is
+// limited by CSV parsing, and the export quotes every text field, so a
+// parser has to know for each comma and newline whether it is inside quotes.
+// forEachCsvRecord does that 64 bytes at a time. It compares a block against
+// '"', ',', '\n' and '\r' with SSE2 or AVX2 to get one bit mask per
+// character, and turns the quote mask into an inside-quotes mask with a
+// prefix XOR: bit i is the XOR of the quote bits up to i, which is a
+// carry-less multiply by all ones (PCLMULQDQ with AVX2, six shifts with
+// SSE2). A doubled quote toggles the mask twice, so it needs no special case,
+// and neither does a newline inside quotes. Commas and newlines outside
+// quotes are written to a position index, one chunk of the file at a time,
+// and the fields are cut from those positions.
+//
+// The same masks check the quoting rules. A quote that opens must follow a
+// separator or a closing quote (the second half of a doubled quote), and a
+// quote that closes must be followed by a separator, a CR or another quote.
+// From the first violation, or an unclosed quote at the end, the rest of the
+// text is handed to the scalar parser, starting at the record where the
+// problem is. The scalar parser skips the bad record and resynchronizes at the
+// next line, so the results match the scalar parser's exactly.
+// `print_monitor.exe --bench csv [MB]` checks every kernel against the scalar
+// parser and times them.
+// ---------------------------------------------------------------------------
+
+const size_t csvMaxFields = 32;          // Records with more fields are counted as malformed
+const size_t csvChunkBytes = 32 * 1024;  // Text indexed per pass, so it is still in L1 when cut; a multiple of 64
+
+// Function to check for PCLMULQDQ (carry-less multiply) support
+bool cpuSupportsPclmul() {
+#if defined(PRINT_MONITOR_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 1)) != 0;
+#elif defined(PRINT_MONITOR_X86)
+    return __builtin_cpu_supports("pclmul");
+#else
+    return false;
+#endif
+}
+
+// The AVX2 kernel also needs PCLMULQDQ, which every AVX2 CPU has
+ColumnKernel detectCsvKernel() {
+#if defined(PRINT_MONITOR_X86)
+    return cpuSupportsAvx2() && cpuSupportsPclmul() ? ColumnKernel::Avx2 : ColumnKernel::Sse2;
+#else
+    return ColumnKernel::Scalar;
+#endif
+}
+
+const ColumnKernel bestCsvKernel = detectCsvKernel();
+
+// Kernel forEachCsvRecord uses (see the `config` command). On export data the
+// SIMD kernels are not yet clearly faster than the scalar parser (compare
+// them with --bench csv), so the scalar parser is the default.
+std::atomic<long long> csvKernelSetting{0};
+
+// Function to get the kernel csv.kernel selects, or the best the CPU has if it has not that one
+ColumnKernel activeCsvKernel() {
+    long long setting = csvKernelSetting.load(std::memory_order_relaxed);
+    if (setting <= 0) return ColumnKernel::Scalar;
+    if (setting == 1 && bestCsvKernel != ColumnKernel::Scalar) return ColumnKernel::Sse2;
+    return bestCsvKernel;
+}
+
+// Function to walk CSV text a field at a time, as forEachCsvRecord does; used
+// from the first quoting error on, and where there is no SIMD kernel
+template <typename Visitor>
+size_t forEachCsvRecordScalar(const char* data, size_t size, Visitor&& visit) {
+    struct FieldSpan {
+        size_t offset;       // Into data, or into scratch when unescaped
+        size_t length;
+        bool unescaped;
+        bool quoted;
+    };
+    FieldSpan spans[csvMaxFields];
+    std::string_view fields[csvMaxFields];
+    std::string scratch;     // Copies of fields with doubled quotes, undoubled
+    size_t malformed = 0;
+    const char* p = data;
+    const char* end = data + size;
+    auto atLineEnd = [end](const char* c) {
+        return c == end || *c == '\n' || (*c == '\r' && (c + 1 == end || c[1] == '\n'));
+    };
+
+    while (p < end) {
+        size_t count = 0;
+        bool bad = false;
+        scratch.clear();
+        while (true) {
+            FieldSpan span = {static_cast<size_t>(p - data), 0, false, false};
+            if (p < end && *p == '"') {
+                span.quoted = true;
+                const char* q = ++p;
+                bool doubled = false;
+                while ((q = static_cast<const char*>(std::memchr(q, '"', end - q))) && q + 1 < end && q[1] == '"') {
+                    doubled = true;
+                    q += 2;
+                }
+                if (!q) {
+                    bad = true;  // Quote never closed
+                    p = end;
+                    break;
+                }
+                span.offset = static_cast<size_t>(p - data);
+                span.length = static_cast<size_t>(q - p);
+                if (doubled) {
+                    span.offset = scratch.size();
+                    span.unescaped = true;
+                    for (const char* c = p; c < q; ++c) {
+                        scratch += *c;
+                        if (*c == '"') ++c;
+                    }
+                    span.length = scratch.size() - span.offset;
+                }
+                p = q + 1;
+                bad = p < end && *p != ',' && !atLineEnd(p);
+            } else {
+                const char* q = p;
+                while (q < end && *q != ',' && *q != '\n' && *q != '"') ++q;
+                bad = q < end && *q == '"';  // Quotes are only allowed around a whole field
+                span.length = static_cast<size_t>(q - p);
+                if (span.length > 0 && q[-1] == '\r' && (q == end || *q == '\n')) --span.length;
+                p = q;
+            }
+            if (count == csvMaxFields) bad = true;
+            if (bad) break;
+            spans[count++] = span;
+            if (p < end && *p == ',') {
+                ++p;
+                continue;
+            }
+            if (p < end && *p == '\r') ++p;
+            if (p < end && *p == '\n') ++p;
+            break;
+        }
+        if (bad) {
+            ++malformed;
+            const char* next = p < end ? static_cast<const char*>(std::memchr(p, '\n', end - p)) : nullptr;
+            p = next ? next + 1 : end;
+            continue;
+        }
+        if (count == 1 && spans[0].length == 0 && !spans[0].quoted) continue;  // Blank line
+        for (size_t i = 0; i < count; ++i) {
+            fields[i] = std::string_view((spans[i].unescaped ? scratch.data() : data) + spans[i].offset, spans[i].length);
+        }
+        visit(fields, count);
+    }
+    return malformed;
+}
+
+
+// Character masks of one 64-byte block, bit i for byte i
+struct CsvBlockBits {
+    uint64_t quotes;
+    uint64_t commas;
+    uint64_t newlines;
+    uint64_t returns;
+};
+
+// Quote state carried from one block to the next
+struct CsvScanState {
+    uint64_t inside = 0;          // All ones if the last block ended inside quotes
+    uint64_t afterSeparator = 1;  // Bit 0 set if the last byte was a comma or newline outside quotes, or at the start
+    uint64_t afterCloser = 0;     // Bit 0 set if the last byte was a closing quote
+};
+
+// Positions found in one chunk, relative to its start
+struct CsvChunkIndex {
+    std::vector<uint32_t> separators;   // Commas and newlines outside quotes
+    std::vector<uint32_t> escapes;      // Second quote of each doubled quote
+    size_t separatorCount = 0;
+    size_t escapeCount = 0;
+};
+
+// Function to compute the prefix XOR of a mask with shifts: bit i becomes the XOR of bits 0..i
+inline uint64_t prefixXorShift(uint64_t bits) {
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+const uint32_t csvNewlineFlag = 0x80000000U;  // Set on index entries for newlines
+
+// Function to write the positions of a mask's set bits, flagging those also set in `newlines`.
+// Positions are written four at a time without a branch per bit, so up to three
+// entries past the returned end are scratch; the index has room for them.
+inline uint32_t* appendBitPositions(uint64_t bits, uint64_t newlines, uint32_t base, uint32_t* out) {
+    uint32_t* end = out + std::popcount(bits);
+    while (out < end) {
+        for (int i = 0; i < 4; ++i) {
+            uint32_t bit = static_cast<uint32_t>(std::countr_zero(bits)) & 63;
+            out[i] = (base + bit) | (static_cast<uint32_t>(newlines >> bit & 1) << 31);
+            bits &= bits - 1;
+        }
+        out += 4;
+    }
+    return end;
+}
+
+// Function to index one block given its masks and inside-quotes mask (the
+// prefix XOR of its quotes, flipped if the last block ended inside quotes);
+// returns the bits of quotes that break the quoting rules
+inline uint64_t indexCsvBlock(const CsvBlockBits& bits, uint64_t inQuotes, uint64_t valid, uint32_t base,
+                              CsvScanState& state, CsvChunkIndex& index) {
+    uint64_t separators = (bits.commas | bits.newlines) & ~inQuotes & valid;
+    uint64_t openers = bits.quotes & inQuotes;
+    uint64_t closers = bits.quotes & ~inQuotes;
+    uint64_t afterSeparator = separators << 1 | state.afterSeparator;
+    uint64_t afterCloser = closers << 1 | state.afterCloser;
+    uint64_t escapes = openers & afterCloser;
+    uint64_t errors = (openers & ~(afterSeparator | afterCloser)) |
+                      (afterCloser & ~(bits.commas | bits.newlines | bits.returns | bits.quotes));
+    state.inside = static_cast<uint64_t>(static_cast<int64_t>(inQuotes) >> 63);
+    state.afterSeparator = separators >> 63;
+    state.afterCloser = closers >> 63;
+
+    uint32_t* separatorsEnd =
+        appendBitPositions(separators, bits.newlines, base, index.separators.data() + index.separatorCount);
+    index.separatorCount = separatorsEnd - index.separators.data();
+    if (escapes) {
+        uint32_t* escapesEnd = appendBitPositions(escapes, 0, base, index.escapes.data() + index.escapeCount);
+        index.escapeCount = escapesEnd - index.escapes.data();
+    }
+    return errors & valid;
+}
+
+#if defined(PRINT_MONITOR_X86)
+inline CsvBlockBits classifyCsvBlockSse2(const char* p) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i carriageReturn = _mm_set1_epi8('\r');
+    CsvBlockBits bits = {0, 0, 0, 0};
+    for (int i = 0; i < 4; ++i) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * i));
+        int shift = 16 * i;
+        bits.quotes |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)))) << shift;
+        bits.commas |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, comma)))) << shift;
+        bits.newlines |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, newline)))) << shift;
+        bits.returns |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, carriageReturn)))) << shift;
+    }
+    return bits;
+}
+
+// Function to index a chunk with SSE2; returns the offset of the first quoting error, or SIZE_MAX
+size_t scanCsvChunkSse2(const char* data, size_t length, CsvScanState& state, CsvChunkIndex& index) {
+    alignas(16) char tail[64];
+    for (size_t offset = 0; offset < length; offset += 64) {
+        const char* block = data + offset;
+        uint64_t valid = ~0ULL;
+        if (length - offset < 64) {
+            std::memset(tail, 0, sizeof(tail));
+            std::memcpy(tail, block, length - offset);
+            block = tail;
+            valid = (1ULL << (length - offset)) - 1;
+        }
+        CsvBlockBits bits = classifyCsvBlockSse2(block);
+        uint64_t inQuotes = prefixXorShift(bits.quotes) ^ state.inside;
+        uint64_t errors = indexCsvBlock(bits, inQuotes, valid, static_cast<uint32_t>(offset), state, index);
+        if (errors) return offset + std::countr_zero(errors);
+    }
+    return SIZE_MAX;
+}
+
+PRINT_MONITOR_TARGET_AVX2_PCLMUL
+inline CsvBlockBits classifyCsvBlockAvx2(const char* p) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i carriageReturn = _mm256_set1_epi8('\r');
+    const __m256i targets[4] = {quote, comma, newline, carriageReturn};
+    __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+    uint64_t masks[4];
+    for (int i = 0; i < 4; ++i) {
+        uint64_t lowBits = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, targets[i])));
+        uint64_t highBits = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, targets[i])));
+        masks[i] = lowBits | highBits << 32;
+    }
+    return CsvBlockBits{masks[0], masks[1], masks[2], masks[3]};
+}
+
+// Function to index a chunk with AVX2, taking the prefix XOR as a carry-less
+// multiply by all ones; returns the offset of the first quoting error, or SIZE_MAX
+PRINT_MONITOR_TARGET_AVX2_PCLMUL
+size_t scanCsvChunkAvx2(const char* data, size_t length, CsvScanState& state, CsvChunkIndex& index) {
+    alignas(32) char tail[64];
+    const __m128i allOnes = _mm_set1_epi8(-1);
+    for (size_t offset = 0; offset < length; offset += 64) {
+        const char* block = data + offset;
+        uint64_t valid = ~0ULL;
+        if (length - offset < 64) {
+            std::memset(tail, 0, sizeof(tail));
+            std::memcpy(tail, block, length - offset);
+            block = tail;
+            valid = (1ULL << (length - offset)) - 1;
+        }
+        CsvBlockBits bits = classifyCsvBlockAvx2(block);
+        __m128i product = _mm_clmulepi64_si128(_mm_set_epi64x(0, static_cast<long long>(bits.quotes)), allOnes, 0);
+        uint64_t inQuotes;
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(&inQuotes), product);
+        inQuotes ^= state.inside;
+        uint64_t errors = indexCsvBlock(bits, inQuotes, valid, static_cast<uint32_t>(offset), state, index);
+        if (errors) return offset + std::countr_zero(errors);
+    }
+    return SIZE_MAX;
+}
+#endif
+
+// Function to walk CSV text with the given kernel; see forEachCsvRecord
+template <typename Visitor>
+size_t forEachCsvRecordWith(ColumnKernel kernel, const char* data, size_t size, Visitor&& visit) {
+#if defined(PRINT_MONITOR_X86)
+    if (kernel == ColumnKernel::Scalar) return forEachCsvRecordScalar(data, size, visit);
+    struct UnescapedField {
+        size_t field;
+        size_t offset;  // Into scratch, which may move until the record is finished
+    };
+    std::string_view fields[csvMaxFields];
+    UnescapedField unescaped[csvMaxFields];
+    size_t unescapedCount = 0;
+    std::string scratch;
+    size_t count = 0;
+    bool fieldHasEscape = false;
+    size_t fieldStart = 0;
+    size_t recordStart = 0;
+    size_t malformed = 0;
+
+    thread_local CsvChunkIndex index;
+    size_t chunkCapacity = std::min(csvChunkBytes, size) + 64;
+    if (index.separators.size() < chunkCapacity) {
+        index.separators.resize(chunkCapacity);
+        index.escapes.resize(chunkCapacity);
+    }
+    CsvScanState state;
+    bool failed = false;
+    for (size_t chunk = 0; chunk < size && !failed; chunk += csvChunkBytes) {
+        size_t length = std::min(csvChunkBytes, size - chunk);
+        index.separatorCount = 0;
+        index.escapeCount = 0;
+        size_t error = kernel == ColumnKernel::Avx2 ? scanCsvChunkAvx2(data + chunk, length, state, index)
+                                                    : scanCsvChunkSse2(data + chunk, length, state, index);
+        uint32_t* separators = index.separators.data();
+        const uint32_t* escapes = index.escapes.data();
+        size_t separatorCount = index.separatorCount;
+        size_t escapeCount = index.escapeCount;
+        if (error != SIZE_MAX) {
+            // Cut the fields up to the error, and leave the rest of its record to the scalar parser
+            while (separatorCount > 0 && (separators[separatorCount - 1] & ~csvNewlineFlag) > error) --separatorCount;
+        } else if (chunk + length == size && !state.inside &&
+                   (separatorCount == 0 || separators[separatorCount - 1] != ((length - 1) | csvNewlineFlag))) {
+            // The last record has no line break; the end of the text ends it
+            separators[separatorCount++] = static_cast<uint32_t>(length) | csvNewlineFlag;
+        }
+
+        // Cut fields between consecutive separators; a quoted field's quoting was
+        // checked by the masks, apart from text after its closing quote and a CR
+        size_t escape = 0;
+        for (size_t i = 0; i < separatorCount; ++i) {
+            uint32_t entry = separators[i];
+            uint32_t offset = entry & ~csvNewlineFlag;
+            bool lineEnd = (entry & csvNewlineFlag) != 0;
+            if (escape < escapeCount && escapes[escape] < offset) {
+                fieldHasEscape = true;
+                do ++escape; while (escape < escapeCount && escapes[escape] < offset);
+            }
+            size_t end = chunk + offset;
+            const char* text = data + fieldStart;
+            size_t fieldLength = end - fieldStart;
+            if (lineEnd && fieldLength > 0 && text[fieldLength - 1] == '\r') --fieldLength;
+            if (count == csvMaxFields) {
+                failed = true;
+                break;
+            }
+            if (fieldLength > 0 && *text == '"') {
+                if (fieldLength < 2 || text[fieldLength - 1] != '"') {
+                    failed = true;  // Text after the closing quote
+                    break;
+                }
+                ++text;
+                fieldLength -= 2;
+                if (fieldHasEscape) {
+                    size_t scratchOffset = scratch.size();
+                    const char* c = text;
+                    const char* stop = text + fieldLength;
+                    while (const char* quote = static_cast<const char*>(std::memchr(c, '"', stop - c))) {
+                        scratch.append(c, quote + 1 - c);  // Keep one of the pair
+                        c = quote + 2;
+                    }
+                    scratch.append(c, stop - c);
+                    unescaped[unescapedCount++] = {count, scratchOffset};
+                    fieldLength = scratch.size() - scratchOffset;
+                    fieldHasEscape = false;
+                }
+            }
+            fields[count++] = std::string_view(text, fieldLength);
+            fieldStart = end + 1;
+            if (!lineEnd) continue;
+
+            if (count != 1 || fieldLength != 0 || data[recordStart] == '"') {  // Not a blank line
+                for (size_t u = 0; u < unescapedCount; ++u) {
+                    const UnescapedField& field = unescaped[u];
+                    fields[field.field] = std::string_view(scratch.data() + field.offset, fields[field.field].size());
+                }
+                visit(fields, count);
+            }
+            count = 0;
+            if (unescapedCount > 0) {
+                unescapedCount = 0;
+                scratch.clear();
+            }
+            recordStart = fieldStart;
+        }
+        if (escape < escapeCount) fieldHasEscape = true;  // The field goes on into the next chunk
+        failed = failed || error != SIZE_MAX;
+    }
+    failed = failed || state.inside;  // A quote is still open at the end
+    if (failed) {
+        // Let the scalar parser skip the bad record and carry on from the next line
+        malformed += forEachCsvRecordScalar(data + recordStart, size - recordStart, visit);
+    }
+    return malformed;
+#else
+    (void)kernel;
+    return forEachCsvRecordScalar(data, size, visit);
+#endif
+}
+
+// Function to walk the records of RFC-4180 CSV text, calling visit(fields, count)
+// with each record's fields unquoted; skips blank lines and returns how many
+// malformed records (stray or unclosed quotes, too many fields) were skipped
+template <typename Visitor>
+size_t forEachCsvRecord(const char* data, size_t size, Visitor&& visit) {
+    return forEachCsvRecordWith(activeCsvKernel(), data, size, visit);
+}
+
+// Function to check the CSV kernels against the scalar parser and time them
+int runCsvBenchmark(size_t megabytes) {
+    static const char* const printers[] = {"Office_HP_LaserJet_4250", "\\\\printsrv01\\Floor3-Color",
+                                           "Brother \"Mono\" HL-L2350DW", "Canon iR-ADV C5535"};
+    static const char* const users[] = {"jsmith", "Jürgen Müller", "o\"brien", "mlopez", "akowalski"};
+    std::cout << "Generating " << megabytes << " MB of exports..." << std::endl;
+    std::string text = csvHeader;
+    PrintJob job;
+    job.status = "Printing";
+    job.colorMode = "Color";
+    job.duplexSetting = "Duplex Vertical";
+    job.paperSize = "A4";
+    for (size_t i = 0; text.size() < megabytes * 1024 * 1024; ++i) {
+        job.printerName = printers[i % std::size(printers)];
+        job.userAccount = users[i % std::size(users)];
+        job.timestamp = "2026-10-17T09:30:" + std::to_string(10 + i % 50) + ".000+00:00";
+        job.pages = static_cast<int>(1 + i % 40);
+        job.documentSize = static_cast<int>(4096 + i * 37 % 2000000);
+        job.jobId = i % 1000 == 0 ? "multi\nline" : std::to_string(i);
+        appendCsvRow(text, job);
+    }
+
+    // Malformed records between good ones, for the fallback to the scalar parser
+    std::string broken = csvHeader + "\"a\"b,1\r\nplain,ok\r\nx\"y,2\r\n\"fine \"\"quoted\"\"\",3\r\n";
+    broken += std::string(100, 'z') + ",\"unclosed\r\nstill,inside\r\n";
+
+    auto digest = [](ColumnKernel kernel, const std::string& input, size_t& records, size_t& malformed) {
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        records = 0;
+        malformed = forEachCsvRecordWith(kernel, input.data(), input.size(), [&](const std::string_view* fields, size_t count) {
+            ++records;
+            for (size_t i = 0; i < count; ++i) {
+                for (char c : fields[i]) hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+                hash = (hash ^ (i + 1 < count ? 0x1f : 0x1e)) * 0x100000001b3ULL;
+            }
+        });
+        return hash;
+    };
+
+    std::vector<ColumnKernel> kernels = {ColumnKernel::Scalar};
+#if defined(PRINT_MONITOR_X86)
+    kernels.push_back(ColumnKernel::Sse2);
+    if (cpuSupportsAvx2() && cpuSupportsPclmul()) kernels.push_back(ColumnKernel::Avx2);
+#endif
+    bool allOk = true;
+    size_t expectedRecords = 0, expectedMalformed = 0, brokenRecords = 0, brokenMalformed = 0;
+    uint64_t expectedHash = 0, brokenHash = 0;
+    for (ColumnKernel kernel : kernels) {
+        // Best of three, timed with a visitor that only touches the field lengths; the digest is checked separately
+        size_t fieldBytes = 0;
+        double seconds = 0;
+        for (int run = 0; run < 3; ++run) {
+            fieldBytes = 0;
+            auto started = std::chrono::steady_clock::now();
+            forEachCsvRecordWith(kernel, text.data(), text.size(), [&](const std::string_view* fields, size_t count) {
+                for (size_t i = 0; i < count; ++i) fieldBytes += fields[i].size();
+            });
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            seconds = run == 0 ? elapsed : std::min(seconds, elapsed);
+        }
+        size_t records = 0, malformed = 0;
+        uint64_t hash = digest(kernel, text, records, malformed) ^ fieldBytes;
+        size_t badRecords = 0, badMalformed = 0;
+        uint64_t badHash = digest(kernel, broken, badRecords, badMalformed);
+        if (kernel == ColumnKernel::Scalar) {
+            expectedHash = hash;
+            expectedRecords = records;
+            expectedMalformed = malformed;
+            brokenHash = badHash;
+            brokenRecords = badRecords;
+            brokenMalformed = badMalformed;
+        }
+        bool ok = hash == expectedHash && records == expectedRecords && malformed == expectedMalformed &&
+                  badHash == brokenHash && badRecords == brokenRecords && badMalformed == brokenMalformed;
+        allOk = allOk && ok;
+        char line[160];
+        std::snprintf(line, sizeof(line), "%-8s%10.2f GB/s%10.1f ms  %zu records, %zu malformed%s",
+                      columnKernelName(kernel), text.size() / std::max(seconds, 1e-9) / 1e9, seconds * 1000,
+                      records, malformed, ok ? "" : "  MISMATCH");
+        std::cout << line << std::endl;
+    }
+    std::cout << "Malformed sample: " << brokenRecords << " records, " << brokenMalformed << " malformed" << std::endl;
+    std::cout << "Active kernel: " << columnKernelName(activeCsvKernel()) << " (csv.kernel " << csvKernelSetting
+              << ")" << std::endl;
+    return allOk ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------------
+// Analyzing export archives
+//
+// `analyze <glob> [by <field>[,<field>...]] [from=..] [to=..] [printer=..]
+// [user=..] [status=..] [color=..] [top=<n>] [all]` totals jobs, pages and
+// document bytes over export files on disk (saves, autosaves, partitions),
+// grouped by printer, user, status, color, duplex, paper, hour, day or month.
+// The filters take the same values as `export` but are matched against the
+// names in the files. Columns are found by their header names.
+//
+// Files are handed out to up to one worker per core. A worker maps its file,
+// parses it and keeps a compact record for each row: a hash of printer, job
+// ID and detection time, a group ID local to the file (none if the row does
+// not match the filters), pages and bytes. Autosaves repeat every job still
+// in the store, so the records are then split into shards by hash, and each
+// shard's worker counts a job once, from the most recently written file that
+// has it, into partial totals per group that are merged at the end. `all`
+// counts every row.
+// `print_monitor.exe --bench analyze [MB]` writes synthetic exports and
+// times the command on them.
+// ---------------------------------------------------------------------------
+
+// Export columns the analyzer reads, found by header name
+enum AnalyzeColumn {
+    PrinterColumn, TimestampColumn, StatusColumn, PagesColumn, SizeColumn,
+    ColorColumn, DuplexColumn, PaperColumn, UserColumn, JobIdColumn, AnalyzeColumnCount
+};
+const char* const analyzeColumnHeaders[] = {
+    "Printer Name", "Timestamp", "Status", "Pages", "Document Size",
+    "Color Mode", "Duplex Setting", "Paper Size", "User Account", "Job ID"
+};
+
+// Group-by fields: the column each one reads, and how much of it (0 = all; timestamps are cut to hour, day or month)
+struct AnalyzeGroupField {
+    const char* name;
+    AnalyzeColumn column;
+    size_t prefix;
+};
+const AnalyzeGroupField analyzeGroupFields[] = {
+    {"printer", PrinterColumn, 0}, {"user", UserColumn, 0},     {"status", StatusColumn, 0},
+    {"color", ColorColumn, 0},     {"duplex", DuplexColumn, 0}, {"paper", PaperColumn, 0},
+    {"hour", TimestampColumn, 13}, {"day", TimestampColumn, 10}, {"month", TimestampColumn, 7},
+};
+
+struct AnalyzeQuery {
+    std::string pattern;
+    std::vector<size_t> groupBy;          // Indexes into analyzeGroupFields
+    std::string from;                     // YYYY-MM-DDTHH:MM:SS, inclusive; empty = open
+    std::string to;                       // Exclusive
+    std::vector<std::string> printers;    // Empty = any
+    std::vector<std::string> users;
+    std::vector<std::string> statuses;
+    std::vector<std::string> colors;
+    size_t top = 20;
+    bool distinct = true;                 // Count a job once across files
+};
+
+const uint32_t analyzeNoGroup = 0xffffffffU;  // Row does not match the filters
+
+// One row, as kept between parsing and merging
+struct AnalyzeRecord {
+    uint64_t key;      // Hash of printer, job ID and detection time
+    uint32_t group;    // Local to the file until the groups are merged, or analyzeNoGroup
+    uint32_t pages;
+    uint64_t bytes;
+};
+
+struct AnalyzeFileResult {
+    std::vector<AnalyzeRecord> records;
+    std::vector<std::string> groups;      // Group keys by local group ID
+    uint64_t size = 0;
+    uint64_t rows = 0;
+    uint64_t malformed = 0;
+    std::string error;                    // Set when the file was skipped
+};
+
+struct AnalyzeTotals {
+    uint64_t jobs = 0;
+    uint64_t pages = 0;
+    uint64_t bytes = 0;
+};
+
+// Open-addressing set of job keys for the merge, sized up front; a zero slot is empty
+struct AnalyzeKeySet {
+    std::vector<uint64_t> slots;
+
+    explicit AnalyzeKeySet(size_t capacity) : slots(std::bit_ceil(std::max<size_t>(16, capacity * 2))) {}
+
+    // Function to add a key; returns false if it was already there
+    bool insert(uint64_t key) {
+        key |= 1;  // Never zero; costs one bit of a 64-bit hash
+        size_t mask = slots.size() - 1;
+        for (size_t slot = (key * 0x9E3779B97F4A7C15ULL) >> 32 & mask;; slot = (slot + 1) & mask) {
+            if (slots[slot] == key) return false;
+            if (slots[slot] == 0) {
+                slots[slot] = key;
+                return true;
+            }
+        }
+    }
+};
+
+// Read-only mapping of a whole file
+struct MappedInputFile {
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+    const char* data = nullptr;
+    size_t size = 0;
+    DWORD error = 0;
+
+    ~MappedInputFile() {
+        close();
+    }
+
+    // Function to map a file; an empty file opens with no data
+    bool open(const std::string& path) {
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL, NULL);
+        LARGE_INTEGER length;
+        if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &length)) {
+            error = GetLastError();
+            close();
+            return false;
+        }
+        size = static_cast<size_t>(length.QuadPart);
+        if (size == 0) return true;
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        data = mapping ? static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+        if (!data) {
+            error = GetLastError();
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        data = nullptr;
+        mapping = NULL;
+        file = INVALID_HANDLE_VALUE;
+    }
+};
+
+// Function to match a file name against a pattern of * and ?, ignoring case as Windows does
+bool matchWildcard(const char* pattern, const char* name) {
+    const char* star = nullptr;
+    const char* resume = nullptr;
+    while (*name) {
+        if (*pattern == '*') {
+            star = pattern++;
+            resume = name;
+        } else if (*pattern == '?' ||
+                   std::tolower(static_cast<unsigned char>(*pattern)) == std::tolower(static_cast<unsigned char>(*name))) {
+            ++pattern;
+            ++name;
+        } else if (star) {
+            pattern = star + 1;
+            name = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (*pattern == '*') ++pattern;
+    return *pattern == '\0';
+}
+
+// Function to list the files matching a glob (wildcards in the file name only), oldest first
+std::vector<std::filesystem::path> expandGlob(const std::string& pattern) {
+    namespace fs = std::filesystem;
+    size_t slash = pattern.find_last_of("/\\");
+    fs::path directory = slash == std::string::npos ? fs::path(".") : fs::path(pattern.substr(0, slash + 1));
+    std::string namePattern = slash == std::string::npos ? pattern : pattern.substr(slash + 1);
+
+    std::vector<std::pair<fs::file_time_type, fs::path>> found;
+    std::error_code error;
+    for (const auto& entry : fs::directory_iterator(directory, error)) {
+        if (!entry.is_regular_file(error)) continue;
+        if (!matchWildcard(namePattern.c_str(), entry.path().filename().string().c_str())) continue;
+        found.emplace_back(entry.last_write_time(error), entry.path());
+    }
+    std::sort(found.begin(), found.end());
+    std::vector<fs::path> files;
+    for (auto& file : found) files.push_back(std::move(file.second));
+    return files;
+}
+
+// Function to format a filter time like the start of an exported timestamp
+std::string formatFilterTimestamp(int64_t seconds) {
+    time_t time = static_cast<time_t>(seconds);
+    std::tm tm = {};
+    localtime_s(&tm, &time);
+    char text[32];
+    std::strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%S", &tm);
+    return text;
+}
+
+// Function to parse the arguments of the analyze command
+bool parseAnalyzeQuery(const std::string& args, AnalyzeQuery& query, std::ostream& out) {
+    std::vector<std::string> tokens = splitExportArguments(args);
+    if (tokens.empty()) {
+        out << "Usage: analyze <glob> [by <field>[,<field>...]] [filters] [top=<n>] [all]" << std::endl;
+        return false;
+    }
+    query.pattern = tokens[0];
+    for (size_t i = 1; i < tokens.size(); ++i) {
+        const std::string& token = tokens[i];
+        if (token == "all") {
+            query.distinct = false;
+            continue;
+        }
+        if (token == "by") {
+            std::istringstream in(i + 1 < tokens.size() ? tokens[++i] : "");
+            std::string item;
+            while (std::getline(in, item, ',')) {
+                size_t field = 0;
+                while (field < std::size(analyzeGroupFields) && item != analyzeGroupFields[field].name) ++field;
+                if (field == std::size(analyzeGroupFields)) {
+                    out << "Unknown group-by field: " << item
+                              << " (printer, user, status, color, duplex, paper, hour, day or month)" << std::endl;
+                    return false;
+                }
+                query.groupBy.push_back(field);
+            }
+            continue;
+        }
+        size_t equals = token.find('=');
+        std::string key = token.substr(0, equals);
+        std::string value = equals == std::string::npos ? "" : token.substr(equals + 1);
+        bool valid = !value.empty();
+        int64_t seconds = 0;
+        uint32_t mask = 0;
+        auto splitList = [&value](std::vector<std::string>& list) {
+            std::istringstream in(value);
+            std::string item;
+            while (std::getline(in, item, ',')) list.push_back(item);
+        };
+        auto maskNames = [&mask](const auto& names, std::vector<std::string>& list) {
+            for (size_t code = 0; code < std::size(names); ++code) {
+                if (mask >> code & 1) list.push_back(names[code]);
+            }
+        };
+        if (key == "from" || key == "to") {
+            valid = valid && parseFilterTime(value, seconds);
+            if (valid) (key == "from" ? query.from : query.to) = formatFilterTimestamp(seconds);
+        } else if (key == "printer") {
+            splitList(query.printers);
+        } else if (key == "user") {
+            splitList(query.users);
+        } else if (key == "status") {
+            valid = valid && parseFilterCodes(value, jobStatusNames, mask);
+            maskNames(jobStatusNames, query.statuses);
+        } else if (key == "color") {
+            valid = valid && parseFilterCodes(value, colorModeNames, mask);
+            maskNames(colorModeNames, query.colors);
+        } else if (key == "top") {
+            char* end = nullptr;
+            query.top = std::strtoull(value.c_str(), &end, 10);
+            valid = valid && *end == '\0';
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            out << "Invalid analyze argument: " << token << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Function to check a field against a filter list, without case; an empty list matches anything
+bool matchesAnalyzeList(const std::vector<std::string>& list, std::string_view value) {
+    if (list.empty()) return true;
+    for (const auto& item : list) {
+        if (item.size() == value.size() &&
+            std::equal(item.begin(), item.end(), value.begin(), [](char x, char y) {
+                return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+            })) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Function to parse one export file into records of its matching rows
+void analyzeFile(const std::filesystem::path& path, const AnalyzeQuery& query, AnalyzeFileResult& result) {
+    MappedInputFile input;
+    if (!input.open(path.string())) {
+        result.error = "could not open it (error " + std::to_string(input.error) + ")";
+        return;
+    }
+    result.size = input.size;
+
+    size_t columns[AnalyzeColumnCount];
+    size_t needed = 0;               // Fields a row must have
+    bool header = true;
+    std::unordered_map<std::string, uint32_t> groupIds;
+    std::string groupKey;
+    result.malformed += forEachCsvRecord(input.data, input.size, [&](const std::string_view* fields, size_t count) {
+        if (header) {
+            header = false;
+            for (size_t column = 0; column < AnalyzeColumnCount; ++column) {
+                columns[column] = std::find(fields, fields + count, analyzeColumnHeaders[column]) - fields;
+                if (columns[column] == count) {
+                    result.error = std::string("no \"") + analyzeColumnHeaders[column] + "\" column";
+                    return;
+                }
+                needed = std::max(needed, columns[column] + 1);
+            }
+            return;
+        }
+        if (!result.error.empty()) return;
+        if (count < needed) {
+            ++result.malformed;
+            return;
+        }
+        ++result.rows;
+        uint64_t key = 0xcbf29ce484222325ULL;
+        for (size_t column : {columns[PrinterColumn], columns[JobIdColumn], columns[TimestampColumn]}) {
+            for (char c : fields[column]) key = (key ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+            key = (key ^ 0x1f) * 0x100000001b3ULL;  // Keeps "ab","c" apart from "a","bc"
+        }
+        // A row that does not match is still kept, without a group, so that
+        // an older copy of the job in another file is not counted in its place
+        std::string_view detected = fields[columns[TimestampColumn]].substr(0, 19);
+        if ((!query.from.empty() && detected < query.from) || (!query.to.empty() && detected >= query.to) ||
+            !matchesAnalyzeList(query.printers, fields[columns[PrinterColumn]]) ||
+            !matchesAnalyzeList(query.users, fields[columns[UserColumn]]) ||
+            !matchesAnalyzeList(query.statuses, fields[columns[StatusColumn]]) ||
+            !matchesAnalyzeList(query.colors, fields[columns[ColorColumn]])) {
+            if (query.distinct) result.records.push_back({key, analyzeNoGroup, 0, 0});
+            return;
+        }
+
+        groupKey.clear();
+        for (size_t i = 0; i < query.groupBy.size(); ++i) {
+            const AnalyzeGroupField& field = analyzeGroupFields[query.groupBy[i]];
+            std::string_view value = fields[columns[field.column]];
+            if (field.prefix) value = value.substr(0, field.prefix);
+            if (i > 0) groupKey += " | ";
+            groupKey += value;
+        }
+        auto group = groupIds.find(groupKey);
+        if (group == groupIds.end()) {
+            group = groupIds.emplace(groupKey, static_cast<uint32_t>(result.groups.size())).first;
+            result.groups.push_back(groupKey);
+        }
+
+        AnalyzeRecord record = {key, group->second, 0, 0};
+        std::string_view pages = fields[columns[PagesColumn]];
+        std::string_view bytes = fields[columns[SizeColumn]];
+        std::from_chars(pages.data(), pages.data() + pages.size(), record.pages);
+        std::from_chars(bytes.data(), bytes.data() + bytes.size(), record.bytes);
+        result.records.push_back(record);
+    });
+    if (header && result.error.empty()) result.error = "it is empty";
+    if (!result.error.empty()) result.records.clear();
+}
+
+// Function to run an analyze query over the files matching its glob and print the totals
+bool runAnalysis(const AnalyzeQuery& query, std::ostream& out, AnalyzeTotals* overallTotals = nullptr) {
+    auto started = std::chrono::steady_clock::now();
+    std::vector<std::filesystem::path> files = expandGlob(query.pattern);
+    if (files.empty()) {
+        out << "No files match " << query.pattern << std::endl;
+        return false;
+    }
+    size_t threads = std::min<size_t>(files.size(), std::max(1U, std::thread::hardware_concurrency()));
+
+    // Parse: workers take files in turn
+    std::vector<AnalyzeFileResult> results(files.size());
+    std::atomic<size_t> nextFile{0};
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back([&] {
+            for (size_t file = nextFile++; file < files.size(); file = nextFile++) {
+                analyzeFile(files[file], query, results[file]);
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    workers.clear();
+
+    // Give the groups global IDs
+    std::unordered_map<std::string, uint32_t> groupIds;
+    std::vector<std::string> groups;
+    uint64_t totalSize = 0, totalRows = 0, totalMalformed = 0;
+    size_t skipped = 0;
+    for (size_t file = 0; file < files.size(); ++file) {
+        AnalyzeFileResult& result = results[file];
+        totalSize += result.size;
+        totalRows += result.rows;
+        totalMalformed += result.malformed;
+        if (!result.error.empty()) {
+            LOG_WARN("Skipping ", files[file].string(), ": ", result.error);
+            ++skipped;
+            continue;
+        }
+        std::vector<uint32_t> remap(result.groups.size());
+        for (size_t local = 0; local < result.groups.size(); ++local) {
+            auto it = groupIds.emplace(result.groups[local], static_cast<uint32_t>(groups.size())).first;
+            if (it->second == groups.size()) groups.push_back(result.groups[local]);
+            remap[local] = it->second;
+        }
+        for (auto& record : result.records) {
+            if (record.group != analyzeNoGroup) record.group = remap[record.group];
+        }
+    }
+
+    // Merge: each shard of job keys is counted by one worker, newest file first
+    size_t shards = std::max<size_t>(1, std::min<size_t>(std::max(1U, std::thread::hardware_concurrency()), 64));
+    size_t totalRecords = 0;
+    for (const auto& result : results) totalRecords += result.records.size();
+    std::vector<std::vector<AnalyzeTotals>> partial(shards, std::vector<AnalyzeTotals>(groups.size()));
+    std::vector<uint64_t> duplicates(shards, 0);
+    for (size_t shard = 0; shard < shards; ++shard) {
+        workers.emplace_back([&, shard] {
+            AnalyzeKeySet seen(query.distinct ? totalRecords / shards + totalRecords / shards / 8 + 64 : 0);
+            std::vector<AnalyzeTotals>& totals = partial[shard];
+            for (size_t file = results.size(); file-- > 0;) {
+                for (const auto& record : results[file].records) {
+                    if ((record.key >> 40) % shards != shard) continue;
+                    if (query.distinct && !seen.insert(record.key)) {
+                        ++duplicates[shard];
+                        continue;
+                    }
+                    if (record.group == analyzeNoGroup) continue;
+                    AnalyzeTotals& group = totals[record.group];
+                    ++group.jobs;
+                    group.pages += record.pages;
+                    group.bytes += record.bytes;
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+
+    std::vector<AnalyzeTotals> totals(groups.size());
+    AnalyzeTotals overall;
+    uint64_t duplicateRows = 0;
+    for (size_t shard = 0; shard < shards; ++shard) {
+        duplicateRows += duplicates[shard];
+        for (size_t group = 0; group < groups.size(); ++group) {
+            totals[group].jobs += partial[shard][group].jobs;
+            totals[group].pages += partial[shard][group].pages;
+            totals[group].bytes += partial[shard][group].bytes;
+        }
+    }
+    std::vector<size_t> order;
+    for (size_t group = 0; group < groups.size(); ++group) {
+        if (totals[group].jobs == 0) continue;  // Only had copies of jobs counted from newer files
+        order.push_back(group);
+        overall.jobs += totals[group].jobs;
+        overall.pages += totals[group].pages;
+        overall.bytes += totals[group].bytes;
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return totals[a].jobs != totals[b].jobs ? totals[a].jobs > totals[b].jobs : groups[a] < groups[b];
+    });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    out << "\n=== Analysis of " << query.pattern << " ===" << std::endl;
+    out << std::fixed << std::setprecision(2);
+    out << "Files: " << files.size() - skipped << " read, " << skipped << " skipped, "
+              << totalSize / 1e6 << " MB in " << seconds << " s with " << threads << " threads ("
+              << totalSize / 1e6 / std::max(seconds, 1e-9) << " MB/s)" << std::endl;
+    out << "Rows: " << totalRows << " read, " << totalMalformed << " malformed and skipped";
+    if (query.distinct) out << ", " << duplicateRows << " repeated in other files and counted once";
+    out << std::endl;
+    if (!query.groupBy.empty()) {
+        out << "By ";
+        for (size_t i = 0; i < query.groupBy.size(); ++i) {
+            out << (i ? ", " : "") << analyzeGroupFields[query.groupBy[i]].name;
+        }
+        out << ":" << std::endl;
+        for (size_t i = 0; i < order.size() && i < query.top; ++i) {
+            const AnalyzeTotals& group = totals[order[i]];
+            out << "  " << (groups[order[i]].empty() ? "(empty)" : groups[order[i]]) << ": " << group.jobs
+                      << " jobs, " << group.pages << " pages, " << group.bytes / 1e6 << " MB" << std::endl;
+        }
+        if (order.size() > query.top) {
+            out << "  (" << order.size() - query.top << " more groups; use top=<n> to show them)" << std::endl;
+        }
+    }
+    out << "Total: " << overall.jobs << " jobs, " << overall.pages << " pages, " << overall.bytes / 1e6
+              << " MB" << std::endl;
+    out << std::defaultfloat << std::setprecision(6);
+    out << "=====================\n" << std::endl;
+    if (overallTotals) *overallTotals = overall;
+    return true;
+}
+
+// Analyze command: "analyze <glob> [by <fields>] [filters] [top=<n>] [all]"
+void handleAnalyzeCommand(const std::string& args, std::ostream& out) {
+    AnalyzeQuery query;
+    if (parseAnalyzeQuery(args, query, out)) runAnalysis(query, out);
+}
+
+// Function to write synthetic autosave-like exports, each repeating most of
+// the previous one's jobs, and time an analysis of them
+int runAnalyzeBenchmark(size_t megabytes) {
+    namespace fs = std::filesystem;
+    const fs::path directory = "print_monitor_analyze_bench";
+    const size_t fileCount = 16;
+    static const char* const printers[] = {"Office_HP_LaserJet_4250", "\\\\printsrv01\\Floor3-Color",
+                                           "Brother HL-L2350DW series", "Canon iR-ADV C5535"};
+    static const char* const users[] = {"jsmith", "Jürgen Müller", "o\"brien", "mlopez", "akowalski"};
+    std::error_code ec;
+    fs::create_directories(directory, ec);
+
+    PrintJob job;
+    job.status = "Completed";
+    job.colorMode = "Monochrome";
+    job.duplexSetting = "Simplex";
+    job.paperSize = "A4";
+    job.printerName = printers[0];
+    job.userAccount = users[0];
+    job.timestamp = "2026-10-10T09:30:00.000+00:00";
+    job.pages = 10;
+    job.documentSize = 40000;
+    job.jobId = "1000000";
+    std::string sample;
+    appendCsvRow(sample, job);
+    size_t rowBytes = sample.size();
+    size_t rowsPerFile = std::max<size_t>(1, megabytes * 1024 * 1024 / fileCount / rowBytes);
+    size_t stride = rowsPerFile * 3 / 4;  // A quarter of each file repeats the previous one
+    std::cout << "Writing " << fileCount << " files of " << rowsPerFile << " jobs..." << std::endl;
+    for (size_t file = 0; file < fileCount; ++file) {
+        MappedFileWriter writer;
+        std::string name = (directory / ("print_jobs_auto_save_" + std::to_string(100 + file) + ".csv")).string();
+        bool ok = writer.open(name, rowsPerFile * rowBytes) && writer.write(csvHeader);
+        for (size_t row = 0; ok && row < rowsPerFile; ++row) {
+            size_t id = file * stride + row;
+            job.printerName = printers[id % std::size(printers)];
+            job.userAccount = users[id / 7 % std::size(users)];
+            job.timestamp = "2026-" + std::to_string(10 + id / 2000000 % 3) + "-" + std::to_string(10 + id / 100000 % 18) +
+                            "T09:30:00.000+00:00";
+            job.pages = static_cast<int>(1 + id % 20);
+            job.documentSize = static_cast<int>(20000 + id % 50000);
+            job.jobId = std::to_string(id);
+            char* out = writer.reserve(csvRowBound(job));
+            if (!out) break;
+            writer.commit(formatCsvRow(out, job));
+        }
+        if (!writer.close()) {
+            std::cout << "Could not write " << name << std::endl;
+            return 1;
+        }
+    }
+
+    AnalyzeQuery query;
+    AnalyzeTotals overall;
+    bool ok = parseAnalyzeQuery("\"" + (directory / "*.csv").string() + "\" by printer,month", query, std::cout) &&
+              runAnalysis(query, std::cout, &overall);
+    size_t expected = (fileCount - 1) * stride + rowsPerFile;
+    fs::remove_all(directory, ec);
+    ok = ok && overall.jobs == expected;
+    std::cout << (ok ? "Distinct job count matches." : "Distinct job count does not match.") << " Expected "
+              << expected << "." << std::endl;
+    return ok ? 0 : 1;
+}
+
+// Show current statistics
+void showStatistics(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(jobsMutex);
+    
+    out << "\n=== Print Job Statistics ===" << std::endl;
+    out << "Total print jobs recorded: " << printJobs.size() << std::endl;
+    
+    if (!printJobs.empty()) {
+        // Aggregate over the job columns rather than the rows
+        const JobColumns& columns = jobColumns;
+        uint64_t statusCount[std::size(jobStatusNames)];
+        countCodesColumn(columns.status.data(), columns.size(), statusCount, std::size(jobStatusNames));
+        int64_t totalPages = sumInt32Column(columns.pages.data(), columns.size());
+        int64_t totalSize = sumInt32Column(columns.documentSize.data(), columns.size());
+        
+        out << "Jobs by status:" << std::endl;
+        for (size_t code = 0; code < std::size(jobStatusNames); ++code) {
+            if (statusCount[code] > 0) {
+                out << "  " << jobStatusNames[code] << ": " << statusCount[code] << std::endl;
+            }
+        }
+
+        std::lock_guard<std::mutex> inventoryLock(inventoryMutex);
+        std::vector<uint64_t> printerCount = countIdsColumn(columns.printerId.data(), columns.size(),
+                                                            printerInventory.size());
+        out << "Jobs by printer:" << std::endl;
+        for (size_t id = 0; id < printerCount.size(); ++id) {
+            if (printerCount[id] > 0) {
+                out << "  " << printerInventory[id].name << ": " << printerCount[id] << std::endl;
+            }
+        }
+        
+        out << "Total pages printed: " << totalPages << std::endl;
+        out << "Total document size: " << totalSize << " bytes" << std::endl;
+        out << "Average pages per job: " << (double)totalPages / printJobs.size() << std::endl;
+    }
+    
+    {
+        std::lock_guard<std::mutex> inventoryLock(inventoryMutex);
+        size_t present = std::count_if(printerInventory.begin(), printerInventory.end(),
+                                       [](const PrinterRecord& record) { return record.present; });
+        out << "Printers in inventory: " << present << " (" << printerInventory.size() << " known, "
+                  << inventoryRefreshCount << " refreshes)" << std::endl;
+    }
+    out << "Jobs decoded last cycle: " << lastCycleJobsDecoded << " ("
+              << lastCycleJobsUnchanged << " unchanged and skipped)" << std::endl;
+    out << "Store lock acquisitions: " << lastCycleLockAcquisitions << " last cycle, "
+              << storeLockAcquisitions << " total" << std::endl;
+    
+    showSchedulerStatistics(out);
+    {
+        std::lock_guard<std::mutex> pollLock(pollsInFlightMutex);
+        out << "Polls in flight: " << pollsInFlight.size() << " (" << pollsSkippedInFlight
+                  << " timer ticks skipped while a poll was still running)" << std::endl;
+    }
+    showBreakerStatistics(out);
+    showAnomalyStatistics(out);
+    showLogSinkStatistics(out);
+    showIoStatistics(out);
+    showJobHistoryStatistics(out);
+    {
+        std::lock_guard<std::mutex> stuckLock(stuckMutex);
+        out << "Stuck jobs: " << stuckJobKeys.size() << " now, " << stuckJobsDetected << " detected ("
+                  << trackedJobs.size() << " jobs tracked, " << stuckDeadlines.size() << " deadlines queued)"
+                  << std::endl;
+    }
+    if (partitionMode == 1 || partitionMode == 2 || partitionsSealed > 0) {
+        std::lock_guard<std::mutex> partitionLock(partitionMutex);
+        out << "Partitioned export: " << partitionRowsWritten << " jobs written, " << partitionsSealed
+                  << " partitions sealed, current "
+                  << (currentPartition.active ? currentPartition.name : std::string("none")) << std::endl;
+    }
+    out << "Monitoring status: " << (monitoringActive ? "ACTIVE" : "STOPPED") << std::endl;
+    out << "============================\n" << std::endl;
+}
+
+// Runtime settings adjustable with the `config` command
+struct ConfigSetting {
+    const char* key;
+    std::atomic<long long>* value;
+    const char* description;
+};
+
+const ConfigSetting configSettings[] = {
+    { "log.level",                 &logLevelThreshold,        "Minimum level logged: 0=DEBUG 1=INFO 2=WARN 3=ERROR" },
+    { "log.file.level",            &logSinks[LOG_SINK_FILE].level,           "Lowest level written to print_monitor.log (4 = off)" },
+    { "log.file.buffer_lines",     &logSinks[LOG_SINK_FILE].bufferLines,     "Lines queued for the log file before new ones are dropped" },
+    { "log.file.flush_ms",         &logSinks[LOG_SINK_FILE].flushMs,         "Let log file lines collect this long before writing (0 = at once)" },
+    { "log.console.level",         &logSinks[LOG_SINK_CONSOLE].level,        "Lowest level echoed to the console (4 = off)" },
+    { "log.console.buffer_lines",  &logSinks[LOG_SINK_CONSOLE].bufferLines,  "Lines queued for the console before new ones are dropped" },
+    { "log.console.flush_ms",      &logSinks[LOG_SINK_CONSOLE].flushMs,      "Let console lines collect this long before writing (0 = at once)" },
+    { "log.syslog.level",          &logSinks[LOG_SINK_SYSLOG].level,         "Lowest level sent to syslog (4 = off)" },
+    { "log.syslog.buffer_lines",   &logSinks[LOG_SINK_SYSLOG].bufferLines,   "Lines queued for syslog before new ones are dropped" },
+    { "log.syslog.flush_ms",       &logSinks[LOG_SINK_SYSLOG].flushMs,       "Let syslog lines collect this long before sending (0 = at once)" },
+    { "log.syslog.port",           &syslogPort,               "UDP port of the local syslog daemon (127.0.0.1)" },
+    { "log.memory.level",          &logSinks[LOG_SINK_MEMORY].level,         "Lowest level kept for the tail command (4 = off)" },
+    { "log.memory.lines",          &logSinks[LOG_SINK_MEMORY].bufferLines,   "Lines kept for the tail command" },
+    { "log.max_bytes",             &logMaxBytes,              "Rotate the log at this size in bytes (0 = never)" },
+    { "log.max_age_hours",         &logMaxAgeHours,           "Rotate the log after this many hours (0 = never)" },
+    { "log.retention_count",       &logRetentionCount,        "Number of rotated logs to keep" },
+    { "inventory.refresh_minutes", &inventoryRefreshMinutes,  "Re-enumerate printers at least this often (0 = only on change)" },
+    { "poll.interval_seconds",     &pollIntervalSeconds,      "Default interval between polls of each printer" },
+    { "save.interval_minutes",     &autosaveIntervalMinutes,  "Autosave interval, applied when monitoring starts" },
+    { "export.partition",          &partitionMode,            "Partitioned export of finalized jobs: 0 = off, 1 = hourly, 2 = daily" },
+    { "export.partition_buffer_kb", &partitionBufferKb,       "Size of each write buffer of the open partition file" },
+    { "history.filter_kb",         &historyFilterKb,          "Memory for the job history's Bloom filters (0 = no history)" },
+    { "history.false_positive_ppm", &historyFalsePositivePpm, "Target rate, per million, of history lookups searched on disk in vain" },
+    { "history.generations",       &historyGenerationCount,   "Filter generations kept before the oldest is dropped with its file" },
+    { "csv.kernel",                &csvKernelSetting,         "Parser for reading exports: 0 = scalar, 1 = SSE2, 2 = AVX2 (or the best the CPU has)" },
+    { "io.backend",                &ioBackend,                "File writes: 0 = overlapped I/O, 1 = thread pool" },
+    { "io.queue_depth",            &ioQueueDepth,             "Write buffers per file, and so writes in flight (1-64)" },
+    { "io.buffer_kb",              &ioBufferKb,               "Size of each file write buffer" },
+    { "snapshot.interval_minutes", &snapshotIntervalMinutes,  "Warm-start snapshot interval, applied when monitoring starts" },
+    { "spooler.call_timeout_ms",   &spoolerCallTimeoutMs,     "Deadline for each OpenPrinter/EnumJobs/ClosePrinter call" },
+    { "breaker.failure_threshold", &breakerFailureThreshold,  "Consecutive failures before a printer's circuit opens" },
+    { "breaker.base_backoff_seconds", &breakerBaseBackoffSeconds, "First retry delay after a circuit opens" },
+    { "breaker.max_backoff_seconds", &breakerMaxBackoffSeconds, "Upper bound for the doubling retry delay" },
+    { "anomaly.z_threshold",       &anomalyZThreshold,        "Z-score at which a queue metric raises an alert" },
+    { "anomaly.half_life_polls",   &anomalyHalfLifePolls,     "Half-life of the queue baselines, in polls" },
+    { "anomaly.warmup_polls",      &anomalyWarmupPolls,       "Polls a baseline learns before it may alert" },
+    { "series.chunk_minutes",      &seriesChunkMinutes,       "Time covered by each compressed time-series chunk" },
+    { "series.retention_days",     &seriesRetentionDays,      "Days of time-series samples kept per printer" },
+    { "stuck.spooling_minutes",    &stuckSpoolingMinutes,     "Minutes Spooling before a job is stuck (0 = never)" },
+    { "stuck.paused_minutes",      &stuckPausedMinutes,       "Minutes Paused before a job is stuck (0 = never)" },
+    { "stuck.error_minutes",       &stuckErrorMinutes,        "Minutes in Error before a job is stuck (0 = never)" },
+    { "stuck.intervention_minutes", &stuckInterventionMinutes, "Minutes awaiting user intervention before a job is stuck (0 = never)" },
+};
+
+// Show or change configuration: "config" or "config <key> <value>"
+void handleConfigCommand(const std::string& args, std::ostream& out) {
+    std::istringstream in(args);
+    std::string key;
+    long long value = 0;
+
+    if (!(in >> key)) {
+        out << "\n=== Configuration ===" << std::endl;
+        for (const auto& setting : configSettings) {
+            out << "  " << std::left << std::setw(28) << setting.key << std::right
+                      << setting.value->load() << "  (" << setting.description << ")" << std::endl;
+        }
+        out << "=====================\n" << std::endl;
+        return;
+    }
+
+    for (const auto& setting : configSettings) {
+        if (key == setting.key) {
+            if (!(in >> value) || value < 0) {
+                out << "Please specify a non-negative value for " << key << "." << std::endl;
+                return;
+            }
+            setting.value->store(value);
+            LOG_INFO("Configuration changed: ", key, " = ", value);
+            return;
+        }
+    }
+    out << "Unknown configuration key: " << key << std::endl;
+}
+
+// List the printer inventory with IDs and poll intervals
+void showPrinters(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(inventoryMutex);
+    out << "\n=== Printers ===" << std::endl;
+    for (const auto& printer : printerInventory) {
+        out << "  [" << printer.id << "] " << printer.name
+                  << (printer.present ? "" : " (removed)")
+                  << (printer.location.empty() ? "" : " - " + printer.location)
+                  << ", every " << effectivePollInterval(printer) << "s"
+                  << (printer.pollIntervalSeconds > 0 ? "" : " (default)");
+        BreakerState breaker = breakerStateOf(printer.id);
+        if (breaker != BreakerState::Closed) {
+            out << ", circuit " << breakerStateName(breaker);
+        }
+        out << std::endl;
+    }
+    out << "================\n" << std::endl;
+}
+
+// Function to turn a cost rate field ("*" or a name from the table) into a code mask
+template <size_t N>
+bool parseCostField(const std::string& token, const char* const (&names)[N], uint32_t& mask) {
+    if (token == "*") {
+        mask = anyCodeMask;
+        return true;
+    }
+    for (size_t code = 0; code < N; ++code) {
+        std::string name = names[code];
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        if (token == name) {
+            mask = 1U << code;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Function to describe a code mask for the rate listing
+template <size_t N>
+std::string describeCostField(uint32_t mask, const char* const (&names)[N]) {
+    if (mask == anyCodeMask) return "*";
+    std::string text;
+    for (size_t code = 0; code < N; ++code) {
+        if (mask >> code & 1) text += (text.empty() ? "" : "/") + std::string(names[code]);
+    }
+    return text;
+}
+
+// Function to print the configured cost rates
+void showCostRates(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(jobsMutex);
+    out << "\n=== Cost Rates (price per page) ===" << std::endl;
+    if (costRates.empty()) {
+        out << "  No rates set; jobs are recorded at zero cost." << std::endl;
+    }
+    for (const auto& rate : costRates) {
+        out << "  printer " << (rate.printerId == noColumnId ? "*" : std::to_string(rate.printerId))
+                  << ", paper " << describeCostField(rate.paperMask, paperSizeNames)
+                  << ", color " << describeCostField(rate.colorMask, colorModeNames)
+                  << ", duplex " << describeCostField(rate.duplexMask, duplexSettingNames)
+                  << ": " << formatCost(rate.pricePerPage) << std::endl;
+    }
+    out << "===================================\n" << std::endl;
+}
+
+// Function to print the cost totals by printer and by user, largest first
+void showCostReport(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(jobsMutex);
+    out << "\n=== Print Costs ===" << std::endl;
+    out << "Total: " << formatCost(costTotal) << std::endl;
+
+    std::vector<std::pair<int64_t, std::string>> rows;
+    {
+        std::lock_guard<std::mutex> inventoryLock(inventoryMutex);
+        for (size_t id = 0; id < costByPrinter.size(); ++id) {
+            if (costByPrinter[id] != 0) {
+                rows.emplace_back(costByPrinter[id], id < printerInventory.size() ? printerInventory[id].name : "?");
+            }
+        }
+    }
+    std::sort(rows.rbegin(), rows.rend());
+    out << "By printer:" << std::endl;
+    for (const auto& row : rows) {
+        out << "  " << row.second << ": " << formatCost(row.first) << std::endl;
+    }
+
+    rows.clear();
+    for (size_t id = 0; id < costByUser.size(); ++id) {
+        if (costByUser[id] != 0) rows.emplace_back(costByUser[id], userNames[id]);
+    }
+    std::sort(rows.rbegin(), rows.rend());
+    out << "By user:" << std::endl;
+    for (const auto& row : rows) {
+        out << "  " << row.second << ": " << formatCost(row.first) << std::endl;
+    }
+    out << "===================\n" << std::endl;
+}
+
+// Cost command: "cost", "cost rates", or
+// "cost rate <printer id|*> <paper|*> <color|*> <duplex|*> <price per page|off>"
+void handleCostCommand(const std::string& args, std::ostream& out) {
+    std::istringstream in(args);
+    std::string action;
+    in >> action;
+    if (action.empty()) {
+        showCostReport(out);
+        return;
+    }
+    if (action == "rates") {
+        showCostRates(out);
+        return;
+    }
+
+    std::string printer, paper, color, duplex, price;
+    CostRate rate;
+    bool valid = action == "rate" && static_cast<bool>(in >> printer >> paper >> color >> duplex >> price);
+    if (valid && printer != "*") {
+        char* end = nullptr;
+        unsigned long id = std::strtoul(printer.c_str(), &end, 10);
+        valid = *end == '\0' && id < noColumnId;
+        rate.printerId = static_cast<uint32_t>(id);
+    }
+    valid = valid && parseCostField(paper, paperSizeNames, rate.paperMask);
+    if (valid && color == "mono") color = "monochrome";
+    valid = valid && parseCostField(color, colorModeNames, rate.colorMask);
+    if (valid && duplex == "duplex") {
+        rate.duplexMask = (1U << columnCode(duplexSettingNames, "Duplex Vertical")) |
+                          (1U << columnCode(duplexSettingNames, "Duplex Horizontal"));
+    } else {
+        valid = valid && parseCostField(duplex, duplexSettingNames, rate.duplexMask);
+    }
+    if (valid && price == "off") {
+        rate.pricePerPage = -1;
+    } else if (valid) {
+        char* end = nullptr;
+        double amount = std::strtod(price.c_str(), &end);
+        valid = *end == '\0' && amount >= 0;
+        rate.pricePerPage = std::llround(amount * 1000);
+    }
+    if (!valid) {
+        out << "Usage: cost | cost rates | cost rate <printer id|*> <paper|*> <color|*> <duplex|*> <price|off>" << std::endl;
+        out << "  paper: letter legal a4 a3 a5 custom unknown; color: color mono unknown;" << std::endl;
+        out << "  duplex: simplex duplex unknown" << std::endl;
+        return;
+    }
+
+    setCostRate(rate);
+    if (rate.pricePerPage < 0) {
+        LOG_INFO("Cost rate removed: ", printer, " ", paper, " ", color, " ", duplex);
+    } else {
+        LOG_INFO("Cost rate set: ", printer, " ", paper, " ", color, " ", duplex, " = ",
+                 formatCost(rate.pricePerPage), " per page (applies to jobs recorded from now on)");
+    }
+}
+
+// Set a printer's own poll interval: "interval <printer id> <seconds>" (0 restores the default)
+void handleIntervalCommand(const std::string& args, std::ostream& out) {
+    std::istringstream in(args);
+    uint32_t printerId = 0;
+    long long seconds = 0;
+    if (!(in >> printerId >> seconds) || seconds < 0) {
+        out << "Usage: interval <printer id> <seconds>" << std::endl;
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(inventoryMutex);
+        if (printerId >= printerInventory.size()) {
+            out << "Unknown printer ID: " << printerId << std::endl;
+            return;
+        }
+        printerInventory[printerId].pollIntervalSeconds = seconds;
+    }
+    // The next housekeeping run re-arms the printer's poll timer
+    LOG_INFO("Poll interval for printer ", printerId, " set to ",
+             seconds > 0 ? std::to_string(seconds) + "s" : std::string("the default"));
+}
+
+// Show help information
+void showHelp(std::ostream& out) {
+    out << "\n=== Print Job Monitor Help ===" << std::endl;
+    out << "Commands:" << std::endl;
+    out << "  start         - Start monitoring print jobs" << std::endl;
+    out << "  stop          - Stop monitoring print jobs" << std::endl;
+    out << "  save          - Force save current data to CSV" << std::endl;
+    out << "  export [file] - Export to specified CSV file" << std::endl;
+    out << "  export [file] [from=t] [to=t] [printer=p] [user=u] [status=s] [color=c]" << std::endl;
+    out << "                - Export only matching jobs; t is YYYY-MM-DD[THH:MM] or 7d/12h ago," << std::endl;
+    out << "                  p is a printer ID or name, and lists are comma-separated" << std::endl;
+    out << "  analyze glob [by f[,f]] [filters] [top=n] [all]" << std::endl;
+    out << "                - Total jobs, pages and bytes in export files, grouped by printer, user," << std::endl;
+    out << "                  status, color, duplex, paper, hour, day or month; export's filters apply" << std::endl;
+    out << "  stats         - Show current statistics" << std::endl;
+    out << "  binlog on|off - Toggle binary structured logging" << std::endl;
+    out << "  config [k v]  - Show settings or set key k to value v" << std::endl;
+    out << "  printers      - List known printers with IDs and poll intervals" << std::endl;
+    out << "  interval i s  - Poll printer i every s seconds (0 = default)" << std::endl;
+    out << "  tail [n]      - Show the last n log lines (default 20)" << std::endl;
+    out << "  stuck         - List jobs stuck in Spooling, Paused, Error or User Intervention" << std::endl;
+    out << "  series [i metric [hours [step]]]" << std::endl;
+    out << "                - Time-series storage, or printer i's depth|active|ppm history" << std::endl;
+    out << "  cost          - Show print costs by printer and user" << std::endl;
+    out << "  cost rates    - List cost rates" << std::endl;
+    out << "  cost rate p paper color duplex price" << std::endl;
+    out << "                - Set a price per page (* = any, price 'off' removes)" << std::endl;
+    out << "  help          - Show this help message" << std::endl;
+    out << "  quit/exit     - Quit the application" << std::endl;
+    out << "==============================\n" << std::endl;
+}
+
+// Function to run one command line; returns false when the command asks the application to exit
+bool executeCommand(std::string input, std::ostream& out) {
+    // Convert to lowercase for easier command matching
+    std::transform(input.begin(), input.end(), input.begin(), ::tolower);
+
+    if (input == "start") {
+        startMonitoring();
+    }
+    else if (input == "stop") {
+        stopMonitoring();
+    }
+    else if (input == "save") {
+        forceSave();
+    }
+    else if (input.substr(0, 6) == "export") {
+        std::string filename = "print_jobs_export.csv";
+        ExportFilter filter;
+        if (parseExportFilter(input.substr(6), filename, filter, out)) {
+            if (filename.length() > 0) {
+                exportToCSV(filename, filter);
+            } else {
+                out << "Please specify a filename for export." << std::endl;
+            }
+        }
+    }
+    else if (input.substr(0, 7) == "analyze") {
+        handleAnalyzeCommand(input.substr(7), out);
+    }
+    else if (input == "stats") {
+        showStatistics(out);
+    }
+    else if (input == "binlog on" || input == "binlog off") {
+        setBinaryLogging(input == "binlog on");
+    }
+    else if (input == "printers") {
+        showPrinters(out);
+    }
+    else if (input == "stuck") {
+        showStuckJobs(out);
+    }
+    else if (input.substr(0, 4) == "tail") {
+        showLogTail(input.substr(4), out);
+    }
+    else if (input.substr(0, 6) == "series") {
+        handleSeriesCommand(input.substr(6), out);
+    }
+    else if (input.substr(0, 8) == "interval") {
+        handleIntervalCommand(input.substr(8), out);
+    }
+    else if (input.substr(0, 4) == "cost") {
+        handleCostCommand(input.substr(4), out);
+    }
+    else if (input.substr(0, 6) == "config") {
+        handleConfigCommand(input.substr(6), out);
+    }
+    else if (input == "help") {
+        showHelp(out);
+    }
+    else if (input == "quit" || input == "exit") {
+        if (monitoringActive) {
+            stopMonitoring();
+        }
+        out << "Exiting..." << std::endl;
+        return false;
+    }
+    else if (!input.empty()) {
+        out << "Unknown command. Type 'help' for available commands." << std::endl;
+    }
+    return true;
+}
+
+// Main command loop
+void commandLoop() {
+    std::cout << "Windows Print Job Monitoring System" << std::endl;
+    std::cout << "Type 'help' for available commands or 'quit' to exit.\n" << std::endl;
+    
+    std::string input;
+    while (true) {
+        std::cout << "> ";
+        std::getline(std::cin, input);
+        if (!executeCommand(input, std::cout)) {
+            break;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Self-test
+//
+// `print_monitor.exe --self-test` runs checks that need no printers or
+// spooler: each one builds its own input, runs the code under test and
+// compares the result with what it has to be. It prints a line per check and
+// exits with 1 if any failed, so it can run straight after a build. Log lines
+// the checks cause go only to the memory sink, and files they write are
+// removed again.
+// ---------------------------------------------------------------------------
+
+const char* selfTestFileName = "print_monitor_selftest.tmp";
+
+// Function to print one self-test result; returns whether it passed
+bool selfTestCheck(const char* name, bool passed) {
+    std::cout << (passed ? "  ok      " : "  FAILED  ") << name << std::endl;
+    return passed;
+}
+
+// Function to check that LOG_EVENT skips its arguments below the level, and that a binary log decodes back to its events
+bool selfTestBinaryLog() {
+    bool ok = true;
+    int evaluated = 0;
+    auto counted = [&evaluated](unsigned long long value) {
+        ++evaluated;
+        return logUint(value);
+    };
+    logLevelThreshold = static_cast<long long>(LogLevel::Error);
+    LOG_EVENT(LOGFMT_JOB_DETECTED, counted(41), logString("Self-test printer"), logString("Printing"));
+    ok &= selfTestCheck("LOG_EVENT below the level evaluates no arguments", evaluated == 0);
+
+    logLevelThreshold = static_cast<long long>(LogLevel::Info);
+    size_t internedBefore;
+    {
+        std::lock_guard<std::mutex> lock(internMutex);
+        internedBefore = internedStrings.size();
+    }
+    LOG_EVENT(LOGFMT_JOB_DETECTED, logUint(40), logString("Self-test text printer"), logString("Printing"));
+    {
+        std::lock_guard<std::mutex> lock(internMutex);
+        ok &= selfTestCheck("text-mode LOG_EVENT interns no strings", internedStrings.size() == internedBefore);
+    }
+    bool rendered = false;
+    {
+        LogSink& memory = logSinks[LOG_SINK_MEMORY];
+        std::lock_guard<std::mutex> lock(memory.mutex);
+        for (const auto& line : memory.queue) {
+            rendered |= line.text.find("Detected print job: 40 on Self-test text printer - Status: Printing") != std::string::npos;
+        }
+    }
+    ok &= selfTestCheck("text-mode LOG_EVENT renders its strings", rendered);
+
+    const char* savedFileName = binaryLogFileName;
+    binaryLogFileName = selfTestFileName;
+    setBinaryLogging(true);
+    LOG_EVENT(LOGFMT_JOB_DETECTED, counted(42), logString("Self-test printer"), logString("Printing"));
+    LOG_EVENT(LOGFMT_ENUM_PRINTERS_FAILED, logErrorCode(5));
+    setBinaryLogging(false);
+    binaryLogFileName = savedFileName;
+
+    std::ostringstream decoded;
+    std::streambuf* savedOutput = std::cout.rdbuf(decoded.rdbuf());
+    int result = decodeBinaryLog(selfTestFileName);
+    std::cout.rdbuf(savedOutput);
+    std::error_code error;
+    std::filesystem::remove(selfTestFileName, error);
+    std::string text = decoded.str();
+    ok &= selfTestCheck("binary log decodes to the events written",
+                        result == 0 && evaluated == 1 &&
+                        text.find("Detected print job: 42 on Self-test printer - Status: Printing") != std::string::npos &&
+                        text.find("Failed to enumerate printers. Error: 5") != std::string::npos);
+    return ok;
+}
+
+// Function to check that PM_LOG evaluates and writes a line only at enabled levels: those
+// compiled in, at or above logLevelThreshold, and accepted by at least one sink
+bool selfTestLogLevels() {
+    LogSink& memory = logSinks[LOG_SINK_MEMORY];
+    long long savedMemoryLevel = memory.level;
+    int evaluated = 0;
+    auto counted = [&evaluated](int value) {
+        ++evaluated;
+        return value;
+    };
+    auto ringHas = [&memory](const std::string& text) {
+        std::lock_guard<std::mutex> lock(memory.mutex);
+        for (const auto& line : memory.queue) {
+            if (line.text.find(text) != std::string::npos) return true;
+        }
+        return false;
+    };
+
+    memory.level = static_cast<long long>(LogLevel::Debug);
+    logLevelThreshold = static_cast<long long>(LogLevel::Debug);
+    LOG_DEBUG("self-test level ", counted(1));
+    bool ok = selfTestCheck("LOG_DEBUG is evaluated only when compiled in",
+                            evaluated == (logLevelCompiledIn(LogLevel::Debug) ? 1 : 0) &&
+                            ringHas("self-test level 1") == logLevelCompiledIn(LogLevel::Debug));
+
+    evaluated = 0;
+    logLevelThreshold = static_cast<long long>(LogLevel::Warn);
+    LOG_DEBUG("self-test level ", counted(2));
+    LOG_INFO("self-test level ", counted(3));
+    LOG_WARN("self-test level ", counted(4));
+    ok &= selfTestCheck("levels below logLevelThreshold evaluate no arguments and write nothing",
+                        evaluated == 1 && !ringHas("self-test level 2") && !ringHas("self-test level 3") &&
+                        ringHas("self-test level 4"));
+
+    // With every sink above WARN, a WARN line has nowhere to go
+    evaluated = 0;
+    memory.level = static_cast<long long>(LogLevel::Error);
+    LOG_WARN("self-test level ", counted(5));
+    LOG_ERROR("self-test level ", counted(6));
+    ok &= selfTestCheck("levels no sink accepts evaluate no arguments",
+                        evaluated == 1 && !ringHas("self-test level 5") && ringHas("self-test level 6"));
+
+    memory.level = savedMemoryLevel;
+    logLevelThreshold = static_cast<long long>(LogLevel::Info);
+    return ok;
+}
+
+// Function to check that commitJobBatch records a printer's jobs under one acquisition of
+// jobsMutex, updates jobs already in the store in place, and evicts the oldest past 1000 jobs
+bool selfTestJobStore() {
+    long long savedHistoryKb = historyFilterKb;
+    historyFilterKb = 0;
+    std::vector<int64_t> savedByUser, savedByPrinter;
+    int64_t savedTotal;
+    uint64_t savedSequence;
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        savedByUser.swap(costByUser);
+        savedByPrinter.swap(costByPrinter);
+        savedTotal = costTotal;
+        savedSequence = firstJobSequence;
+    }
+
+    auto job = [](size_t id, const char* status) {
+        PrintJob result;
+        result.printerName = "Self-test";
+        result.jobId = std::to_string(id);
+        result.status = status;
+        result.userAccount = "alice";
+        result.timestamp = "2026-10-18T09:30:00.000+00:00";
+        result.pages = 1;
+        return result;
+    };
+    // Function to check that the store, its columns and the dedupe index agree, and hold jobs first..last in order
+    auto storeHolds = [](size_t first, size_t last) {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        bool consistent = printJobs.size() == last - first + 1 && jobColumns.size() == printJobs.size() &&
+                          recordedJobKeys.size() == printJobs.size();
+        for (size_t row = 0; consistent && row < printJobs.size(); ++row) {
+            auto it = recordedJobKeys.find(jobKey(printJobs[row].printerName, printJobs[row].jobId));
+            consistent = printJobs[row].jobId == std::to_string(first + row) && it != recordedJobKeys.end() &&
+                         it->second - firstJobSequence == row &&
+                         jobColumns.status[row] == columnCode(jobStatusNames, printJobs[row].status);
+        }
+        return consistent;
+    };
+
+    std::vector<PrintJob> batch;
+    for (size_t id = 0; id < 5; ++id) batch.push_back(job(id, "Spooling"));
+    uint64_t acquisitions = storeLockAcquisitions;
+    commitJobBatch(0, batch);
+    bool oneLock = storeLockAcquisitions == acquisitions + 1 && storeHolds(0, 4);
+
+    batch = {job(1, "Printing"), job(3, "Error"), job(5, "Spooling")};
+    batch[1].pages = 7;
+    acquisitions = storeLockAcquisitions;
+    commitJobBatch(0, batch);
+    bool updated = storeLockAcquisitions == acquisitions + 1 && storeHolds(0, 5);
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        updated = updated && printJobs[1].status == "Printing" && printJobs[3].status == "Error" &&
+                  printJobs[3].pages == 7 && jobColumns.pages[3] == 7 && printJobs[0].status == "Spooling";
+    }
+
+    // 1006 jobs: the oldest 100 go, as the store evicts at least that many at once
+    batch.clear();
+    for (size_t id = 6; id < 1006; ++id) batch.push_back(job(id, "Spooling"));
+    commitJobBatch(0, batch);
+    bool evicted = storeHolds(100, 1005);
+
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        printJobs.clear();
+        jobColumns.clear();
+        recordedJobKeys.clear();
+        firstJobSequence = savedSequence;
+        costByUser.swap(savedByUser);
+        costByPrinter.swap(savedByPrinter);
+        costTotal = savedTotal;
+    }
+    historyFilterKb = savedHistoryKb;
+    bool ok = selfTestCheck("a batch of new jobs is recorded in order under one store lock", oneLock);
+    ok &= selfTestCheck("jobs already in the store take the batch's status and pages in place", updated);
+    ok &= selfTestCheck("past 1000 jobs the oldest are evicted, with their dedupe keys", evicted);
+    return ok;
+}
+
+// Function to check that an enumeration keeps each printer's ID, marks missing printers
+// absent rather than dropping them, and that the fallback refresh comes due on its cadence
+bool selfTestPrinterInventory() {
+    std::vector<PrinterRecord> savedInventory;
+    std::unordered_map<std::string, uint32_t> savedIds;
+    {
+        std::lock_guard<std::mutex> lock(inventoryMutex);
+        savedInventory.swap(printerInventory);
+        savedIds.swap(printerIdsByName);
+    }
+    HANDLE savedNotification = printerChangeNotification;
+    printerChangeNotification = NULL;  // Only the cadence can make the inventory stale
+    long long savedMinutes = inventoryRefreshMinutes;
+    auto savedRefresh = lastInventoryRefresh;
+
+    // Function to apply an enumeration of printers given as name and location pairs
+    auto enumerate = [](std::initializer_list<std::pair<const char*, const char*>> printers) {
+        std::vector<WideString> strings;
+        for (const auto& printer : printers) {
+            for (const char* text : {printer.first, printer.second}) strings.emplace_back(text, text + std::strlen(text));
+        }
+        std::vector<PRINTER_INFO_2W> infos(printers.size());
+        for (size_t i = 0; i < infos.size(); ++i) {
+            infos[i].pPrinterName = strings[2 * i].data();
+            infos[i].pLocation = strings[2 * i + 1].data();
+        }
+        return applyPrinterEnumeration(infos.data(), static_cast<DWORD>(infos.size()));
+    };
+    // Function to list the present printers as "ID name@location"
+    auto listed = []() {
+        std::string text;
+        for (const PrinterRecord& printer : presentPrinters()) {
+            text += std::to_string(printer.id) + " " + printer.name + "@" + printer.location + ";";
+        }
+        return text;
+    };
+
+    InventoryChange first = enumerate({{"Alpha", "Floor 1"}, {"Beta", "Floor 2"}});
+    bool assigned = first.added == 2 && first.removed == 0 && first.present == 2 &&
+                    listed() == "0 Alpha@Floor 1;1 Beta@Floor 2;";
+    InventoryChange second = enumerate({{"Gamma", "Floor 3"}, {"Beta", "Floor 2"}});
+    bool absent = second.added == 1 && second.removed == 1 && second.present == 2 &&
+                  listed() == "1 Beta@Floor 2;2 Gamma@Floor 3;";
+    {
+        std::lock_guard<std::mutex> lock(inventoryMutex);
+        absent = absent && printerInventory.size() == 3 && printerInventory[0].name == "Alpha" && !printerInventory[0].present;
+    }
+    InventoryChange third = enumerate({{"Alpha", "Lobby"}, {"Beta", "Floor 2"}, {"Gamma", "Floor 3"}});
+    bool returned = third.added == 1 && third.removed == 0 && third.present == 3 &&
+                    listed() == "0 Alpha@Lobby;1 Beta@Floor 2;2 Gamma@Floor 3;";
+
+    inventoryRefreshMinutes = 60;
+    lastInventoryRefresh = std::chrono::steady_clock::now() - std::chrono::minutes(59);
+    bool cadence = !printerInventoryStale();
+    lastInventoryRefresh = std::chrono::steady_clock::now() - std::chrono::minutes(61);
+    cadence = cadence && printerInventoryStale();
+    inventoryRefreshMinutes = 0;
+    cadence = cadence && !printerInventoryStale();
+
+    {
+        std::lock_guard<std::mutex> lock(inventoryMutex);
+        printerInventory.swap(savedInventory);
+        printerIdsByName.swap(savedIds);
+    }
+    printerChangeNotification = savedNotification;
+    inventoryRefreshMinutes = savedMinutes;
+    lastInventoryRefresh = savedRefresh;
+    bool ok = selfTestCheck("new printers get the next ID in enumeration order", assigned);
+    ok &= selfTestCheck("a printer missing from an enumeration is marked absent and keeps its ID", absent);
+    ok &= selfTestCheck("a returning printer gets its old ID back and its current location", returned);
+    ok &= selfTestCheck("the fallback refresh is due after inventory.refresh_minutes, never at 0", cadence);
+    return ok;
+}
+
+// Where a self-test coroutine ran at each step of the poll pipeline, and what its calls returned
+struct PipelineProbe {
+    const WorkerPool* startedOn = nullptr;
+    const WorkerPool* callRanOn = nullptr;
+    const WorkerPool* resumedOn = nullptr;
+    const WorkerPool* timeoutResumedOn = nullptr;
+    const WorkerPool* movedTo = nullptr;
+    const WorkerPool* stayedOn = nullptr;
+    SpoolerResult failed;
+    SpoolerResult timedOut;
+    bool resumedBeforeSlowCall = false;
+    std::atomic<bool> slowCallReturned{false};
+    std::mutex mutex;
+    std::condition_variable condition;
+    size_t finished = 0;  // Coroutines that reached their end
+};
+
+// Function to mark a self-test coroutine finished
+void finishPipelineProbe(PipelineProbe& probe) {
+    std::lock_guard<std::mutex> lock(probe.mutex);
+    ++probe.finished;
+    probe.condition.notify_all();
+}
+
+// Self-test coroutine that walks the steps of a poll: a failing spooler call,
+// one that outlives its deadline, and moves between pools
+PollTask runPipelineProbe(std::shared_ptr<PipelineProbe> probe) {
+    probe->startedOn = currentWorkerPool;
+    auto session = std::make_shared<SpoolerSession>();
+    probe->failed = co_await spoolerCall(session, [probe](SpoolerSession&) -> BOOL {
+        probe->callRanOn = currentWorkerPool;
+        SetLastError(ERROR_ACCESS_DENIED);
+        return FALSE;
+    });
+    probe->resumedOn = currentWorkerPool;
+
+    probe->timedOut = co_await spoolerCall(session, [probe](SpoolerSession&) -> BOOL {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+        probe->slowCallReturned = true;
+        return TRUE;
+    });
+    probe->resumedBeforeSlowCall = !probe->slowCallReturned;
+    probe->timeoutResumedOn = currentWorkerPool;
+
+    co_await ResumeOnPool{ ioWritePool };
+    probe->movedTo = currentWorkerPool;
+    WorkerPool stopped;
+    co_await ResumeOnPool{ stopped };
+    probe->stayedOn = currentWorkerPool;
+    co_await ResumeOnExecutor{};
+    finishPipelineProbe(*probe);
+}
+
+// Self-test coroutine that makes one slow spooler call, to see calls from many polls overlap
+PollTask runSlowSpoolerCall(std::shared_ptr<PipelineProbe> probe) {
+    co_await spoolerCall(std::make_shared<SpoolerSession>(), [](SpoolerSession&) -> BOOL {
+        std::this_thread::sleep_for(std::chrono::milliseconds(250));
+        return TRUE;
+    });
+    finishPipelineProbe(*probe);
+}
+
+// Function to check that poll coroutines run on the executor, make spooler calls on the
+// blocking pool, resume on the executor when a call returns or its deadline passes, and
+// that many polls' calls are in flight at once; it starts the scheduler and both pools itself
+bool selfTestPollExecutor() {
+    long long savedTimeoutMs = spoolerCallTimeoutMs;
+    uint64_t timedOutBefore = spoolerCallsTimedOut;
+    startWorkerPool(pollExecutor, pollExecutorThreads);
+    startWorkerPool(spoolerCallPool, spoolerCallThreads);
+    startScheduler();
+    // Function to wait until the given number of coroutines have finished
+    auto waitFinished = [](PipelineProbe& probe, size_t count) {
+        std::unique_lock<std::mutex> lock(probe.mutex);
+        return probe.condition.wait_for(lock, std::chrono::seconds(10), [&] { return probe.finished >= count; });
+    };
+
+    spoolerCallTimeoutMs = 100;
+    auto probe = std::make_shared<PipelineProbe>();
+    runPipelineProbe(probe);
+    bool finished = waitFinished(*probe, 1);
+    bool onExecutor = finished && probe->startedOn == &pollExecutor && probe->callRanOn == &spoolerCallPool &&
+                      probe->resumedOn == &pollExecutor;
+    bool failedCall = finished && !probe->failed.ok && probe->failed.error == ERROR_ACCESS_DENIED && !probe->failed.timedOut;
+    bool deadline = finished && probe->timedOut.timedOut && probe->timedOut.error == ERROR_TIMEOUT &&
+                    probe->resumedBeforeSlowCall && probe->timeoutResumedOn == &pollExecutor &&
+                    spoolerCallsTimedOut == timedOutBefore + 1;
+    bool pools = finished && probe->movedTo == &ioWritePool && probe->stayedOn == &ioWritePool;
+
+    // Twelve polls' 250 ms calls take 1.5 s if only the two executor threads make them
+    spoolerCallTimeoutMs = 5000;
+    auto slow = std::make_shared<PipelineProbe>();
+    auto started = std::chrono::steady_clock::now();
+    for (int i = 0; i < 12; ++i) runSlowSpoolerCall(slow);
+    bool overlapped = waitFinished(*slow, 12) && std::chrono::steady_clock::now() - started < std::chrono::milliseconds(1000);
+
+    bool ok = selfTestCheck("a poll starts on the executor, calls on the blocking pool and resumes on the executor",
+                            onExecutor);
+    ok &= selfTestCheck("a failed spooler call reports the error its thread saw", failedCall);
+    ok &= selfTestCheck("a call past spooler.call_timeout_ms resumes the poll with a timeout before it returns", deadline);
+    ok &= selfTestCheck("ResumeOnPool moves to a running pool and stays put for a stopped one", pools);
+    ok &= selfTestCheck("spooler calls from many polls are in flight at once", overlapped);
+
+    // The abandoned call still holds a blocking-call thread; let it return before the pools stop
+    for (int i = 0; i < 200 && !probe->slowCallReturned; ++i) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    stopScheduler();
+    stopWorkerPool(spoolerCallPool);
+    stopWorkerPool(pollExecutor);
+    spoolerCallTimeoutMs = savedTimeoutMs;
+    return ok;
+}
+
+// Function to clear the timer wheel and rewind it to tick 0; caller holds schedulerMutex
+void resetTimerWheel() {
+    for (auto& level : timerWheel) std::fill(std::begin(level), std::end(level), -1);
+    currentTimerTick = 0;
+    dueTimers.clear();
+}
+
+// Function to check that the timer wheel dispatches each timer on its tick, through every
+// cascade, and drops cancelled ones; it turns the wheel by hand, so the scheduler must be stopped
+bool selfTestTimerWheel() {
+    // Delays in ticks: the first slot, both sides of each cascade, and beyond the wheel's range
+    const uint64_t delays[] = {0, 1, 63, 64, 65, 4095, 4096, 4097, 262143, 262144, 300000, timerWheelMaxTicks + 5};
+    std::vector<uint64_t> firedAt(std::size(delays), UINT64_MAX);
+    std::vector<int32_t> nodes;
+    {
+        std::lock_guard<std::mutex> lock(schedulerMutex);
+        resetTimerWheel();
+    }
+    for (uint64_t delay : delays) {
+        TimerHandle handle = scheduleTimer("self-test", timerTick * static_cast<int64_t>(delay),
+                                           std::chrono::milliseconds(0), [] {});
+        nodes.push_back(static_cast<int32_t>((handle & 0xffffffffULL) - 1));
+    }
+    TimerHandle cancelled = scheduleTimer("self-test", timerTick * 100, std::chrono::milliseconds(0), [] {});
+    bool cancelOk = cancelTimer(cancelled) && !cancelTimer(cancelled);
+
+    bool strayFired = false;
+    {
+        std::lock_guard<std::mutex> lock(schedulerMutex);
+        while (currentTimerTick <= timerWheelMaxTicks + 10) {
+            uint64_t tick = currentTimerTick;
+            advanceTimerWheel();
+            for (const TimerDispatch& dispatch : dueTimers) {
+                auto it = std::find(nodes.begin(), nodes.end(), dispatch.node);
+                if (it == nodes.end()) {
+                    strayFired = true;
+                } else {
+                    firedAt[it - nodes.begin()] = tick;
+                }
+                freeTimer(dispatch.node);
+            }
+            dueTimers.clear();
+        }
+        resetTimerWheel();
+    }
+
+    bool onTime = true;
+    for (size_t i = 0; i < std::size(delays); ++i) onTime = onTime && firedAt[i] == delays[i];
+    bool ok = selfTestCheck("timers fire on their tick across every wheel level", onTime);
+    ok &= selfTestCheck("a cancelled timer never fires and cannot be cancelled twice", cancelOk && !strayFired);
+    return ok;
+}
+
+// Function to check the circuit breaker's trips, backoff doubling and cap, and half-open trial poll
+bool selfTestCircuitBreaker() {
+    PrinterRecord printer;
+    printer.id = 0xfffffff0;  // Not a real inventory ID
+    printer.name = "Self-test printer";
+    SpoolerResult failure;
+    failure.error = ERROR_TIMEOUT;
+    failure.timedOut = true;
+    long long savedThreshold = breakerFailureThreshold, savedBase = breakerBaseBackoffSeconds, savedMax = breakerMaxBackoffSeconds;
+    breakerFailureThreshold = 3;
+    breakerBaseBackoffSeconds = 30;
+    breakerMaxBackoffSeconds = 100;
+
+    // Seconds until the open breaker's next trial poll; moves it into the past if expire is set
+    auto backoffSeconds = [&printer](bool expire) {
+        std::lock_guard<std::mutex> lock(breakersMutex);
+        CircuitBreaker& breaker = printerBreakers[printer.id];
+        auto remaining = std::chrono::duration_cast<std::chrono::seconds>(
+            breaker.retryAt - std::chrono::steady_clock::now() + std::chrono::milliseconds(500)).count();
+        if (expire) breaker.retryAt = std::chrono::steady_clock::now() - std::chrono::seconds(1);
+        return remaining;
+    };
+
+    breakerRecordFailure(printer, failure);
+    breakerRecordFailure(printer, failure);
+    bool belowThreshold = breakerStateOf(printer.id) == BreakerState::Closed && breakerAllowsPoll(printer.id);
+    breakerRecordFailure(printer, failure);
+    bool trips = breakerStateOf(printer.id) == BreakerState::Open && !breakerAllowsPoll(printer.id) &&
+                 backoffSeconds(true) == 30;
+    bool oneTrial = breakerAllowsPoll(printer.id) && breakerStateOf(printer.id) == BreakerState::HalfOpen &&
+                    !breakerAllowsPoll(printer.id);
+    breakerRecordFailure(printer, failure);
+    bool doubles = breakerStateOf(printer.id) == BreakerState::Open && backoffSeconds(true) == 60;
+    breakerAllowsPoll(printer.id);
+    breakerRecordFailure(printer, failure);
+    bool capped = backoffSeconds(true) == 100;
+    breakerAllowsPoll(printer.id);
+    breakerRecordSuccess(printer);
+    breakerRecordFailure(printer, failure);
+    bool closes = breakerStateOf(printer.id) == BreakerState::Closed;
+
+    forgetPrinterBreaker(printer.id);
+    breakerFailureThreshold = savedThreshold;
+    breakerBaseBackoffSeconds = savedBase;
+    breakerMaxBackoffSeconds = savedMax;
+    bool ok = selfTestCheck("breaker opens at breaker.failure_threshold consecutive failures", belowThreshold && trips);
+    ok &= selfTestCheck("an expired backoff lets exactly one trial poll through", oneTrial);
+    ok &= selfTestCheck("backoff doubles per trip up to breaker.max_backoff_seconds", doubles && capped);
+    ok &= selfTestCheck("a successful poll closes the breaker and resets its count", closes);
+    return ok;
+}
+
+// Function to check that a snapshot restores the jobs and fingerprints it saved, and that a
+// snapshot with another version, a bad checksum or a missing byte is refused
+bool selfTestSnapshot() {
+    long long savedHistoryKb = historyFilterKb;
+    historyFilterKb = 0;  // Keep the check away from the history files
+    std::vector<PrintJob> batch(3);
+    for (size_t i = 0; i < batch.size(); ++i) {
+        PrintJob& job = batch[i];
+        job.printerName = "Self-test printer";
+        job.timestamp = "2026-10-17T09:30:10.000+00:00";
+        job.status = i == 1 ? "Error" : "Printing";
+        job.pages = static_cast<int>(i + 1);
+        job.documentSize = 1000 * static_cast<int>(i + 1);
+        job.colorMode = "Color";
+        job.duplexSetting = "Simplex";
+        job.paperSize = "A4";
+        job.userAccount = i == 2 ? "Jürgen" : "jsmith";
+        job.jobId = std::to_string(100 + i);
+        job.submitted = 20261017093010000ULL + i;
+    }
+    commitJobBatch(0, batch);
+    {
+        std::shared_ptr<PrinterFingerprints> table = fingerprintsForPrinter(0);
+        std::lock_guard<std::mutex> lock(table->mutex);
+        table->polls = 7;
+        table->jobs[100].value = 0x1234;
+    }
+
+    const char* savedName = snapshotFileName;
+    snapshotFileName = selfTestFileName;
+    bool saved = saveSnapshot();
+    snapshotFileName = savedName;
+    std::ifstream file(selfTestFileName, std::ios::binary);
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    file.close();
+    std::error_code error;
+    std::filesystem::remove(selfTestFileName, error);
+
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        printJobs.clear();
+    }
+    forgetPrinterFingerprints(0);
+    bool restored = saved && restoreSnapshot(data.data(), data.size());
+    bool jobsMatch;
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        jobsMatch = printJobs.size() == batch.size();
+        for (size_t i = 0; jobsMatch && i < batch.size(); ++i) {
+            const PrintJob& a = printJobs[i];
+            const PrintJob& b = batch[i];
+            jobsMatch = a.printerName == b.printerName && a.status == b.status && a.pages == b.pages &&
+                        a.documentSize == b.documentSize && a.userAccount == b.userAccount &&
+                        a.jobId == b.jobId && a.submitted == b.submitted && jobColumns.size() == batch.size();
+        }
+    }
+    std::shared_ptr<PrinterFingerprints> table = fingerprintsForPrinter(0);
+    bool fingerprintsMatch = table->polls == 7 && table->jobs.count(100) && table->jobs[100].value == 0x1234;
+
+    auto refused = [&data](size_t offset, bool truncate) {
+        std::vector<uint8_t> altered = data;
+        if (truncate) {
+            altered.pop_back();
+        } else {
+            altered[offset] ^= 1;
         }
-        else if (input == "stats") {
-            showStatistics();
+        return !restoreSnapshot(altered.data(), altered.size());
+    };
+    bool refusesBad = data.size() > snapshotHeaderSize && refused(sizeof(snapshotMagic), false) &&
+                      refused(data.size() - 1, false) && refused(0, true);
+
+    // A poll holds its fingerprint table by shared_ptr, so forgetting the printer meanwhile must not free it
+    forgetPrinterFingerprints(0);
+    table->jobs[101].value = 1;
+    bool outlives = table.use_count() == 1 && table->jobs.size() == 2;
+    table.reset();
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        printJobs.clear();
+        jobColumns.clear();
+        recordedJobKeys.clear();
+    }
+    historyFilterKb = savedHistoryKb;
+
+    bool ok = selfTestCheck("snapshot restores the jobs and fingerprints it saved", restored && jobsMatch && fingerprintsMatch);
+    ok &= selfTestCheck("snapshot with another version, a bad checksum or a missing byte is refused", refusesBad);
+    ok &= selfTestCheck("a fingerprint table held by a poll outlives forgetPrinterFingerprints", outlives);
+    return ok;
+}
+
+// Function to check that a series chunk decodes to exactly the samples appended, across every
+// delta-of-delta range and XOR window, and that samples past series.retention_days are dropped
+bool selfTestTimeSeries() {
+    // Interval changes at both ends of each delta-of-delta range, and beyond them
+    const int64_t steps[] = {30, 30, 30, -33, 64, 65, -255, 256, 257, -2047, 2048, 2049, -100000, 5000000, 1, 1};
+    // Repeats, sign and exponent flips, every mantissa bit, and values that need no header
+    const double values[] = {3, 3, -3, 0.0, -0.0, 1e-310, HUGE_VAL,
+                             std::nan(""), 1.0000000000000002, 1, 2, 3, 5, 4.5, 4.25, 123456.789};
+    std::vector<int64_t> timestamps;
+    int64_t timestamp = 1700000000, interval = 0;
+    for (int64_t step : steps) {
+        interval += step;
+        timestamp += std::max<int64_t>(0, interval);
+        timestamps.push_back(timestamp);
+    }
+    SeriesChunk chunk;
+    for (size_t i = 0; i < timestamps.size(); ++i) chunk.append(timestamps[i], values[i % std::size(values)]);
+    size_t position = 0;
+    bool exact = true;
+    decodeSeriesChunk(chunk, [&](int64_t decodedTime, double value) {
+        exact = exact && position < timestamps.size() && decodedTime == timestamps[position] &&
+                std::bit_cast<uint64_t>(value) == std::bit_cast<uint64_t>(values[position % std::size(values)]);
+        ++position;
+    });
+    exact = exact && position == timestamps.size() && chunk.bits.size() == (chunk.bitLength + 7) / 8;
+
+    long long savedChunk = seriesChunkMinutes, savedRetention = seriesRetentionDays;
+    seriesChunkMinutes = 60;
+    seriesRetentionDays = 2;
+    TimeSeries series;
+    for (int64_t minute = 0; minute < 5 * 24 * 60; minute += 5) appendSeriesSample(series, 1700000000 + minute * 60, 1);
+    int64_t newest = 1700000000 + (5 * 24 * 60 - 5) * 60;
+    bool retained = !series.chunks.empty() && series.chunks.front().last >= newest - 2 * 86400 &&
+                    series.chunks.front().start <= newest - 2 * 86400 + 3600 &&
+                    series.chunks.back().last == newest;
+    seriesChunkMinutes = savedChunk;
+    seriesRetentionDays = savedRetention;
+
+    bool ok = selfTestCheck("Gorilla chunk decodes to the exact timestamps and value bits", exact);
+    ok &= selfTestCheck("chunks older than series.retention_days are dropped", retained);
+    return ok;
+}
+
+// Function to check every column kernel against a plain loop, at every length and alignment near the vector widths
+bool selfTestColumnKernels() {
+    std::vector<ColumnKernel> kernels{ ColumnKernel::Scalar };
+#if defined(PRINT_MONITOR_X86)
+    kernels.push_back(ColumnKernel::Sse2);
+    if (cpuSupportsAvx2()) kernels.push_back(ColumnKernel::Avx2);
+#endif
+    const size_t codeCount = std::size(jobStatusNames);
+    std::vector<int32_t> values(300);
+    std::vector<uint8_t> codes(300);
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    for (size_t i = 0; i < values.size(); ++i) {
+        state = mixFingerprint(state, i);
+        values[i] = i % 5 == 0 ? (i % 10 ? INT32_MAX : INT32_MIN) : static_cast<int32_t>(state);
+        codes[i] = static_cast<uint8_t>(i % 11 == 0 ? 255 : (state >> 40) % (codeCount + 2));  // Some not counted
+    }
+
+    bool sums = true, histograms = true;
+    for (size_t start = 0; start < 4; ++start) {
+        for (size_t count = 0; start + count <= values.size(); count += count < 70 ? 1 : 37) {
+            int64_t expectedSum = 0;
+            std::vector<uint64_t> expectedCounts(codeCount, 0);
+            for (size_t i = start; i < start + count; ++i) {
+                expectedSum += values[i];
+                if (codes[i] < codeCount) ++expectedCounts[codes[i]];
+            }
+            for (ColumnKernel kernel : kernels) {
+                sums = sums && sumInt32Column(values.data() + start, count, kernel) == expectedSum;
+                std::vector<uint64_t> counts(codeCount, 7);  // Filled in whatever was there
+                countCodesColumn(codes.data() + start, count, counts.data(), codeCount, kernel);
+                histograms = histograms && counts == expectedCounts;
+            }
         }
-        else if (input == "help") {
-            showHelp();
+    }
+    // One code over many blocks, where the kernels' byte-wide counters would overflow
+    std::vector<uint8_t> run(255 * 32 * 2 + 45, 1);
+    run[100] = 0;
+    for (size_t count : {size_t(255 * 16 - 1), size_t(255 * 16 + 1), size_t(255 * 32), size_t(255 * 32 + 17), run.size()}) {
+        std::vector<uint64_t> expectedCounts(codeCount, 0);
+        for (size_t i = 0; i < count; ++i) ++expectedCounts[run[i]];
+        for (ColumnKernel kernel : kernels) {
+            std::vector<uint64_t> counts(codeCount);
+            countCodesColumn(run.data(), count, counts.data(), codeCount, kernel);
+            histograms = histograms && counts == expectedCounts;
         }
-        else if (input == "quit" || input == "exit") {
-            if (monitoringActive) {
-                stopMonitoring();
+    }
+    bool ok = selfTestCheck("every sum kernel matches a plain loop without overflowing", sums);
+    ok &= selfTestCheck("every status histogram kernel matches a plain loop and skips unknown codes", histograms);
+    return ok;
+}
+
+// Function to check that the most specific cost rate prices a job and that the totals follow re-pricing
+bool selfTestCostAccounting() {
+    long long savedHistoryKb = historyFilterKb;
+    historyFilterKb = 0;
+    std::vector<CostRate> savedRates;
+    std::vector<int64_t> savedByUser, savedByPrinter;
+    int64_t savedTotal;
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        savedRates.swap(costRates);
+        savedByUser.swap(costByUser);
+        savedByPrinter.swap(costByPrinter);
+        savedTotal = costTotal;
+        costTotal = 0;
+        costTables.clear();
+    }
+    const uint8_t a3 = columnCode(paperSizeNames, "A3"), a4 = columnCode(paperSizeNames, "A4");
+    const uint8_t color = columnCode(colorModeNames, "Color"), mono = columnCode(colorModeNames, "Monochrome");
+    const uint8_t simplex = columnCode(duplexSettingNames, "Simplex");
+    const uint8_t duplex = columnCode(duplexSettingNames, "Duplex Vertical");
+    auto rate = [](uint32_t printerId, uint32_t paperMask, uint32_t colorMask, uint32_t duplexMask, int64_t price) {
+        CostRate result;
+        result.printerId = printerId;
+        result.paperMask = paperMask;
+        result.colorMask = colorMask;
+        result.duplexMask = duplexMask;
+        result.pricePerPage = price;
+        return result;
+    };
+    setCostRate(rate(noColumnId, anyCodeMask, anyCodeMask, anyCodeMask, 50));
+    setCostRate(rate(noColumnId, anyCodeMask, 1U << color, anyCodeMask, 100));
+    setCostRate(rate(1, anyCodeMask, 1U << color, anyCodeMask, 150));
+    setCostRate(rate(noColumnId, anyCodeMask, anyCodeMask, 1U << duplex, 30));  // Ties with color; set later, so it wins
+    setCostRate(rate(noColumnId, anyCodeMask, anyCodeMask, anyCodeMask, 60));   // Replaces the first
+    setCostRate(rate(noColumnId, 1U << a3, anyCodeMask, anyCodeMask, 500));
+    setCostRate(rate(noColumnId, 1U << a3, anyCodeMask, anyCodeMask, -1));      // Removes it again
+    bool specific;
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        specific = costRates.size() == 4 && priceJob(0, 3, a4, mono, simplex) == 180 &&
+                   priceJob(0, 3, a4, color, simplex) == 300 && priceJob(0, 3, a4, color, duplex) == 90 &&
+                   priceJob(1, 3, a4, color, duplex) == 450 && priceJob(0, 3, a3, mono, simplex) == 180 &&
+                   priceJob(noColumnId, 3, a4, color, simplex) == 300 && priceJob(1, 0, a4, color, simplex) == 0;
+    }
+
+    // Function to make a job with the fields its price depends on
+    auto job = [](const char* user, const char* id, int pages, const char* colorMode, const char* duplexSetting) {
+        PrintJob result;
+        result.printerName = "Self-test";
+        result.timestamp = "2026-10-18T09:30:00.000+00:00";
+        result.status = "Spooling";
+        result.userAccount = user;
+        result.jobId = id;
+        result.pages = pages;
+        result.colorMode = colorMode;
+        result.duplexSetting = duplexSetting;
+        result.paperSize = "A4";
+        return result;
+    };
+    // Function to compare the totals with what is expected, and with the costs held per job
+    auto totalsAre = [](int64_t alice, int64_t bob, int64_t printer0, int64_t printer1) {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        int64_t perJob = 0;
+        for (int64_t cost : jobColumns.cost) perJob += cost;
+        auto at = [](const std::vector<int64_t>& totals, uint32_t id) { return id < totals.size() ? totals[id] : 0; };
+        return at(costByUser, internUser("alice")) == alice && at(costByUser, internUser("bob")) == bob &&
+               at(costByPrinter, 0) == printer0 && at(costByPrinter, 1) == printer1 &&
+               costTotal == alice + bob && costTotal == perJob;
+    };
+    commitJobBatch(0, {job("alice", "1", 2, "Monochrome", "Simplex"), job("bob", "2", 4, "Color", "Duplex Vertical")});
+    commitJobBatch(1, {job("alice", "3", 1, "Color", "Duplex Vertical")});
+    bool accumulated = totalsAre(270, 120, 240, 150);
+    PrintJob moved = job("bob", "2", 4, "Color", "Duplex Vertical");
+    moved.status = "Printing";
+    commitJobBatch(0, {moved});
+    bool statusOnly = totalsAre(270, 120, 240, 150);
+    moved.pages = 10;
+    moved.colorMode = "Monochrome";
+    commitJobBatch(0, {moved});
+    bool repriced = statusOnly && totalsAre(270, 300, 420, 150);
+    setCostRate(rate(noColumnId, anyCodeMask, anyCodeMask, anyCodeMask, 1000));
+    bool kept = totalsAre(270, 300, 420, 150);
+
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        printJobs.clear();
+        jobColumns.clear();
+        recordedJobKeys.clear();
+        costRates.swap(savedRates);
+        costByUser.swap(savedByUser);
+        costByPrinter.swap(savedByPrinter);
+        costTotal = savedTotal;
+        costTables.clear();  // Resolved again from the restored rates on first use
+    }
+    historyFilterKb = savedHistoryKb;
+    bool ok = selfTestCheck("the most specific cost rate applies, the one set last on a tie", specific);
+    ok &= selfTestCheck("user and printer totals add up the cost of each recorded job", accumulated);
+    ok &= selfTestCheck("a job is re-priced when its pages or settings change, not its status", repriced);
+    ok &= selfTestCheck("changing a rate leaves recorded costs alone", kept);
+    return ok;
+}
+
+// Function to check that jobs are reported stuck once, at their status's deadline, and that superseded deadlines are dropped
+bool selfTestStuckJobs() {
+    long long savedSpooling = stuckSpoolingMinutes, savedPaused = stuckPausedMinutes, savedError = stuckErrorMinutes;
+    stuckSpoolingMinutes = 30;
+    stuckPausedMinutes = 60;
+    stuckErrorMinutes = 15;
+    uint64_t detectedBefore = stuckJobsDetected;
+    const uint32_t printer = 0xfffffff0U;  // Not an inventory ID
+    // Function to list the stuck jobs of the test printer
+    auto stuckIds = [printer]() {
+        std::lock_guard<std::mutex> lock(stuckMutex);
+        std::vector<uint32_t> ids;
+        for (uint64_t key : stuckJobKeys) {
+            if (key >> 32 == printer) ids.push_back(static_cast<uint32_t>(key));
+        }
+        std::sort(ids.begin(), ids.end());
+        return ids;
+    };
+    trackJobState(printer, 1, JOB_STATUS_SPOOLING, 0);
+    trackJobState(printer, 2, JOB_STATUS_PAUSED, 0);
+    trackJobState(printer, 3, JOB_STATUS_ERROR, 0);
+    trackJobState(printer, 4, JOB_STATUS_SPOOLING, 0);
+    trackJobState(printer, 5, JOB_STATUS_SPOOLING, 0);
+    trackJobState(printer, 6, JOB_STATUS_SPOOLING, 0);
+    trackJobState(printer, 5, JOB_STATUS_SPOOLING, 100);  // Same status seen again keeps its deadline
+    trackJobState(printer, 3, JOB_STATUS_PRINTING, 600);  // Not tracked in Printing
+    trackJobState(printer, 4, JOB_STATUS_PAUSED, 1000);   // A new status starts a new deadline
+    untrackJobs(printer, {{6, JobFingerprint()}});
+
+    expireStuckJobs(1799);
+    bool onTime = stuckIds().empty();
+    expireStuckJobs(1800);
+    onTime = onTime && stuckIds() == std::vector<uint32_t>{1, 5};
+    expireStuckJobs(4599);
+    onTime = onTime && stuckIds() == std::vector<uint32_t>{1, 2, 5};
+    expireStuckJobs(4600);
+    onTime = onTime && stuckIds() == std::vector<uint32_t>{1, 2, 4, 5};
+    expireStuckJobs(100000);
+    bool once = stuckIds() == std::vector<uint32_t>{1, 2, 4, 5} && stuckJobsDetected - detectedBefore == 4;
+    trackJobState(printer, 1, JOB_STATUS_PRINTING, 100000);
+    once = once && stuckIds() == std::vector<uint32_t>{2, 4, 5};
+
+    // A job flipping between statuses leaves a superseded entry per flip; they are compacted away
+    for (int flip = 0; flip < 1000; ++flip) {
+        trackJobState(printer, 7, flip % 2 ? JOB_STATUS_SPOOLING : JOB_STATUS_PAUSED, 100000 + flip);
+    }
+    expireStuckJobs(100000);
+    bool compacted;
+    {
+        std::lock_guard<std::mutex> lock(stuckMutex);
+        compacted = stuckDeadlines.size() <= 2 * trackedJobs.size() + 64;
+    }
+    expireStuckJobs(100999 + 30 * 60);
+    compacted = compacted && stuckIds() == std::vector<uint32_t>{2, 4, 5, 7};
+
+    forgetPrinterStuckJobs(printer);
+    {
+        std::lock_guard<std::mutex> lock(stuckMutex);
+        rebuildStuckDeadlines();
+    }
+    stuckJobsDetected = detectedBefore;
+    stuckSpoolingMinutes = savedSpooling;
+    stuckPausedMinutes = savedPaused;
+    stuckErrorMinutes = savedError;
+    bool ok = selfTestCheck("jobs are reported stuck at their status's deadline, not before", onTime);
+    ok &= selfTestCheck("a stuck job is reported once and leaves the stuck set when its status changes", once);
+    ok &= selfTestCheck("superseded deadlines are compacted and never fire", compacted);
+    return ok;
+}
+
+// Function to check the queue anomaly detectors: half-life, warm-up, one alert per excursion, upward only
+bool selfTestAnomalyDetectors() {
+    long long savedThreshold = anomalyZThreshold, savedHalfLife = anomalyHalfLifePolls, savedWarmup = anomalyWarmupPolls;
+    anomalyZThreshold = 4;
+    anomalyHalfLifePolls = 30;
+    anomalyWarmupPolls = 20;
+    uint64_t alertsBefore = anomalyAlertsTotal;
+
+    // A baseline moves half way to a new level in one half-life
+    double alpha = 1 - std::exp(std::log(0.5) / 30.0);
+    EwmaDetector detector;
+    for (int poll = 0; poll < 200; ++poll) detector.observe(0, alpha, 1.0);
+    bool steady = detector.mean == 0 && detector.variance == 0 && detector.lastScore == 0;
+    for (int poll = 0; poll < 30; ++poll) detector.observe(10, alpha, 1.0);
+    bool halfLife = steady && std::fabs(detector.mean - 5) < 1e-9;
+
+    PrinterRecord printer;
+    printer.id = 0xfffffff0U;  // Not an inventory ID
+    printer.name = "Self-test";
+    // Function to feed depths and return how many alerts they raised
+    auto feed = [&printer](std::initializer_list<size_t> depths, size_t faults = 0) {
+        uint64_t before = anomalyAlertsTotal;
+        for (size_t depth : depths) observeQueue(printer, depth, 0, faults);
+        return anomalyAlertsTotal - before;
+    };
+    bool warmup = feed({5, 5, 5, 5, 50, 5}) == 0;  // A spike while learning does not alert
+    for (int poll = 0; poll < 40; ++poll) feed({5});
+    bool alerts = feed({50}) == 1 && feed({60, 70}) == 0;  // One alert for the whole excursion
+    auto alerting = [&printer](int metric) {
+        std::lock_guard<std::mutex> lock(detectorsMutex);
+        return printerDetectors[printer.id].metrics[metric].alerting;
+    };
+    alerts = alerts && alerting(QUEUE_DEPTH);
+    for (int poll = 0; poll < 200; ++poll) feed({5});
+    alerts = alerts && !alerting(QUEUE_DEPTH) && feed({0, 0, 0}) == 0 && feed({5}) == 0;  // Downward is not an anomaly
+    for (int poll = 0; poll < 200; ++poll) feed({5});
+    alerts = alerts && feed({50}) == 1;  // Alerts again once back to normal
+    forgetPrinterDetectors(printer.id);
+
+    // A queue that is always empty does not alert on one job or one fault
+    for (int poll = 0; poll < 100; ++poll) feed({0});
+    bool floor = feed({1}, 1) == 0 && feed({0}, 3) == 1 && alerting(QUEUE_FAULTS) && !alerting(QUEUE_DEPTH);
+    forgetPrinterDetectors(printer.id);
+
+    anomalyAlertsTotal = alertsBefore;
+    anomalyZThreshold = savedThreshold;
+    anomalyHalfLifePolls = savedHalfLife;
+    anomalyWarmupPolls = savedWarmup;
+    bool ok = selfTestCheck("a baseline moves half way to a new level in anomaly.half_life_polls", halfLife);
+    ok &= selfTestCheck("no alert during anomaly.warmup_polls", warmup);
+    ok &= selfTestCheck("one alert per upward excursion, none for a drop, again after recovering", alerts);
+    ok &= selfTestCheck("the deviation floor keeps an idle queue from alerting on one job", floor);
+    return ok;
+}
+
+// Function to check that AsyncFile writes exactly the bytes given, on both I/O backends
+bool selfTestAsyncFile() {
+    long long savedBackend = ioBackend;
+    std::string expected;
+    for (size_t i = 0; expected.size() < 200 * 1024; ++i) expected += "line " + std::to_string(i * 7919) + "\r\n";
+    bool truncated = true, appended = true;
+    for (long long backend : {0, 1}) {
+        ioBackend = backend;
+        // Pieces of every size from a byte to several buffers, in 4 KB buffers
+        AsyncFile file;
+        bool ok = file.open(selfTestFileName, false, 4096);
+        size_t half = expected.size() / 2;
+        for (size_t at = 0, piece = 1; at < half; at += piece, piece = piece * 3 % 20011) {
+            file.write(expected.data() + at, std::min(piece, half - at));
+        }
+        ok = file.close() && ok;
+        std::ifstream first(selfTestFileName, std::ios::binary);
+        std::string content((std::istreambuf_iterator<char>(first)), std::istreambuf_iterator<char>());
+        first.close();
+        truncated = truncated && ok && content == expected.substr(0, half);
+
+        ok = file.open(selfTestFileName, true, 4096);
+        file.write(expected.data() + half, 1000);
+        file.submit();
+        file.write(expected.data() + half + 1000, expected.size() - half - 1000);
+        ok = file.close() && ok;
+        std::ifstream second(selfTestFileName, std::ios::binary);
+        content.assign((std::istreambuf_iterator<char>(second)), std::istreambuf_iterator<char>());
+        second.close();
+        appended = appended && ok && content == expected;
+    }
+    ioBackend = savedBackend;
+    std::error_code error;
+    std::filesystem::remove(selfTestFileName, error);
+    bool ok = selfTestCheck("a truncated file holds the bytes written, on both io.backend settings", truncated);
+    ok &= selfTestCheck("an appended file continues after the existing bytes, on both io.backend settings", appended);
+    return ok;
+}
+
+// Function to check that the mapped export writer writes exactly the rows appendCsvRow formats, and that they parse back
+bool selfTestMappedWriter() {
+    std::vector<PrintJob> jobs(3000);
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        PrintJob& job = jobs[i];
+        job.printerName = i % 2 ? "\\\\printsrv01\\Floor3-Color" : "Brother \"Mono\", HL-L2350DW";
+        job.timestamp = "2026-10-18T09:30:00.000+00:00";
+        job.status = "Printing";
+        job.pages = static_cast<int>(i % 40);
+        job.documentSize = -static_cast<int>(i * 7919);
+        job.colorMode = "Color";
+        job.duplexSetting = "Simplex";
+        job.paperSize = "A4";
+        job.userAccount = std::string(i % 13 * 3, '"') + "user\r\n" + std::to_string(i);  // More quotes than the estimate allows for
+        job.jobId = i % 5 ? std::to_string(i) : "";
+    }
+    std::string expected = csvHeader;
+    for (const auto& job : jobs) appendCsvRow(expected, job);
+
+    // Function to export the first `rows` jobs as exportToCSV does, sized `extra` bytes past its estimate
+    auto writeMapped = [&](size_t rows, int64_t extra) {
+        uint64_t estimate = csvHeader.size();
+        for (size_t i = 0; i < rows; ++i) estimate += csvTextLength(jobs[i]) + csvRowOverhead;
+        MappedFileWriter file;
+        bool ok = file.open(selfTestFileName, estimate + extra) && file.write(csvHeader);
+        for (size_t i = 0; ok && i < rows; ++i) {
+            char* out = file.reserve(csvRowBound(jobs[i]));
+            ok = out != nullptr;
+            if (ok) file.commit(formatCsvRow(out, jobs[i]));
+        }
+        ok = file.close() && ok;
+        std::ifstream written(selfTestFileName, std::ios::binary);
+        std::string content((std::istreambuf_iterator<char>(written)), std::istreambuf_iterator<char>());
+        return ok ? content : std::string();
+    };
+    std::string rowsOnly = csvHeader;
+    for (size_t i = 0; i < 10; ++i) appendCsvRow(rowsOnly, jobs[i]);
+    bool sameBytes = writeMapped(jobs.size(), 0) == expected && writeMapped(jobs.size(), 1 << 20) == expected &&
+                     writeMapped(10, 0) == rowsOnly && writeMapped(0, 0) == csvHeader;
+    std::error_code error;
+    std::filesystem::remove(selfTestFileName, error);
+
+    size_t row = 0;
+    bool parsesBack = true;
+    size_t malformed = forEachCsvRecord(expected.data(), expected.size(), [&](const std::string_view* fields, size_t count) {
+        if (row++ == 0) return;  // Header
+        if (row - 2 >= jobs.size() || count != 10) {
+            parsesBack = false;
+            return;
+        }
+        const PrintJob& job = jobs[row - 2];
+        parsesBack = parsesBack && fields[0] == job.printerName && fields[1] == job.timestamp && fields[2] == job.status &&
+                     fields[3] == std::to_string(job.pages) && fields[4] == std::to_string(job.documentSize) &&
+                     fields[5] == job.colorMode && fields[6] == job.duplexSetting && fields[7] == job.paperSize &&
+                     fields[8] == job.userAccount && fields[9] == job.jobId;
+    });
+    parsesBack = parsesBack && malformed == 0 && row == jobs.size() + 1;
+
+    bool ok = selfTestCheck("mapped export equals the rows formatted in memory, growing and truncating as needed", sameBytes);
+    ok &= selfTestCheck("exported rows with quotes, commas and line breaks parse back to the fields written", parsesBack);
+    return ok;
+}
+
+// Function to check wideStringToUtf8 against hand-encoded UTF-8, with the first non-ASCII unit at every offset
+bool selfTestUtf8() {
+    // Function to build a wide string from code units
+    auto wide = [](std::initializer_list<uint16_t> units) {
+        WideString text;
+        for (uint16_t unit : units) text.push_back(static_cast<WCHAR>(unit));
+        return text;
+    };
+    struct Utf8Case {
+        WideString text;
+        const char* expected;
+    };
+    const Utf8Case cases[] = {
+        {wide({}), ""},
+        {wide({'a', 0x7F, 0x80, 0x7FF, 0x800, 0xFFFF}), "a\x7F\xC2\x80\xDF\xBF\xE0\xA0\x80\xEF\xBF\xBF"},
+        {wide({0xD83D, 0xDDA8, 0xDBFF, 0xDFFF}), "\xF0\x9F\x96\xA8\xF4\x8F\xBF\xBF"},
+        {wide({0xD800, 'x', 0xDC00, 0xDBFF}), "\xEF\xBF\xBDx\xEF\xBF\xBD\xEF\xBF\xBD"},  // Unpaired surrogates
+        {wide({0xDC00, 0xD800}), "\xEF\xBF\xBD\xEF\xBF\xBD"},
+    };
+    bool encoded = true;
+    for (const Utf8Case& test : cases) {
+        encoded = encoded && wideStringToUtf8(test.text.data(), test.text.size()) == test.expected;
+    }
+    encoded = encoded && wideStringToUtf8(static_cast<const WCHAR*>(nullptr)) == "";
+    WideString euros(150, static_cast<WCHAR>(0x20AC));  // Three bytes each, past the stack buffer
+    std::string expectedEuros;
+    for (size_t i = 0; i < euros.size(); ++i) expectedEuros += "\xE2\x82\xAC";
+    encoded = encoded && wideStringToUtf8(euros.c_str()) == expectedEuros;
+
+    // ASCII of every length up to past the stack buffer, then with an 'é' at each offset
+    bool asciiPrefix = true;
+    std::string ascii;
+    WideString asciiWide;
+    for (size_t length = 0; length <= 300; ++length) {
+        asciiPrefix = asciiPrefix && wideStringToUtf8(asciiWide.c_str()) == ascii;
+        if (length <= 40 || (length >= 120 && length <= 140)) {
+            for (size_t at = 0; at <= length; ++at) {
+                WideString text = asciiWide;
+                text.insert(text.begin() + at, static_cast<WCHAR>(0xE9));
+                std::string expected = ascii.substr(0, at) + "\xC3\xA9" + ascii.substr(at);
+                asciiPrefix = asciiPrefix && wideStringToUtf8(text.data(), text.size()) == expected;
+            }
+        }
+        char c = static_cast<char>(' ' + length % 95);
+        ascii += c;
+        asciiWide.push_back(static_cast<WCHAR>(c));
+    }
+    bool ok = selfTestCheck("code points at each UTF-8 length boundary, surrogate pairs and unpaired surrogates", encoded);
+    ok &= selfTestCheck("the ASCII fast path hands over at every offset, on the stack and on the heap", asciiPrefix);
+    return ok;
+}
+
+// Function to check hourly partitions: rows land in the period's file, a restart appends to it, and sealing renames it and adds it to the manifest
+bool selfTestPartitions() {
+    namespace fs = std::filesystem;
+    const char* savedDirectory = partitionDirectory;
+    long long savedMode = partitionMode;
+    // Function to forget the partition state held in memory, as a restart would
+    auto restart = []() {
+        suspendPartitions();
+        std::lock_guard<std::mutex> lock(partitionMutex);
+        currentPartition.active = false;
+        partitionsRecovered = false;
+        nextManifestSequence = 1;
+    };
+    restart();
+    partitionDirectory = "print_monitor_selftest_partitions";
+    std::error_code error;
+    fs::remove_all(partitionDirectory, error);
+    partitionMode = 1;
+
+    std::tm tm = {};
+    tm.tm_year = 2026 - 1900;
+    tm.tm_mon = 9;
+    tm.tm_mday = 18;
+    tm.tm_hour = 10;
+    tm.tm_min = 30;
+    tm.tm_isdst = -1;
+    const int64_t start = static_cast<int64_t>(std::mktime(&tm));  // 10:30 local
+    std::vector<PrintJob> jobs(6);
+    std::string expected[3] = {csvHeader, csvHeader, csvHeader};  // The 10:00, 11:00 and 12:00 partitions
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        jobs[i].printerName = "Self-test";
+        jobs[i].jobId = std::to_string(i);
+        jobs[i].userAccount = i % 2 ? "alice" : "o\"brien";
+        jobs[i].status = "Printed";
+        jobs[i].pages = static_cast<int>(i + 1);
+        appendCsvRow(expected[i < 4 ? 0 : i - 3], jobs[i]);
+    }
+    writeFinalizedJobs({jobs[0], jobs[1]}, start);
+    writeFinalizedJobs({jobs[2]}, start + 600);
+    maintainPartitions(start + 1200);  // Flushed, not sealed
+    restart();
+    writeFinalizedJobs({jobs[3]}, start + 1500);  // Appended to the same partition
+    writeFinalizedJobs({jobs[4]}, start + 3600);  // Next hour: the 10:00 partition is sealed
+    maintainPartitions(start + 7200);             // 12:30: the 11:00 partition is sealed
+    writeFinalizedJobs({jobs[5]}, start + 7300);
+    restart();
+    maintainPartitions(start + 3 * 3600);         // Left over from before the restart, and over
+
+    const char* const names[3] = {"print_jobs_2026-10-18T10.csv", "print_jobs_2026-10-18T11.csv",
+                                  "print_jobs_2026-10-18T12.csv"};
+    bool contents = true, manifestOk = true;
+    std::ifstream manifest(fs::path(partitionDirectory) / partitionManifestName);
+    std::string line;
+    manifestOk = std::getline(manifest, line) && line == "sequence,file,rows,bytes,fnv1a64,sealed_at";
+    for (size_t i = 0; i < 3; ++i) {
+        std::ifstream sealed(fs::path(partitionDirectory) / names[i], std::ios::binary);
+        std::string content((std::istreambuf_iterator<char>(sealed)), std::istreambuf_iterator<char>());
+        contents = contents && content == expected[i];
+        char hash[17];
+        std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(snapshotChecksum(
+                          reinterpret_cast<const uint8_t*>(content.data()), content.size())));
+        std::string prefix = std::to_string(i + 1) + "," + names[i] + "," + (i == 0 ? "4" : "1") + "," +
+                             std::to_string(content.size()) + "," + hash + ",";
+        manifestOk = manifestOk && std::getline(manifest, line) && line.compare(0, prefix.size(), prefix) == 0;
+    }
+    manifestOk = manifestOk && !std::getline(manifest, line);
+    manifest.close();
+    size_t files = 0;
+    for (const auto& entry : fs::directory_iterator(partitionDirectory, error)) {
+        (void)entry;
+        ++files;
+    }
+
+    restart();
+    fs::remove_all(partitionDirectory, error);
+    partitionDirectory = savedDirectory;
+    partitionMode = savedMode;
+    bool ok = selfTestCheck("each period's file holds its rows once, with one header, across a restart", contents && files == 4);
+    ok &= selfTestCheck("sealed partitions are listed in the manifest in sequence, with rows, bytes and checksum", manifestOk);
+    return ok;
+}
+
+// Function to check that filtered exports select exactly the rows a plain test of each job's fields selects
+bool selfTestExportFilters() {
+    long long savedHistoryKb = historyFilterKb;
+    historyFilterKb = 0;
+    std::vector<PrinterRecord> savedInventory;
+    {
+        std::lock_guard<std::mutex> lock(inventoryMutex);
+        savedInventory = printerInventory;
+        printerInventory.assign(2, PrinterRecord());
+        for (uint32_t id = 0; id < 2; ++id) {
+            printerInventory[id].id = id;
+            printerInventory[id].name = id == 0 ? "Self-test A" : "Self-test B";
+        }
+    }
+    const char* const users[] = {"alice", "bob", "carol"};
+    const char* const statuses[] = {"Printing", "Error", "Paused", "Spooling"};
+    const char* const colors[] = {"Color", "Monochrome", "Unknown"};
+    for (uint32_t printer = 0; printer < 2; ++printer) {
+        std::vector<PrintJob> batch(100);
+        for (size_t i = 0; i < batch.size(); ++i) {
+            PrintJob& job = batch[i];
+            job.printerName = printer == 0 ? "Self-test A" : "Self-test B";
+            char timestamp[64];
+            std::snprintf(timestamp, sizeof(timestamp), "2026-10-%02uT%02u:15:00.000+00:00",
+                          static_cast<unsigned>(10 + i / 24), static_cast<unsigned>(i % 24));
+            job.timestamp = timestamp;
+            job.status = statuses[(i + printer) % std::size(statuses)];
+            job.colorMode = colors[i % std::size(colors)];
+            job.duplexSetting = "Simplex";
+            job.paperSize = "A4";
+            job.userAccount = users[(i / 2) % std::size(users)];
+            job.jobId = std::to_string(i);
+            job.pages = 1;
+        }
+        commitJobBatch(printer, batch);
+    }
+
+    // Each filter, and the same test written against the job's fields
+    struct FilterCase {
+        const char* args;
+        std::function<bool(const PrintJob&)> matches;
+    };
+    auto between = [](const PrintJob& job, const char* from, const char* to) {
+        std::string when = job.timestamp.substr(0, 19);
+        return when >= from && when < to;
+    };
+    const FilterCase cases[] = {
+        {"", [](const PrintJob&) { return true; }},
+        {"printer=\"Self-test A\"", [](const PrintJob& job) { return job.printerName == "Self-test A"; }},
+        {"printer=\"0,self-test b\" user=bob", [](const PrintJob& job) { return job.userAccount == "bob"; }},
+        {"user=alice,carol status=error,paused", [](const PrintJob& job) {
+             return job.userAccount != "bob" && (job.status == "Error" || job.status == "Paused");
+         }},
+        {"color=mono from=2026-10-11T05:00 to=2026-10-12", [&between](const PrintJob& job) {
+             return job.colorMode == "Monochrome" && between(job, "2026-10-11T05:00:00", "2026-10-12T00:00:00");
+         }},
+        {"printer=1 status=printing color=color,unknown to=2026-10-13T10:15:00", [&between](const PrintJob& job) {
+             return job.printerName == "Self-test B" && job.status == "Printing" && job.colorMode != "Monochrome" &&
+                    between(job, "0000", "2026-10-13T10:15:00");
+         }},
+        {"user=nobody", [](const PrintJob&) { return false; }},
+    };
+
+    bool allMatch = true;
+    std::ostringstream messages;  // "No user matches ..." and the like
+    for (const FilterCase& test : cases) {
+        std::string filename;
+        ExportFilter filter;
+        bool parsed = parseExportFilter(test.args, filename, filter, messages);
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        std::vector<size_t> expected;
+        for (size_t row = 0; row < printJobs.size(); ++row) {
+            if (test.matches(printJobs[row])) expected.push_back(row);
+        }
+        allMatch = allMatch && parsed && selectExportRows(filter) == expected;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        printJobs.clear();
+        jobColumns.clear();
+        recordedJobKeys.clear();
+    }
+    {
+        std::lock_guard<std::mutex> lock(inventoryMutex);
+        printerInventory = std::move(savedInventory);
+    }
+    historyFilterKb = savedHistoryKb;
+    return selfTestCheck("filtered export rows match a field-by-field test of every job", allMatch);
+}
+
+// Function to check analyze over a few small export files: distinct counting from the newest file, filters and skipped rows
+bool selfTestAnalyze() {
+    namespace fs = std::filesystem;
+    const fs::path directory = "print_monitor_selftest_analyze";
+    std::error_code error;
+    fs::remove_all(directory, error);
+    fs::create_directories(directory, error);
+    auto job = [](const char* printer, const char* user, const char* status, int pages, int size, const char* id,
+                  const char* day) {
+        PrintJob result;
+        result.printerName = printer;
+        result.userAccount = user;
+        result.status = status;
+        result.pages = pages;
+        result.documentSize = size;
+        result.jobId = id;
+        result.timestamp = std::string("2026-10-") + day + "T09:00:00.000+00:00";
+        result.colorMode = "Monochrome";
+        result.duplexSetting = "Simplex";
+        result.paperSize = "A4";
+        return result;
+    };
+    // Function to write a file and date it `age` seconds back, so the files' order differs from their names'
+    auto writeFile = [&directory](const char* name, const std::string& text, int age) {
+        fs::path path = directory / name;
+        std::ofstream(path, std::ios::binary) << text;
+        std::error_code ignored;
+        fs::last_write_time(path, fs::file_time_type::clock::now() - std::chrono::seconds(age), ignored);
+    };
+    std::string older = csvHeader;
+    appendCsvRow(older, job("Office", "alice", "Completed", 2, 100, "1", "10"));
+    appendCsvRow(older, job("Office", "bob", "Completed", 3, 200, "2", "11"));
+    appendCsvRow(older, job("Office", "alice", "Spooling", 5, 300, "3", "12"));
+    older += "\"a\"b,1\r\n";  // Stray quote
+    writeFile("b_older.csv", older, 200);
+    // Columns in another order; job 3 again, since printed
+    std::string newer = "\"Job ID\",\"Pages\",\"Printer Name\",\"User Account\",\"Status\",\"Timestamp\","
+                        "\"Document Size\",\"Color Mode\",\"Duplex Setting\",\"Paper Size\"\r\n";
+    newer += "3,5,Office,alice,Printing,2026-10-12T09:00:00.000+00:00,300,Monochrome,Simplex,A4\r\n";
+    newer += "4,7,Lab,carol,Printing,2026-10-13T09:00:00.000+00:00,400,Monochrome,Simplex,A4\r\n";
+    newer += "x,1\r\n";  // Too few fields
+    writeFile("a_newer.csv", newer, 100);
+    writeFile("c_no_columns.csv", "\"Printer Name\"\r\n\"Office\"\r\n", 300);
+    writeFile("notes.txt", older, 50);
+
+    // Function to run a query, returning its totals and what it printed
+    auto analyze = [&directory](const std::string& args, AnalyzeTotals& totals, std::string& output) {
+        std::ostringstream printed;
+        AnalyzeQuery query;
+        totals = AnalyzeTotals();
+        bool ran = parseAnalyzeQuery("\"" + (directory / "*.csv").string() + "\" " + args, query, printed) &&
+                   runAnalysis(query, printed, &totals);
+        output = printed.str();
+        return ran;
+    };
+    auto printed = [](const std::string& output, const char* line) { return output.find(line) != std::string::npos; };
+    AnalyzeTotals totals;
+    std::string output;
+    bool distinct = analyze("by status", totals, output) && totals.jobs == 4 && totals.pages == 17 &&
+                    totals.bytes == 1000 && printed(output, "  Completed: 2 jobs, 5 pages") &&
+                    printed(output, "  Printing: 2 jobs, 12 pages") && !printed(output, "Spooling") &&
+                    printed(output, "Files: 2 read, 1 skipped") && printed(output, "Rows: 5 read, 2 malformed") &&
+                    printed(output, "1 repeated in other files");
+    bool everyRow = analyze("by status all", totals, output) && totals.jobs == 5 && totals.pages == 22 &&
+                    printed(output, "  Spooling: 1 jobs, 5 pages");
+    bool filtered = analyze("printer=LAB", totals, output) && totals.jobs == 1 && totals.pages == 7 &&
+                    analyze("status=spooling", totals, output) && totals.jobs == 0 &&  // Its newest copy is Printing
+                    analyze("by day from=2026-10-11 to=2026-10-13", totals, output) && totals.jobs == 2 &&
+                    printed(output, "  2026-10-11: 1 jobs") && printed(output, "  2026-10-12: 1 jobs") &&
+                    analyze("by user,month user=alice,carol", totals, output) && totals.jobs == 3 &&
+                    printed(output, "  alice | 2026-10: 2 jobs, 7 pages");
+    fs::remove_all(directory, error);
+
+    bool ok = selfTestCheck("a job in several files is counted once, from the newest file", distinct);
+    ok &= selfTestCheck("`all` counts every row", everyRow);
+    ok &= selfTestCheck("filters match the newest copy of each job, and groups total what they match", filtered);
+    return ok;
+}
+
+// Function to check every CSV kernel against hand-parsed records and against the scalar parser
+bool selfTestCsvKernels() {
+    using Records = std::vector<std::vector<std::string>>;
+    auto parse = [](ColumnKernel kernel, const std::string& text, Records& records) {
+        records.clear();
+        return forEachCsvRecordWith(kernel, text.data(), text.size(), [&](const std::string_view* fields, size_t count) {
+            records.emplace_back(fields, fields + count);
+        });
+    };
+    std::vector<ColumnKernel> kernels = {ColumnKernel::Scalar};
+#if defined(PRINT_MONITOR_X86)
+    kernels.push_back(ColumnKernel::Sse2);
+    if (cpuSupportsAvx2() && cpuSupportsPclmul()) kernels.push_back(ColumnKernel::Avx2);
+#endif
+
+    // Inputs with the records and malformed count they must give
+    struct CsvCase {
+        std::string text;
+        Records records;
+        size_t malformed;
+    };
+    const CsvCase cases[] = {
+        {"a,\"b,c\"\r\n\"d\"\"e\",\"f\ng\"\n", {{"a", "b,c"}, {"d\"e", "f\ng"}}, 0},
+        {"\"\"\"\"\"\",,\"\"\n\n\"\"\n", {{"\"\"", "", ""}, {""}}, 0},
+        {"no,newline", {{"no", "newline"}}, 0},
+        {"\"a\"b,1\nok,2\nx\"y,3\n\"fine\",4\r\n", {{"ok", "2"}, {"fine", "4"}}, 2},
+        {"ok\n\"unclosed,1\nstill,inside\n", {{"ok"}}, 1},
+        {std::string(csvMaxFields, ',') + "\nlast\n", {{"last"}}, 1},
+    };
+    bool handParsed = true;
+    Records records;
+    for (const CsvCase& test : cases) {
+        for (ColumnKernel kernel : kernels) {
+            size_t malformed = parse(kernel, test.text, records);
+            handParsed = handParsed && records == test.records && malformed == test.malformed;
+        }
+    }
+
+    // The same awkward record slid across 64-byte blocks and the chunk boundary, with and without a bad record after it
+    const std::string tricky = "\"a \"\"b\"\", c\r\nd\",\"\",x\r\n\"multi\nline \"\"end\"\"\"\n";
+    bool matchesScalar = true;
+    Records expected;
+    for (size_t base : {size_t(0), csvChunkBytes - 200}) {
+        for (size_t shift = 0; shift < 200; ++shift) {
+            std::string text;
+            while (text.size() + 64 < base) text += "filler,\"padded \"\" field\",42\n";
+            text += std::string(base + shift - std::min(text.size(), base + shift), 'p') + ",";
+            text += tricky;
+            if (shift % 2) text += "\"bad\"x,1\n";
+            text += "tail,\"t\"\n";
+            size_t expectedMalformed = parse(ColumnKernel::Scalar, text, expected);
+            for (ColumnKernel kernel : kernels) {
+                size_t malformed = parse(kernel, text, records);
+                matchesScalar = matchesScalar && records == expected && malformed == expectedMalformed;
             }
-            std::cout << "Exiting..." << std::endl;
-            break;
         }
-        else if (input.empty()) {
+    }
+
+    bool ok = selfTestCheck("every CSV kernel unquotes, skips blank lines and counts malformed records as written",
+                            handParsed);
+    ok &= selfTestCheck("every CSV kernel matches the scalar parser across 64-byte blocks and chunks", matchesScalar);
+    return ok;
+}
+
+// Function to check the job history: no false negatives, generations rotated and
+// dropped, sealed generations written sorted, and keys found again after a reload
+bool selfTestJobHistory() {
+    namespace fs = std::filesystem;
+    const char* savedDirectory = historyDirectory;
+    long long savedKb = historyFilterKb, savedGenerations = historyGenerationCount, savedPpm = historyFalsePositivePpm;
+    // Function to drop the history held in memory, as a restart would
+    auto forgetHistory = []() {
+        std::lock_guard<std::mutex> filesLock(historyFilesMutex);
+        closeHistoryFile();
+        historyFileNumber = 0;
+        std::lock_guard<std::mutex> lock(historyMutex);
+        historyGenerations.clear();
+        historyUnwritten.clear();
+        historyToSeal.clear();
+        historyToRemove.clear();
+        clearHistoryAnswers();
+        historyLoaded = false;
+    };
+    forgetHistory();
+    historyDirectory = "print_monitor_selftest_history";
+    std::error_code error;
+    fs::remove_all(historyDirectory, error);
+    historyFilterKb = 1;  // A few hundred keys per generation
+    historyGenerationCount = 3;
+    historyFalsePositivePpm = 10000;
+
+    // Five generations' worth of evicted keys, the last one only started; the first two are dropped
+    BloomFilter sizing;
+    configureHistoryFilter(sizing);
+    size_t capacity = static_cast<size_t>(sizing.capacity);
+    std::vector<uint64_t> keys(4 * capacity + 10);
+    for (size_t i = 0; i < keys.size(); ++i) keys[i] = mixFingerprint(0, i);
+    prepareJobHistory();
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        recordJobHistory(keys);
+    }
+    auto kept = keys.begin() + 2 * capacity;
+    // Function to check that the kept keys are found and the dropped or never recorded ones are not
+    auto lookupsExact = [&]() {
+        bool exact = true;
+        for (auto it = keys.begin(); it != keys.end(); ++it) exact = exact && jobHistoryContains(*it) == (it >= kept);
+        for (size_t i = 0; i < 1000; ++i) exact = exact && !jobHistoryContains(mixFingerprint(0, keys.size() + i));
+        return exact;
+    };
+    bool noFalseNegatives = true;
+    {
+        std::lock_guard<std::mutex> lock(historyMutex);
+        for (const HistoryGeneration& generation : historyGenerations) {
+            for (uint64_t key : generation.keys) noFalseNegatives = noFalseNegatives && generation.filter.mightContain(key);
+        }
+    }
+    bool inMemory = lookupsExact();
+
+    writeJobHistory();
+    std::vector<uint64_t> numbers;
+    bool sealed = true;
+    {
+        std::lock_guard<std::mutex> lock(historyMutex);
+        for (const HistoryGeneration& generation : historyGenerations) {
+            numbers.push_back(generation.number);
+            sealed = sealed && generation.sealed == (generation.number != 5);
+        }
+    }
+    std::vector<std::string> files;
+    for (const auto& entry : fs::directory_iterator(historyDirectory, error)) files.push_back(entry.path().filename().string());
+    std::sort(files.begin(), files.end());
+    bool rotated = numbers == std::vector<uint64_t>{3, 4, 5} &&
+                   files == std::vector<std::string>{"job_keys_3.bin", "job_keys_4.bin", "job_keys_5.bin"};
+    bool sortedFiles = sealed;
+    for (uint64_t number : {3, 4}) {
+        std::vector<uint64_t> written = readHistoryFile(number);
+        std::vector<uint64_t> expected(kept + (number - 3) * capacity, kept + (number - 2) * capacity);
+        std::sort(expected.begin(), expected.end());
+        sortedFiles = sortedFiles && written == expected;
+    }
+    uint64_t searchesBefore = historyFileSearches;
+    bool fromFiles = lookupsExact() && historyFileSearches > searchesBefore;
+
+    suspendJobHistory();
+    forgetHistory();
+    bool reloaded = lookupsExact();
+    {
+        std::lock_guard<std::mutex> lock(historyMutex);
+        reloaded = reloaded && historyGenerations.size() == 3 && historyGenerations.back().number == 5 &&
+                   !historyGenerations.back().sealed && historyGenerations.back().keys.size() == 10;
+    }
+
+    forgetHistory();
+    fs::remove_all(historyDirectory, error);
+    historyDirectory = savedDirectory;
+    historyFilterKb = savedKb;
+    historyGenerationCount = savedGenerations;
+    historyFalsePositivePpm = savedPpm;
+    bool ok = selfTestCheck("Bloom filters have no false negatives, and lookups are exact from memory",
+                            noFalseNegatives && inMemory);
+    ok &= selfTestCheck("full generations are sealed and beyond history.generations the oldest are dropped", rotated);
+    ok &= selfTestCheck("sealed generation files hold their keys sorted and are searched", sortedFiles && fromFiles);
+    ok &= selfTestCheck("after a reload the evicted keys are found again", reloaded);
+    return ok;
+}
+
+// Function to check that rotation moves the active log aside and queues it, that compressed
+// archives decompress to the log, and that pruning keeps the newest log.retention_count archives
+bool selfTestLogRotation() {
+    namespace fs = std::filesystem;
+    const char* savedFileName = logFileName;
+    const char* savedPrefix = rotatedLogPrefix;
+    long long savedRetention = logRetentionCount;
+    logFileName = selfTestFileName;
+    rotatedLogPrefix = "print_monitor_selftest-";
+    logRetentionCount = 3;
+    auto readText = [](const std::string& name) {
+        std::vector<char> data;
+        return readFileBytes(name, data) ? std::string(data.begin(), data.end()) : std::string("<missing>");
+    };
+
+    { std::ofstream(selfTestFileName, std::ios::binary) << "before\r\n"; }
+    AsyncFile logFile;
+    logFile.open(logFileName, true);
+    rotateLogFile(logFile);
+    logFile.write(std::string("between\r\n"));
+    rotateLogFile(logFile);
+    logFile.write(std::string("after\r\n"));
+    logFile.close();
+    std::vector<std::string> queued;
+    {
+        std::lock_guard<std::mutex> lock(compressionMutex);
+        queued.assign(compressionQueue.begin(), compressionQueue.end());
+        compressionQueue.clear();
+    }
+    bool rotated = queued.size() == 2 && queued[0] != queued[1] &&
+                   readText(queued[0]) == "before\r\n" && readText(queued[1]) == "between\r\n" &&
+                   readText(selfTestFileName) == "after\r\n";
+
+    // Older finished archives, plus output of an unfinished compression
+    for (int day = 1; day <= 5; ++day) {
+        std::ofstream(std::string(rotatedLogPrefix) + "2026-01-0" + std::to_string(day) + "T00-00-00.000.log.xpress");
+    }
+    std::string unfinished = std::string(rotatedLogPrefix) + "2026-01-06T00-00-00.000.log.xpress.tmp";
+    { std::ofstream file(unfinished); }
+    {
+        // Logs waiting to be compressed are not counted
+        std::lock_guard<std::mutex> lock(compressionMutex);
+        compressionQueue.assign(queued.begin(), queued.end());
+    }
+    pruneRotatedLogs();
+    auto present = [](const std::string& name) { return fs::exists(name); };
+    std::string oldest = std::string(rotatedLogPrefix) + "2026-01-0";
+    bool prunedQueued = !present(oldest + "1T00-00-00.000.log.xpress") && !present(oldest + "2T00-00-00.000.log.xpress") &&
+                        present(oldest + "3T00-00-00.000.log.xpress") && present(oldest + "5T00-00-00.000.log.xpress") &&
+                        present(queued[0]) && present(queued[1]) && present(unfinished);
+
+    std::error_code error;
+    bool compressed = !compressFile(std::string(rotatedLogPrefix) + "missing.log", unfinished);
+    for (const auto& path : queued) {
+        compressed = compressed && compressFile(path, path + compressedLogExtension);
+        fs::remove(path, error);
+    }
+    {
+        std::lock_guard<std::mutex> lock(compressionMutex);
+        compressionQueue.clear();
+    }
+    pruneRotatedLogs();
+    bool prunedArchives = !present(oldest + "3T00-00-00.000.log.xpress") && !present(oldest + "4T00-00-00.000.log.xpress") &&
+                          present(oldest + "5T00-00-00.000.log.xpress") && present(unfinished);
+    for (size_t i = 0; i < queued.size(); ++i) {
+        std::ostringstream decoded;
+        std::streambuf* savedOutput = std::cout.rdbuf(decoded.rdbuf());
+        int result = decompressLogFile(queued[i] + compressedLogExtension);
+        std::cout.rdbuf(savedOutput);
+        compressed = compressed && result == 0 && decoded.str() == (i == 0 ? "before\r\n" : "between\r\n");
+    }
+
+    for (const auto& entry : fs::directory_iterator(".", error)) {
+        std::string name = entry.path().filename().string();
+        if (name.compare(0, strlen(rotatedLogPrefix), rotatedLogPrefix) == 0) fs::remove(entry.path(), error);
+    }
+    fs::remove(selfTestFileName, error);
+    logFileName = savedFileName;
+    rotatedLogPrefix = savedPrefix;
+    logRetentionCount = savedRetention;
+    bool ok = selfTestCheck("a rotated log keeps the lines before it and the active file starts afresh", rotated);
+    ok &= selfTestCheck("pruning keeps log.retention_count archives and leaves queued logs and .tmp output", prunedQueued);
+    ok &= selfTestCheck("once compressed, the newest archives are kept and decompress to the log", compressed && prunedArchives);
+    return ok;
+}
+
+// Function to check that each log sink delivers only the levels it is set to, that the memory
+// ring keeps its newest lines, and that a full sink queue drops lines and counts them
+bool selfTestLogSinks() {
+    const char* savedFileName = logFileName;
+    long long savedLevels[LOG_SINK_COUNT], savedBuffers[LOG_SINK_COUNT];
+    for (int sink = 0; sink < LOG_SINK_COUNT; ++sink) {
+        savedLevels[sink] = logSinks[sink].level;
+        savedBuffers[sink] = logSinks[sink].bufferLines;
+        logSinks[sink].level = logSinkOff;
+    }
+    LogSink& memory = logSinks[LOG_SINK_MEMORY];
+    std::deque<LogLine> savedRing;
+    {
+        std::lock_guard<std::mutex> lock(memory.mutex);
+        savedRing.swap(memory.queue);
+    }
+    auto ringText = [&memory]() {
+        std::lock_guard<std::mutex> lock(memory.mutex);
+        std::string text;
+        for (const auto& line : memory.queue) text += line.text.substr(line.text.find("] [") + 2);
+        return text;
+    };
+    auto readText = [](const char* name) {
+        std::vector<char> data;
+        return readFileBytes(name, data) ? std::string(data.begin(), data.end()) : std::string();
+    };
+    logFileName = selfTestFileName;
+    std::error_code error;
+    std::filesystem::remove(selfTestFileName, error);
+
+    // Memory at WARN, the file (written directly, its thread is not running) at ERROR
+    int evaluated = 0;
+    auto counted = [&evaluated](int value) { ++evaluated; return value; };
+    memory.level = static_cast<long long>(LogLevel::Warn);
+    logSinks[LOG_SINK_FILE].level = static_cast<long long>(LogLevel::Error);
+    LOG_INFO("self-test info ", counted(1));
+    LOG_WARN("self-test warn ", counted(2));
+    LOG_ERROR("self-test error ", counted(3));
+    std::string fileText = readText(selfTestFileName);
+    bool levels = evaluated == 2 &&
+                  ringText() == "[WARN] self-test warn 2\n[ERROR] self-test error 3\n" &&
+                  fileText.find("self-test error 3") != std::string::npos && fileText.find("warn") == std::string::npos;
+
+    memory.bufferLines = 3;
+    for (int i = 0; i < 5; ++i) LOG_WARN("self-test ring ", i);
+    bool ring = ringText() == "[WARN] self-test ring 2\n[WARN] self-test ring 3\n[WARN] self-test ring 4\n";
+
+    // The file sink's thread writes its lines in CRLF
+    std::filesystem::remove(selfTestFileName, error);
+    logSinks[LOG_SINK_FILE].level = static_cast<long long>(LogLevel::Warn);
+    startLogSink(logSinks[LOG_SINK_FILE], logWriterLoop);
+    for (int i = 0; i < 100; ++i) LOG_WARN("self-test threaded ", i);
+    stopLogSink(logSinks[LOG_SINK_FILE]);
+    fileText = readText(selfTestFileName);
+    size_t lines = 0;
+    for (size_t at = fileText.find("self-test threaded "); at != std::string::npos; at = fileText.find("self-test threaded ", at + 1)) ++lines;
+    bool threaded = lines == 100 && fileText.find("self-test threaded 99\r\n") != std::string::npos &&
+                    fileText.find("\n") == fileText.find("\r\n") + 1;
+
+    // A sink whose queue is full drops the line rather than waiting
+    LogSink& console = logSinks[LOG_SINK_CONSOLE];
+    uint64_t droppedBefore = console.dropped;
+    console.bufferLines = 2;
+    {
+        std::lock_guard<std::mutex> lock(console.mutex);
+        console.running = true;
+    }
+    bool queued = true;
+    for (int i = 0; i < 3; ++i) queued = enqueueLogLine(console, LogLevel::Warn, "self-test queued\n") && queued;
+    bool dropped;
+    {
+        std::lock_guard<std::mutex> lock(console.mutex);
+        dropped = queued && console.queue.size() == 2 && console.dropped == droppedBefore + 1;
+        console.queue.clear();
+        console.running = false;
+    }
+
+    std::filesystem::remove(selfTestFileName, error);
+    logFileName = savedFileName;
+    {
+        std::lock_guard<std::mutex> lock(memory.mutex);
+        memory.queue.swap(savedRing);
+    }
+    for (int sink = 0; sink < LOG_SINK_COUNT; ++sink) {
+        logSinks[sink].level = savedLevels[sink];
+        logSinks[sink].bufferLines = savedBuffers[sink];
+    }
+    bool ok = selfTestCheck("each sink gets only its levels, and a level no sink takes evaluates no arguments", levels);
+    ok &= selfTestCheck("the memory sink keeps its newest log.memory.lines lines", ring);
+    ok &= selfTestCheck("the file sink's thread writes every line, in CRLF", threaded);
+    ok &= selfTestCheck("a full sink queue drops the line and counts it", dropped);
+    return ok;
+}
+
+// Function to check that a job is decoded again only when a field we record changes, and
+// that jobs missing from a poll leave the table with their last fingerprint
+bool selfTestFingerprints() {
+    PrinterFingerprints printer;
+    DEVMODEW devMode{};
+    devMode.dmFields = DM_COLOR | DM_DUPLEX | DM_PAPERSIZE;
+    devMode.dmColor = DMCOLOR_COLOR;
+    devMode.dmDuplex = DMDUP_SIMPLEX;
+    devMode.dmPaperSize = DMPAPER_A4;
+    JOB_INFO_2W base{};
+    base.Status = JOB_STATUS_SPOOLING;
+    base.TotalPages = 12;
+    base.PagesPrinted = 0;
+    base.Size = 40960;
+    base.Priority = 1;
+    base.pDevMode = &devMode;
+
+    JobFingerprint previous;
+    bool fresh = true;
+    for (DWORD id = 1; id <= 3; ++id) {
+        JOB_INFO_2W info = base;
+        info.JobId = id;
+        fresh = fresh && compareJobFingerprint(printer, info, 1, previous) == JobChange::New && previous.value == 0;
+    }
+
+    // Each recorded field, changed alone and then changed back, makes the job changed twice
+    std::vector<std::function<void(JOB_INFO_2W&, DEVMODEW&)>> recorded = {
+        [](JOB_INFO_2W& info, DEVMODEW&) { info.Status = JOB_STATUS_PRINTING; },
+        [](JOB_INFO_2W& info, DEVMODEW&) { info.TotalPages = 13; },
+        [](JOB_INFO_2W& info, DEVMODEW&) { info.PagesPrinted = 1; },
+        [](JOB_INFO_2W& info, DEVMODEW&) { info.Size = 40961; },
+        [](JOB_INFO_2W&, DEVMODEW& mode) { mode.dmColor = DMCOLOR_MONOCHROME; },
+        [](JOB_INFO_2W&, DEVMODEW& mode) { mode.dmDuplex = DMDUP_VERTICAL; },
+        [](JOB_INFO_2W&, DEVMODEW& mode) { mode.dmPaperSize = DMPAPER_LETTER; },
+        [](JOB_INFO_2W&, DEVMODEW& mode) { mode.dmFields &= ~DM_DUPLEX; },
+        [](JOB_INFO_2W& info, DEVMODEW&) { info.pDevMode = nullptr; },
+    };
+    uint64_t poll = 1;
+    bool changed = true, unchanged = true;
+    for (const auto& change : recorded) {
+        JOB_INFO_2W info = base;
+        info.JobId = 1;
+        DEVMODEW mode = devMode;
+        info.pDevMode = base.pDevMode ? &mode : nullptr;
+        change(info, mode);
+        changed = changed && compareJobFingerprint(printer, info, ++poll, previous) == JobChange::Changed;
+        info = base;
+        info.JobId = 1;
+        changed = changed && compareJobFingerprint(printer, info, ++poll, previous) == JobChange::Changed;
+        unchanged = unchanged && compareJobFingerprint(printer, info, ++poll, previous) == JobChange::Unchanged;
+    }
+
+    // Fields we do not record leave the fingerprint alone
+    JOB_INFO_2W moved = base;
+    moved.JobId = 1;
+    moved.Priority = 99;
+    moved.Position = 7;
+    moved.Time = 1234;
+    unchanged = unchanged && compareJobFingerprint(printer, moved, ++poll, previous) == JobChange::Unchanged;
+
+    // Job 2 is seen once more with new page counts; job 3 is not seen again
+    JOB_INFO_2W printing = base;
+    printing.JobId = 2;
+    printing.Status = JOB_STATUS_PRINTING;
+    printing.PagesPrinted = 5;
+    bool reported = compareJobFingerprint(printer, printing, poll, previous) == JobChange::Changed &&
+                    previous.status == JOB_STATUS_SPOOLING && previous.pagesPrinted == 0 && previous.lastSeenPoll == 1;
+    DepartedJobs departed = pruneJobFingerprints(printer, poll);
+    bool pruned = reported && departed.size() == 1 && departed[0].first == 3 &&
+                  departed[0].second.status == JOB_STATUS_SPOOLING && departed[0].second.totalPages == 12 &&
+                  printer.jobs.size() == 2 && printer.jobs.at(2).pagesPrinted == 5;
+
+    bool ok = selfTestCheck("a job seen for the first time is new", fresh);
+    ok &= selfTestCheck("a change to status, pages, size or the decoded DEVMODE fields marks the job changed", changed);
+    ok &= selfTestCheck("an identical job, or one differing only in fields not recorded, is unchanged", unchanged);
+    ok &= selfTestCheck("a changed job reports its last fingerprint, and jobs missing from a poll are pruned with theirs", pruned);
+    return ok;
+}
+
+// Function to run every self-test check; returns the process exit code
+int runSelfTest() {
+    long long savedLevels[LOG_SINK_COUNT];
+    for (int sink = 0; sink < LOG_SINK_COUNT; ++sink) {
+        savedLevels[sink] = logSinks[sink].level;
+        logSinks[sink].level = sink == LOG_SINK_MEMORY ? static_cast<long long>(LogLevel::Info) : logSinkOff;
+    }
+    long long savedThreshold = logLevelThreshold;
+    startWorkerPool(ioWritePool, ioWriteThreads);
+
+    bool ok = true;
+    std::cout << "Binary log" << std::endl;
+    ok &= selfTestBinaryLog();
+    std::cout << "Log levels" << std::endl;
+    ok &= selfTestLogLevels();
+    std::cout << "Job store" << std::endl;
+    ok &= selfTestJobStore();
+    std::cout << "Printer inventory" << std::endl;
+    ok &= selfTestPrinterInventory();
+    std::cout << "Timer wheel" << std::endl;
+    ok &= selfTestTimerWheel();
+    std::cout << "Poll executor" << std::endl;
+    ok &= selfTestPollExecutor();
+    std::cout << "Circuit breaker" << std::endl;
+    ok &= selfTestCircuitBreaker();
+    std::cout << "Warm-start snapshot" << std::endl;
+    ok &= selfTestSnapshot();
+    std::cout << "Time series" << std::endl;
+    ok &= selfTestTimeSeries();
+    std::cout << "Column kernels" << std::endl;
+    ok &= selfTestColumnKernels();
+    std::cout << "Cost accounting" << std::endl;
+    ok &= selfTestCostAccounting();
+    std::cout << "Stuck jobs" << std::endl;
+    ok &= selfTestStuckJobs();
+    std::cout << "Anomaly detectors" << std::endl;
+    ok &= selfTestAnomalyDetectors();
+    std::cout << "Async file writer" << std::endl;
+    ok &= selfTestAsyncFile();
+    std::cout << "Mapped export writer" << std::endl;
+    ok &= selfTestMappedWriter();
+    std::cout << "UTF-16 to UTF-8" << std::endl;
+    ok &= selfTestUtf8();
+    std::cout << "Partitioned exports" << std::endl;
+    ok &= selfTestPartitions();
+    std::cout << "Export filters" << std::endl;
+    ok &= selfTestExportFilters();
+    std::cout << "Analyze" << std::endl;
+    ok &= selfTestAnalyze();
+    std::cout << "CSV kernels" << std::endl;
+    ok &= selfTestCsvKernels();
+    std::cout << "Job history" << std::endl;
+    ok &= selfTestJobHistory();
+    std::cout << "Log rotation" << std::endl;
+    ok &= selfTestLogRotation();
+    std::cout << "Log sinks" << std::endl;
+    ok &= selfTestLogSinks();
+    std::cout << "Fingerprint delta" << std::endl;
+    ok &= selfTestFingerprints();
+    std::cout << "Command pipe" << std::endl;
+    ok &= selfTestCommandPipe();
+
+    stopWorkerPool(ioWritePool);
+    logLevelThreshold = savedThreshold;
+    for (int sink = 0; sink < LOG_SINK_COUNT; ++sink) logSinks[sink].level = savedLevels[sink];
+    std::cout << (ok ? "All checks passed." : "Some checks FAILED.") << std::endl;
+    return ok ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------------
+// Headless mode
+//
+// `--headless` runs the monitor without the interactive prompt and
+// `--service` runs it under the Service Control Manager. Both start
+// monitoring straight away, switch the console log sink off (the other
+// sinks are unaffected), and take commands over the named pipe
+// \\.\pipe\print_monitor: a client connects, writes one command line and
+// reads the command's output until the pipe is closed. `print_monitor.exe
+// --send <command>` is that client. `quit` over the pipe, a service stop or
+// shutdown, or Ctrl+C / Ctrl+Break on a headless console shuts down the same
+// way `quit` does at the prompt.
+//
+// The pipe only accepts local clients, and with the default security only
+// administrators and the account the monitor runs as can write to it.
+// Commands run one at a time and print to a buffer that is sent back to the
+// client; std::cout is left alone, so log lines and other threads' output
+// never end up in a reply.
+// ---------------------------------------------------------------------------
+
+const char* commandPipeName = "\\\\.\\pipe\\print_monitor";
+const char* serviceName = "PrintMonitor";
+
+std::mutex headlessStopMutex;
+std::condition_variable headlessStopCondition;
+bool headlessStopRequested = false;
+
+std::thread commandPipeThread;
+std::atomic<bool> commandPipeRunning{false};
+std::atomic<bool> commandPipeExited{false};
+std::mutex commandMutex;  // Serializes pipe commands
+
+SERVICE_STATUS_HANDLE serviceStatusHandle = NULL;
+SERVICE_STATUS serviceStatus{};
+
+// Function to ask a headless run to shut down; safe from any thread or handler
+void requestHeadlessStop() {
+    std::lock_guard<std::mutex> lock(headlessStopMutex);
+    headlessStopRequested = true;
+    headlessStopCondition.notify_all();
+}
+
+// Function to report the service's state to the Service Control Manager (no-op outside --service)
+void reportServiceStatus(DWORD state, DWORD exitCode, DWORD waitHintMs) {
+    if (!serviceStatusHandle) return;
+    serviceStatus.dwServiceType = SERVICE_WIN32_OWN_PROCESS;
+    serviceStatus.dwCurrentState = state;
+    serviceStatus.dwControlsAccepted = state == SERVICE_START_PENDING ? 0 : SERVICE_ACCEPT_STOP | SERVICE_ACCEPT_SHUTDOWN;
+    serviceStatus.dwWin32ExitCode = exitCode == 0 ? NO_ERROR : ERROR_SERVICE_SPECIFIC_ERROR;
+    serviceStatus.dwServiceSpecificExitCode = exitCode;
+    serviceStatus.dwWaitHint = waitHintMs;
+    if (state == SERVICE_RUNNING || state == SERVICE_STOPPED) {
+        serviceStatus.dwCheckPoint = 0;
+    } else {
+        ++serviceStatus.dwCheckPoint;
+    }
+    SetServiceStatus(serviceStatusHandle, &serviceStatus);
+}
+
+// Function to run a pipe command, returning what it printed
+std::string runPipeCommand(const std::string& command, bool& exitRequested) {
+    std::lock_guard<std::mutex> lock(commandMutex);
+    std::ostringstream output;
+    try {
+        exitRequested = !executeCommand(command, output);
+    } catch (const std::exception& e) {
+        output << "Command failed: " << e.what() << std::endl;
+    }
+    return output.str();
+}
+
+// Command pipe thread: serve one client at a time, one command per connection
+void commandPipeLoop() {
+    while (commandPipeRunning) {
+        HANDLE pipe = CreateNamedPipeA(commandPipeName, PIPE_ACCESS_DUPLEX,
+                                       PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+                                       1, 64 * 1024, 4096, 0, NULL);
+        if (pipe == INVALID_HANDLE_VALUE) {
+            LOG_ERROR("Failed to create command pipe ", commandPipeName, ". Error: ", GetLastError());
+            std::this_thread::sleep_for(std::chrono::seconds(1));
             continue;
         }
-        else {
-            std::cout << "Unknown command. Type 'help' for available commands." << std::endl;
+
+        bool connected = ConnectNamedPipe(pipe, NULL) || GetLastError() == ERROR_PIPE_CONNECTED;
+        char buffer[4096];
+        DWORD bytesRead = 0;
+        if (connected && commandPipeRunning && ReadFile(pipe, buffer, sizeof(buffer), &bytesRead, NULL)) {
+            std::string command(buffer, bytesRead);
+            while (!command.empty() && (command.back() == '\n' || command.back() == '\r')) command.pop_back();
+            LOG_INFO("Pipe command: ", command);
+
+            bool exitRequested = false;
+            std::string output = runPipeCommand(command, exitRequested);
+            DWORD written = 0;
+            if (!WriteFile(pipe, output.data(), static_cast<DWORD>(output.size()), &written, NULL)) {
+                LOG_WARN("Failed to reply on command pipe. Error: ", GetLastError());
+            }
+            FlushFileBuffers(pipe);
+            if (exitRequested) requestHeadlessStop();
+        }
+        DisconnectNamedPipe(pipe);
+        CloseHandle(pipe);
+    }
+    commandPipeExited = true;
+}
+
+// Function to start serving the command pipe
+void startCommandPipe() {
+    commandPipeRunning = true;
+    commandPipeExited = false;
+    commandPipeThread = std::thread(commandPipeLoop);
+}
+
+// Function to stop the command pipe thread, connecting to the pipe to wake it if it is waiting for a client
+void stopCommandPipe() {
+    if (!commandPipeThread.joinable()) return;
+    commandPipeRunning = false;
+    while (!commandPipeExited) {
+        HANDLE wake = CreateFileA(commandPipeName, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+        if (wake != INVALID_HANDLE_VALUE) CloseHandle(wake);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    commandPipeThread.join();
+}
+
+// Function to run without the command prompt until a stop is requested
+void runHeadless() {
+    {
+        std::lock_guard<std::mutex> lock(headlessStopMutex);
+        headlessStopRequested = false;
+    }
+    startMonitoring();
+    startCommandPipe();
+    reportServiceStatus(SERVICE_RUNNING, 0, 0);
+    LOG_INFO("Running headless; send commands with: print_monitor.exe --send <command>");
+
+    {
+        std::unique_lock<std::mutex> lock(headlessStopMutex);
+        headlessStopCondition.wait(lock, [] { return headlessStopRequested; });
+    }
+    LOG_INFO("Headless shutdown requested.");
+    reportServiceStatus(SERVICE_STOP_PENDING, 0, 30000);
+    stopCommandPipe();
+}
+
+// Console control handler for --headless: Ctrl+C, Ctrl+Break or closing the console stop the monitor
+BOOL WINAPI headlessConsoleHandler(DWORD controlType) {
+    switch (controlType) {
+    case CTRL_C_EVENT:
+    case CTRL_BREAK_EVENT:
+    case CTRL_CLOSE_EVENT:
+        requestHeadlessStop();
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+// Service control handler: stop and shutdown end the headless run
+DWORD WINAPI serviceControlHandler(DWORD control, DWORD, LPVOID, LPVOID) {
+    switch (control) {
+    case SERVICE_CONTROL_STOP:
+    case SERVICE_CONTROL_SHUTDOWN:
+        reportServiceStatus(SERVICE_STOP_PENDING, 0, 30000);
+        requestHeadlessStop();
+        return NO_ERROR;
+    case SERVICE_CONTROL_INTERROGATE:
+        return NO_ERROR;
+    default:
+        return ERROR_CALL_NOT_IMPLEMENTED;
+    }
+}
+
+// Function to send one command to a headless monitor and print its output
+int sendPipeCommand(const std::string& command, std::ostream& out) {
+    // The server recreates its single pipe instance between clients, so retry briefly
+    HANDLE pipe = INVALID_HANDLE_VALUE;
+    for (int attempt = 0; attempt < 50 && pipe == INVALID_HANDLE_VALUE; ++attempt) {
+        pipe = CreateFileA(commandPipeName, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+        if (pipe != INVALID_HANDLE_VALUE) break;
+        DWORD error = GetLastError();
+        if (error == ERROR_PIPE_BUSY) {
+            WaitNamedPipeA(commandPipeName, 100);
+        } else if (error == ERROR_FILE_NOT_FOUND) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        } else {
+            break;
         }
     }
+    if (pipe == INVALID_HANDLE_VALUE) {
+        std::cerr << "Could not connect to " << commandPipeName << " (is print_monitor running headless?). Error: "
+                  << GetLastError() << std::endl;
+        return 1;
+    }
+
+    DWORD written = 0;
+    if (!WriteFile(pipe, command.data(), static_cast<DWORD>(command.size()), &written, NULL)) {
+        std::cerr << "Could not send the command. Error: " << GetLastError() << std::endl;
+        CloseHandle(pipe);
+        return 1;
+    }
+    char buffer[4096];
+    DWORD bytesRead = 0;
+    while (ReadFile(pipe, buffer, sizeof(buffer), &bytesRead, NULL) || GetLastError() == ERROR_MORE_DATA) {
+        out.write(buffer, bytesRead);
+    }
+    CloseHandle(pipe);
+    return 0;
+}
+
+// Function to check that a command sent over the command pipe comes back with the
+// output it prints at the prompt, and that `quit` asks the headless run to stop
+bool selfTestCommandPipe() {
+    const char* savedPipeName = commandPipeName;
+    commandPipeName = "\\\\.\\pipe\\print_monitor_selftest";  // Leave a running monitor's pipe alone
+    {
+        std::lock_guard<std::mutex> lock(headlessStopMutex);
+        headlessStopRequested = false;
+    }
+    // Function to ask whether a headless stop was requested, waiting up to the given time for one
+    auto stopRequested = [](std::chrono::milliseconds wait) {
+        std::unique_lock<std::mutex> lock(headlessStopMutex);
+        return headlessStopCondition.wait_for(lock, wait, [] { return headlessStopRequested; });
+    };
+
+    startCommandPipe();
+    std::ostringstream help, unknown, quit, expected;
+    executeCommand("help", expected);
+    bool roundTrip = sendPipeCommand("HELP", help) == 0 && help.str() == expected.str() && !help.str().empty();
+    bool unknownReply = sendPipeCommand("frobnicate", unknown) == 0 &&
+                        unknown.str() == "Unknown command. Type 'help' for available commands.\n" &&
+                        !stopRequested(std::chrono::milliseconds(0));
+    bool quitReply = sendPipeCommand("quit", quit) == 0 && quit.str() == "Exiting...\n" &&
+                     stopRequested(std::chrono::seconds(5));
+    stopCommandPipe();
+
+    {
+        std::lock_guard<std::mutex> lock(headlessStopMutex);
+        headlessStopRequested = false;
+    }
+    commandPipeName = savedPipeName;
+    bool ok = selfTestCheck("a pipe command replies with what it prints at the prompt", roundTrip);
+    ok &= selfTestCheck("an unknown pipe command says so and keeps the monitor running", unknownReply);
+    ok &= selfTestCheck("quit over the pipe replies and asks the headless run to stop", quitReply);
+    return ok;
 }
 
-std::thread periodicSaveThread;
+// Function to make the executable's directory current; services start in the system directory
+void useApplicationDirectory() {
+    char path[MAX_PATH];
+    DWORD length = GetModuleFileNameA(NULL, path, MAX_PATH);
+    if (length == 0 || length == MAX_PATH) return;
+    std::string directory(path, length);
+    size_t slash = directory.find_last_of("\\/");
+    if (slash != std::string::npos) {
+        SetCurrentDirectoryA(directory.substr(0, slash).c_str());
+    }
+}
 
-int main() {
+// Function to initialize, run the prompt or headless loop, and shut down; returns the exit code
+int runApplication(bool headless) {
     try {
-        logMessage("INFO", "Initializing Windows Print Job Monitoring System...");
+        startWorkerPool(ioWritePool, ioWriteThreads);
+        startLogWriter();
+        
+        LOG_INFO("Initializing Windows Print Job Monitoring System...");
         
         // Initialize random seed for any simulated jobs
         srand(static_cast<unsigned>(time(nullptr)));
         
-        // Start the periodic save thread
-        periodicSaveThread = std::thread(periodicSave);
+        // Start the timer wheel that drives polling, autosave and housekeeping,
+        // and the executor that runs the poll coroutines
+        startWorkerPool(pollExecutor, pollExecutorThreads);
+        startWorkerPool(spoolerCallPool, spoolerCallThreads);
+        startScheduler();
+
+        // Resume from the last snapshot, if any
+        loadSnapshot();
         
-        // Start the command loop
-        commandLoop();
+        // Take commands from the prompt, or from the command pipe when headless
+        if (headless) {
+            runHeadless();
+        } else {
+            commandLoop();
+        }
         
         // Stop monitoring if still active
         if (monitoringActive) {
             stopMonitoring();
         }
         
-        // Wait for periodic save thread to finish
-        monitoringActive = false;
-        if (periodicSaveThread.joinable()) {
-            periodicSaveThread.join();
-        }
+        stopScheduler();
+        stopWorkerPool(spoolerCallPool);
+        stopWorkerPool(pollExecutor);
+        saveSnapshot();
+        closeBinaryLogFile();
         
-        logMessage("INFO", "Windows Print Job Monitoring System exited normally.");
+        LOG_INFO("Windows Print Job Monitoring System exited normally.");
+        stopLogWriter();
+        stopWorkerPool(ioWritePool);
     } catch (const std::exception& e) {
-        logMessage("ERROR", std::string("Uncaught exception in main: ") + e.what());
+        LOG_ERROR("Uncaught exception in main: ", e.what());
+        stopCommandPipe();
+        stopScheduler();
+        stopWorkerPool(spoolerCallPool);
+        stopWorkerPool(pollExecutor);
+        stopLogWriter();
+        stopWorkerPool(ioWritePool);
         return 1;
     } catch (...) {
-        logMessage("ERROR", "Unknown exception in main.");
+        LOG_ERROR("Unknown exception in main.");
+        stopCommandPipe();
+        stopScheduler();
+        stopWorkerPool(spoolerCallPool);
+        stopWorkerPool(pollExecutor);
+        stopLogWriter();
+        stopWorkerPool(ioWritePool);
         return 1;
     }
     
     return 0;
-}
\ No newline at end of file
+}
+
+// Service entry point, called on a dispatcher thread by StartServiceCtrlDispatcher
+void WINAPI serviceMain(DWORD, LPSTR*) {
+    serviceStatusHandle = RegisterServiceCtrlHandlerExA(serviceName, serviceControlHandler, NULL);
+    if (!serviceStatusHandle) return;
+    reportServiceStatus(SERVICE_START_PENDING, 0, 30000);
+    int result = runApplication(true);
+    reportServiceStatus(SERVICE_STOPPED, static_cast<DWORD>(result), 0);
+}
+
+int main(int argc, char* argv[]) {
+    // Offline tool mode: render a binary log and exit
+    if (argc >= 3 && std::string(argv[1]) == "--decode-log") {
+        return decodeBinaryLog(argv[2]);
+    }
+    if (argc >= 3 && std::string(argv[1]) == "--decompress-log") {
+        return decompressLogFile(argv[2]);
+    }
+    if (argc >= 2 && std::string(argv[1]) == "--self-test") {
+        return runSelfTest();
+    }
+    if (argc >= 3 && std::string(argv[1]) == "--bench" && std::string(argv[2]) == "log") {
+        return runLogBenchmark(argc >= 4 ? std::strtoull(argv[3], nullptr, 10) : 10000000);
+    }
+    if (argc >= 3 && std::string(argv[1]) == "--bench" && std::string(argv[2]) == "columns") {
+        return runColumnBenchmark(argc >= 4 ? std::strtoull(argv[3], nullptr, 10) : 10000000);
+    }
+    if (argc >= 3 && std::string(argv[1]) == "--bench" && std::string(argv[2]) == "series") {
+        return runSeriesBenchmark(argc >= 4 ? std::strtoull(argv[3], nullptr, 10) : 1000000);
+    }
+    if (argc >= 3 && std::string(argv[1]) == "--bench" && std::string(argv[2]) == "io") {
+        return runIoBenchmark(argc >= 4 ? std::strtoull(argv[3], nullptr, 10) : 256);
+    }
+    if (argc >= 3 && std::string(argv[1]) == "--bench" && std::string(argv[2]) == "utf8") {
+        return runUtf8Benchmark(argc >= 4 ? std::strtoull(argv[3], nullptr, 10) : 1000000);
+    }
+    if (argc >= 3 && std::string(argv[1]) == "--bench" && std::string(argv[2]) == "csv") {
+        return runCsvBenchmark(argc >= 4 ? std::strtoull(argv[3], nullptr, 10) : 256);
+    }
+    if (argc >= 3 && std::string(argv[1]) == "--bench" && std::string(argv[2]) == "analyze") {
+        return runAnalyzeBenchmark(argc >= 4 ? std::strtoull(argv[3], nullptr, 10) : 1024);
+    }
+    if (argc >= 3 && std::string(argv[1]) == "--bench" && std::string(argv[2]) == "history") {
+        return runHistoryBenchmark(argc >= 4 ? std::strtoull(argv[3], nullptr, 10) : 1000000);
+    }
+    if (argc >= 3 && std::string(argv[1]) == "--bench" && std::string(argv[2]) == "export") {
+        return runExportBenchmark(argc >= 4 ? std::strtoull(argv[3], nullptr, 10) : 1000000);
+    }
+    if (argc >= 3 && std::string(argv[1]) == "--send") {
+        std::string command;
+        for (int i = 2; i < argc; ++i) {
+            if (i > 2) command += ' ';
+            command += argv[i];
+        }
+        return sendPipeCommand(command, std::cout);
+    }
+
+    // Service mode: the Service Control Manager calls serviceMain
+    if (argc >= 2 && std::string(argv[1]) == "--service") {
+        logSinks[LOG_SINK_CONSOLE].level = logSinkOff;
+        useApplicationDirectory();
+        SERVICE_TABLE_ENTRYA services[] = {
+            { const_cast<LPSTR>(serviceName), serviceMain },
+            { NULL, NULL }
+        };
+        if (!StartServiceCtrlDispatcherA(services)) {
+            std::cerr << "--service must be started by the Service Control Manager (error "
+                      << GetLastError() << "); use --headless to run without a console UI." << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    bool headless = argc >= 2 && std::string(argv[1]) == "--headless";
+    if (headless) {
+        logSinks[LOG_SINK_CONSOLE].level = logSinkOff;
+        SetConsoleCtrlHandler(headlessConsoleHandler, TRUE);
+    }
+    return runApplication(headless);
+}
+